@@ -97,10 +97,12 @@ PT_THREAD(coap_blocking_request
         coap_set_header_block2(request, state->block_num, 0,
                                REST_MAX_CHUNK_SIZE);
       }
-      state->transaction->packet_len = coap_serialize_message(request,
-                                                              state->
-                                                              transaction->
-                                                              packet);
+      if(!coap_transaction_serialize(state->transaction, request)) {
+        coap_clear_transaction(state->transaction);
+        state->transaction = NULL;
+        PRINTF("Could not allocate transaction buffer");
+        PT_EXIT(&state->pt);
+      }
 
       coap_send_transaction(state->transaction);
       PRINTF("Requested #%lu (MID %u)\n", state->block_num, request->mid);
@@ -58,13 +58,8 @@
 #define PRINTLLADDR(addr)
 #endif
 
-/* These should go into the state struct so that we can have multiple
-   requests */
-
-static uint8_t more;
-static uint32_t res_block;
-static uint8_t block_error;
-
+/* etag_len before the first response of a transfer */
+#define ETAG_NOT_SEEN 0xff
 
 static void coap_request_callback(void *callback_data, void *response);
 
@@ -73,23 +68,81 @@ static void coap_request_callback(void *callback_data, void *response);
 static void
 progress_request(struct request_state *state) {
   coap_packet_t *request = state->request;
+  uint32_t offset;
+
   request->mid = coap_get_mid();
   if((state->transaction =
       coap_new_transaction(request->mid, state->remote_endpoint))) {
     state->transaction->callback = coap_request_callback;
     state->transaction->callback_data = state;
 
-    if(state->block_num > 0) {
+    if(state->payload != NULL) {
+      /* Block1 upload - send the next block of the payload */
+      offset = state->block1_num * state->block1_size;
+      if(state->block1_num == 0) {
+        coap_set_header_size1(request, state->payload_len);
+      }
+      coap_set_header_block1(request, state->block1_num,
+                             offset + state->block1_size < state->payload_len,
+                             state->block1_size);
+      coap_set_payload(request, state->payload + offset,
+                       MIN(state->block1_size, state->payload_len - offset));
+    } else if(state->block_num > 0) {
       coap_set_header_block2(request, state->block_num, 0,
-                             REST_MAX_CHUNK_SIZE);
+                             state->block2_size);
     }
-    state->transaction->packet_len =
-      coap_serialize_message(request, state->transaction->packet);
+    if(coap_transaction_serialize(state->transaction, request)) {
+      coap_send_transaction(state->transaction);
+      PRINTF("Requested #%lu (MID %u)\n", (unsigned long) state->block_num,
+             request->mid);
+      return;
+    }
+    coap_clear_transaction(state->transaction);
+    state->transaction = NULL;
+  }
+
+  /* the request could not be sent - end it as if the server did not respond */
+  PRINTF("No free transaction or buffer for the request\n");
+  state->response = NULL;
+  state->callback(state);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Handles the response to a Block1 upload. Returns non-zero if the next
+ * block has been requested and the response should not be passed on.
+ */
+static int
+progress_upload(struct request_state *state)
+{
+  uint16_t size;
+  uint32_t offset;
+
+  if(state->response->code != CONTINUE_2_31) {
+    /* final response - later Block2 requests carry no payload */
+    state->payload = NULL;
+    CLEAR_OPTION(state->request, COAP_OPTION_BLOCK1);
+    CLEAR_OPTION(state->request, COAP_OPTION_SIZE1);
+    coap_set_payload(state->request, NULL, 0);
+    return 0;
+  }
 
-    coap_send_transaction(state->transaction);
-    PRINTF("Requested #%lu (MID %u)\n", (unsigned long) state->block_num,
-           request->mid);
+  offset = (state->block1_num + 1) * state->block1_size;
+  if(offset >= state->payload_len) {
+    PRINTF("Continue after last block\n");
+    return 0;
+  }
+  if(coap_get_header_block1(state->response, NULL, NULL, &size, NULL) &&
+     size < state->block1_size) {
+    /* the server asks for smaller blocks from now on */
+    state->block1_size = size;
   }
+  state->block1_num = offset / state->block1_size;
+
+  PRINTF("Continue upload #%lu (%u bytes per block)\n",
+         (unsigned long) state->block1_num, state->block1_size);
+  progress_request(state);
+  return 1;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -98,6 +151,12 @@ static void
 coap_request_callback(void *callback_data, void *response)
 {
   struct request_state *state = (struct request_state *)callback_data;
+  const uint8_t *etag;
+  uint32_t res_block = 0;
+  uint16_t size;
+  uint8_t more = 0;
+  int etag_len;
+
   state->response = (coap_packet_t *)response;
 
   PRINTF("COAP: request callback\n");
@@ -108,12 +167,33 @@ coap_request_callback(void *callback_data, void *response)
     return;
   }
 
+  if(state->payload != NULL && progress_upload(state)) {
+    return;
+  }
+
   /* Got a response */
-  coap_get_header_block2(state->response, &res_block, &more, NULL, NULL);
+  if(coap_get_header_block2(state->response, &res_block, &more, &size, NULL)) {
+    state->block2_size = size;
+  }
   PRINTF("Received #%lu%s (%u bytes)\n",
          (unsigned long) res_block, (unsigned) more ? "+" : "",
          state->response->payload_len);
 
+  /* all blocks must belong to the same representation */
+  etag_len = coap_get_header_etag(state->response, &etag);
+  if(state->etag_len == ETAG_NOT_SEEN) {
+    state->etag_len = etag_len;
+    if(etag_len > 0) {
+      memcpy(state->etag, etag, etag_len);
+    }
+  } else if(etag_len != state->etag_len ||
+            (etag_len > 0 && memcmp(etag, state->etag, etag_len) != 0)) {
+    PRINTF("ETag changed during transfer - giving up\n");
+    state->response = NULL;
+    state->callback(state);
+    return;
+  }
+
   if(res_block == state->block_num) {
     /* Call the callback function as we have more data */
     state->callback(state);
@@ -121,10 +201,10 @@ coap_request_callback(void *callback_data, void *response)
   } else {
     PRINTF("WRONG BLOCK %lu/%lu\n", (unsigned long) res_block,
            (unsigned long) state->block_num);
-    ++block_error;
+    ++(state->block_error);
   }
 
-  if(more && block_error < COAP_MAX_ATTEMPTS) {
+  if(more && state->block_error < COAP_MAX_ATTEMPTS) {
     progress_request(state);
   } else {
     /* failure - now we give up and notify the callback */
@@ -140,17 +220,48 @@ coap_send_request(struct request_state *state, coap_endpoint_t *endpoint,
                   coap_packet_t *request,
                   void (*callback)(struct request_state *state))
 {
-  /* can we have these variables shared between multiple requests? */
-  /* ripped from blocking request */
-  more = 0;
-  res_block = 0;
-  block_error = 0;
+  coap_send_request_payload(state, endpoint, request, request->payload,
+                            request->payload_len, callback);
+}
 
+/*---------------------------------------------------------------------------*/
+
+void
+coap_send_request_payload(struct request_state *state,
+                          coap_endpoint_t *endpoint, coap_packet_t *request,
+                          const uint8_t *payload, uint16_t payload_len,
+                          void (*callback)(struct request_state *state))
+{
   state->block_num = 0;
+  state->block_error = 0;
+  state->block2_size = COAP_MAX_BLOCK_SIZE;
+  state->etag_len = ETAG_NOT_SEEN;
+  /* a request with Block2 starts the transfer at that block */
+  coap_get_header_block2(request, &state->block_num, NULL,
+                         &state->block2_size, NULL);
   state->response = NULL;
   state->request = request;
   state->remote_endpoint = endpoint;
   state->callback = callback;
 
+  /* payloads larger than a block are uploaded with Block1 */
+  if(payload_len > COAP_MAX_BLOCK_SIZE) {
+    state->payload = payload;
+    state->payload_len = payload_len;
+    state->block1_num = 0;
+    state->block1_size = COAP_MAX_BLOCK_SIZE;
+  } else {
+    state->payload = NULL;
+    coap_set_payload(request, payload, payload_len);
+  }
+
   progress_request(state);
 }
+
+/*---------------------------------------------------------------------------*/
+
+void
+coap_stop_request(struct request_state *state)
+{
+  state->block_error = COAP_MAX_ATTEMPTS;
+}
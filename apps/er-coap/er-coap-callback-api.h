@@ -55,11 +55,41 @@ struct request_state {
   coap_packet_t *request;
   coap_endpoint_t *remote_endpoint;
   uint32_t block_num;
+  uint16_t block2_size;
+  uint8_t block_error;
+  uint8_t etag_len;
+  uint8_t etag[COAP_ETAG_LEN];
+  /* Block1 upload of payloads larger than a block, NULL when done */
+  const uint8_t *payload;
+  uint16_t payload_len;
+  uint16_t block1_size;
+  uint32_t block1_num;
   void *user_data;
   ntimer_t ntimer;
   void (*callback)(struct request_state *state);
 };
 
+/*
+ * Sends the request and calls the callback for each block of the
+ * response.
+ */
 void coap_send_request(struct request_state *state, coap_endpoint_t *endpoint,  coap_packet_t *request, void (*callback)(struct request_state *state));
 
+/*
+ * As coap_send_request() but with a payload that may be larger than
+ * REST_MAX_CHUNK_SIZE. A payload larger than COAP_MAX_BLOCK_SIZE is sent
+ * with Block1 and must stay valid until the final response is received.
+ */
+void coap_send_request_payload(struct request_state *state,
+                               coap_endpoint_t *endpoint,
+                               coap_packet_t *request,
+                               const uint8_t *payload, uint16_t payload_len,
+                               void (*callback)(struct request_state *state));
+
+/*
+ * Called from the callback to not request any more blocks. The callback
+ * is then called once more without response.
+ */
+void coap_stop_request(struct request_state *state);
+
 #endif /* COAP_CALLBACK_API_H_ */
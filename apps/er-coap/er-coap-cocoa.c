@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *      CoAP module for adaptive retransmission timeouts, based on CoCoA
+ *      (draft-ietf-core-cocoa). Each endpoint has a strong RTT estimator
+ *      fed by exchanges without retransmissions and a weak estimator fed
+ *      by exchanges with one or two retransmissions. Both are combined
+ *      into an overall RTO.
+ * \author
+ *      Joakim Eriksson <joakime@sics.se>
+ */
+
+#include "er-coap-cocoa.h"
+#include "sys/ntimer.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#define PRINTEP(ep) coap_endpoint_print(ep)
+#else
+#define PRINTF(...)
+#define PRINTEP(ep)
+#endif
+
+/* Default RTO for unknown endpoints */
+#define RTO_INIT     (1000UL * COAP_RESPONSE_TIMEOUT)
+#define RTO_MIN      100UL
+#define RTO_MAX      32000UL
+
+/* The estimator state is in ms with RFC 6298 fixed point gains */
+typedef struct {
+  uint32_t srtt;
+  uint32_t rttvar;
+  uint32_t rto;
+} rtt_estimator_t;
+
+typedef struct {
+  coap_endpoint_t endpoint;
+  uint64_t last_update;
+  uint32_t rto;
+  uint32_t min_rtt;
+  rtt_estimator_t strong;
+  rtt_estimator_t weak;
+  uint8_t in_use;
+} cocoa_entry_t;
+
+#if COAP_MAX_RTT_ESTIMATORS > 0
+static cocoa_entry_t entries[COAP_MAX_RTT_ESTIMATORS];
+#endif /* COAP_MAX_RTT_ESTIMATORS > 0 */
+
+static coap_cocoa_stats_t stats;
+
+/*---------------------------------------------------------------------------*/
+#if COAP_MAX_RTT_ESTIMATORS > 0
+static cocoa_entry_t *
+find_entry(const coap_endpoint_t *ep)
+{
+  int i;
+  for(i = 0; i < COAP_MAX_RTT_ESTIMATORS; i++) {
+    if(entries[i].in_use && coap_endpoint_cmp(&entries[i].endpoint, ep)) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static cocoa_entry_t *
+new_entry(const coap_endpoint_t *ep)
+{
+  cocoa_entry_t *e = NULL;
+  int i;
+
+  for(i = 0; i < COAP_MAX_RTT_ESTIMATORS; i++) {
+    if(!entries[i].in_use) {
+      e = &entries[i];
+      break;
+    }
+    /* Replace the endpoint that was least recently updated */
+    if(e == NULL || entries[i].last_update < e->last_update) {
+      e = &entries[i];
+    }
+  }
+
+  memset(e, 0, sizeof(cocoa_entry_t));
+  coap_endpoint_copy(&e->endpoint, ep);
+  e->rto = RTO_INIT;
+  e->in_use = 1;
+  return e;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+update_estimator(rtt_estimator_t *est, uint32_t rtt, uint8_t k)
+{
+  uint32_t delta;
+
+  if(est->srtt == 0) {
+    est->srtt = rtt;
+    est->rttvar = rtt / 2;
+  } else {
+    delta = est->srtt > rtt ? est->srtt - rtt : rtt - est->srtt;
+    est->rttvar = (3 * est->rttvar + delta) / 4;
+    est->srtt = (7 * est->srtt + rtt) / 8;
+  }
+  est->rto = est->srtt + k * est->rttvar;
+  return est->rto;
+}
+/*---------------------------------------------------------------------------*/
+/* Moves the RTO of endpoints that have not been heard for long towards the default */
+static void
+age_entry(cocoa_entry_t *e, uint64_t now)
+{
+  if(e->rto < 1000 && now - e->last_update > 16 * e->rto) {
+    e->rto *= 2;
+    e->last_update = now;
+  } else if(e->rto > 3000 && now - e->last_update > 4 * e->rto) {
+    e->rto = (e->rto + RTO_INIT) / 2;
+    e->last_update = now;
+  }
+}
+#endif /* COAP_MAX_RTT_ESTIMATORS > 0 */
+/*---------------------------------------------------------------------------*/
+uint32_t
+coap_cocoa_get_rto(const coap_endpoint_t *ep)
+{
+  uint32_t rto = RTO_INIT;
+#if COAP_MAX_RTT_ESTIMATORS > 0
+  cocoa_entry_t *e;
+
+  e = find_entry(ep);
+  if(e != NULL) {
+    age_entry(e, ntimer_uptime());
+    rto = e->rto;
+  }
+#endif /* COAP_MAX_RTT_ESTIMATORS > 0 */
+
+  stats.transmissions++;
+
+  /* Dithered between RTO and RTO * COAP_RESPONSE_RANDOM_FACTOR */
+  return rto + rand() % ((uint32_t)(rto * (COAP_RESPONSE_RANDOM_FACTOR - 1.0)) + 1);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+coap_cocoa_get_backoff(uint32_t rto)
+{
+#if COAP_MAX_RTT_ESTIMATORS > 0
+  /* Variable backoff: faster recovery for short RTOs, less for long ones */
+  if(rto < 1000) {
+    return 6;
+  }
+  if(rto > 3000) {
+    return 3;
+  }
+#endif /* COAP_MAX_RTT_ESTIMATORS > 0 */
+  return 4;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_cocoa_exchange_done(const coap_endpoint_t *ep, uint64_t first_sent,
+                         uint64_t last_sent, uint8_t retransmissions)
+{
+#if COAP_MAX_RTT_ESTIMATORS > 0
+  cocoa_entry_t *e;
+  uint64_t now;
+  uint32_t rtt;
+
+  now = ntimer_uptime();
+  e = find_entry(ep);
+  if(e == NULL) {
+    e = new_entry(ep);
+  }
+
+  if(retransmissions > 0 && e->min_rtt > 0 && now - last_sent < e->min_rtt) {
+    /* Faster than any measured RTT - answer to an earlier transmission */
+    stats.spurious_retransmissions++;
+  }
+
+  rtt = (uint32_t)(now - first_sent);
+  if(retransmissions == 0) {
+    if(e->min_rtt == 0 || rtt < e->min_rtt) {
+      e->min_rtt = rtt;
+    }
+    e->rto = (update_estimator(&e->strong, rtt, 4) + e->rto) / 2;
+  } else if(retransmissions <= 2) {
+    e->rto = (update_estimator(&e->weak, rtt, 1) + 3 * e->rto) / 4;
+  } else {
+    /* Too ambiguous to be used */
+    return;
+  }
+
+  if(e->rto < RTO_MIN) {
+    e->rto = RTO_MIN;
+  } else if(e->rto > RTO_MAX) {
+    e->rto = RTO_MAX;
+  }
+  e->last_update = now;
+
+  PRINTF("CoCoA: ");
+  PRINTEP(ep);
+  PRINTF(" RTT %lu ms (%u retransmissions) RTO %lu ms\n",
+         (unsigned long)rtt, retransmissions, (unsigned long)e->rto);
+#endif /* COAP_MAX_RTT_ESTIMATORS > 0 */
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_cocoa_retransmission(void)
+{
+  stats.retransmissions++;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_cocoa_timeout(void)
+{
+  stats.timeouts++;
+}
+/*---------------------------------------------------------------------------*/
+const coap_cocoa_stats_t *
+coap_cocoa_get_stats(void)
+{
+  return &stats;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *      CoAP module for adaptive retransmission timeouts (CoCoA). The
+ *      round trip time to each endpoint is estimated from the exchanges
+ *      and used to set the initial retransmission timeout.
+ * \author
+ *      Joakim Eriksson <joakime@sics.se>
+ */
+
+#ifndef ER_COAP_COCOA_H_
+#define ER_COAP_COCOA_H_
+
+#include "er-coap.h"
+
+typedef struct {
+  uint32_t transmissions;
+  uint32_t retransmissions;
+  uint32_t spurious_retransmissions;
+  uint32_t timeouts;
+} coap_cocoa_stats_t;
+
+/* Returns the initial retransmission timeout in ms for an endpoint */
+uint32_t coap_cocoa_get_rto(const coap_endpoint_t *ep);
+
+/*
+ * Returns the backoff factor in halves (3 = 1.5, 4 = 2, 6 = 3) to use
+ * for an exchange with the specified initial retransmission timeout.
+ */
+uint8_t coap_cocoa_get_backoff(uint32_t rto);
+
+/*
+ * Updates the RTT estimators of an endpoint when an exchange completes.
+ * The times are when the message was first and last transmitted.
+ */
+void coap_cocoa_exchange_done(const coap_endpoint_t *ep, uint64_t first_sent,
+                              uint64_t last_sent, uint8_t retransmissions);
+
+void coap_cocoa_retransmission(void);
+void coap_cocoa_timeout(void);
+
+const coap_cocoa_stats_t *coap_cocoa_get_stats(void);
+
+#endif /* ER_COAP_COCOA_H_ */
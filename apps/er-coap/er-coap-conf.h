@@ -50,11 +50,55 @@
 #define COAP_SERVER_PORT               COAP_DEFAULT_PORT
 #endif
 
-/* The number of concurrent messages that can be stored for retransmission in the transaction layer. */
+/*
+ * The number of concurrent exchanges in the transaction layer. Messages
+ * are kept in the buffers below, so a transaction is bookkeeping only.
+ */
 #ifndef COAP_MAX_OPEN_TRANSACTIONS
-#define COAP_MAX_OPEN_TRANSACTIONS     4
+#define COAP_MAX_OPEN_TRANSACTIONS     8
 #endif /* COAP_MAX_OPEN_TRANSACTIONS */
 
+/* Number of buckets in the transaction MID hash table */
+#ifndef COAP_TRANSACTION_HASH_SIZE
+#define COAP_TRANSACTION_HASH_SIZE     8
+#endif /* COAP_TRANSACTION_HASH_SIZE */
+
+/*
+ * Confirmable messages are kept in buffers of two size classes for
+ * retransmission. Messages are serialized into a large buffer, which
+ * other messages hold only until they are sent.
+ */
+#ifndef COAP_TRANSACTION_SMALL_BUFFER_SIZE
+#define COAP_TRANSACTION_SMALL_BUFFER_SIZE 64
+#endif /* COAP_TRANSACTION_SMALL_BUFFER_SIZE */
+
+#ifndef COAP_TRANSACTION_SMALL_BUFFERS
+#define COAP_TRANSACTION_SMALL_BUFFERS 4
+#endif /* COAP_TRANSACTION_SMALL_BUFFERS */
+
+#ifndef COAP_TRANSACTION_LARGE_BUFFERS
+#define COAP_TRANSACTION_LARGE_BUFFERS 2
+#endif /* COAP_TRANSACTION_LARGE_BUFFERS */
+
+/*
+ * Large buffers that confirmable messages may not keep, so that responses
+ * to incoming requests can be serialized while messages over the small
+ * buffer size wait for their ACK. Must be less than the large buffers.
+ */
+#ifndef COAP_TRANSACTION_RESERVED_LARGE_BUFFERS
+#define COAP_TRANSACTION_RESERVED_LARGE_BUFFERS 1
+#endif /* COAP_TRANSACTION_RESERVED_LARGE_BUFFERS */
+
+/* Number of outstanding confirmable messages per endpoint (NSTART) */
+#ifndef COAP_NSTART
+#define COAP_NSTART                    1
+#endif /* COAP_NSTART */
+
+/* Number of confirmable messages waiting for NSTART per endpoint */
+#ifndef COAP_MAX_QUEUED_PER_ENDPOINT
+#define COAP_MAX_QUEUED_PER_ENDPOINT   2
+#endif /* COAP_MAX_QUEUED_PER_ENDPOINT */
+
 /* Maximum number of failed request attempts before action */
 #ifndef COAP_MAX_ATTEMPTS
 #define COAP_MAX_ATTEMPTS              4
@@ -65,11 +109,37 @@
 #define COAP_MAX_HEADER_SIZE           (4 + COAP_TOKEN_LEN + 3 + 1 + COAP_ETAG_LEN + 4 + 4 + 30)  /* 65 */
 #endif /* COAP_MAX_HEADER_SIZE */
 
-/* Number of observer slots (each takes abot xxx bytes) */
+/* Number of observer slots */
 #ifndef COAP_MAX_OBSERVERS
-#define COAP_MAX_OBSERVERS    COAP_MAX_OPEN_TRANSACTIONS - 1
+#define COAP_MAX_OBSERVERS             3
 #endif /* COAP_MAX_OBSERVERS */
 
+/* Number of path nodes in the observer index (one per distinct path segment) */
+#ifndef COAP_OBSERVE_MAX_NODES
+#define COAP_OBSERVE_MAX_NODES         ((COAP_MAX_OBSERVERS) * 3)
+#endif /* COAP_OBSERVE_MAX_NODES */
+
+/* Number of buckets in the observer token, MID and path node hash tables.
+   Lookups stay constant-time while it is about the number of observers. */
+#ifndef COAP_OBSERVE_HASH_SIZE
+#define COAP_OBSERVE_HASH_SIZE         8
+#endif /* COAP_OBSERVE_HASH_SIZE */
+
+/* Number of endpoints with RTT estimates for adaptive retransmission timeouts, 0 to disable */
+#ifndef COAP_MAX_RTT_ESTIMATORS
+#define COAP_MAX_RTT_ESTIMATORS        4
+#endif /* COAP_MAX_RTT_ESTIMATORS */
+
+/* Number of responses kept for replay to retransmitted requests, 0 to disable */
+#ifndef COAP_DEDUP_CACHE_SIZE
+#define COAP_DEDUP_CACHE_SIZE          2
+#endif /* COAP_DEDUP_CACHE_SIZE */
+
+/* Responses larger than this are not kept for replay */
+#ifndef COAP_DEDUP_MAX_RESPONSE_SIZE
+#define COAP_DEDUP_MAX_RESPONSE_SIZE   COAP_MAX_PACKET_SIZE
+#endif /* COAP_DEDUP_MAX_RESPONSE_SIZE */
+
 /* Interval in notifies in which NON notifies are changed to CON notifies to check client. */
 #define COAP_OBSERVE_REFRESH_INTERVAL  20
 
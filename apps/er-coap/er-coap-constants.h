@@ -74,7 +74,8 @@ typedef enum {
   COAP_GET = 1,
   COAP_POST,
   COAP_PUT,
-  COAP_DELETE
+  COAP_DELETE,
+  COAP_FETCH                    /* RFC 8132 */
 } coap_method_t;
 
 /* CoAP response codes */
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *      CoAP module for duplicate detection of requests
+ * \author
+ *      Joakim Eriksson <joakime@sics.se>
+ */
+
+#include "er-coap-dedup.h"
+#include "er-coap-transport.h"
+#include "sys/ntimer.h"
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#if COAP_DEDUP_CACHE_SIZE > 0
+
+typedef struct {
+  coap_endpoint_t endpoint;
+  uint64_t expires;
+  uint16_t mid;
+  uint8_t token_len;
+  uint8_t token[COAP_TOKEN_LEN];
+  uint16_t response_len;
+  uint8_t response[COAP_DEDUP_MAX_RESPONSE_SIZE];
+} dedup_entry_t;
+
+static dedup_entry_t entries[COAP_DEDUP_CACHE_SIZE];
+static uint8_t next_entry;
+#endif /* COAP_DEDUP_CACHE_SIZE > 0 */
+
+static coap_dedup_stats_t stats;
+
+/*---------------------------------------------------------------------------*/
+#if COAP_DEDUP_CACHE_SIZE > 0
+static dedup_entry_t *
+find_entry(const coap_endpoint_t *ep, const coap_packet_t *request)
+{
+  dedup_entry_t *e;
+  uint64_t now;
+  int i;
+
+  now = ntimer_uptime();
+  for(i = 0; i < COAP_DEDUP_CACHE_SIZE; i++) {
+    e = &entries[i];
+    if(e->response_len > 0 && e->mid == request->mid && now < e->expires &&
+       e->token_len == request->token_len &&
+       memcmp(e->token, request->token, e->token_len) == 0 &&
+       coap_endpoint_cmp(&e->endpoint, ep)) {
+      return e;
+    }
+  }
+  return NULL;
+}
+#endif /* COAP_DEDUP_CACHE_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
+int
+coap_dedup_replay(const coap_endpoint_t *ep, const coap_packet_t *request)
+{
+#if COAP_DEDUP_CACHE_SIZE > 0
+  dedup_entry_t *e;
+
+  e = find_entry(ep, request);
+  if(e != NULL) {
+    PRINTF("Duplicate request MID %u - replaying response\n", request->mid);
+    stats.hits++;
+    coap_send_message(ep, e->response, e->response_len);
+    return 1;
+  }
+#endif /* COAP_DEDUP_CACHE_SIZE > 0 */
+  stats.misses++;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_dedup_add(const coap_endpoint_t *ep, const coap_packet_t *request,
+               const uint8_t *response, uint16_t response_len)
+{
+#if COAP_DEDUP_CACHE_SIZE > 0
+  dedup_entry_t *e;
+
+  if(response_len == 0 || response_len > COAP_DEDUP_MAX_RESPONSE_SIZE) {
+    /* Too large to keep - a duplicate will be handled again */
+    return;
+  }
+
+  e = find_entry(ep, request);
+  if(e == NULL) {
+    /* Replace the oldest entry */
+    e = &entries[next_entry];
+    next_entry = (next_entry + 1) % COAP_DEDUP_CACHE_SIZE;
+  }
+
+  coap_endpoint_copy(&e->endpoint, ep);
+  e->expires = ntimer_uptime() + COAP_EXCHANGE_LIFETIME;
+  e->mid = request->mid;
+  e->token_len = request->token_len;
+  memcpy(e->token, request->token, request->token_len);
+  e->response_len = response_len;
+  memcpy(e->response, response, response_len);
+#endif /* COAP_DEDUP_CACHE_SIZE > 0 */
+}
+/*---------------------------------------------------------------------------*/
+const coap_dedup_stats_t *
+coap_dedup_get_stats(void)
+{
+  return &stats;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *      CoAP module for duplicate detection of requests. The responses
+ *      to recent requests are kept and replayed when a retransmission
+ *      of the same request is received.
+ * \author
+ *      Joakim Eriksson <joakime@sics.se>
+ */
+
+#ifndef ER_COAP_DEDUP_H_
+#define ER_COAP_DEDUP_H_
+
+#include "er-coap.h"
+
+/*
+ * EXCHANGE_LIFETIME in RFC 7252: the time a duplicate of a confirmable
+ * request can be received, MAX_TRANSMIT_SPAN + 2 * MAX_LATENCY +
+ * PROCESSING_DELAY, in milliseconds.
+ */
+#define COAP_EXCHANGE_LIFETIME                                          \
+  ((uint32_t)(1000 * COAP_RESPONSE_TIMEOUT *                            \
+              ((1 << COAP_MAX_RETRANSMIT) - 1) *                        \
+              COAP_RESPONSE_RANDOM_FACTOR) +                            \
+   2 * 100000UL + 1000 * COAP_RESPONSE_TIMEOUT)
+
+typedef struct {
+  uint32_t hits;
+  uint32_t misses;
+} coap_dedup_stats_t;
+
+/*
+ * Sends the stored response if the request is a duplicate of a recent
+ * request. Returns 1 if the request was a duplicate.
+ */
+int coap_dedup_replay(const coap_endpoint_t *ep, const coap_packet_t *request);
+
+/* Stores the serialized response to a request */
+void coap_dedup_add(const coap_endpoint_t *ep, const coap_packet_t *request,
+                    const uint8_t *response, uint16_t response_len);
+
+const coap_dedup_stats_t *coap_dedup_get_stats(void);
+
+#endif /* ER_COAP_DEDUP_H_ */
@@ -90,7 +90,7 @@ er_coap_call_handlers(coap_packet_t *request, coap_packet_t *response,
         /* Request handled. */
 
         /* Check response code before doing observe! */
-        if(request->code == COAP_GET) {
+        if(request->code == COAP_GET || request->code == COAP_FETCH) {
           coap_observe_handler(NULL, request, response);
         }
 
@@ -142,6 +142,10 @@ coap_receive(const coap_endpoint_t *src,
   /* static declaration reduces stack peaks and program code size */
   static coap_packet_t message[1]; /* this way the packet can be treated as pointer as usual */
   static coap_packet_t response[1];
+  /* the transaction buffer, with COAP_MAX_PACKET_SIZE + 1 bytes for the
+   * terminating '\0' which will not be sent
+   * Use snprintf(buf, len+1, "", ...) to completely fill payload */
+  uint8_t *response_buffer = NULL;
   coap_transaction_t *transaction = NULL;
   coap_handler_status_t status;
 
@@ -150,7 +154,11 @@ coap_receive(const coap_endpoint_t *src,
 
   if(erbium_status_code == NO_ERROR) {
 
-    /*TODO duplicates suppression, if required by application */
+    /* retransmitted requests get the same response without running the handlers again */
+    if(message->code >= COAP_GET && message->code <= COAP_FETCH &&
+       coap_dedup_replay(src, message)) {
+      return erbium_status_code;
+    }
 
     PRINTF("  Parsed: v %u, t %u, tkl %u, c %u, mid %u\n", message->version,
            message->type, message->token_len, message->code, message->mid);
@@ -161,14 +169,21 @@ coap_receive(const coap_endpoint_t *src,
     PRINTF("\n");
 
     /* handle requests */
-    if(message->code >= COAP_GET && message->code <= COAP_DELETE) {
+    if(message->code >= COAP_GET && message->code <= COAP_FETCH) {
 
-      /* use transaction buffer for response to confirmable request */
-      if((transaction = coap_new_transaction(message->mid, src))) {
+      /* transaction for the response, also reserving the MID */
+      transaction = coap_new_transaction(message->mid, src);
+      if(transaction &&
+         (response_buffer = coap_transaction_alloc_packet(transaction)) == NULL) {
+        coap_clear_transaction(transaction);
+        transaction = NULL;
+      }
+      if(transaction) {
         uint32_t block_num = 0;
         uint16_t block_size = COAP_MAX_BLOCK_SIZE;
         uint32_t block_offset = 0;
         int32_t new_offset = 0;
+        uint16_t response_len;
 
         /* prepare response */
         if(message->type == COAP_TYPE_CON) {
@@ -195,7 +210,7 @@ coap_receive(const coap_endpoint_t *src,
 
         /* call REST framework and check if found and allowed */
         status = call_service(message, response,
-                              transaction->packet + COAP_MAX_HEADER_SIZE,
+                              response_buffer + COAP_MAX_HEADER_SIZE,
                               block_size, &new_offset);
         if(status != COAP_HANDLER_STATUS_CONTINUE) {
 
@@ -269,10 +284,9 @@ coap_receive(const coap_endpoint_t *src,
             /* serialize response */
         }
           if(erbium_status_code == NO_ERROR) {
-            if((transaction->packet_len = coap_serialize_message(response,
-                                                                 transaction->
-                                                                 packet)) ==
-               0) {
+            response_len = coap_serialize_message(response, response_buffer);
+            if(!coap_transaction_set_packet(transaction, response_buffer,
+                                            response_len)) {
               erbium_status_code = PACKET_SERIALIZATION_ERROR;
             }
           }
@@ -301,6 +315,12 @@ coap_receive(const coap_endpoint_t *src,
         restful_response_handler callback = transaction->callback;
         void *callback_data = transaction->callback_data;
 
+        /* update the RTT estimate of the endpoint */
+        coap_cocoa_exchange_done(&transaction->endpoint,
+                                 transaction->first_sent,
+                                 transaction->last_sent,
+                                 transaction->retrans_counter);
+
         coap_clear_transaction(transaction);
 
         /* check if someone registered for the response */
@@ -325,10 +345,18 @@ coap_receive(const coap_endpoint_t *src,
     /* if(parsed correctly) */
   if(erbium_status_code == NO_ERROR) {
     if(transaction) {
+      coap_dedup_add(src, message, transaction->packet,
+                     transaction->packet_len);
       coap_send_transaction(transaction);
     }
   } else if(erbium_status_code == MANUAL_RESPONSE) {
     PRINTF("Clearing transaction for manual response");
+    if(transaction && message->type == COAP_TYPE_CON) {
+      /* the separate response was accepted with an empty ACK */
+      coap_init_message(response, COAP_TYPE_ACK, 0, message->mid);
+      coap_dedup_add(src, message, response_buffer,
+                     coap_serialize_message(response, response_buffer));
+    }
     coap_clear_transaction(transaction);
   } else {
     coap_message_type_t reply_type = COAP_TYPE_ACK;
@@ -377,6 +405,9 @@ coap_set_service_callback(service_callback_t callback)
 rest_resource_flags_t
 coap_get_rest_method(void *packet)
 {
+  if(((coap_packet_t *)packet)->code == COAP_FETCH) {
+    return METHOD_FETCH;
+  }
   return (rest_resource_flags_t)(1 <<
                                  (((coap_packet_t *)packet)->code - 1));
 }
@@ -43,6 +43,8 @@
 #include "er-coap-transactions.h"
 #include "er-coap-observe.h"
 #include "er-coap-separate.h"
+#include "er-coap-dedup.h"
+#include "er-coap-cocoa.h"
 #include "er-coap-observe-client.h"
 #include "er-coap-transport.h"
 
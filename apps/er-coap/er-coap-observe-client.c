@@ -312,8 +312,13 @@ coap_obs_request_registration(const coap_endpoint_t *endpoint, char *uri,
     if(obs) {
       t->callback = handle_obs_registration_response;
       t->callback_data = obs;
-      t->packet_len = coap_serialize_message(request, t->packet);
-      coap_send_transaction(t);
+      if(coap_transaction_serialize(t, request)) {
+        coap_send_transaction(t);
+      } else {
+        coap_clear_transaction(t);
+        coap_obs_remove_observee(obs);
+        obs = NULL;
+      }
     } else {
       PRINTF("Could not allocate obs_subject resource buffer");
       coap_clear_transaction(t);
@@ -37,10 +37,11 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include "er-coap-observe.h"
 #include "er-coap-engine.h"
-#include "lib/memb.h"
+#include "sys/cc.h"
 
 #define DEBUG 0
 #if DEBUG
@@ -53,41 +54,347 @@
 #endif
 
 /*---------------------------------------------------------------------------*/
-MEMB(observers_memb, coap_observer_t, COAP_MAX_OBSERVERS);
-LIST(observers_list);
+/*
+ * Observers are indexed in a trie of path segments so that a notification
+ * finds its observers in O(path depth) instead of comparing the URL of
+ * every observer. The children of a node are found through the node hash
+ * table, so wide levels such as /3303/0..n do not need a sibling scan.
+ * The token and MID hash tables are used for cancellation and RST
+ * matching. The observer and sibling lists are doubly linked so that an
+ * observer is removed without walking any list, and observers and nodes
+ * come from free lists rather than from a MEMB, which scans its blocks.
+ */
+typedef struct coap_observe_node {
+  struct coap_observe_node *parent;
+  struct coap_observe_node *child;
+  struct coap_observe_node *sibling;
+  struct coap_observe_node *prev_sibling;
+  struct coap_observe_node *next_hash; /* node hash chain */
+  coap_observer_t *observers;   /* observers of exactly this path */
+  uint8_t segment_len;
+  char segment[COAP_OBSERVER_URL_LEN];
+} coap_observe_node_t;
+
+static coap_observer_t observers_pool[COAP_MAX_OBSERVERS];
+static coap_observe_node_t nodes_pool[COAP_OBSERVE_MAX_NODES];
+/* Freed entries are chained through next_in_node and sibling. The entries
+   from the used counts on have never been allocated. */
+static coap_observer_t *free_observers;
+static coap_observe_node_t *free_nodes;
+static uint16_t observers_used;
+static uint16_t nodes_used;
+static uint16_t observer_count;
+static coap_observe_node_t root;
+static coap_observer_callback_t observer_callback;
+static coap_observe_node_t *node_table[COAP_OBSERVE_HASH_SIZE];
+static coap_observer_t *token_table[COAP_OBSERVE_HASH_SIZE];
+static coap_observer_t *mid_table[COAP_OBSERVE_HASH_SIZE];
 /*---------------------------------------------------------------------------*/
 /*- Internal API ------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
 static coap_observer_t *
+alloc_observer(void)
+{
+  coap_observer_t *o;
+
+  if(free_observers != NULL) {
+    o = free_observers;
+    free_observers = o->next_in_node;
+  } else if(observers_used < COAP_MAX_OBSERVERS) {
+    o = &observers_pool[observers_used++];
+  } else {
+    return NULL;
+  }
+  observer_count++;
+  return o;
+}
+/*---------------------------------------------------------------------------*/
+static void
+free_observer(coap_observer_t *o)
+{
+  o->next_in_node = free_observers;
+  free_observers = o;
+  observer_count--;
+}
+/*---------------------------------------------------------------------------*/
+static coap_observe_node_t *
+alloc_node(void)
+{
+  coap_observe_node_t *n;
+
+  if(free_nodes != NULL) {
+    n = free_nodes;
+    free_nodes = n->sibling;
+  } else if(nodes_used < COAP_OBSERVE_MAX_NODES) {
+    n = &nodes_pool[nodes_used++];
+  } else {
+    return NULL;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+free_node(coap_observe_node_t *n)
+{
+  n->sibling = free_nodes;
+  free_nodes = n;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned int
+token_hash(const uint8_t *token, size_t token_len)
+{
+  unsigned int hash = 0;
+  while(token_len-- > 0) {
+    hash = hash * 31 + *token++;
+  }
+  return hash % COAP_OBSERVE_HASH_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned int
+node_hash(const coap_observe_node_t *parent, const char *segment, int len)
+{
+  unsigned int hash = (uintptr_t)parent / sizeof(*parent);
+  while(len-- > 0) {
+    hash = hash * 31 + *segment++;
+  }
+  return hash % COAP_OBSERVE_HASH_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+#define mid_hash(mid) ((mid) % COAP_OBSERVE_HASH_SIZE)
+/*---------------------------------------------------------------------------*/
+static void
+mid_table_remove(coap_observer_t *o)
+{
+  coap_observer_t **p;
+  for(p = &mid_table[mid_hash(o->last_mid)]; *p != NULL; p = &(*p)->next_mid) {
+    if(*p == o) {
+      *p = o->next_mid;
+      break;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+mid_table_add(coap_observer_t *o)
+{
+  o->next_mid = mid_table[mid_hash(o->last_mid)];
+  mid_table[mid_hash(o->last_mid)] = o;
+}
+/*---------------------------------------------------------------------------*/
+static void
+token_table_remove(coap_observer_t *o)
+{
+  coap_observer_t **p;
+  for(p = &token_table[token_hash(o->token, o->token_len)]; *p != NULL;
+      p = &(*p)->next_token) {
+    if(*p == o) {
+      *p = o->next_token;
+      break;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the node of the path, creating the missing nodes when create
+ * is set. Empty segments are ignored so "/a//b" and "a/b" are the same
+ * path. Returns NULL if the node does not exist or could not be created.
+ */
+static coap_observe_node_t *
+get_node(const char *path, int path_len, int create)
+{
+  coap_observe_node_t *node = &root;
+  coap_observe_node_t *n;
+  unsigned int hash;
+  int len;
+
+  while(path_len > 0) {
+    if(*path == '/') {
+      path++;
+      path_len--;
+      continue;
+    }
+    for(len = 0; len < path_len && path[len] != '/'; len++);
+
+    hash = node_hash(node, path, len);
+    for(n = node_table[hash]; n != NULL; n = n->next_hash) {
+      if(n->parent == node && n->segment_len == len &&
+         memcmp(n->segment, path, len) == 0) {
+        break;
+      }
+    }
+    if(n == NULL) {
+      if(!create || len > sizeof(n->segment) ||
+         (n = alloc_node()) == NULL) {
+        return NULL;
+      }
+      memcpy(n->segment, path, len);
+      n->segment_len = len;
+      n->observers = NULL;
+      n->child = NULL;
+      n->parent = node;
+      n->prev_sibling = NULL;
+      n->sibling = node->child;
+      if(n->sibling != NULL) {
+        n->sibling->prev_sibling = n;
+      }
+      node->child = n;
+      n->next_hash = node_table[hash];
+      node_table[hash] = n;
+    }
+    node = n;
+    path += len;
+    path_len -= len;
+  }
+  return node;
+}
+/*---------------------------------------------------------------------------*/
+/* Free nodes that no longer have any observers below them */
+static void
+prune_node(coap_observe_node_t *node)
+{
+  coap_observe_node_t *parent;
+  coap_observe_node_t **p;
+
+  while(node != &root && node->observers == NULL && node->child == NULL) {
+    parent = node->parent;
+    if(node->prev_sibling != NULL) {
+      node->prev_sibling->sibling = node->sibling;
+    } else {
+      parent->child = node->sibling;
+    }
+    if(node->sibling != NULL) {
+      node->sibling->prev_sibling = node->prev_sibling;
+    }
+    for(p = &node_table[node_hash(parent, node->segment, node->segment_len)];
+        *p != NULL; p = &(*p)->next_hash) {
+      if(*p == node) {
+        *p = node->next_hash;
+        break;
+      }
+    }
+    free_node(node);
+    node = parent;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static coap_observer_t *
 add_observer(const coap_endpoint_t *endpoint, const uint8_t *token,
-             size_t token_len, const char *uri, int uri_len)
+             size_t token_len, const char *uri, int uri_len, uint16_t accept,
+             uint8_t method)
 {
+  coap_observe_node_t *node;
+  coap_observer_t *o;
+  int max;
+
+  o = alloc_observer();
+  if(o == NULL) {
+    return NULL;
+  }
+
+  max = sizeof(o->url) - 1;
+  if(max > uri_len) {
+    max = uri_len;
+  }
+  memcpy(o->url, uri, max);
+  o->url[max] = 0;
+
   /* Remove existing observe relationship, if any. */
-  coap_remove_observer_by_uri(endpoint, uri);
+  if(method == COAP_FETCH) {
+    /* the request payload selects what to observe - the token identifies */
+    coap_remove_observer_by_token(endpoint, (uint8_t *)token, token_len);
+  } else {
+    coap_remove_observer_by_uri(endpoint, o->url);
+  }
 
-  coap_observer_t *o = memb_alloc(&observers_memb);
+  if((node = get_node(o->url, max, 1)) == NULL) {
+    PRINTF("No observe node for /%s\n", o->url);
+    free_observer(o);
+    return NULL;
+  }
 
-  if(o) {
-    int max = sizeof(o->url) - 1;
-    if(max > uri_len) {
-      max = uri_len;
-    }
-    memcpy(o->url, uri, max);
-    o->url[max] = 0;
-    coap_endpoint_copy(&o->endpoint, endpoint);
-    o->token_len = token_len;
-    memcpy(o->token, token, token_len);
-    o->last_mid = 0;
+  coap_endpoint_copy(&o->endpoint, endpoint);
+  o->token_len = token_len;
+  memcpy(o->token, token, token_len);
+  o->last_mid = 0;
+  o->obs_counter = 0;
+  o->accept = accept;
+  o->method = method;
 
-    PRINTF("Adding observer (%u/%u) for /%s [0x%02X%02X]\n",
-           list_length(observers_list) + 1, COAP_MAX_OBSERVERS,
-           o->url, o->token[0], o->token[1]);
-    list_add(observers_list, o);
+  o->node = node;
+  o->prev_in_node = NULL;
+  o->next_in_node = node->observers;
+  if(o->next_in_node != NULL) {
+    o->next_in_node->prev_in_node = o;
   }
+  node->observers = o;
+  o->next_token = token_table[token_hash(token, token_len)];
+  token_table[token_hash(token, token_len)] = o;
+  mid_table_add(o);
+
+  PRINTF("Adding observer (%u/%u) for /%s [0x%02X%02X]\n",
+         observer_count, COAP_MAX_OBSERVERS,
+         o->url, o->token[0], o->token[1]);
 
+  if(observer_callback != NULL) {
+    observer_callback(o, 1);
+  }
   return o;
 }
 /*---------------------------------------------------------------------------*/
+void
+coap_set_observer_callback(coap_observer_callback_t callback)
+{
+  observer_callback = callback;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the first observer of the trie in pre-order from node */
+static coap_observer_t *
+first_observer_from(coap_observe_node_t *node)
+{
+  while(node != NULL) {
+    if(node->observers != NULL) {
+      return node->observers;
+    }
+    if(node->child != NULL) {
+      node = node->child;
+      continue;
+    }
+    while(node != &root && node->sibling == NULL) {
+      node = node->parent;
+    }
+    node = node == &root ? NULL : node->sibling;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+coap_observer_t *
+coap_get_first_observer(void)
+{
+  return first_observer_from(&root);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the observer after obs. The observer returned is not freed by
+ * removing obs, so loops can fetch it before removing obs.
+ */
+coap_observer_t *
+coap_get_next_observer(coap_observer_t *obs)
+{
+  coap_observe_node_t *node;
+
+  if(obs->next_in_node != NULL) {
+    return obs->next_in_node;
+  }
+  node = obs->node;
+  if(node->child != NULL) {
+    return first_observer_from(node->child);
+  }
+  while(node != &root && node->sibling == NULL) {
+    node = node->parent;
+  }
+  return node == &root ? NULL : first_observer_from(node->sibling);
+}
+/*---------------------------------------------------------------------------*/
 /*- Removal -----------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
 void
@@ -96,8 +403,23 @@ coap_remove_observer(coap_observer_t *o)
   PRINTF("Removing observer for /%s [0x%02X%02X]\n", o->url, o->token[0],
          o->token[1]);
 
-  memb_free(&observers_memb, o);
-  list_remove(observers_list, o);
+  if(observer_callback != NULL) {
+    observer_callback(o, 0);
+  }
+
+  if(o->prev_in_node != NULL) {
+    o->prev_in_node->next_in_node = o->next_in_node;
+  } else {
+    o->node->observers = o->next_in_node;
+  }
+  if(o->next_in_node != NULL) {
+    o->next_in_node->prev_in_node = o->prev_in_node;
+  }
+  prune_node(o->node);
+  token_table_remove(o);
+  mid_table_remove(o);
+
+  free_observer(o);
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -105,12 +427,13 @@ coap_remove_observer_by_client(const coap_endpoint_t *endpoint)
 {
   int removed = 0;
   coap_observer_t *obs = NULL;
+  coap_observer_t *next;
 
   PRINTF("Remove check client ");
   PRINTEP(endpoint);
   PRINTF("\n");
-  for(obs = (coap_observer_t *)list_head(observers_list); obs;
-      obs = obs->next) {
+  for(obs = coap_get_first_observer(); obs; obs = next) {
+    next = coap_get_next_observer(obs);
     if(coap_endpoint_cmp(&obs->endpoint, endpoint)) {
       coap_remove_observer(obs);
       removed++;
@@ -125,10 +448,11 @@ coap_remove_observer_by_token(const coap_endpoint_t *endpoint,
 {
   int removed = 0;
   coap_observer_t *obs = NULL;
+  coap_observer_t *next;
 
-  for(obs = (coap_observer_t *)list_head(observers_list); obs;
-      obs = obs->next) {
-    PRINTF("Remove check Token 0x%02X%02X\n", token[0], token[1]);
+  PRINTF("Remove check Token 0x%02X%02X\n", token[0], token[1]);
+  for(obs = token_table[token_hash(token, token_len)]; obs; obs = next) {
+    next = obs->next_token;
     if(coap_endpoint_cmp(&obs->endpoint, endpoint)
        && obs->token_len == token_len
        && memcmp(obs->token, token, token_len) == 0) {
@@ -139,21 +463,39 @@ coap_remove_observer_by_token(const coap_endpoint_t *endpoint,
   return removed;
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Removes the observers of the uri and of its parent paths, optionally
+ * only those of one endpoint.
+ */
 int
 coap_remove_observer_by_uri(const coap_endpoint_t *endpoint,
                             const char *uri)
 {
   int removed = 0;
+  coap_observe_node_t *node;
   coap_observer_t *obs = NULL;
+  coap_observer_t *next;
+  int uri_len, len;
 
-  for(obs = (coap_observer_t *)list_head(observers_list); obs;
-      obs = obs->next) {
-    PRINTF("Remove check URL %p\n", uri);
-    if((endpoint == NULL
-        || (coap_endpoint_cmp(&obs->endpoint, endpoint)))
-       && (obs->url == uri || memcmp(obs->url, uri, strlen(obs->url)) == 0)) {
-      coap_remove_observer(obs);
-      removed++;
+  PRINTF("Remove check URL %s\n", uri);
+  uri_len = strlen(uri);
+  for(len = 0; len <= uri_len; len++) {
+    if(len < uri_len && uri[len] != '/') {
+      continue;
+    }
+    if((node = get_node(uri, len, 0)) == NULL) {
+      break;
+    }
+    for(obs = node->observers; obs; obs = next) {
+      next = obs->next_in_node;
+      if(obs->method == COAP_FETCH) {
+        /* FETCH observations are only removed by token */
+        continue;
+      }
+      if(endpoint == NULL || coap_endpoint_cmp(&obs->endpoint, endpoint)) {
+        coap_remove_observer(obs);
+        removed++;
+      }
     }
   }
   return removed;
@@ -164,10 +506,11 @@ coap_remove_observer_by_mid(const coap_endpoint_t *endpoint, uint16_t mid)
 {
   int removed = 0;
   coap_observer_t *obs = NULL;
+  coap_observer_t *next;
 
-  for(obs = (coap_observer_t *)list_head(observers_list); obs;
-      obs = obs->next) {
-    PRINTF("Remove check MID %u\n", mid);
+  PRINTF("Remove check MID %u\n", mid);
+  for(obs = mid_table[mid_hash(mid)]; obs; obs = next) {
+    next = obs->next_mid;
     if(coap_endpoint_cmp(&obs->endpoint, endpoint)
        && obs->last_mid == mid) {
       coap_remove_observer(obs);
@@ -177,6 +520,23 @@ coap_remove_observer_by_mid(const coap_endpoint_t *endpoint, uint16_t mid)
   return removed;
 }
 /*---------------------------------------------------------------------------*/
+coap_observer_t *
+coap_get_observer_by_token(const coap_endpoint_t *endpoint,
+                           const uint8_t *token, size_t token_len)
+{
+  coap_observer_t *obs;
+
+  for(obs = token_table[token_hash(token, token_len)]; obs;
+      obs = obs->next_token) {
+    if(coap_endpoint_cmp(&obs->endpoint, endpoint)
+       && obs->token_len == token_len
+       && memcmp(obs->token, token, token_len) == 0) {
+      return obs;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
 /*- Notification ------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
 void
@@ -184,6 +544,200 @@ coap_notify_observers(resource_t *resource)
 {
   coap_notify_observers_sub(resource, NULL);
 }
+/*---------------------------------------------------------------------------*/
+/*
+ * Notifications are rendered once per content format into the shared
+ * payload area of the notification buffer and then sent to every
+ * matching observer. Only the header (type, MID, token and observe
+ * sequence) differs between the observers and it is serialized right
+ * in front of the shared payload.
+ */
+static uint8_t notification_buffer[COAP_MAX_PACKET_SIZE + 1];
+#define NOTIFICATION_PAYLOAD (notification_buffer + COAP_MAX_HEADER_SIZE + 1)
+
+/* ETag of the last notification sent in blocks */
+static uint32_t notification_etag;
+
+/* Observers matching the notification being sent */
+static coap_observer_t *matching_observers[COAP_MAX_OBSERVERS];
+/* The fake request of the notification being rendered */
+static const coap_packet_t *notification_request;
+/*---------------------------------------------------------------------------*/
+/*
+ * The content of FETCH observations depends on the original request so
+ * they are rendered per observer. The fake FETCH carries the token and
+ * endpoint of the observer for the handler to find its observation.
+ */
+static void
+render_notification(resource_t *resource, const char *url,
+                    coap_observer_t *obs, coap_packet_t *notification)
+{
+  coap_packet_t request[1]; /* this way the packet can be treated as pointer as usual */
+  int32_t new_offset = 0;
+
+  coap_init_message(notification, COAP_TYPE_NON, CONTENT_2_05, 0);
+  /* create a "fake" request for the URI */
+  coap_init_message(request, COAP_TYPE_CON, obs->method, 0);
+  coap_set_header_uri_path(request, url);
+  if(obs->accept != COAP_OBSERVER_NO_ACCEPT) {
+    coap_set_header_accept(request, obs->accept);
+  }
+  if(obs->method == COAP_FETCH) {
+    coap_set_token(request, obs->token, obs->token_len);
+    coap_set_src_endpoint(request, &obs->endpoint);
+  }
+
+  notification_request = request;
+  /* Either old style get_handler or the full handler */
+  if(er_coap_call_handlers(request, notification, NOTIFICATION_PAYLOAD,
+                           COAP_MAX_BLOCK_SIZE, &new_offset) > 0) {
+    PRINTF("Notification on new handlers\n");
+  } else {
+    if(resource != NULL) {
+      resource->get_handler(request, notification, NOTIFICATION_PAYLOAD,
+                            COAP_MAX_BLOCK_SIZE, &new_offset);
+    } else {
+      /* What to do here? */
+      notification->code = BAD_REQUEST_4_00;
+    }
+  }
+  notification_request = NULL;
+
+  /* Make sure the payload is in the shared payload area */
+  if(notification->payload_len > 0 &&
+     notification->payload != NOTIFICATION_PAYLOAD) {
+    memmove(NOTIFICATION_PAYLOAD, notification->payload,
+            notification->payload_len);
+    notification->payload = NOTIFICATION_PAYLOAD;
+  }
+
+  /*
+   * A representation larger than one block is notified with its first
+   * block. The observers fetch the rest with Block2 and use the ETag to
+   * tell the notifications apart (RFC 7959, section 2.6).
+   */
+  if(notification->code < BAD_REQUEST_4_00 &&
+     ((new_offset != 0 && new_offset != -1) ||
+      notification->payload_len > COAP_MAX_BLOCK_SIZE)) {
+    notification_etag++;
+    coap_set_header_etag(notification, (uint8_t *)&notification_etag,
+                         sizeof(notification_etag));
+    coap_set_header_block2(notification, 0, 1, COAP_MAX_BLOCK_SIZE);
+    coap_set_payload(notification, notification->payload,
+                     MIN(notification->payload_len, COAP_MAX_BLOCK_SIZE));
+    PRINTF("Notification in blocks, ETag %lu\n",
+           (unsigned long)notification_etag);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_notification(coap_observer_t *obs, coap_packet_t *notification)
+{
+  static uint8_t header[COAP_MAX_HEADER_SIZE + 1];
+  coap_transaction_t *transaction;
+  uint16_t payload_len;
+  uint8_t *packet;
+  size_t len;
+
+  if(obs->obs_counter % COAP_OBSERVE_REFRESH_INTERVAL == 0) {
+    PRINTF("           Force Confirmable for\n");
+    notification->type = COAP_TYPE_CON;
+  } else {
+    notification->type = COAP_TYPE_NON;
+  }
+  notification->mid = coap_get_mid();
+
+  PRINTF("           Observer ");
+  PRINTEP(&obs->endpoint);
+  PRINTF("\n");
+
+  if(notification->code < BAD_REQUEST_4_00) {
+    coap_set_header_observe(notification, obs->obs_counter);
+  }
+  coap_set_token(notification, obs->token, obs->token_len);
+
+  /* Serialize the header only and put it in front of the shared payload */
+  payload_len = notification->payload_len;
+  notification->payload_len = 0;
+  len = coap_serialize_message(notification, header);
+  notification->payload_len = payload_len;
+  if(len == 0) {
+    PRINTF("Failed to serialize notification header\n");
+    return;
+  }
+  if(payload_len > 0) {
+    header[len++] = 0xFF;
+  }
+  packet = NOTIFICATION_PAYLOAD - len;
+  memcpy(packet, header, len);
+  len += payload_len;
+
+  if(notification->type == COAP_TYPE_CON) {
+    /* Confirmable notifications need their own copy for retransmissions */
+    if((transaction = coap_new_transaction(notification->mid,
+                                           &obs->endpoint)) == NULL) {
+      return;
+    }
+    if(!coap_transaction_set_packet(transaction, packet, len)) {
+      coap_clear_transaction(transaction);
+      return;
+    }
+    coap_send_transaction(transaction);
+  } else {
+    coap_send_message(&obs->endpoint, packet, len);
+  }
+
+  /* update last MID for RST matching */
+  mid_table_remove(obs);
+  obs->last_mid = notification->mid;
+  mid_table_add(obs);
+  if(notification->code < BAD_REQUEST_4_00) {
+    obs->obs_counter++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Collects the observers of the path and, with sub_ok, of its sub-paths */
+static int
+collect_observers(const char *path, int sub_ok, coap_observer_t **observers,
+                  int max)
+{
+  coap_observe_node_t *node, *n;
+  coap_observer_t *obs;
+  int count = 0;
+
+  node = get_node(path, strlen(path), 0);
+  if(node == NULL) {
+    return 0;
+  }
+  for(obs = node->observers; obs && count < max; obs = obs->next_in_node) {
+    observers[count++] = obs;
+  }
+  /* walk the sub-tree without recursion */
+  n = sub_ok ? node->child : NULL;
+  while(n != NULL) {
+    for(obs = n->observers; obs && count < max; obs = obs->next_in_node) {
+      observers[count++] = obs;
+    }
+    if(n->child != NULL) {
+      n = n->child;
+      continue;
+    }
+    while(n != node && n->sibling == NULL) {
+      n = n->parent;
+    }
+    n = n == node ? NULL : n->sibling;
+  }
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns up to max observers a notification of the path would reach */
+int
+coap_get_observers_sub(const char *path, coap_observer_t **observers,
+                       int max)
+{
+  return collect_observers(path, 1, observers, max);
+}
+/*---------------------------------------------------------------------------*/
 /* Can be used either for sub - or when there is not resource - just
    a handler */
 void
@@ -191,11 +745,12 @@ coap_notify_observers_sub(resource_t *resource, const char *subpath)
 {
   /* build notification */
   coap_packet_t notification[1]; /* this way the packet can be treated as pointer as usual */
-  coap_packet_t request[1]; /* this way the packet can be treated as pointer as usual */
   coap_observer_t *obs = NULL;
-  int url_len, obs_url_len;
+  int url_len;
   char url[COAP_OBSERVER_URL_LEN];
   uint8_t sub_ok = 0;
+  uint16_t accept;
+  int count, i, j;
 
   if(resource != NULL) {
     url_len = strlen(resource->url);
@@ -213,79 +768,50 @@ coap_notify_observers_sub(resource_t *resource, const char *subpath)
   /* url now contains the notify URL that needs to match the observer */
   PRINTF("Observe: Notification from %s\n", url);
 
-  coap_init_message(notification, COAP_TYPE_NON, CONTENT_2_05, 0);
-  /* create a "fake" request for the URI */
-  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
-  coap_set_header_uri_path(request, url);
-
-  /* iterate over observers */
-  url_len = strlen(url);
+  /* collect the observers of the url and, if allowed, of its sub-paths */
   /* Assumes lazy evaluation... */
   sub_ok = (resource == NULL) || (resource->flags & HAS_SUB_RESOURCES);
-  for(obs = (coap_observer_t *)list_head(observers_list); obs;
-      obs = obs->next) {
-    obs_url_len = strlen(obs->url);
-
-    /* Do a match based on the parent/sub-resource match so that it is
-       possible to do parent-node observe */
-
-    /***** TODO fix here so that we handle the notofication correctly ******/
-    /* All the new-style ... is assuming that the URL might be within */
-    if((obs_url_len == url_len
-        || (obs_url_len > url_len
-            && sub_ok
-            && obs->url[url_len] == '/'))
-       && strncmp(url, obs->url, url_len) == 0) {
-      coap_transaction_t *transaction = NULL;
-
-      /*TODO implement special transaction for CON, sharing the same buffer to allow for more observers */
-
-      if((transaction = coap_new_transaction(coap_get_mid(), &obs->endpoint))) {
-        if(obs->obs_counter % COAP_OBSERVE_REFRESH_INTERVAL == 0) {
-          PRINTF("           Force Confirmable for\n");
-          notification->type = COAP_TYPE_CON;
-        }
-
-        PRINTF("           Observer ");
-        PRINTEP(&obs->endpoint);
-        PRINTF("\n");
-
-        /* update last MID for RST matching */
-        obs->last_mid = transaction->mid;
-
-        /* prepare response */
-        notification->mid = transaction->mid;
-
-        /* Either old style get_handler or the full handler */
-        if(er_coap_call_handlers(request, notification, transaction->packet +
-                                 COAP_MAX_HEADER_SIZE, REST_MAX_CHUNK_SIZE,
-                                 NULL) > 0) {
-          PRINTF("Notification on new handlers\n");
-        } else {
-          if(resource != NULL) {
-            resource->get_handler(request, notification,
-                                  transaction->packet + COAP_MAX_HEADER_SIZE,
-                                  REST_MAX_CHUNK_SIZE, NULL);
-          } else {
-            /* What to do here? */
-            notification->code = BAD_REQUEST_4_00;
-          }
-        }
-
-        if(notification->code < BAD_REQUEST_4_00) {
-          coap_set_header_observe(notification, (obs->obs_counter)++);
-        }
-        coap_set_token(notification, obs->token, obs->token_len);
-
-        transaction->packet_len =
-          coap_serialize_message(notification, transaction->packet);
+  count = collect_observers(url, sub_ok, matching_observers,
+                            COAP_MAX_OBSERVERS);
 
-        coap_send_transaction(transaction);
+  /* render once per content format and send to all observers using it */
+  for(i = 0; i < count; i++) {
+    if(matching_observers[i] == NULL) {
+      continue;
+    }
+    if(matching_observers[i]->method == COAP_FETCH) {
+      coap_notify_observer(matching_observers[i]);
+      continue;
+    }
+    accept = matching_observers[i]->accept;
+    render_notification(resource, url, matching_observers[i], notification);
+    for(j = i; j < count; j++) {
+      obs = matching_observers[j];
+      if(obs != NULL && obs->method == COAP_GET && obs->accept == accept) {
+        send_notification(obs, notification);
+        matching_observers[j] = NULL;
       }
     }
   }
 }
 /*---------------------------------------------------------------------------*/
+/* Tells resource handlers apart the fake requests of notifications */
+int
+coap_observe_is_notification(const coap_packet_t *request)
+{
+  return request != NULL && request == notification_request;
+}
+/*---------------------------------------------------------------------------*/
+/* Sends the current representation of the observed request to one observer */
+void
+coap_notify_observer(coap_observer_t *obs)
+{
+  coap_packet_t notification[1]; /* this way the packet can be treated as pointer as usual */
+
+  render_notification(NULL, obs->url, obs, notification);
+  send_notification(obs, notification);
+}
+/*---------------------------------------------------------------------------*/
 void
 coap_observe_handler(resource_t *resource, void *request, void *response)
 {
@@ -293,18 +819,28 @@ coap_observe_handler(resource_t *resource, void *request, void *response)
   coap_packet_t *const coap_res = (coap_packet_t *)response;
   const coap_endpoint_t *src_ep;
   coap_observer_t *obs;
+  uint32_t observe;
+  const char *uri_path = NULL;
+  int uri_path_len;
+  unsigned int accept;
 
   PRINTF("CoAP observer handler rsc: %d\n", resource != NULL);
 
-  if(coap_req->code == COAP_GET && coap_res->code < 128) { /* GET request and response without error code */
-    if(IS_OPTION(coap_req, COAP_OPTION_OBSERVE)) {
+  if((coap_req->code == COAP_GET || coap_req->code == COAP_FETCH) &&
+     coap_res->code < 128) { /* GET/FETCH request and response without error code */
+    if(coap_get_header_observe(coap_req, &observe)) {
       src_ep = coap_get_src_endpoint(coap_req);
       if(src_ep == NULL) {
         /* No source endpoint, can not add */
-      } else if(coap_req->observe == 0) {
+      } else if(observe == 0) {
+        uri_path_len = coap_get_header_uri_path(coap_req, &uri_path);
+        if(!coap_get_header_accept(coap_req, &accept)) {
+          accept = COAP_OBSERVER_NO_ACCEPT;
+        }
         obs = add_observer(src_ep,
                            coap_req->token, coap_req->token_len,
-                           coap_req->uri_path, coap_req->uri_path_len);
+                           uri_path, uri_path_len,
+                           accept, coap_req->code);
         if(obs) {
           coap_set_header_observe(coap_res, (obs->obs_counter)++);
           /*
@@ -317,14 +853,14 @@ coap_observe_handler(resource_t *resource, void *request, void *response)
           coap_set_payload(coap_res,
                            content,
                            snprintf(content, sizeof(content), "Added %u/%u",
-                                    list_length(observers_list),
+                                    observer_count,
                                     COAP_MAX_OBSERVERS));
 #endif
         } else {
           coap_res->code = SERVICE_UNAVAILABLE_5_03;
           coap_set_payload(coap_res, "TooManyObservers", 16);
         }
-      } else if(coap_req->observe == 1) {
+      } else if(observe == 1) {
 
         /* remove client if it is currently observe */
         coap_remove_observer_by_token(src_ep,
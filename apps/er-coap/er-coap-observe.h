@@ -44,6 +44,9 @@
 
 #define COAP_OBSERVER_URL_LEN 20
 
+/* Accept value of observers that did not request a content format */
+#define COAP_OBSERVER_NO_ACCEPT 0xffff
+
 typedef struct coap_observable {
   uint32_t observe_clock;
   ntimer_t orphan_timer;
@@ -52,14 +55,22 @@ typedef struct coap_observable {
   uint8_t buffer[COAP_MAX_PACKET_SIZE + 1];
 } coap_observable_t;
 
+struct coap_observe_node;
+
 typedef struct coap_observer {
-  struct coap_observer *next;   /* for LIST */
+  struct coap_observer *next_in_node;  /* observers of the same path */
+  struct coap_observer *prev_in_node;
+  struct coap_observer *next_token;    /* token hash chain */
+  struct coap_observer *next_mid;      /* MID hash chain */
+  struct coap_observe_node *node;
 
   char url[COAP_OBSERVER_URL_LEN];
   coap_endpoint_t endpoint;
   uint8_t token_len;
   uint8_t token[COAP_TOKEN_LEN];
   uint16_t last_mid;
+  uint16_t accept;
+  uint8_t method;               /* COAP_GET or COAP_FETCH */
 
   int32_t obs_counter;
 
@@ -67,7 +78,14 @@ typedef struct coap_observer {
   uint8_t retrans_counter;
 } coap_observer_t;
 
-list_t coap_get_observers(void);
+/* Called after an observer is added and before it is removed */
+typedef void (*coap_observer_callback_t)(coap_observer_t *obs, int added);
+
+coap_observer_t *coap_get_first_observer(void);
+coap_observer_t *coap_get_next_observer(coap_observer_t *obs);
+int coap_get_observers_sub(const char *path, coap_observer_t **observers,
+                           int max);
+void coap_set_observer_callback(coap_observer_callback_t callback);
 void coap_remove_observer(coap_observer_t *o);
 int coap_remove_observer_by_client(const coap_endpoint_t *ep);
 int coap_remove_observer_by_token(const coap_endpoint_t *ep,
@@ -76,9 +94,14 @@ int coap_remove_observer_by_uri(const coap_endpoint_t *ep,
                                 const char *uri);
 int coap_remove_observer_by_mid(const coap_endpoint_t *ep,
                                 uint16_t mid);
+coap_observer_t *coap_get_observer_by_token(const coap_endpoint_t *ep,
+                                            const uint8_t *token,
+                                            size_t token_len);
 
 void coap_notify_observers(resource_t *resource);
 void coap_notify_observers_sub(resource_t *resource, const char *subpath);
+void coap_notify_observer(coap_observer_t *obs);
+int coap_observe_is_notification(const coap_packet_t *request);
 
 void coap_observe_handler(resource_t *resource, void *request,
                           void *response);
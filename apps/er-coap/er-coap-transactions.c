@@ -38,10 +38,11 @@
 
 #include "er-coap-transactions.h"
 #include "er-coap-observe.h"
+#include "er-coap-cocoa.h"
 #include "sys/ntimer.h"
 #include "lib/memb.h"
 #include "lib/list.h"
-#include <stdlib.h>
+#include <string.h>
 
 #define DEBUG 0
 #if DEBUG
@@ -53,10 +54,38 @@
 #define PRINTEP(ep)
 #endif
 
+/* The flags of a transaction */
+#define TRANSACTION_IN_FLIGHT     0x01
+#define TRANSACTION_QUEUED        0x02
+#define TRANSACTION_OWNS_PACKET   0x04
+#define TRANSACTION_LARGE_PACKET  0x08
+
+#define mid_hash(mid) ((mid) % COAP_TRANSACTION_HASH_SIZE)
+
+#define IS_CON(packet) (COAP_TYPE_CON == \
+    ((COAP_HEADER_TYPE_MASK & (packet)[0]) >> COAP_HEADER_TYPE_POSITION))
+
+typedef struct {
+  uint8_t data[COAP_TRANSACTION_SMALL_BUFFER_SIZE];
+} small_buffer_t;
+
+typedef struct {
+  uint8_t data[COAP_MAX_PACKET_SIZE + 1];
+} large_buffer_t;
+
 /*---------------------------------------------------------------------------*/
 MEMB(transactions_memb, coap_transaction_t, COAP_MAX_OPEN_TRANSACTIONS);
 LIST(transactions_list);
 
+/* Message buffers of confirmable messages kept for retransmission */
+MEMB(small_buffers_memb, small_buffer_t, COAP_TRANSACTION_SMALL_BUFFERS);
+MEMB(large_buffers_memb, large_buffer_t, COAP_TRANSACTION_LARGE_BUFFERS);
+
+static coap_transaction_t *mid_table[COAP_TRANSACTION_HASH_SIZE];
+
+/* Large buffers kept by confirmable messages until they are acknowledged */
+static uint8_t large_packets;
+
 /*---------------------------------------------------------------------------*/
 static void
 coap_retransmit_transaction(ntimer_t *nt)
@@ -71,6 +100,127 @@ coap_retransmit_transaction(ntimer_t *nt)
   coap_send_transaction(t);
 }
 /*---------------------------------------------------------------------------*/
+static uint8_t *
+alloc_buffer(uint16_t len)
+{
+  uint8_t *buf = NULL;
+  if(len <= COAP_TRANSACTION_SMALL_BUFFER_SIZE) {
+    buf = memb_alloc(&small_buffers_memb);
+  }
+  if(buf == NULL) {
+    buf = memb_alloc(&large_buffers_memb);
+  }
+  return buf;
+}
+/*---------------------------------------------------------------------------*/
+static void
+free_buffer(coap_transaction_t *t)
+{
+  if(t->flags & TRANSACTION_OWNS_PACKET) {
+    if(memb_inmemb(&small_buffers_memb, t->packet)) {
+      memb_free(&small_buffers_memb, t->packet);
+    } else {
+      memb_free(&large_buffers_memb, t->packet);
+    }
+    if(t->flags & TRANSACTION_LARGE_PACKET) {
+      large_packets--;
+    }
+    t->flags &= ~(TRANSACTION_OWNS_PACKET | TRANSACTION_LARGE_PACKET);
+  }
+  t->packet = NULL;
+  t->packet_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Moves a confirmable message that fits into a small buffer there */
+static void
+shrink_buffer(coap_transaction_t *t)
+{
+  uint8_t *buf;
+
+  if(t->packet_len <= COAP_TRANSACTION_SMALL_BUFFER_SIZE &&
+     memb_inmemb(&large_buffers_memb, t->packet) &&
+     (buf = memb_alloc(&small_buffers_memb)) != NULL) {
+    memcpy(buf, t->packet, t->packet_len);
+    memb_free(&large_buffers_memb, t->packet);
+    t->packet = buf;
+    if(t->flags & TRANSACTION_LARGE_PACKET) {
+      large_packets--;
+      t->flags &= ~TRANSACTION_LARGE_PACKET;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Keeps a confirmable message for retransmission. A message that needs a
+ * large buffer is refused when only the reserved large buffers are left,
+ * so that incoming requests can still be answered while it is in flight
+ * or waiting for NSTART.
+ */
+static int
+keep_packet(coap_transaction_t *t)
+{
+  shrink_buffer(t);
+  if(!memb_inmemb(&large_buffers_memb, t->packet) ||
+     (t->flags & TRANSACTION_LARGE_PACKET)) {
+    return 1;
+  }
+  if(large_packets >= COAP_TRANSACTION_LARGE_BUFFERS -
+     COAP_TRANSACTION_RESERVED_LARGE_BUFFERS) {
+    PRINTF("No large buffer to keep transaction %u (%u bytes)\n",
+           t->mid, t->packet_len);
+    free_buffer(t);
+    return 0;
+  }
+  large_packets++;
+  t->flags |= TRANSACTION_LARGE_PACKET;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+count_flagged(const coap_endpoint_t *ep, uint8_t flag)
+{
+  coap_transaction_t *t;
+  int count = 0;
+
+  for(t = list_head(transactions_list); t; t = t->next) {
+    if((t->flags & flag) && coap_endpoint_cmp(&t->endpoint, ep)) {
+      count++;
+    }
+  }
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+/* Ends a transaction and tells the callback that no response came */
+static void
+fail_transaction(coap_transaction_t *t)
+{
+  restful_response_handler callback = t->callback;
+  void *callback_data = t->callback_data;
+
+  coap_clear_transaction(t);
+
+  if(callback) {
+    callback(callback_data, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Sends the oldest message queued for an endpoint */
+static void
+send_queued(const coap_endpoint_t *ep)
+{
+  coap_transaction_t *t;
+
+  for(t = list_head(transactions_list); t; t = t->next) {
+    if((t->flags & TRANSACTION_QUEUED) &&
+       coap_endpoint_cmp(&t->endpoint, ep)) {
+      PRINTF("Sending queued transaction %u\n", t->mid);
+      t->flags &= ~TRANSACTION_QUEUED;
+      coap_send_transaction(t);
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
 
 /*---------------------------------------------------------------------------*/
 /*- Internal API ------------------------------------------------------------*/
@@ -82,26 +232,110 @@ coap_new_transaction(uint16_t mid, const coap_endpoint_t *endpoint)
 
   if(t) {
     t->mid = mid;
+    t->flags = 0;
     t->retrans_counter = 0;
+    t->packet = NULL;
+    t->packet_len = 0;
 
     /* save client address */
     coap_endpoint_copy(&t->endpoint, endpoint);
 
     list_add(transactions_list, t); /* list itself makes sure same element is not added twice */
+    t->next_mid = mid_table[mid_hash(mid)];
+    mid_table[mid_hash(mid)] = t;
   }
 
   return t;
 }
 /*---------------------------------------------------------------------------*/
+uint8_t *
+coap_transaction_alloc_packet(coap_transaction_t *t)
+{
+  free_buffer(t);
+  if((t->packet = memb_alloc(&large_buffers_memb)) == NULL) {
+    PRINTF("No free buffer for transaction %u\n", t->mid);
+    return NULL;
+  }
+  t->flags |= TRANSACTION_OWNS_PACKET;
+  return t->packet;
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_transaction_set_packet(coap_transaction_t *t, uint8_t *data,
+                            uint16_t len)
+{
+  uint8_t *buf;
+
+  if(len > 0 && data == t->packet) {
+    /* serialized into the buffer from coap_transaction_alloc_packet() */
+    t->packet_len = len;
+    return !IS_CON(data) || keep_packet(t);
+  }
+  free_buffer(t);
+  if(len == 0) {
+    return 0;
+  }
+  if(!IS_CON(data)) {
+    /* Sent and freed at once - no need for a copy */
+    t->packet = data;
+  } else {
+    if((buf = alloc_buffer(len)) == NULL) {
+      PRINTF("No free buffer for transaction %u (%u bytes)\n", t->mid, len);
+      return 0;
+    }
+    memcpy(buf, data, len);
+    t->packet = buf;
+    t->flags |= TRANSACTION_OWNS_PACKET;
+    t->packet_len = len;
+    return keep_packet(t);
+  }
+  t->packet_len = len;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_transaction_serialize(coap_transaction_t *t, coap_packet_t *message)
+{
+  uint8_t *buf;
+
+  if((buf = coap_transaction_alloc_packet(t)) == NULL) {
+    return 0;
+  }
+  return coap_transaction_set_packet(t, buf,
+                                     coap_serialize_message(message, buf));
+}
+/*---------------------------------------------------------------------------*/
 void
 coap_send_transaction(coap_transaction_t *t)
 {
+  if(t->packet == NULL) {
+    PRINTF("No message in transaction %u\n", t->mid);
+    coap_clear_transaction(t);
+    return;
+  }
+
+  if(IS_CON(t->packet) && !(t->flags & TRANSACTION_IN_FLIGHT)) {
+    if(count_flagged(&t->endpoint, TRANSACTION_IN_FLIGHT) >= COAP_NSTART) {
+      if(count_flagged(&t->endpoint, TRANSACTION_QUEUED) >=
+         COAP_MAX_QUEUED_PER_ENDPOINT) {
+        PRINTF("Too many messages queued, dropping transaction %u\n", t->mid);
+        fail_transaction(t);
+        return;
+      }
+      /* sent when an outstanding exchange with the endpoint completes */
+      PRINTF("Queueing transaction %u\n", t->mid);
+      t->flags |= TRANSACTION_QUEUED;
+      return;
+    }
+    t->flags |= TRANSACTION_IN_FLIGHT;
+  }
+
   PRINTF("Sending transaction %u\n", t->mid);
 
   coap_send_message(&t->endpoint, t->packet, t->packet_len);
+  t->last_sent = ntimer_uptime();
 
-  if(COAP_TYPE_CON ==
-     ((COAP_HEADER_TYPE_MASK & t->packet[0]) >> COAP_HEADER_TYPE_POSITION)) {
+  if(IS_CON(t->packet)) {
     if(t->retrans_counter < COAP_MAX_RETRANSMIT) {
       /* not timed out yet */
       PRINTF("Keeping transaction %u\n", t->mid);
@@ -109,15 +343,17 @@ coap_send_transaction(coap_transaction_t *t)
       if(t->retrans_counter == 0) {
         ntimer_set_callback(&t->retrans_timer, coap_retransmit_transaction);
         ntimer_set_user_data(&t->retrans_timer, t);
-        t->retrans_interval =
-          COAP_RESPONSE_TIMEOUT_TICKS + (rand() %
-                                         COAP_RESPONSE_TIMEOUT_BACKOFF_MASK);
+        /* initial interval from the measured RTT to the endpoint */
+        t->retrans_interval = coap_cocoa_get_rto(&t->endpoint);
+        t->retrans_backoff = coap_cocoa_get_backoff(t->retrans_interval);
+        t->first_sent = t->last_sent;
         PRINTF("Initial interval %lu msec\n",
                (unsigned long)t->retrans_interval);
       } else {
-        t->retrans_interval <<= 1;  /* double */
-        PRINTF("Doubled (%u) interval %d s\n", t->retrans_counter,
-               t->retrans_interval / 1000);
+        t->retrans_interval = t->retrans_interval * t->retrans_backoff / 2;
+        coap_cocoa_retransmission();
+        PRINTF("Backoff (%u) interval %lu msec\n", t->retrans_counter,
+               (unsigned long)t->retrans_interval);
       }
 
       /* interval updated above */
@@ -127,17 +363,12 @@ coap_send_transaction(coap_transaction_t *t)
     } else {
       /* timed out */
       PRINTF("Timeout\n");
-      restful_response_handler callback = t->callback;
-      void *callback_data = t->callback_data;
+      coap_cocoa_timeout();
 
       /* handle observers */
       coap_remove_observer_by_client(&t->endpoint);
 
-      coap_clear_transaction(t);
-
-      if(callback) {
-        callback(callback_data, NULL);
-      }
+      fail_transaction(t);
     }
   } else {
     coap_clear_transaction(t);
@@ -147,20 +378,39 @@ coap_send_transaction(coap_transaction_t *t)
 void
 coap_clear_transaction(coap_transaction_t *t)
 {
+  coap_transaction_t **p;
+  coap_endpoint_t endpoint;
+  uint8_t flags;
+
   if(t) {
     PRINTF("Freeing transaction %u: %p\n", t->mid, t);
 
     ntimer_stop(&t->retrans_timer);
     list_remove(transactions_list, t);
+    for(p = &mid_table[mid_hash(t->mid)]; *p != NULL; p = &(*p)->next_mid) {
+      if(*p == t) {
+        *p = t->next_mid;
+        break;
+      }
+    }
+    free_buffer(t);
+    flags = t->flags;
+    coap_endpoint_copy(&endpoint, &t->endpoint);
     memb_free(&transactions_memb, t);
+
+    if(flags & TRANSACTION_IN_FLIGHT) {
+      /* let the next message to the endpoint go */
+      send_queued(&endpoint);
+    }
   }
 }
+/*---------------------------------------------------------------------------*/
 coap_transaction_t *
 coap_get_transaction_by_mid(uint16_t mid)
 {
   coap_transaction_t *t = NULL;
 
-  for(t = (coap_transaction_t *)list_head(transactions_list); t; t = t->next) {
+  for(t = mid_table[mid_hash(mid)]; t; t = t->next_mid) {
     if(t->mid == mid) {
       PRINTF("Found transaction for MID %u: %p\n", t->mid, t);
       return t;
@@ -52,23 +52,55 @@
 /* container for transactions with message buffer and retransmission info */
 typedef struct coap_transaction {
   struct coap_transaction *next;        /* for LIST */
+  struct coap_transaction *next_mid;    /* for the MID hash table */
 
   uint16_t mid;
+  uint8_t flags;
   ntimer_t retrans_timer;
   uint32_t retrans_interval;
   uint8_t retrans_counter;
+  uint8_t retrans_backoff; /* in halves, see coap_cocoa_get_backoff() */
+  uint64_t first_sent;
+  uint64_t last_sent;
 
   coap_endpoint_t endpoint;
 
   restful_response_handler callback;
   void *callback_data;
 
+  /* sized to the serialized message, see coap_transaction_set_packet() */
   uint16_t packet_len;
-  uint8_t packet[COAP_MAX_PACKET_SIZE + 1];     /* +1 for the terminating '\0' which will not be sent
-                                                 * Use snprintf(buf, len+1, "", ...) to completely fill payload */
+  uint8_t *packet;
 } coap_transaction_t;
 
 coap_transaction_t *coap_new_transaction(uint16_t mid, const coap_endpoint_t *ep);
+
+/*
+ * Gives the transaction a buffer of COAP_MAX_PACKET_SIZE + 1 bytes to
+ * serialize its message into, then passed to coap_transaction_set_packet().
+ * Returns NULL if no buffer is free.
+ */
+uint8_t *coap_transaction_alloc_packet(coap_transaction_t *t);
+
+/*
+ * Sets the serialized message of a transaction. Confirmable messages are
+ * copied to a buffer of matching size for retransmissions. Other messages
+ * are freed when sent and only reference the data, which must be kept
+ * until coap_send_transaction() is called. Returns 0 if no buffer is free,
+ * or if a confirmable message would take one of the large buffers reserved
+ * by COAP_TRANSACTION_RESERVED_LARGE_BUFFERS.
+ */
+int coap_transaction_set_packet(coap_transaction_t *t, uint8_t *data,
+                                uint16_t len);
+/* Serializes a message and sets it as the message of the transaction */
+int coap_transaction_serialize(coap_transaction_t *t, coap_packet_t *message);
+
+/*
+ * Sends the message of a transaction. Confirmable messages are queued
+ * while COAP_NSTART confirmable messages to the same endpoint are
+ * outstanding. If COAP_MAX_QUEUED_PER_ENDPOINT messages are queued
+ * already, the transaction ends at once with a NULL response.
+ */
 void coap_send_transaction(coap_transaction_t *t);
 void coap_clear_transaction(coap_transaction_t *t);
 coap_transaction_t *coap_get_transaction_by_mid(uint16_t mid);
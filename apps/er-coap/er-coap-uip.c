@@ -92,6 +92,31 @@ coap_endpoint_cmp(const coap_endpoint_t *e1, const coap_endpoint_t *e2)
   return e1->port == e2->port;
 }
 /*---------------------------------------------------------------------------*/
+int
+coap_endpoint_is_secure(const coap_endpoint_t *ep)
+{
+  /* No DTLS support over uIP yet */
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_endpoint_is_connected(const coap_endpoint_t *ep)
+{
+  /* Plain UDP does not need a connection */
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_endpoint_connect(coap_endpoint_t *ep)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_endpoint_disconnect(coap_endpoint_t *ep)
+{
+}
+/*---------------------------------------------------------------------------*/
 static int
 index_of(const char *data, int offset, int len, uint8_t c)
 {
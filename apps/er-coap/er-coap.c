@@ -415,6 +415,173 @@ coap_serialize_message(coap_packet_t *coap_pkt, uint8_t *buffer)
   return (option - buffer) + coap_pkt->payload_len; /* packet length */
 }
 /*---------------------------------------------------------------------------*/
+/* Decodes an option value into the packet struct */
+static coap_status_t
+coap_parse_option(coap_packet_t *coap_pkt, unsigned int option_number,
+                  uint8_t *current_option, size_t option_length)
+{
+  switch(option_number) {
+  case COAP_OPTION_CONTENT_FORMAT:
+    coap_pkt->content_format = coap_parse_int_option(current_option,
+                                                     option_length);
+    PRINTF("Content-Format [%u]\n", coap_pkt->content_format);
+    break;
+  case COAP_OPTION_MAX_AGE:
+    coap_pkt->max_age = coap_parse_int_option(current_option,
+                                              option_length);
+    PRINTF("Max-Age [%lu]\n", (unsigned long)coap_pkt->max_age);
+    break;
+  case COAP_OPTION_ETAG:
+    coap_pkt->etag_len = MIN(COAP_ETAG_LEN, option_length);
+    memcpy(coap_pkt->etag, current_option, coap_pkt->etag_len);
+    PRINTF("ETag %u [0x%02X%02X%02X%02X%02X%02X%02X%02X]\n",
+           coap_pkt->etag_len, coap_pkt->etag[0], coap_pkt->etag[1],
+           coap_pkt->etag[2], coap_pkt->etag[3], coap_pkt->etag[4],
+           coap_pkt->etag[5], coap_pkt->etag[6], coap_pkt->etag[7]
+           );                 /*FIXME always prints 8 bytes */
+    break;
+  case COAP_OPTION_ACCEPT:
+    coap_pkt->accept = coap_parse_int_option(current_option, option_length);
+    PRINTF("Accept [%u]\n", coap_pkt->accept);
+    break;
+  case COAP_OPTION_IF_MATCH:
+    /* TODO support multiple ETags */
+    coap_pkt->if_match_len = MIN(COAP_ETAG_LEN, option_length);
+    memcpy(coap_pkt->if_match, current_option, coap_pkt->if_match_len);
+    PRINTF("If-Match %u [0x%02X%02X%02X%02X%02X%02X%02X%02X]\n",
+           coap_pkt->if_match_len, coap_pkt->if_match[0],
+           coap_pkt->if_match[1], coap_pkt->if_match[2],
+           coap_pkt->if_match[3], coap_pkt->if_match[4],
+           coap_pkt->if_match[5], coap_pkt->if_match[6],
+           coap_pkt->if_match[7]
+           ); /* FIXME always prints 8 bytes */
+    break;
+  case COAP_OPTION_IF_NONE_MATCH:
+    coap_pkt->if_none_match = 1;
+    PRINTF("If-None-Match\n");
+    break;
+
+  case COAP_OPTION_PROXY_URI:
+#if COAP_PROXY_OPTION_PROCESSING
+    coap_pkt->proxy_uri = (char *)current_option;
+    coap_pkt->proxy_uri_len = option_length;
+#endif
+    PRINTPRE("Proxy-Uri NOT IMPLEMENTED [",(int)coap_pkt->proxy_uri_len,
+             coap_pkt->proxy_uri);
+    PRINTF("]\n");
+
+    coap_error_message = "This is a constrained server (Contiki)";
+    return PROXYING_NOT_SUPPORTED_5_05;
+    break;
+  case COAP_OPTION_PROXY_SCHEME:
+#if COAP_PROXY_OPTION_PROCESSING
+    coap_pkt->proxy_scheme = (char *)current_option;
+    coap_pkt->proxy_scheme_len = option_length;
+#endif
+    PRINTPRE("Proxy-Scheme NOT IMPLEMENTED [",
+             (int)coap_pkt->proxy_scheme_len, coap_pkt->proxy_scheme);
+    PRINTF("]\n");
+    coap_error_message = "This is a constrained server (Contiki)";
+    return PROXYING_NOT_SUPPORTED_5_05;
+    break;
+
+  case COAP_OPTION_URI_HOST:
+    coap_pkt->uri_host = (char *)current_option;
+    coap_pkt->uri_host_len = option_length;
+    PRINTPRE("Uri-Host [", (int)coap_pkt->uri_host_len,
+             coap_pkt->uri_host);
+    PRINTF("]\n");
+    break;
+  case COAP_OPTION_URI_PORT:
+    coap_pkt->uri_port = coap_parse_int_option(current_option,
+                                               option_length);
+    PRINTF("Uri-Port [%u]\n", coap_pkt->uri_port);
+    break;
+  case COAP_OPTION_URI_PATH:
+    /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
+    coap_merge_multi_option((char **)&(coap_pkt->uri_path),
+                            &(coap_pkt->uri_path_len), current_option,
+                            option_length, '/');
+    PRINTPRE("Uri-Path [",(int)coap_pkt->uri_path_len, coap_pkt->uri_path);
+    PRINTF("]\n");
+    break;
+  case COAP_OPTION_URI_QUERY:
+    /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
+    coap_merge_multi_option((char **)&(coap_pkt->uri_query),
+                            &(coap_pkt->uri_query_len), current_option,
+                            option_length, '&');
+    PRINTPRE("Uri-Query[",(int)coap_pkt->uri_query_len,coap_pkt->uri_query);
+    PRINTF("]\n");
+    break;
+
+  case COAP_OPTION_LOCATION_PATH:
+    /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
+    coap_merge_multi_option((char **)&(coap_pkt->location_path),
+                            &(coap_pkt->location_path_len), current_option,
+                            option_length, '/');
+
+    PRINTPRE("Location-Path [",(int)coap_pkt->location_path_len,
+             coap_pkt->location_path);
+    PRINTF("]\n");
+    break;
+  case COAP_OPTION_LOCATION_QUERY:
+    /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
+    coap_merge_multi_option((char **)&(coap_pkt->location_query),
+                            &(coap_pkt->location_query_len), current_option,
+                            option_length, '&');
+    PRINTPRE("Location-Query [",(int)coap_pkt->location_query_len,
+             coap_pkt->location_query);
+    PRINTF("]\n");
+    break;
+
+  case COAP_OPTION_OBSERVE:
+    coap_pkt->observe = coap_parse_int_option(current_option,
+                                              option_length);
+    PRINTF("Observe [%lu]\n", (unsigned long)coap_pkt->observe);
+    break;
+  case COAP_OPTION_BLOCK2:
+    coap_pkt->block2_num = coap_parse_int_option(current_option,
+                                                 option_length);
+    coap_pkt->block2_more = (coap_pkt->block2_num & 0x08) >> 3;
+    coap_pkt->block2_size = 16 << (coap_pkt->block2_num & 0x07);
+    coap_pkt->block2_offset = (coap_pkt->block2_num & ~0x0000000F)
+      << (coap_pkt->block2_num & 0x07);
+    coap_pkt->block2_num >>= 4;
+    PRINTF("Block2 [%lu%s (%u B/blk)]\n",
+           (unsigned long)coap_pkt->block2_num,
+           coap_pkt->block2_more ? "+" : "", coap_pkt->block2_size);
+    break;
+  case COAP_OPTION_BLOCK1:
+    coap_pkt->block1_num = coap_parse_int_option(current_option,
+                                                 option_length);
+    coap_pkt->block1_more = (coap_pkt->block1_num & 0x08) >> 3;
+    coap_pkt->block1_size = 16 << (coap_pkt->block1_num & 0x07);
+    coap_pkt->block1_offset = (coap_pkt->block1_num & ~0x0000000F)
+      << (coap_pkt->block1_num & 0x07);
+    coap_pkt->block1_num >>= 4;
+    PRINTF("Block1 [%lu%s (%u B/blk)]\n",
+           (unsigned long)coap_pkt->block1_num,
+           coap_pkt->block1_more ? "+" : "", coap_pkt->block1_size);
+    break;
+  case COAP_OPTION_SIZE2:
+    coap_pkt->size2 = coap_parse_int_option(current_option, option_length);
+    PRINTF("Size2 [%lu]\n", (unsigned long)coap_pkt->size2);
+    break;
+  case COAP_OPTION_SIZE1:
+    coap_pkt->size1 = coap_parse_int_option(current_option, option_length);
+    PRINTF("Size1 [%lu]\n", (unsigned long)coap_pkt->size1);
+    break;
+  default:
+    PRINTF("unknown (%u)\n", option_number);
+    /* check if critical (odd) */
+    if(option_number & 1) {
+      coap_error_message = "Unsupported critical option";
+      return BAD_OPTION_4_02;
+    }
+  }
+  return NO_ERROR;
+}
+/*---------------------------------------------------------------------------*/
 coap_status_t
 coap_parse_message(coap_packet_t *coap_pkt, uint8_t *data, uint16_t data_len)
 {
@@ -460,6 +627,7 @@ coap_parse_message(coap_packet_t *coap_pkt, uint8_t *data, uint16_t data_len)
   unsigned int option_number = 0;
   unsigned int option_delta = 0;
   size_t option_length = 0;
+  coap_status_t status;
 
   while(current_option < data + data_len) {
     /* payload marker 0xFF, currently only checking for 0xF* because rest is reserved */
@@ -510,164 +678,10 @@ coap_parse_message(coap_packet_t *coap_pkt, uint8_t *data, uint16_t data_len)
 
     SET_OPTION(coap_pkt, option_number);
 
-    switch(option_number) {
-    case COAP_OPTION_CONTENT_FORMAT:
-      coap_pkt->content_format = coap_parse_int_option(current_option,
-                                                       option_length);
-      PRINTF("Content-Format [%u]\n", coap_pkt->content_format);
-      break;
-    case COAP_OPTION_MAX_AGE:
-      coap_pkt->max_age = coap_parse_int_option(current_option,
-                                                option_length);
-      PRINTF("Max-Age [%lu]\n", (unsigned long)coap_pkt->max_age);
-      break;
-    case COAP_OPTION_ETAG:
-      coap_pkt->etag_len = MIN(COAP_ETAG_LEN, option_length);
-      memcpy(coap_pkt->etag, current_option, coap_pkt->etag_len);
-      PRINTF("ETag %u [0x%02X%02X%02X%02X%02X%02X%02X%02X]\n",
-             coap_pkt->etag_len, coap_pkt->etag[0], coap_pkt->etag[1],
-             coap_pkt->etag[2], coap_pkt->etag[3], coap_pkt->etag[4],
-             coap_pkt->etag[5], coap_pkt->etag[6], coap_pkt->etag[7]
-             );                 /*FIXME always prints 8 bytes */
-      break;
-    case COAP_OPTION_ACCEPT:
-      coap_pkt->accept = coap_parse_int_option(current_option, option_length);
-      PRINTF("Accept [%u]\n", coap_pkt->accept);
-      break;
-    case COAP_OPTION_IF_MATCH:
-      /* TODO support multiple ETags */
-      coap_pkt->if_match_len = MIN(COAP_ETAG_LEN, option_length);
-      memcpy(coap_pkt->if_match, current_option, coap_pkt->if_match_len);
-      PRINTF("If-Match %u [0x%02X%02X%02X%02X%02X%02X%02X%02X]\n",
-             coap_pkt->if_match_len, coap_pkt->if_match[0],
-             coap_pkt->if_match[1], coap_pkt->if_match[2],
-             coap_pkt->if_match[3], coap_pkt->if_match[4],
-             coap_pkt->if_match[5], coap_pkt->if_match[6],
-             coap_pkt->if_match[7]
-             ); /* FIXME always prints 8 bytes */
-      break;
-    case COAP_OPTION_IF_NONE_MATCH:
-      coap_pkt->if_none_match = 1;
-      PRINTF("If-None-Match\n");
-      break;
-
-    case COAP_OPTION_PROXY_URI:
-#if COAP_PROXY_OPTION_PROCESSING
-      coap_pkt->proxy_uri = (char *)current_option;
-      coap_pkt->proxy_uri_len = option_length;
-#endif
-      PRINTPRE("Proxy-Uri NOT IMPLEMENTED [",(int)coap_pkt->proxy_uri_len,
-               coap_pkt->proxy_uri);
-      PRINTF("]\n");
-
-      coap_error_message = "This is a constrained server (Contiki)";
-      return PROXYING_NOT_SUPPORTED_5_05;
-      break;
-    case COAP_OPTION_PROXY_SCHEME:
-#if COAP_PROXY_OPTION_PROCESSING
-      coap_pkt->proxy_scheme = (char *)current_option;
-      coap_pkt->proxy_scheme_len = option_length;
-#endif
-      PRINTPRE("Proxy-Scheme NOT IMPLEMENTED [",
-               (int)coap_pkt->proxy_scheme_len, coap_pkt->proxy_scheme);
-      PRINTF("]\n");
-      coap_error_message = "This is a constrained server (Contiki)";
-      return PROXYING_NOT_SUPPORTED_5_05;
-      break;
-
-    case COAP_OPTION_URI_HOST:
-      coap_pkt->uri_host = (char *)current_option;
-      coap_pkt->uri_host_len = option_length;
-      PRINTPRE("Uri-Host [", (int)coap_pkt->uri_host_len,
-               coap_pkt->uri_host);
-      PRINTF("]\n");
-      break;
-    case COAP_OPTION_URI_PORT:
-      coap_pkt->uri_port = coap_parse_int_option(current_option,
-                                                 option_length);
-      PRINTF("Uri-Port [%u]\n", coap_pkt->uri_port);
-      break;
-    case COAP_OPTION_URI_PATH:
-      /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
-      coap_merge_multi_option((char **)&(coap_pkt->uri_path),
-                              &(coap_pkt->uri_path_len), current_option,
-                              option_length, '/');
-      PRINTPRE("Uri-Path [",(int)coap_pkt->uri_path_len, coap_pkt->uri_path);
-      PRINTF("]\n");
-      break;
-    case COAP_OPTION_URI_QUERY:
-      /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
-      coap_merge_multi_option((char **)&(coap_pkt->uri_query),
-                              &(coap_pkt->uri_query_len), current_option,
-                              option_length, '&');
-      PRINTPRE("Uri-Query[",(int)coap_pkt->uri_query_len,coap_pkt->uri_query);
-      PRINTF("]\n");
-      break;
-
-    case COAP_OPTION_LOCATION_PATH:
-      /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
-      coap_merge_multi_option((char **)&(coap_pkt->location_path),
-                              &(coap_pkt->location_path_len), current_option,
-                              option_length, '/');
-
-      PRINTPRE("Location-Path [",(int)coap_pkt->location_path_len,
-               coap_pkt->location_path);
-      PRINTF("]\n");
-      break;
-    case COAP_OPTION_LOCATION_QUERY:
-      /* coap_merge_multi_option() operates in-place on the IPBUF, but final packet field should be const string -> cast to string */
-      coap_merge_multi_option((char **)&(coap_pkt->location_query),
-                              &(coap_pkt->location_query_len), current_option,
-                              option_length, '&');
-      PRINTPRE("Location-Query [",(int)coap_pkt->location_query_len,
-               coap_pkt->location_query);
-      PRINTF("]\n");
-      break;
-
-    case COAP_OPTION_OBSERVE:
-      coap_pkt->observe = coap_parse_int_option(current_option,
-                                                option_length);
-      PRINTF("Observe [%lu]\n", (unsigned long)coap_pkt->observe);
-      break;
-    case COAP_OPTION_BLOCK2:
-      coap_pkt->block2_num = coap_parse_int_option(current_option,
-                                                   option_length);
-      coap_pkt->block2_more = (coap_pkt->block2_num & 0x08) >> 3;
-      coap_pkt->block2_size = 16 << (coap_pkt->block2_num & 0x07);
-      coap_pkt->block2_offset = (coap_pkt->block2_num & ~0x0000000F)
-        << (coap_pkt->block2_num & 0x07);
-      coap_pkt->block2_num >>= 4;
-      PRINTF("Block2 [%lu%s (%u B/blk)]\n",
-             (unsigned long)coap_pkt->block2_num,
-             coap_pkt->block2_more ? "+" : "", coap_pkt->block2_size);
-      break;
-    case COAP_OPTION_BLOCK1:
-      coap_pkt->block1_num = coap_parse_int_option(current_option,
-                                                   option_length);
-      coap_pkt->block1_more = (coap_pkt->block1_num & 0x08) >> 3;
-      coap_pkt->block1_size = 16 << (coap_pkt->block1_num & 0x07);
-      coap_pkt->block1_offset = (coap_pkt->block1_num & ~0x0000000F)
-        << (coap_pkt->block1_num & 0x07);
-      coap_pkt->block1_num >>= 4;
-      PRINTF("Block1 [%lu%s (%u B/blk)]\n",
-             (unsigned long)coap_pkt->block1_num,
-             coap_pkt->block1_more ? "+" : "", coap_pkt->block1_size);
-      break;
-    case COAP_OPTION_SIZE2:
-      coap_pkt->size2 = coap_parse_int_option(current_option, option_length);
-      PRINTF("Size2 [%lu]\n", (unsigned long)coap_pkt->size2);
-      break;
-    case COAP_OPTION_SIZE1:
-      coap_pkt->size1 = coap_parse_int_option(current_option, option_length);
-      PRINTF("Size1 [%lu]\n", (unsigned long)coap_pkt->size1);
-      break;
-    default:
-      PRINTF("unknown (%u)\n", option_number);
-      /* check if critical (odd) */
-      if(option_number & 1) {
-        coap_error_message = "Unsupported critical option";
-        return BAD_OPTION_4_02;
-      }
+    status = coap_parse_option(coap_pkt, option_number, current_option,
+                               option_length);
+    if(status != NO_ERROR) {
+      return status;
     }
 
     current_option += option_length;
@@ -39,6 +39,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 #include "sys/ntimer.h"
 #include "lib/list.h"
 #include "rest-engine.h"
@@ -55,7 +56,8 @@
 #define PRINTLLADDR(addr)
 #endif
 
-static void process_callback(ntimer_t *t);
+static void process_callback(rest_periodic_t *periodic);
+static void periodic_timer_callback(ntimer_t *t);
 
 /*---------------------------------------------------------------------------*/
 LIST(restful_services);
@@ -63,6 +65,12 @@ LIST(restful_periodic_services);
 /*---------------------------------------------------------------------------*/
 static uint8_t is_initialized = 0;
 
+/* Scheduled periodic handlers as a min-heap ordered on deadline */
+static rest_periodic_t *periodic_heap[REST_MAX_PERIODIC];
+static uint8_t periodic_count;
+static rest_periodic_t *periodic_running;
+static ntimer_t periodic_ntimer;
+
 /*---------------------------------------------------------------------------*/
 /*- REST Engine API ---------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
@@ -114,12 +122,16 @@ rest_activate_resource(resource_t *resource, const char *path)
      && resource->periodic->periodic_handler
      && resource->periodic->period) {
     PRINTF("Periodic resource: %p (%s)\n", resource->periodic,
-           resource->periodic->resource->url);
+           resource->url);
     list_add(restful_periodic_services, resource->periodic);
     periodic = resource->periodic;
-    ntimer_set_callback(&periodic->periodic_timer, process_callback);
-    ntimer_set_user_data(&periodic->periodic_timer, resource);
-    ntimer_set(&periodic->periodic_timer, periodic->period);
+    periodic->periodic_timer.period = periodic->period;
+    periodic->periodic_timer.callback = process_callback;
+    periodic->periodic_timer.user_data = resource;
+    if(!rest_periodic_start(&periodic->periodic_timer)) {
+      printf("REST: /%s not scheduled, increase REST_MAX_PERIODIC_RESOURCES\n",
+             resource->url);
+    }
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -191,16 +203,188 @@ rest_invoke_restful_service(void *request, void *response, uint8_t *buffer,
   return found & allowed;
 }
 /*---------------------------------------------------------------------------*/
-/* This callback occurs when t is expired */
+/*- Periodic scheduler ------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+static void
+heap_set(uint8_t index, rest_periodic_t *periodic)
+{
+  periodic_heap[index] = periodic;
+  periodic->heap_index = index + 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_sift_up(uint8_t index)
+{
+  rest_periodic_t *periodic;
+  uint8_t parent;
+
+  periodic = periodic_heap[index];
+  while(index > 0) {
+    parent = (index - 1) / 2;
+    if(periodic_heap[parent]->deadline <= periodic->deadline) {
+      break;
+    }
+    heap_set(index, periodic_heap[parent]);
+    index = parent;
+  }
+  heap_set(index, periodic);
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_sift_down(uint8_t index)
+{
+  rest_periodic_t *periodic;
+  uint8_t child;
+
+  periodic = periodic_heap[index];
+  for(;;) {
+    child = 2 * index + 1;
+    if(child >= periodic_count) {
+      break;
+    }
+    if(child + 1 < periodic_count &&
+       periodic_heap[child + 1]->deadline < periodic_heap[child]->deadline) {
+      child++;
+    }
+    if(periodic->deadline <= periodic_heap[child]->deadline) {
+      break;
+    }
+    heap_set(index, periodic_heap[child]);
+    index = child;
+  }
+  heap_set(index, periodic);
+}
+/*---------------------------------------------------------------------------*/
 static void
-process_callback(ntimer_t *t)
+heap_remove(rest_periodic_t *periodic)
+{
+  uint8_t index;
+
+  index = periodic->heap_index - 1;
+  periodic->heap_index = 0;
+  periodic_count--;
+  if(index < periodic_count) {
+    /* Move the last handler to the free position */
+    heap_set(index, periodic_heap[periodic_count]);
+    if(index > 0 && periodic_heap[index]->deadline
+       < periodic_heap[(index - 1) / 2]->deadline) {
+      heap_sift_up(index);
+    } else {
+      heap_sift_down(index);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the latest time the scheduler can wake up without delaying any
+ * handler more than its slack. Subtrees with deadlines after the limit
+ * can not lower it further.
+ */
+static uint64_t
+latest_wakeup(uint8_t index, uint64_t limit)
+{
+  rest_periodic_t *periodic;
+
+  if(index >= periodic_count || periodic_heap[index]->deadline >= limit) {
+    return limit;
+  }
+  periodic = periodic_heap[index];
+  if(periodic->deadline + periodic->slack < limit) {
+    limit = periodic->deadline + periodic->slack;
+  }
+  limit = latest_wakeup(2 * index + 1, limit);
+  return latest_wakeup(2 * index + 2, limit);
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_periodic_timer(void)
+{
+  uint64_t wakeup, now;
+
+  if(periodic_count == 0) {
+    ntimer_stop(&periodic_ntimer);
+    return;
+  }
+
+  wakeup = latest_wakeup(0, UINT64_MAX);
+  now = ntimer_uptime();
+  ntimer_set_callback(&periodic_ntimer, periodic_timer_callback);
+  ntimer_set(&periodic_ntimer, wakeup > now ? wakeup - now : 0);
+}
+/*---------------------------------------------------------------------------*/
+/* Calls all periodic handlers that have reached their deadline */
+static void
+periodic_timer_callback(ntimer_t *t)
+{
+  rest_periodic_t *periodic;
+  uint64_t now;
+
+  now = ntimer_uptime();
+  while(periodic_count > 0 && periodic_heap[0]->deadline <= now) {
+    periodic = periodic_heap[0];
+    heap_remove(periodic);
+
+    /* The callback might stop or restart the handler */
+    periodic_running = periodic;
+    periodic->callback(periodic);
+
+    if(periodic_running == periodic && periodic->period > 0) {
+      /* Keep the phase of the handler unless it has fallen behind */
+      periodic->deadline += periodic->period;
+      if(periodic->deadline <= now) {
+        periodic->deadline = now + periodic->period;
+      }
+      heap_set(periodic_count++, periodic);
+      heap_sift_up(periodic_count - 1);
+    }
+    periodic_running = NULL;
+  }
+
+  update_periodic_timer();
+}
+/*---------------------------------------------------------------------------*/
+int
+rest_periodic_start(rest_periodic_t *periodic)
+{
+  if(periodic == periodic_running) {
+    /* The running handler takes back the slot kept for it */
+    periodic_running = NULL;
+  } else if(periodic->heap_index > 0) {
+    heap_remove(periodic);
+  } else if(periodic_count + (periodic_running != NULL) >= REST_MAX_PERIODIC) {
+    /* The running handler keeps a slot to be rescheduled in */
+    return 0;
+  }
+
+  periodic->deadline = ntimer_uptime() + periodic->period;
+  heap_set(periodic_count++, periodic);
+  heap_sift_up(periodic_count - 1);
+
+  update_periodic_timer();
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+rest_periodic_stop(rest_periodic_t *periodic)
+{
+  if(periodic == periodic_running) {
+    periodic_running = NULL;
+  }
+  if(periodic->heap_index > 0) {
+    heap_remove(periodic);
+    update_periodic_timer();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+process_callback(rest_periodic_t *periodic)
 {
   resource_t *resource;
-  resource = ntimer_get_user_data(t);
+  resource = periodic->user_data;
   if(resource != NULL && (resource->flags & IS_PERIODIC)
      && resource->periodic != NULL && resource->periodic->period) {
     PRINTF("Periodic: timer expired for /%s (period: %lu)\n",
-           resource->url, resource->periodic->period);
+           resource->url, (unsigned long)resource->periodic->period);
 
     if(!is_initialized) {
       /* REST has not yet been initialized. */
@@ -208,8 +392,10 @@ process_callback(ntimer_t *t)
       /* Call the periodic_handler function. */
       resource->periodic->periodic_handler();
     }
-
-    ntimer_set(t, resource->periodic->period);
   }
+
+  /* The period of the resource might have been changed */
+  periodic->period = resource != NULL && resource->periodic != NULL
+    ? resource->periodic->period : 0;
 }
 /*---------------------------------------------------------------------------*/
@@ -55,8 +55,38 @@
 #define REST_MAX_CHUNK_SIZE     64
 #endif
 
+/*
+ * The maximum number of periodic resources, and of other periodic
+ * handlers such as the IPSO sensor sampling, that can be scheduled at
+ * the same time. Together they size the scheduler heap.
+ */
+#ifndef REST_MAX_PERIODIC_RESOURCES
+#define REST_MAX_PERIODIC_RESOURCES 8
+#endif
+
+#ifndef REST_MAX_PERIODIC_HANDLERS
+#define REST_MAX_PERIODIC_HANDLERS  4
+#endif
+
+#ifndef REST_MAX_PERIODIC
+#define REST_MAX_PERIODIC       (REST_MAX_PERIODIC_RESOURCES + REST_MAX_PERIODIC_HANDLERS)
+#endif
+
+#if REST_MAX_PERIODIC > 255
+#error "REST_MAX_PERIODIC must fit the 8-bit heap index"
+#endif
+
+/*
+ * The default time in milliseconds a periodic resource handler may be
+ * delayed to share a wakeup with other periodic handlers.
+ */
+#ifndef REST_PERIODIC_SLACK
+#define REST_PERIODIC_SLACK     0
+#endif
+
 typedef struct resource_s resource_t;
 typedef struct periodic_resource_s periodic_resource_t;
+typedef struct rest_periodic rest_periodic_t;
 
 /* signatures of handler functions */
 typedef void (*restful_handler)(void *request, void *response,
@@ -90,9 +120,24 @@ struct resource_s {
   };
 };
 
+/*
+ * A periodic handler scheduled by the REST engine. All periodic handlers
+ * share one timer and a handler is called at most slack milliseconds
+ * after its deadline, which lets handlers with nearby deadlines be
+ * called in the same wakeup.
+ */
+struct rest_periodic {
+  uint64_t deadline;
+  uint32_t period;                /* in milliseconds, 0 stops the handler */
+  uint32_t slack;                 /* in milliseconds */
+  void (*callback)(rest_periodic_t *periodic);
+  void *user_data;
+  uint8_t heap_index;             /* 0 when not scheduled */
+};
+
 struct periodic_resource_s {
   uint32_t period;
-  ntimer_t periodic_timer;
+  rest_periodic_t periodic_timer;
   const restful_periodic_handler periodic_handler;
 };
 
@@ -119,7 +164,14 @@ struct periodic_resource_s {
  * The subscriber list will be maintained by the final_handler rest_subscription_handler() (see rest-mapping header file).
  */
 #define PERIODIC_RESOURCE(name, attributes, get_handler, post_handler, put_handler, delete_handler, period, periodic_handler) \
-  static periodic_resource_t periodic_##name = { period, { 0 }, periodic_handler }; \
+  PERIODIC_RESOURCE_WITH_SLACK(name, attributes, get_handler, post_handler, put_handler, delete_handler, period, REST_PERIODIC_SLACK, periodic_handler)
+
+/*
+ * Same as PERIODIC_RESOURCE() but the periodic handler may be delayed up to slack milliseconds
+ * to be called together with other periodic handlers.
+ */
+#define PERIODIC_RESOURCE_WITH_SLACK(name, attributes, get_handler, post_handler, put_handler, delete_handler, period, periodic_slack, periodic_handler) \
+  static periodic_resource_t periodic_##name = { period, { .slack = periodic_slack }, periodic_handler }; \
   resource_t name = { NULL, NULL, IS_OBSERVABLE | IS_PERIODIC, attributes, get_handler, post_handler, put_handler, delete_handler, { .periodic = &periodic_##name } }
 
 struct rest_implementation {
@@ -242,5 +294,23 @@ void rest_activate_resource(resource_t *resource, const char *path);
  */
 list_t rest_get_resources(void);
 /*---------------------------------------------------------------------------*/
+/**
+ * \brief      Schedules a periodic handler. The callback is first called
+ *             one period from now and then every period until the handler
+ *             is stopped or its period is set to 0.
+ * \param periodic
+ *             The periodic handler with period, slack, and callback set.
+ * \return     1 if the handler was scheduled, 0 if too many periodic
+ *             handlers are already scheduled.
+ */
+int rest_periodic_start(rest_periodic_t *periodic);
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief      Stops a periodic handler.
+ * \param periodic
+ *             The periodic handler to stop.
+ */
+void rest_periodic_stop(rest_periodic_t *periodic);
+/*---------------------------------------------------------------------------*/
 
 #endif /*REST_ENGINE_H_ */
@@ -86,7 +86,7 @@ static int32_t counter = 0;
 static int32_t edge_selection = 3; /* both */
 static int32_t debounce_time = 10;
 
-static const uint16_t resources[] =
+static const lwm2m_resource_id_t resources[] =
   {IPSO_INPUT_STATE, IPSO_INPUT_COUNTER, IPSO_INPUT_POLARITY,
    IPSO_INPUT_DEBOUNCE, IPSO_INPUT_EDGE_SEL, IPSO_INPUT_CTR_RESET,
    IPSO_INPUT_SENSOR_TYPE};
@@ -96,7 +96,7 @@ static lwm2m_object_instance_t reg_object = {
   .object_id = 3200,
   .instance_id = 0,
   .resource_ids = resources,
-  .resource_count = sizeof(resources) / sizeof(uint16_t),
+  .resource_count = LWM2M_RESOURCE_COUNT(resources),
   .callback = lwm2m_callback,
 };
 
@@ -43,6 +43,7 @@
  */
 #include "ipso-sensor-template.h"
 #include "lwm2m-engine.h"
+#include "rest-engine.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -55,47 +56,170 @@
 
 #define IPSO_SENSOR_RESET_MINMAX 5605
 
+/* Aggregated values over the sample history (vendor specific resources) */
+#define IPSO_SENSOR_MEAN_VALUE   26241
+#define IPSO_SENSOR_WINDOW_MIN   26242
+#define IPSO_SENSOR_WINDOW_MAX   26243
+#define IPSO_SENSOR_STDDEV       26244
+#define IPSO_SENSOR_HISTORY      26245
+
+/* How long a sensor update may be delayed to share a wakeup with others */
+#ifdef IPSO_SENSOR_TEMPLATE_CONF_SLACK
+#define IPSO_SENSOR_SLACK IPSO_SENSOR_TEMPLATE_CONF_SLACK
+#else
+#define IPSO_SENSOR_SLACK 1000
+#endif
+
+/* Sorted on resource ID for faster lookup */
 static const lwm2m_resource_id_t resources[] =
   {
-    RO(IPSO_SENSOR_VALUE), RO(IPSO_SENSOR_UNIT),
     RO(IPSO_SENSOR_MIN_VALUE), RO(IPSO_SENSOR_MAX_VALUE),
     RO(IPSO_SENSOR_MIN_RANGE), RO(IPSO_SENSOR_MAX_RANGE),
-    EX(IPSO_SENSOR_RESET_MINMAX)
+    EX(IPSO_SENSOR_RESET_MINMAX),
+    RO(IPSO_SENSOR_VALUE), RO(IPSO_SENSOR_UNIT),
+#if IPSO_SENSOR_HISTORY_SIZE > 0
+    RO(IPSO_SENSOR_MEAN_VALUE), RO(IPSO_SENSOR_WINDOW_MIN),
+    RO(IPSO_SENSOR_WINDOW_MAX), RO(IPSO_SENSOR_STDDEV),
+    RO(IPSO_SENSOR_HISTORY), /* Multi-resource-instance */
+#endif /* IPSO_SENSOR_HISTORY_SIZE > 0 */
   };
 
 /*---------------------------------------------------------------------------*/
 static void update_last_value(ipso_sensor_value_t *sval, int32_t value,
                               uint8_t notify);
 /*---------------------------------------------------------------------------*/
-static int init = 0;
-static ntimer_t nt;
-
 /* Currently support max 4 periodic sensors */
 #define MAX_PERIODIC 4
+#if MAX_PERIODIC > REST_MAX_PERIODIC_HANDLERS
+#error "REST_MAX_PERIODIC_HANDLERS is too small for the periodic IPSO sensors"
+#endif
 struct periodic_sensor {
   ipso_sensor_value_t *value;
-  uint16_t ticks_left;
+  rest_periodic_t periodic;
+  /* milliseconds until observers should be notified about the value */
+  uint32_t update_left;
 } periodics[MAX_PERIODIC];
 
+#if IPSO_SENSOR_HISTORY_SIZE > 0
+typedef struct {
+  int32_t mean;
+  int32_t min;
+  int32_t max;
+  int32_t stddev;
+} window_stats_t;
+/*---------------------------------------------------------------------------*/
 static void
-timer_callback(ntimer_t *timer)
+add_sample(ipso_sensor_value_t *sval, int32_t value)
 {
-  int i;
-  ntimer_reset(timer, 1000);
+  sval->history[sval->history_next] = value;
+  sval->history_next = (sval->history_next + 1) % IPSO_SENSOR_HISTORY_SIZE;
+  if(sval->history_count < IPSO_SENSOR_HISTORY_SIZE) {
+    sval->history_count++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the sample at the specified index, where 0 is the oldest */
+static int32_t
+get_sample(const ipso_sensor_value_t *sval, uint8_t index)
+{
+  return sval->history[(sval->history_next + IPSO_SENSOR_HISTORY_SIZE
+                        - sval->history_count + index)
+                       % IPSO_SENSOR_HISTORY_SIZE];
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+isqrt(uint64_t value)
+{
+  uint64_t root, bit;
 
-  for(i = 0; i < MAX_PERIODIC; i++) {
-    if(periodics[i].value != NULL) {
-      if(periodics[i].ticks_left > 0) {
-        periodics[i].ticks_left--;
-      } else {
-        int32_t value;
-        periodics[i].ticks_left = periodics[i].value->sensor->update_interval;
-        if(periodics[i].value->sensor->get_value_in_millis(periodics[i].value->sensor, &value) == LWM2M_STATUS_OK) {
-          update_last_value(periodics[i].value, value, 1);
-        }
-      }
+  root = 0;
+  for(bit = (uint64_t)1 << 62; bit > value; bit >>= 2);
+  for(; bit != 0; bit >>= 2) {
+    if(value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+  }
+  return (uint32_t)root;
+}
+/*---------------------------------------------------------------------------*/
+static void
+get_window_stats(const ipso_sensor_value_t *sval, window_stats_t *stats)
+{
+  int64_t sum, diff;
+  uint64_t squares;
+  int32_t v;
+  uint8_t i;
+
+  if(sval->history_count == 0) {
+    /* No samples yet - use the last known value */
+    stats->mean = stats->min = stats->max = sval->last_value;
+    stats->stddev = 0;
+    return;
+  }
+
+  sum = 0;
+  stats->min = stats->max = get_sample(sval, 0);
+  for(i = 0; i < sval->history_count; i++) {
+    v = get_sample(sval, i);
+    sum += v;
+    if(v < stats->min) {
+      stats->min = v;
+    }
+    if(v > stats->max) {
+      stats->max = v;
+    }
+  }
+  stats->mean = (int32_t)(sum / sval->history_count);
+
+  squares = 0;
+  for(i = 0; i < sval->history_count; i++) {
+    diff = (int64_t)get_sample(sval, i) - stats->mean;
+    squares += (uint64_t)(diff * diff);
+  }
+  stats->stddev = (int32_t)isqrt(squares / sval->history_count);
+}
+/*---------------------------------------------------------------------------*/
+static int
+lwm2m_dim_callback(lwm2m_object_instance_t *object, uint16_t resource_id)
+{
+  if(resource_id == IPSO_SENSOR_HISTORY) {
+    return ((ipso_sensor_value_t *)object)->history_count;
+  }
+  return 0;
+}
+#endif /* IPSO_SENSOR_HISTORY_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
+static void
+timer_callback(rest_periodic_t *periodic)
+{
+  struct periodic_sensor *ps;
+  ipso_sensor_value_t *sval;
+  int32_t value;
+  uint8_t notify;
+
+  ps = periodic->user_data;
+  sval = ps->value;
+
+  /* Only notify about the value once every update interval */
+  notify = 0;
+  if(sval->sensor->update_interval > 0) {
+    if(ps->update_left > periodic->period) {
+      ps->update_left -= periodic->period;
+    } else {
+      ps->update_left = sval->sensor->update_interval * 1000UL;
+      notify = 1;
     }
   }
+
+  if(sval->sensor->get_value_in_millis(sval->sensor, &value) == LWM2M_STATUS_OK) {
+#if IPSO_SENSOR_HISTORY_SIZE > 0
+    add_sample(sval, value);
+#endif /* IPSO_SENSOR_HISTORY_SIZE > 0 */
+    update_last_value(sval, value, notify);
+  }
 }
 
 static void
@@ -105,11 +229,40 @@ add_periodic(const ipso_sensor_t *sensor)
   for(i = 0; i < MAX_PERIODIC; i++) {
     if(periodics[i].value == NULL) {
       periodics[i].value = sensor->sensor_value;
-      periodics[i].ticks_left = sensor->update_interval;
+      periodics[i].update_left = sensor->update_interval * 1000UL;
+      if(sensor->sample_interval > 0) {
+        periodics[i].periodic.period = sensor->sample_interval;
+      } else {
+        periodics[i].periodic.period = periodics[i].update_left;
+      }
+      /* Do not let the slack delay a sample past the next one */
+      periodics[i].periodic.slack = IPSO_SENSOR_SLACK;
+      if(periodics[i].periodic.slack > periodics[i].periodic.period / 2) {
+        periodics[i].periodic.slack = periodics[i].periodic.period / 2;
+      }
+      periodics[i].periodic.callback = timer_callback;
+      periodics[i].periodic.user_data = &periodics[i];
+      if(!rest_periodic_start(&periodics[i].periodic)) {
+        printf("IPSO sensor: sampling not scheduled, increase REST_MAX_PERIODIC_HANDLERS\n");
+        periodics[i].value = NULL;
+      }
       return;
     }
   }
 }
+
+static void
+remove_periodic(const ipso_sensor_t *sensor)
+{
+  int i;
+  for(i = 0; i < MAX_PERIODIC; i++) {
+    if(periodics[i].value != NULL
+       && periodics[i].value == sensor->sensor_value) {
+      rest_periodic_stop(&periodics[i].periodic);
+      periodics[i].value = NULL;
+    }
+  }
+}
 /*---------------------------------------------------------------------------*/
 static void
 update_last_value(ipso_sensor_value_t *sval, int32_t value, uint8_t notify)
@@ -179,6 +332,38 @@ lwm2m_callback(lwm2m_object_instance_t *object,
           }
         }
         break;
+#if IPSO_SENSOR_HISTORY_SIZE > 0
+      case IPSO_SENSOR_MEAN_VALUE:
+      case IPSO_SENSOR_WINDOW_MIN:
+      case IPSO_SENSOR_WINDOW_MAX:
+      case IPSO_SENSOR_STDDEV: {
+        window_stats_t stats;
+        int32_t v;
+        get_window_stats(value, &stats);
+        if(ctx->resource_id == IPSO_SENSOR_MEAN_VALUE) {
+          v = stats.mean;
+        } else if(ctx->resource_id == IPSO_SENSOR_WINDOW_MIN) {
+          v = stats.min;
+        } else if(ctx->resource_id == IPSO_SENSOR_WINDOW_MAX) {
+          v = stats.max;
+        } else {
+          v = stats.stddev;
+        }
+        lwm2m_object_write_float32fix(ctx, (v * 1024) / 1000, 10);
+        break;
+      }
+      case IPSO_SENSOR_HISTORY: {
+        uint8_t i;
+        /* All samples, oldest first, in one response */
+        lwm2m_object_write_enter_ri(ctx);
+        for(i = 0; i < value->history_count; i++) {
+          lwm2m_object_write_float32fix_ri(ctx, i,
+                                           (get_sample(value, i) * 1024) / 1000, 10);
+        }
+        lwm2m_object_write_exit_ri(ctx);
+        break;
+      }
+#endif /* IPSO_SENSOR_HISTORY_SIZE > 0 */
       default:
         return LWM2M_STATUS_ERROR;
       }
@@ -195,18 +380,15 @@ lwm2m_callback(lwm2m_object_instance_t *object,
 int
 ipso_sensor_add(const ipso_sensor_t *sensor)
 {
-  if(sensor->update_interval > 0) {
-    if(init == 0) {
-      ntimer_set_callback(&nt, timer_callback);
-      ntimer_set(&nt, 1000);
-      init = 1;
-    }
-    add_periodic(sensor);
-  }
-
   if(sensor->sensor_value == NULL) {
     return 0;
   }
+
+  if((sensor->update_interval > 0 || sensor->sample_interval > 0)
+     && sensor->get_value_in_millis != NULL) {
+    add_periodic(sensor);
+  }
+
   sensor->sensor_value->reg_object.object_id = sensor->object_id;
   sensor->sensor_value->sensor = sensor;
   if(sensor->instance_id == 0) {
@@ -215,9 +397,12 @@ ipso_sensor_add(const ipso_sensor_t *sensor)
     sensor->sensor_value->reg_object.instance_id = sensor->instance_id;
   }
   sensor->sensor_value->reg_object.callback = lwm2m_callback;
+#if IPSO_SENSOR_HISTORY_SIZE > 0
+  sensor->sensor_value->reg_object.resource_dim_callback = lwm2m_dim_callback;
+#endif /* IPSO_SENSOR_HISTORY_SIZE > 0 */
   sensor->sensor_value->reg_object.resource_ids = resources;
   sensor->sensor_value->reg_object.resource_count =
-    sizeof(resources) / sizeof(lwm2m_resource_id_t);
+    LWM2M_RESOURCE_COUNT(resources);
   lwm2m_engine_add_object(&sensor->sensor_value->reg_object);
   return 1;
 }
@@ -225,6 +410,7 @@ ipso_sensor_add(const ipso_sensor_t *sensor)
 int
 ipso_sensor_remove(const ipso_sensor_t *sensor)
 {
+  remove_periodic(sensor);
   lwm2m_engine_remove_object(&sensor->sensor_value->reg_object);
   return 1;
 }
@@ -47,6 +47,17 @@
 
 #include "lwm2m-engine.h"
 
+/*
+ * Number of samples kept per sensor for the aggregated resources
+ * (mean, window min/max, standard deviation, and history).
+ * 0 disables the aggregation.
+ */
+#ifdef IPSO_SENSOR_TEMPLATE_CONF_HISTORY_SIZE
+#define IPSO_SENSOR_HISTORY_SIZE IPSO_SENSOR_TEMPLATE_CONF_HISTORY_SIZE
+#else
+#define IPSO_SENSOR_HISTORY_SIZE 0
+#endif
+
 typedef struct ipso_sensor ipso_sensor_t;
 
 typedef lwm2m_status_t (*ipso_sensor_get_value_millis_t)(const ipso_sensor_t *sensor, int32_t *v);
@@ -59,6 +70,12 @@ typedef struct ipso_sensor_value {
   int32_t last_value;
   int32_t min_value;
   int32_t max_value;
+#if IPSO_SENSOR_HISTORY_SIZE > 0
+  /* Ring buffer with the latest samples */
+  int32_t history[IPSO_SENSOR_HISTORY_SIZE];
+  uint8_t history_next;
+  uint8_t history_count;
+#endif /* IPSO_SENSOR_HISTORY_SIZE > 0 */
 } ipso_sensor_value_t;
 
 /* Meta data about an IPSO sensor object */
@@ -74,6 +91,8 @@ struct ipso_sensor {
   /* update interval in seconds */
   uint16_t update_interval;
   ipso_sensor_value_t *sensor_value;
+  /* sample interval in milliseconds, 0 to sample at the update interval */
+  uint16_t sample_interval;
 };
 
 
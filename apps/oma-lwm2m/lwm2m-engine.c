@@ -46,6 +46,8 @@
 #include "lwm2m-device.h"
 #include "lwm2m-plain-text.h"
 #include "lwm2m-json.h"
+#include "lwm2m-senml.h"
+#include "lwm2m-notification-attributes.h"
 #include "er-coap-constants.h"
 #include "er-coap-engine.h"
 #include "oma-tlv.h"
@@ -61,7 +63,7 @@
 #include "net/ipv6/uip-ds6.h"
 #endif /* UIP_CONF_IPV6_RPL */
 
-#define DEBUG 1
+#define DEBUG 0
 #if DEBUG
 #define PRINTF(...) printf(__VA_ARGS__)
 #define PRINTS(l,s,f) do { int i;					\
@@ -92,10 +94,21 @@
 #include "lwm2m-rd-client.h"
 #endif
 
+/*
+ * Size of the sorted object instance index used for fast lookup of
+ * (object id, instance id). If more instances than this are registered,
+ * the engine falls back to walking the (sorted) object list.
+ */
+#ifdef LWM2M_ENGINE_CONF_MAX_OBJECTS
+#define MAX_OBJECTS LWM2M_ENGINE_CONF_MAX_OBJECTS
+#else
+#define MAX_OBJECTS 32
+#endif /* LWM2M_ENGINE_CONF_MAX_OBJECTS */
+
 /* MACRO for getting out resource ID from resource array ID + flags */
-#define RSC_ID(x) (x & 0xffff)
-#define RSC_READABLE(x) ((x & LWM2M_RESOURCE_READ) > 0)
-#define RSC_WRITABLE(x) ((x & LWM2M_RESOURCE_WRITE) > 0)
+#define RSC_ID(x) LWM2M_RESOURCE_ID(x)
+#define RSC_READABLE(x) LWM2M_RESOURCE_IS_READABLE(x)
+#define RSC_WRITABLE(x) LWM2M_RESOURCE_IS_WRITABLE(x)
 
 void lwm2m_device_init(void);
 void lwm2m_security_init(void);
@@ -109,11 +122,36 @@ static coap_handler_status_t lwm2m_handler_callback(coap_packet_t *request,
                                                     int32_t *offset);
 static lwm2m_object_instance_t *
 lwm2m_engine_next_object_instance(const lwm2m_context_t *context, lwm2m_object_instance_t *last);
+static lwm2m_object_instance_t *find_instance(uint16_t oid, uint16_t iid);
 
 
 COAP_HANDLER(lwm2m_handler, lwm2m_handler_callback);
+/* All object instances - kept sorted on object id and instance id */
 LIST(object_list);
 
+#if MAX_OBJECTS > 0
+/* Sorted index over object_list for binary search lookups */
+static lwm2m_object_instance_t *object_index[MAX_OBJECTS];
+static uint16_t object_index_count;
+static uint8_t object_index_valid;
+#endif /* MAX_OBJECTS > 0 */
+
+/*
+ * The registration payload (the link format list of object instances)
+ * is built when needed and kept until the object instances change. The
+ * version is increased on every change.
+ */
+#ifdef LWM2M_ENGINE_CONF_RD_DATA_SIZE
+#define RD_DATA_SIZE LWM2M_ENGINE_CONF_RD_DATA_SIZE
+#else
+#define RD_DATA_SIZE 128
+#endif /* LWM2M_ENGINE_CONF_RD_DATA_SIZE */
+
+static uint8_t rd_data[RD_DATA_SIZE];
+static uint16_t rd_data_len;
+static uint16_t rd_data_version;
+static uint8_t rd_data_valid;
+
 /*---------------------------------------------------------------------------*/
 static int
 u16toa(uint8_t *buf, uint16_t v)
@@ -161,6 +199,8 @@ get_method_as_string(rest_resource_flags_t method)
     return "PUT";
   } else if(method == METHOD_DELETE) {
     return "DELETE";
+  } else if(method == METHOD_FETCH) {
+    return "FETCH";
   } else {
     return "UNKNOWN";
   }
@@ -213,7 +253,7 @@ lwm2m_engine_parse_context(const char *path, int path_len,
                            lwm2m_context_t *context)
 {
   int ret;
-  if(context == NULL || path == NULL) {
+  if(context == NULL) {
     return 0;
   }
 
@@ -231,6 +271,11 @@ lwm2m_engine_parse_context(const char *path, int path_len,
   context->reader = &lwm2m_plain_text_reader;
   context->writer = &oma_tlv_writer;
 
+  if(path == NULL) {
+    /* The root path - e.g. a composite operation */
+    return 0;
+  }
+
   ret = parse_path(path, path_len, &context->object_id,
                    &context->object_instance_id, &context->resource_id);
 
@@ -241,33 +286,77 @@ lwm2m_engine_parse_context(const char *path, int path_len,
   return ret;
 }
 /*---------------------------------------------------------------------------*/
-int
-lwm2m_engine_get_rd_data(uint8_t *rd_data, int size)
+static void
+rd_data_invalidate(void)
+{
+  rd_data_valid = 0;
+  rd_data_version++;
+}
+/*---------------------------------------------------------------------------*/
+const uint8_t *
+lwm2m_engine_get_rd_payload(uint16_t *len)
 {
   lwm2m_object_instance_t *o;
-  int pos;
-  int len;
-
-  pos = 0;
-
-  for(o = list_head(object_list); o != NULL; o = o->next) {
-    if(pos > 0) {
-      rd_data[pos++] = ',';
-    }
-    len = append_reg_tag(&rd_data[pos], size - pos,
-                         o->object_id, o->instance_id, -1);
-    if(len > 0 && len < size - pos) {
-      pos += len;
+  /* "</65535/65535>," */
+  uint8_t tag[16];
+  int tag_len;
+
+  if(!rd_data_valid) {
+    rd_data_len = 0;
+    for(o = list_head(object_list); o != NULL; o = o->next) {
+      tag_len = 0;
+      if(rd_data_len > 0) {
+        tag[tag_len++] = ',';
+      }
+      tag_len += append_reg_tag(&tag[tag_len], sizeof(tag) - tag_len,
+                                o->object_id, o->instance_id, -1);
+      if(rd_data_len + tag_len >= sizeof(rd_data)) {
+        PRINTF("lwm2m: registration payload does not fit\n");
+        break;
+      }
+      memcpy(&rd_data[rd_data_len], tag, tag_len);
+      rd_data_len += tag_len;
     }
+    rd_data[rd_data_len] = 0;
+    rd_data_valid = 1;
   }
-  rd_data[pos] = 0;
-  return pos;
+  *len = rd_data_len;
+  return rd_data;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+lwm2m_engine_get_rd_version(void)
+{
+  return rd_data_version;
+}
+/*---------------------------------------------------------------------------*/
+int
+lwm2m_engine_get_rd_data(uint8_t *data, int size)
+{
+  const uint8_t *payload;
+  uint16_t len;
+
+  if(size <= 0) {
+    return 0;
+  }
+  payload = lwm2m_engine_get_rd_payload(&len);
+  if(len >= size) {
+    len = size - 1;
+  }
+  memcpy(data, payload, len);
+  data[len] = 0;
+  return len;
 }
 /*---------------------------------------------------------------------------*/
 void
 lwm2m_engine_init(void)
 {
   list_init(object_list);
+#if MAX_OBJECTS > 0
+  object_index_count = 0;
+  object_index_valid = 1;
+#endif /* MAX_OBJECTS > 0 */
+  lwm2m_notification_attributes_init();
 
 #ifdef LWM2M_ENGINE_CLIENT_ENDPOINT_NAME
   const char *endpoint = LWM2M_ENGINE_CLIENT_ENDPOINT_NAME;
@@ -353,6 +442,12 @@ lwm2m_engine_select_writer(lwm2m_context_t *context, unsigned int accept)
     case APPLICATION_JSON:
       context->writer = &lwm2m_json_writer;
       break;
+    case LWM2M_SENML_JSON:
+      context->writer = &lwm2m_senml_json_writer;
+      break;
+    case LWM2M_SENML_CBOR:
+      context->writer = &lwm2m_senml_cbor_writer;
+      break;
     default:
       PRINTF("Unknown Accept type %u, using LWM2M plain text\n", accept);
       context->writer = &lwm2m_plain_text_writer;
@@ -382,6 +477,12 @@ lwm2m_engine_select_reader(lwm2m_context_t *context, unsigned int content_format
     case TEXT_PLAIN:
       context->reader = &lwm2m_plain_text_reader;
       break;
+    case LWM2M_SENML_JSON:
+      context->reader = &lwm2m_senml_json_reader;
+      break;
+    case LWM2M_SENML_CBOR:
+      context->reader = &lwm2m_senml_cbor_reader;
+      break;
     default:
       PRINTF("Unknown content type %u, using LWM2M plain text\n",
              content_format);
@@ -393,143 +494,459 @@ lwm2m_engine_select_reader(lwm2m_context_t *context, unsigned int content_format
 /*---------------------------------------------------------------------------*/
 /* Lightweight object instances */
 /*---------------------------------------------------------------------------*/
-static lwm2m_object_instance_t *last_ins;
-static int last_rsc_pos;
+/* Returns the position of the resource in the resource array or -1 */
+static int
+find_resource(const lwm2m_object_instance_t *instance, uint16_t rid)
+{
+  int low, high, mid;
+  uint16_t id;
 
-/* Multi read will handle read of JSON / TLV or Discovery (Link Format) */
+  if(instance->resource_ids == NULL) {
+    return -1;
+  }
+
+  if(instance->flags & LWM2M_INSTANCE_FLAG_SORTED_RESOURCES) {
+    low = 0;
+    high = instance->resource_count;
+    while(low < high) {
+      mid = (low + high) / 2;
+      id = RSC_ID(instance->resource_ids[mid]);
+      if(id == rid) {
+        return mid;
+      }
+      if(id < rid) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return -1;
+  }
+
+  for(low = 0; low < instance->resource_count; low++) {
+    if(RSC_ID(instance->resource_ids[low]) == rid) {
+      return low;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * A multi resource read is serialized one unit at a time (the header
+ * of an object instance, one resource or link, the end of an object
+ * instance) and each unit is rendered into a unit buffer before it is
+ * copied to the outgoing block. A read cursor remembers the unit that
+ * was being output when a block was filled so that the next block can
+ * continue from there, even in the middle of a unit, without calling
+ * the callbacks for all earlier resources again. A composite read keeps
+ * one cursor for all its paths.
+ */
+#ifdef LWM2M_ENGINE_CONF_MAX_READ_CURSORS
+#define MAX_READ_CURSORS LWM2M_ENGINE_CONF_MAX_READ_CURSORS
+#else
+#define MAX_READ_CURSORS 2
+#endif /* LWM2M_ENGINE_CONF_MAX_READ_CURSORS */
+
+/*
+ * Each resource is serialized whole into the unit buffer before it is
+ * copied to the block, so a block can start in the middle of a resource.
+ * Reads including a resource that does not fit fail with 5.00 and the
+ * diagnostic payload "ResourceTooLarge". Objects without a resource list
+ * handle their own block offsets and have no such limit.
+ */
+#ifdef LWM2M_ENGINE_CONF_UNIT_BUFFER_SIZE
+#define UNIT_BUFFER_SIZE LWM2M_ENGINE_CONF_UNIT_BUFFER_SIZE
+#else
+#define UNIT_BUFFER_SIZE REST_MAX_CHUNK_SIZE
+#endif /* LWM2M_ENGINE_CONF_UNIT_BUFFER_SIZE */
+
+/* Units of a serialized object instance */
+#define UNIT_INIT_WRITE 0
+#define UNIT_RESOURCE   1
+#define UNIT_END_WRITE  2
+#define UNIT_DONE       3
+
+typedef struct read_cursor {
+  coap_endpoint_t endpoint;
+  uint64_t last_access;
+  unsigned int content_type;
+  uint32_t offset;          /* output offset of the current unit */
+  uint16_t object_id;
+  uint16_t object_instance_id;
+  uint16_t resource_id;
+  uint16_t instance_id;     /* the instance being serialized */
+  uint16_t rsc_pos;         /* the resource being serialized */
+  uint8_t level;
+  uint8_t operation;
+  uint8_t unit;
+  uint8_t writer_flags;     /* writer flags before the current unit */
+  uint8_t more_output;      /* output follows the last instance */
+  uint8_t has_output;
+  uint8_t in_use;
+  uint8_t path_pos;         /* the path being serialized in a composite read */
+  uint16_t composite_key;   /* the paths of a composite read, 0 otherwise */
+} read_cursor_t;
+
+static read_cursor_t read_cursors[MAX_READ_CURSORS];
+static uint8_t unit_buf[UNIT_BUFFER_SIZE];
+/*---------------------------------------------------------------------------*/
+static void
+cursor_reset(read_cursor_t *cursor, const lwm2m_context_t *ctx,
+             const lwm2m_object_instance_t *instance, uint16_t key)
+{
+  cursor->content_type = ctx->content_type;
+  cursor->offset = 0;
+  cursor->object_id = ctx->object_id;
+  cursor->object_instance_id = ctx->object_instance_id;
+  cursor->resource_id = ctx->resource_id;
+  cursor->instance_id = instance->instance_id;
+  cursor->rsc_pos = 0;
+  cursor->level = ctx->level;
+  cursor->operation = ctx->operation;
+  cursor->unit = ctx->operation == LWM2M_OP_DISCOVER
+    ? UNIT_RESOURCE : UNIT_INIT_WRITE;
+  cursor->writer_flags = 0;
+  cursor->more_output = 0;
+  cursor->has_output = 0;
+  cursor->path_pos = 0;
+  cursor->composite_key = key;
+}
+/*---------------------------------------------------------------------------*/
+static int
+cursor_matches(const read_cursor_t *cursor, const lwm2m_context_t *ctx,
+               const coap_endpoint_t *ep, uint16_t key)
+{
+  if(key != 0) {
+    /* The cursor of a composite read moves between the paths */
+    return cursor->in_use &&
+      cursor->composite_key == key &&
+      cursor->operation == ctx->operation &&
+      cursor->content_type == ctx->content_type &&
+      coap_endpoint_cmp(&cursor->endpoint, ep);
+  }
+  return cursor->in_use &&
+    cursor->composite_key == 0 &&
+    cursor->object_id == ctx->object_id &&
+    cursor->object_instance_id == ctx->object_instance_id &&
+    cursor->resource_id == ctx->resource_id &&
+    cursor->level == ctx->level &&
+    cursor->operation == ctx->operation &&
+    cursor->content_type == ctx->content_type &&
+    coap_endpoint_cmp(&cursor->endpoint, ep);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the read cursor to continue from for the request, with key
+ * identifying the paths of a composite read. A new or the least recently
+ * used cursor is taken for requests without a matching cursor. The
+ * returned cursor never points past ctx->offset.
+ */
+static read_cursor_t *
+get_read_cursor(const lwm2m_context_t *ctx, const coap_endpoint_t *ep,
+                const lwm2m_object_instance_t *instance, uint16_t key)
+{
+  static read_cursor_t tmp_cursor;
+  read_cursor_t *cursor;
+  int i;
+
+  if(ep == NULL) {
+    /* No block continuation possible - use a temporary cursor */
+    cursor_reset(&tmp_cursor, ctx, instance, key);
+    return &tmp_cursor;
+  }
+
+  cursor = NULL;
+  for(i = 0; i < MAX_READ_CURSORS; i++) {
+    if(cursor_matches(&read_cursors[i], ctx, ep, key)) {
+      cursor = &read_cursors[i];
+      break;
+    }
+    if(cursor == NULL || !read_cursors[i].in_use ||
+       (cursor->in_use &&
+        read_cursors[i].last_access < cursor->last_access)) {
+      cursor = &read_cursors[i];
+    }
+  }
+
+  if(cursor == NULL) {
+    /* No cursors configured */
+    cursor_reset(&tmp_cursor, ctx, instance, key);
+    return &tmp_cursor;
+  }
+
+  if(i == MAX_READ_CURSORS || ctx->offset < cursor->offset) {
+    /* Start from the beginning and skip up to the requested offset */
+    cursor_reset(cursor, ctx, instance, key);
+    coap_endpoint_copy(&cursor->endpoint, ep);
+    cursor->in_use = 1;
+  }
+  cursor->last_access = ntimer_uptime();
+  return cursor;
+}
+/*---------------------------------------------------------------------------*/
+static void
+release_read_cursor(read_cursor_t *cursor)
+{
+  cursor->in_use = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Render the current unit into the unit buffer */
 static lwm2m_status_t
-perform_multi_resource_read_op(lwm2m_object_instance_t *instance,
-                               lwm2m_context_t *ctx)
+render_unit(lwm2m_object_instance_t *instance, read_cursor_t *cursor,
+            lwm2m_context_t *ctx)
 {
-  int pos = 0;
-  int size = ctx->outsize;
-  int len = 0;
-  uint8_t initialized = 0; /* used for commas, etc */
-  uint8_t num_read = 0;
-
-  if(ctx->offset == 0) {
-    last_ins = instance;
-    last_rsc_pos = 0;
-    /* Here we should print top node */
-  } else {
-    /* offset > 0 - assume that we are already in a disco or multi get*/
-    instance = last_ins;
-    if(last_ins == NULL) {
-      ctx->offset = -1;
-      ctx->outbuf[0] = ' ';
-      pos = 1;
-    }
-  }
-
-  while(instance != NULL) {
-    /* Do the discovery or read */
-    if(instance->resource_ids != NULL && instance->resource_count > 0) {
-      /* show all the available resources (or read all) */
-      while(last_rsc_pos < instance->resource_count) {
-        PRINTF("READ: %x %x %x lv:%d\n", instance->resource_ids[last_rsc_pos], RSC_ID(instance->resource_ids[last_rsc_pos]), ctx->resource_id, ctx->level);
-        if(ctx->level < 3 || ctx->resource_id == RSC_ID(instance->resource_ids[last_rsc_pos])) {
-          if(ctx->operation == LWM2M_OP_DISCOVER) {
-            int dim = 0;
-            len = snprintf((char *) &ctx->outbuf[pos], size - pos,
-                           pos == 0 && ctx->offset == 0 ? "</%d/%d/%d>":",</%d/%d/%d>",
-                           instance->object_id, instance->instance_id,
-                           RSC_ID(instance->resource_ids[last_rsc_pos]));
-            if(instance->resource_dim_callback != NULL &&
-               (dim = instance->resource_dim_callback(instance,
-                                                      RSC_ID(instance->resource_ids[last_rsc_pos]))) > 0) {
-              len += snprintf((char *) &ctx->outbuf[pos + len],
-                              size - pos - len,  ";dim=%d", dim);
-            }
-            /* here we have "read" out something */
-            num_read++;
-            if(len < 0 || len + pos >= size) {
-              /* ok we trunkated here... */
-              ctx->offset += pos;
-              ctx->outlen = pos;
-              /* TODO handle full outbuffer! */
-              return LWM2M_STATUS_OK;
-            }
-            pos += len;
-          } else if(ctx->operation == LWM2M_OP_READ) {
-            lwm2m_status_t success;
-            uint8_t lv;
+  const coap_endpoint_t *ep;
+  lwm2m_resource_id_t rsc;
+  lwm2m_status_t success;
+  int len, dim;
 
-            lv = ctx->level;
+  ctx->outbuf = unit_buf;
+  ctx->outsize = sizeof(unit_buf);
+  ctx->outlen = 0;
+  ctx->writer_flags = cursor->writer_flags;
+  ctx->object_instance_id = instance->instance_id;
 
-            /* Do not allow a read on a non-readable */
-            if(lv == 3 && !RSC_READABLE(instance->resource_ids[last_rsc_pos])) {
-              return LWM2M_STATUS_OPERATION_NOT_ALLOWED;
-            }
-            /* Set the resource ID is ctx->level < 3 */
-            if(lv < 3) {
-              ctx->resource_id = RSC_ID(instance->resource_ids[last_rsc_pos]);
-            }
-            if(lv < 2) {
-              ctx->object_instance_id = instance->instance_id;
-            }
+  if(cursor->unit == UNIT_INIT_WRITE) {
+    ctx->outlen = ctx->writer->init_write(ctx);
+    return LWM2M_STATUS_OK;
+  }
 
-            if(RSC_READABLE(instance->resource_ids[last_rsc_pos])) {
-              ctx->level = 3;
-              if(!initialized) {
-                len = ctx->writer->init_write(ctx);
-                ctx->outlen += len;
-                PRINTF("INIT WRITE len:%d\n", len);
-                initialized = 1;
-              }
-
-              success = instance->callback(instance, ctx);
-
-              if(success != LWM2M_STATUS_OK) {
-                /* What to do here? */
-                PRINTF("Callback failed: %d\n", success);
-                if(lv < 3) {
-                  if(success == LWM2M_STATUS_NOT_FOUND) {
-                    /* ok with a not found during a multi read - what more
-                       is ok? */
-                  } else {
-                    return success;
-                  }
-                } else {
-                  return success;
-                }
-              }
-              /* here we have "read" out something */
-              num_read++;
-              /* We will need to handle no-success and other things */
-              PRINTF("Called %u/%u/%u outlen:%u ok:%u\n",
-                     ctx->object_id, ctx->object_instance_id, ctx->resource_id,
-                     ctx->outlen, success);
-
-              /* we need to handle full buffer, etc here also! */
-              ctx->level = lv;
-              pos = ctx->outlen;
-            }
-          }
-        }
-        last_rsc_pos++;
-      }
+  if(cursor->unit == UNIT_END_WRITE) {
+    /* Writers with one output for all instances need to know the last */
+    if(cursor->more_output || (cursor->level < 2 &&
+       lwm2m_engine_next_object_instance(ctx, instance) != NULL)) {
+      ctx->writer_flags |= WRITER_MORE_INSTANCES;
+    } else {
+      ctx->writer_flags &= ~WRITER_MORE_INSTANCES;
+    }
+    ctx->outlen = ctx->writer->end_write(ctx);
+    return LWM2M_STATUS_OK;
+  }
+
+  rsc = instance->resource_ids[cursor->rsc_pos];
+  if(cursor->operation == LWM2M_OP_DISCOVER) {
+    len = snprintf((char *)unit_buf, sizeof(unit_buf),
+                   cursor->has_output ? ",</%d/%d/%d>" : "</%d/%d/%d>",
+                   instance->object_id, instance->instance_id, RSC_ID(rsc));
+    if(len > 0 && len < sizeof(unit_buf) &&
+       instance->resource_dim_callback != NULL &&
+       (dim = instance->resource_dim_callback(instance, RSC_ID(rsc))) > 0) {
+      len += snprintf((char *)&unit_buf[len], sizeof(unit_buf) - len,
+                      ";dim=%d", dim);
     }
+    if(len > 0 && len < sizeof(unit_buf)) {
+      /* The attributes written by the server doing the discover */
+      ep = ctx->request != NULL ? coap_get_src_endpoint(ctx->request) : NULL;
+      len += lwm2m_notification_attributes_print(ep, instance->object_id,
+                                                 instance->instance_id,
+                                                 RSC_ID(rsc),
+                                                 (char *)&unit_buf[len],
+                                                 sizeof(unit_buf) - len);
+    }
+    if(len < 0 || len >= sizeof(unit_buf)) {
+      return LWM2M_STATUS_RESOURCE_TOO_LARGE;
+    }
+    ctx->outlen = len;
+    return LWM2M_STATUS_OK;
+  }
+
+  ctx->resource_id = RSC_ID(rsc);
+  ctx->level = 3;
+  ctx->writer_flags &= ~WRITER_OUTPUT_FULL;
+  success = instance->callback(instance, ctx);
+  ctx->level = cursor->level;
+
+  PRINTF("Called %u/%u/%u outlen:%u ok:%u\n",
+         ctx->object_id, ctx->object_instance_id, ctx->resource_id,
+         ctx->outlen, success);
+  if(success == LWM2M_STATUS_OK && (ctx->writer_flags & WRITER_OUTPUT_FULL)) {
+    PRINTF("Resource %u/%u/%u larger than %u bytes\n",
+           ctx->object_id, ctx->object_instance_id, ctx->resource_id,
+           (unsigned)sizeof(unit_buf));
+    ctx->writer_flags &= ~WRITER_OUTPUT_FULL;
+    return LWM2M_STATUS_RESOURCE_TOO_LARGE;
+  }
+  return success;
+}
+/*---------------------------------------------------------------------------*/
+/* Step the cursor to the next unit to serialize */
+static lwm2m_object_instance_t *
+next_unit(lwm2m_object_instance_t *instance, read_cursor_t *cursor,
+          lwm2m_context_t *ctx)
+{
+  if(cursor->unit == UNIT_INIT_WRITE) {
+    cursor->unit = UNIT_RESOURCE;
+    cursor->rsc_pos = 0;
+  } else if(cursor->unit == UNIT_RESOURCE) {
+    cursor->rsc_pos++;
+  } else {
+    /* Object instance done - continue with the next instance */
     instance = lwm2m_engine_next_object_instance(ctx, instance);
-    last_ins = instance;
-    if(ctx->operation == LWM2M_OP_READ) {
-      PRINTF("END Writer\n");
-      len = ctx->writer->end_write(ctx);
-      ctx->outlen += len;
-      pos = ctx->outlen;
+    if(instance == NULL) {
+      cursor->unit = UNIT_DONE;
+      return NULL;
     }
+    cursor->instance_id = instance->instance_id;
+    cursor->unit = cursor->operation == LWM2M_OP_DISCOVER
+      ? UNIT_RESOURCE : UNIT_INIT_WRITE;
+    cursor->rsc_pos = 0;
+    cursor->writer_flags &= ~WRITER_RESOURCE_INSTANCE;
+    return instance;
+  }
 
-    initialized = 0;
-    last_rsc_pos = 0;
+  /* Skip resources that should not be part of the output */
+  while(cursor->unit == UNIT_RESOURCE) {
+    if(instance->resource_ids == NULL ||
+       cursor->rsc_pos >= instance->resource_count) {
+      cursor->unit = UNIT_END_WRITE;
+    } else if(cursor->level == 3 &&
+              RSC_ID(instance->resource_ids[cursor->rsc_pos]) !=
+              cursor->resource_id) {
+      int rsc = find_resource(instance, cursor->resource_id);
+      cursor->rsc_pos = rsc > cursor->rsc_pos ? rsc : instance->resource_count;
+    } else if(cursor->operation == LWM2M_OP_READ &&
+              !RSC_READABLE(instance->resource_ids[cursor->rsc_pos])) {
+      cursor->rsc_pos++;
+    } else {
+      break;
+    }
+  }
+  if(cursor->unit == UNIT_END_WRITE && cursor->operation == LWM2M_OP_DISCOVER) {
+    /* No end of instance for link format */
+    return next_unit(instance, cursor, ctx);
   }
+  return instance;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Serialize units from the cursor until it is done or the block is full.
+ * The output between offset and offset + size is copied to outbuf from
+ * position *pos and *pos is updated.
+ */
+static lwm2m_status_t
+serialize_units(lwm2m_object_instance_t *instance, read_cursor_t *cursor,
+                lwm2m_context_t *ctx, uint8_t *outbuf, size_t size,
+                uint32_t offset, size_t *pos)
+{
+  lwm2m_status_t success;
+  uint32_t from;
+  size_t len;
+
+  while(cursor->unit != UNIT_DONE) {
+    success = render_unit(instance, cursor, ctx);
+    if(success != LWM2M_STATUS_OK) {
+      PRINTF("Callback failed: %d\n", success);
+      if(cursor->level == 3 || success != LWM2M_STATUS_NOT_FOUND) {
+        /* ok with a not found during a multi read - what more is ok? */
+        return success;
+      }
+      ctx->outlen = 0;
+    }
 
-  /* did not read anything even if we should have - on single item */
-  if (num_read == 0 && ctx->level == 3) {
-    return LWM2M_STATUS_NOT_FOUND;
+    len = ctx->outlen;
+    if(offset + *pos < cursor->offset + len) {
+      /* This unit has output for this block */
+      from = offset + *pos - cursor->offset;
+      if(len - from > size - *pos) {
+        /* Block full - continue from this unit in the next block */
+        memcpy(&outbuf[*pos], &unit_buf[from], size - *pos);
+        *pos = size;
+        break;
+      }
+      memcpy(&outbuf[*pos], &unit_buf[from], len - from);
+      *pos += len - from;
+    }
+
+    cursor->offset += len;
+    cursor->writer_flags = ctx->writer_flags;
+    if(len > 0) {
+      cursor->has_output = 1;
+    }
+    instance = next_unit(instance, cursor, ctx);
   }
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the instance that was being serialized by the cursor */
+static lwm2m_object_instance_t *
+resume_read_cursor(read_cursor_t *cursor, lwm2m_context_t *ctx)
+{
+  lwm2m_object_instance_t *instance;
 
-  /* seems like we are done! */
-  ctx->offset=-1;
+  instance = find_instance(cursor->object_id, cursor->instance_id);
+  if(instance == NULL || instance->object_id != cursor->object_id) {
+    cursor->unit = UNIT_DONE;
+  } else if(instance->instance_id != cursor->instance_id) {
+    /* The instance has been removed - continue with the next */
+    cursor->instance_id = instance->instance_id;
+    cursor->unit = UNIT_INIT_WRITE;
+    cursor->rsc_pos = 0;
+    cursor->writer_flags &= ~WRITER_RESOURCE_INSTANCE;
+    if(cursor->operation == LWM2M_OP_DISCOVER) {
+      next_unit(instance, cursor, ctx);
+    }
+  }
+  return instance;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Multi read will handle read of JSON / TLV or Discovery (Link Format).
+ * The output starting at ctx->offset is written to the out buffer and
+ * ctx->offset is set to the offset of the next block or -1 if done.
+ */
+static lwm2m_status_t
+perform_multi_resource_read_op(lwm2m_object_instance_t *instance,
+                               lwm2m_context_t *ctx,
+                               const coap_endpoint_t *ep)
+{
+  read_cursor_t *cursor;
+  lwm2m_status_t success;
+  uint8_t *outbuf = ctx->outbuf;
+  size_t size = ctx->outsize;
+  size_t pos = 0;
+  uint32_t offset = ctx->offset;
+
+  if(ctx->level == 3) {
+    int rsc = find_resource(instance, ctx->resource_id);
+    if(rsc < 0) {
+      /* did not read anything even if we should have - on single item */
+      return LWM2M_STATUS_NOT_FOUND;
+    }
+    /* Do not allow a read on a non-readable */
+    if(ctx->operation == LWM2M_OP_READ &&
+       !RSC_READABLE(instance->resource_ids[rsc])) {
+      return LWM2M_STATUS_OPERATION_NOT_ALLOWED;
+    }
+  }
+
+  cursor = get_read_cursor(ctx, ep, instance, 0);
+  if(cursor->offset == 0 && cursor->unit == UNIT_RESOURCE) {
+    /* Step to the first resource to output */
+    cursor->rsc_pos = 0;
+    cursor->unit = UNIT_INIT_WRITE;
+    next_unit(instance, cursor, ctx);
+  } else if(cursor->unit != UNIT_DONE) {
+    instance = resume_read_cursor(cursor, ctx);
+  }
+
+  success = serialize_units(instance, cursor, ctx, outbuf, size, offset, &pos);
+  if(success != LWM2M_STATUS_OK) {
+    release_read_cursor(cursor);
+    ctx->outbuf = outbuf;
+    ctx->outlen = 0;
+    return success;
+  }
+
+  ctx->outbuf = outbuf;
+  ctx->outsize = size;
   ctx->outlen = pos;
+  if(cursor->unit == UNIT_DONE) {
+    /* seems like we are done! */
+    release_read_cursor(cursor);
+    ctx->offset = -1;
+  } else {
+    ctx->offset = offset + pos;
+  }
   return LWM2M_STATUS_OK;
 }
 /*---------------------------------------------------------------------------*/
@@ -594,15 +1011,12 @@ get_or_create_instance(lwm2m_context_t *ctx, uint16_t oid, uint8_t *created)
 static int
 check_write(lwm2m_object_instance_t *instance, int rid)
 {
-  int i;
+  int pos;
   if(instance->resource_ids != NULL && instance->resource_count > 0) {
-    int count = instance->resource_count;
-    for(i = 0; i < count; i++) {
-      if(RSC_ID(instance->resource_ids[i]) == rid &&
-         RSC_WRITABLE(instance->resource_ids[i])) {
-        /* yes - writable */
-        return 1;
-      }
+    pos = find_resource(instance, rid);
+    if(pos >= 0 && RSC_WRITABLE(instance->resource_ids[pos])) {
+      /* yes - writable */
+      return 1;
     }
   }
   return 0;
@@ -748,11 +1162,143 @@ perform_multi_resource_write_op(lwm2m_object_instance_t *instance,
       }
       tlvpos += len;
     }
+  } else if(format == LWM2M_SENML_JSON || format == LWM2M_SENML_CBOR) {
+    lwm2m_senml_record_t record;
+    lwm2m_status_t status;
+    uint16_t req_iid = ctx->object_instance_id;
+    uint16_t req_rid = ctx->resource_id;
+    uint8_t created = 0;
+    const char *name;
+    int ret;
+
+    memset(&record, 0, sizeof(record));
+    while((ret = format == LWM2M_SENML_JSON
+           ? lwm2m_senml_json_next_record(ctx, &record)
+           : lwm2m_senml_cbor_next_record(ctx, &record)) > 0) {
+      /* Names are full paths to resources - with or without leading '/' */
+      name = record.name[0] == '/' ? &record.name[1] : record.name;
+      if(record.value == NULL ||
+         parse_path(name, strlen(name), &oid, &iid, &rid) != 3 ||
+         oid != ctx->object_id ||
+         (olv >= 2 && iid != req_iid) || (olv == 3 && rid != req_rid)) {
+        PRINTF("SenML record %s outside of target\n", record.name);
+        return LWM2M_STATUS_BAD_REQUEST;
+      }
+
+      inpos = ctx->inpos;
+      ctx->object_instance_id = iid;
+      ctx->resource_id = rid;
+      ctx->level = 3;
+      instance = get_or_create_instance(ctx, iid, &created);
+      if(instance == NULL || instance->callback == NULL) {
+        status = LWM2M_STATUS_ERROR;
+      } else if(!created && !check_write(instance, rid)) {
+        /* allow write if just created - otherwise not */
+        status = LWM2M_STATUS_OPERATION_NOT_ALLOWED;
+      } else {
+        ctx->inbuf = (uint8_t *)record.value;
+        ctx->inpos = 0;
+        ctx->insize = record.value_len;
+        status = instance->callback(instance, ctx);
+      }
+      ctx->inbuf = inbuf;
+      ctx->inpos = inpos;
+      ctx->insize = insize;
+      ctx->level = olv;
+      if(status != LWM2M_STATUS_OK) {
+        return status;
+      }
+    }
+    if(ret < 0) {
+      return LWM2M_STATUS_BAD_REQUEST;
+    }
+  } else if(olv == 3 &&
+            (format == TEXT_PLAIN || format == LWM2M_TEXT_PLAIN ||
+             format == APPLICATION_OCTET_STREAM ||
+             format == LWM2M_OLD_OPAQUE)) {
+    /* A single resource value - objects without resource list check
+       their own writes */
+    if(instance->resource_ids != NULL &&
+       !check_write(instance, ctx->resource_id)) {
+      return LWM2M_STATUS_OPERATION_NOT_ALLOWED;
+    }
+    return instance->callback(instance, ctx);
   }
   /* Here we have a success! */
   return LWM2M_STATUS_OK;
 }
 
+/*---------------------------------------------------------------------------*/
+/* Compare an object instance with an object id and instance id */
+static inline int
+instance_cmp(const lwm2m_object_instance_t *i, uint16_t oid, uint16_t iid)
+{
+  if(i->object_id != oid) {
+    return i->object_id < oid ? -1 : 1;
+  }
+  if(i->instance_id != iid) {
+    return i->instance_id < iid ? -1 : 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+#if MAX_OBJECTS > 0
+/* Returns the position of the first index entry not less than oid/iid */
+static int
+index_lower_bound(uint16_t oid, uint16_t iid)
+{
+  int low = 0;
+  int high = object_index_count;
+  int mid;
+  while(low < high) {
+    mid = (low + high) / 2;
+    if(instance_cmp(object_index[mid], oid, iid) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_rebuild(void)
+{
+  lwm2m_object_instance_t *i;
+
+  object_index_count = 0;
+  for(i = list_head(object_list); i != NULL; i = i->next) {
+    if(object_index_count >= MAX_OBJECTS) {
+      PRINTF("lwm2m: object index full - using list lookup\n");
+      object_index_valid = 0;
+      return;
+    }
+    object_index[object_index_count++] = i;
+  }
+  object_index_valid = 1;
+}
+#endif /* MAX_OBJECTS > 0 */
+/*---------------------------------------------------------------------------*/
+/* Returns the first instance not less than oid/iid or NULL if none */
+static lwm2m_object_instance_t *
+find_instance(uint16_t oid, uint16_t iid)
+{
+  lwm2m_object_instance_t *i;
+
+#if MAX_OBJECTS > 0
+  if(object_index_valid) {
+    int pos = index_lower_bound(oid, iid);
+    return pos < object_index_count ? object_index[pos] : NULL;
+  }
+#endif /* MAX_OBJECTS > 0 */
+
+  for(i = list_head(object_list); i != NULL; i = i->next) {
+    if(instance_cmp(i, oid, iid) >= 0) {
+      return i;
+    }
+  }
+  return NULL;
+}
 /*---------------------------------------------------------------------------*/
 uint16_t
 lwm2m_engine_recommend_instance_id(uint16_t object_id)
@@ -761,9 +1307,10 @@ lwm2m_engine_recommend_instance_id(uint16_t object_id)
   uint16_t min_id = 0xffff;
   uint16_t max_id = 0;
   int found = 0;
-  for(i = list_head(object_list); i != NULL ; i = i->next) {
-    if(i->object_id == object_id
-       && i->instance_id != LWM2M_OBJECT_INSTANCE_NONE) {
+  /* All instances of an object are stored next to each other */
+  for(i = find_instance(object_id, 0);
+      i != NULL && i->object_id == object_id; i = i->next) {
+    if(i->instance_id != LWM2M_OBJECT_INSTANCE_NONE) {
       found++;
       if(i->instance_id > max_id) {
         max_id = i->instance_id;
@@ -786,22 +1333,101 @@ lwm2m_engine_recommend_instance_id(uint16_t object_id)
 void
 lwm2m_engine_add_object(lwm2m_object_instance_t *object)
 {
-  list_add(object_list, object);
+  lwm2m_object_instance_t *i, *prev;
+  uint16_t r;
+
+  /* Check once if the resources can be found using binary search */
+  object->flags |= LWM2M_INSTANCE_FLAG_SORTED_RESOURCES;
+  for(r = 1; object->resource_ids != NULL && r < object->resource_count; r++) {
+    if(RSC_ID(object->resource_ids[r - 1]) >=
+       RSC_ID(object->resource_ids[r])) {
+      object->flags &= ~LWM2M_INSTANCE_FLAG_SORTED_RESOURCES;
+      break;
+    }
+  }
+
+  /* Make sure the instance is not already added */
+  lwm2m_engine_remove_object(object);
+  rd_data_invalidate();
+
+  /* Insert sorted on object id and instance id */
+  prev = NULL;
+  for(i = list_head(object_list); i != NULL; i = i->next) {
+    if(instance_cmp(i, object->object_id, object->instance_id) > 0) {
+      break;
+    }
+    prev = i;
+  }
+  list_insert(object_list, prev, object);
+
+#if MAX_OBJECTS > 0
+  if(object_index_valid && object_index_count < MAX_OBJECTS) {
+    int pos = index_lower_bound(object->object_id, object->instance_id);
+    memmove(&object_index[pos + 1], &object_index[pos],
+            (object_index_count - pos) * sizeof(object_index[0]));
+    object_index[pos] = object;
+    object_index_count++;
+  } else {
+    index_rebuild();
+  }
+#endif /* MAX_OBJECTS > 0 */
 }
 /*---------------------------------------------------------------------------*/
 void
 lwm2m_engine_remove_object(lwm2m_object_instance_t *object)
 {
+#if MAX_OBJECTS > 0
+  int pos;
+#endif /* MAX_OBJECTS > 0 */
+
+  rd_data_invalidate();
+
+#if MAX_OBJECTS > 0
+  if(object_index_valid) {
+    pos = index_lower_bound(object->object_id, object->instance_id);
+    while(pos < object_index_count && object_index[pos] != object &&
+          instance_cmp(object_index[pos], object->object_id,
+                       object->instance_id) == 0) {
+      pos++;
+    }
+    if(pos >= object_index_count || object_index[pos] != object) {
+      /* The ids might have been changed after the instance was added */
+      for(pos = 0; pos < object_index_count && object_index[pos] != object;
+          pos++);
+    }
+    if(pos < object_index_count) {
+      object_index_count--;
+      memmove(&object_index[pos], &object_index[pos + 1],
+              (object_index_count - pos) * sizeof(object_index[0]));
+    }
+    list_remove(object_list, object);
+    return;
+  }
+#endif /* MAX_OBJECTS > 0 */
+
   list_remove(object_list, object);
+
+#if MAX_OBJECTS > 0
+  if(list_length(object_list) <= MAX_OBJECTS) {
+    index_rebuild();
+  }
+#endif /* MAX_OBJECTS > 0 */
 }
 /*---------------------------------------------------------------------------*/
 static lwm2m_object_instance_t *
 lwm2m_engine_get_object_instance(const lwm2m_context_t *context)
 {
   lwm2m_object_instance_t *i;
-  for(i = list_head(object_list); i != NULL ; i = i->next) {
-    if(i->object_id == context->object_id &&
-       ((context->level < 2) || i->instance_id == context->object_instance_id)) {
+  if(context->level < 2) {
+    /* First instance of the object */
+    i = find_instance(context->object_id, 0);
+    if(i != NULL && i->object_id == context->object_id) {
+      return i;
+    }
+  } else {
+    i = find_instance(context->object_id, context->object_instance_id);
+    if(i != NULL && instance_cmp(i, context->object_id,
+                                 context->object_instance_id) == 0) {
       return i;
     }
   }
@@ -811,21 +1437,415 @@ lwm2m_engine_get_object_instance(const lwm2m_context_t *context)
 static lwm2m_object_instance_t *
 lwm2m_engine_next_object_instance(const lwm2m_context_t *context, lwm2m_object_instance_t *last)
 {
-  while(last != NULL) {
+  /* The instances are sorted - the next instance of the object follows */
+  if(last != NULL && context->level < 2) {
     last = last->next;
-    if(last != NULL && last->object_id == context->object_id &&
-       ((context->level < 2) || last->instance_id == context->object_instance_id)) {
+    if(last != NULL && last->object_id == context->object_id) {
       return last;
     }
   }
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Composite read and observe: a FETCH of the root path with a SenML pack
+ * of paths in the payload, e.g. [{"n":"/3/0/0"},{"n":"/3303/0"}], reads
+ * all the paths into one SenML response. With the observe option the
+ * paths are kept for the notifications of the observation.
+ */
+#ifdef LWM2M_ENGINE_CONF_MAX_COMPOSITE_PATHS
+#define MAX_COMPOSITE_PATHS LWM2M_ENGINE_CONF_MAX_COMPOSITE_PATHS
+#else
+#define MAX_COMPOSITE_PATHS 8
+#endif /* LWM2M_ENGINE_CONF_MAX_COMPOSITE_PATHS */
+
+#ifdef LWM2M_ENGINE_CONF_MAX_COMPOSITE_OBSERVATIONS
+#define MAX_COMPOSITE_OBSERVATIONS LWM2M_ENGINE_CONF_MAX_COMPOSITE_OBSERVATIONS
+#else
+#define MAX_COMPOSITE_OBSERVATIONS 2
+#endif /* LWM2M_ENGINE_CONF_MAX_COMPOSITE_OBSERVATIONS */
+
+typedef struct composite_path {
+  uint16_t object_id;
+  uint16_t object_instance_id;
+  uint16_t resource_id;
+  uint8_t level;
+} composite_path_t;
+
+typedef struct composite_observation {
+  coap_endpoint_t endpoint;
+  uint8_t token[COAP_TOKEN_LEN];
+  uint8_t token_len;
+  uint8_t path_count;
+  uint8_t in_use;
+  composite_path_t paths[MAX_COMPOSITE_PATHS];
+} composite_observation_t;
+
+#if MAX_COMPOSITE_OBSERVATIONS > 0
+static composite_observation_t composite_observations[MAX_COMPOSITE_OBSERVATIONS];
+#endif /* MAX_COMPOSITE_OBSERVATIONS > 0 */
+/*---------------------------------------------------------------------------*/
+/* Reads the paths of the SenML pack in the request. Returns the count. */
+static int
+parse_composite_paths(lwm2m_context_t *ctx, unsigned int format,
+                      composite_path_t *paths)
+{
+  lwm2m_senml_record_t record;
+  const char *name;
+  int count = 0;
+  int ret, depth;
+
+  if(format != LWM2M_SENML_JSON && format != LWM2M_SENML_CBOR) {
+    return -1;
+  }
+
+  memset(&record, 0, sizeof(record));
+  while((ret = format == LWM2M_SENML_JSON
+         ? lwm2m_senml_json_next_record(ctx, &record)
+         : lwm2m_senml_cbor_next_record(ctx, &record)) > 0) {
+    if(count >= MAX_COMPOSITE_PATHS) {
+      PRINTF("Too many composite paths\n");
+      return -1;
+    }
+    name = record.name[0] == '/' ? &record.name[1] : record.name;
+    depth = parse_path(name, strlen(name), &paths[count].object_id,
+                       &paths[count].object_instance_id,
+                       &paths[count].resource_id);
+    if(depth < 1 || depth > 3) {
+      return -1;
+    }
+    paths[count].level = depth;
+    count++;
+  }
+  return ret < 0 ? -1 : count;
+}
+/*---------------------------------------------------------------------------*/
+/* Sets up the context for the path and returns its first instance */
+static lwm2m_object_instance_t *
+get_composite_instance(lwm2m_context_t *ctx, const composite_path_t *path)
+{
+  lwm2m_object_instance_t *instance;
+  int rsc;
+
+  ctx->object_id = path->object_id;
+  ctx->object_instance_id = path->object_instance_id;
+  ctx->resource_id = path->resource_id;
+  ctx->level = path->level;
+
+  instance = lwm2m_engine_get_object_instance(ctx);
+  if(instance == NULL || instance->callback == NULL ||
+     instance->resource_ids == NULL) {
+    /* Only instances with a resource list can be part of a composite */
+    return NULL;
+  }
+  if(ctx->level == 3) {
+    rsc = find_resource(instance, ctx->resource_id);
+    if(rsc < 0 || !RSC_READABLE(instance->resource_ids[rsc])) {
+      return NULL;
+    }
+  }
+  return instance;
+}
+/*---------------------------------------------------------------------------*/
+/* Identifies the paths of a composite read for its read cursor */
+static uint16_t
+composite_key(const composite_path_t *paths, int count)
+{
+  uint16_t key = count;
+  int i;
+
+  for(i = 0; i < count; i++) {
+    key = key * 31 + paths[i].object_id;
+    key = key * 31 + paths[i].object_instance_id;
+    key = key * 31 + paths[i].resource_id;
+    key = key * 31 + paths[i].level;
+  }
+  return key == 0 ? 1 : key;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads all paths into one output with the multi resource read units.
+ * Paths that do not exist are left out. The output starting at
+ * ctx->offset is written to the out buffer and ctx->offset is set to the
+ * offset of the next block or -1 if done. The read cursor of the
+ * endpoint continues from the path and unit of the previous block.
+ */
+static lwm2m_status_t
+perform_composite_read_op(lwm2m_context_t *ctx, const composite_path_t *paths,
+                          int count, const coap_endpoint_t *ep)
+{
+  lwm2m_object_instance_t *instance;
+  read_cursor_t *cursor;
+  lwm2m_status_t success;
+  uint8_t *outbuf = ctx->outbuf;
+  size_t size = ctx->outsize;
+  size_t pos = 0;
+  uint32_t offset = ctx->offset;
+  int i, first, last;
+
+  /* The first and last existing paths start and end the output */
+  for(first = 0; first < count; first++) {
+    if(get_composite_instance(ctx, &paths[first]) != NULL) {
+      break;
+    }
+  }
+  for(last = count - 1; last > first; last--) {
+    if(get_composite_instance(ctx, &paths[last]) != NULL) {
+      break;
+    }
+  }
+  if(first == count) {
+    return LWM2M_STATUS_NOT_FOUND;
+  }
+
+  instance = get_composite_instance(ctx, &paths[first]);
+  cursor = get_read_cursor(ctx, ep, instance, composite_key(paths, count));
+  if(cursor->offset == 0) {
+    cursor->path_pos = first;
+  }
+
+  for(i = cursor->path_pos; i <= last; i++) {
+    instance = get_composite_instance(ctx, &paths[i]);
+    if(instance == NULL) {
+      continue;
+    }
+    if(i != cursor->path_pos) {
+      /* Continue the output with the next path */
+      cursor->object_id = ctx->object_id;
+      cursor->object_instance_id = ctx->object_instance_id;
+      cursor->resource_id = ctx->resource_id;
+      cursor->level = ctx->level;
+      cursor->instance_id = instance->instance_id;
+      cursor->rsc_pos = 0;
+      cursor->unit = UNIT_INIT_WRITE;
+      cursor->path_pos = i;
+    } else if(cursor->unit != UNIT_DONE) {
+      instance = resume_read_cursor(cursor, ctx);
+    }
+    cursor->more_output = i < last;
+
+    success = serialize_units(instance, cursor, ctx, outbuf, size, offset,
+                              &pos);
+    if(success != LWM2M_STATUS_OK) {
+      release_read_cursor(cursor);
+      ctx->outbuf = outbuf;
+      ctx->outlen = 0;
+      return success;
+    }
+    if(cursor->unit != UNIT_DONE) {
+      /* Block full */
+      break;
+    }
+  }
+
+  ctx->outbuf = outbuf;
+  ctx->outsize = size;
+  ctx->outlen = pos;
+  if(i > last) {
+    release_read_cursor(cursor);
+    ctx->offset = -1;
+  } else {
+    ctx->offset = offset + pos;
+  }
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+#if MAX_COMPOSITE_OBSERVATIONS > 0
+static composite_observation_t *
+find_composite_observation(const coap_endpoint_t *ep, const uint8_t *token,
+                           uint8_t token_len)
+{
+  int i;
+  for(i = 0; i < MAX_COMPOSITE_OBSERVATIONS; i++) {
+    if(composite_observations[i].in_use &&
+       composite_observations[i].token_len == token_len &&
+       memcmp(composite_observations[i].token, token, token_len) == 0 &&
+       coap_endpoint_cmp(&composite_observations[i].endpoint, ep)) {
+      return &composite_observations[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static composite_observation_t *
+new_composite_observation(const coap_endpoint_t *ep, const uint8_t *token,
+                          uint8_t token_len)
+{
+  composite_observation_t *o;
+  int i;
+
+  o = find_composite_observation(ep, token, token_len);
+  for(i = 0; o == NULL && i < MAX_COMPOSITE_OBSERVATIONS; i++) {
+    /* Observations can be removed by the CoAP layer (RST or timeout) */
+    if(!composite_observations[i].in_use ||
+       coap_get_observer_by_token(&composite_observations[i].endpoint,
+                                  composite_observations[i].token,
+                                  composite_observations[i].token_len)
+       == NULL) {
+      o = &composite_observations[i];
+    }
+  }
+  if(o != NULL) {
+    coap_endpoint_copy(&o->endpoint, ep);
+    memcpy(o->token, token, token_len);
+    o->token_len = token_len;
+    o->in_use = 1;
+  }
+  return o;
+}
+/*---------------------------------------------------------------------------*/
+static void
+notify_composite_observations(const lwm2m_object_instance_t *obj,
+                              uint16_t resource)
+{
+  composite_observation_t *o;
+  const composite_path_t *path;
+  coap_observer_t *obs;
+  int i, j;
+
+  for(i = 0; i < MAX_COMPOSITE_OBSERVATIONS; i++) {
+    o = &composite_observations[i];
+    if(!o->in_use) {
+      continue;
+    }
+    for(j = 0; j < o->path_count; j++) {
+      path = &o->paths[j];
+      if(path->object_id == obj->object_id &&
+         (path->level < 2 || path->object_instance_id == obj->instance_id) &&
+         (path->level < 3 || path->resource_id == resource)) {
+        break;
+      }
+    }
+    if(j == o->path_count) {
+      continue;
+    }
+    obs = coap_get_observer_by_token(&o->endpoint, o->token, o->token_len);
+    if(obs == NULL) {
+      /* The observation has been cancelled */
+      o->in_use = 0;
+    } else {
+      coap_notify_observer(obs);
+    }
+  }
+}
+#endif /* MAX_COMPOSITE_OBSERVATIONS > 0 */
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+perform_composite_op(lwm2m_context_t *ctx, coap_packet_t *request,
+                     unsigned int format)
+{
+  composite_path_t paths[MAX_COMPOSITE_PATHS];
+  const coap_endpoint_t *ep = coap_get_src_endpoint(request);
+  lwm2m_status_t success;
+  int count = -1;
+#if MAX_COMPOSITE_OBSERVATIONS > 0
+  composite_observation_t *o = NULL;
+  uint32_t observe;
+
+  if(ep != NULL) {
+    o = find_composite_observation(ep, request->token, request->token_len);
+  }
+#endif /* MAX_COMPOSITE_OBSERVATIONS > 0 */
+
+  if(ctx->content_type != LWM2M_SENML_JSON &&
+     ctx->content_type != LWM2M_SENML_CBOR) {
+    /* Only SenML can hold resources of different objects */
+    return LWM2M_STATUS_NOT_ACCEPTABLE;
+  }
+
+  if(ctx->insize > 0) {
+    count = parse_composite_paths(ctx, format, paths);
+#if MAX_COMPOSITE_OBSERVATIONS > 0
+  } else if(o != NULL) {
+    /* Notification of a composite observation */
+    count = o->path_count;
+    memcpy(paths, o->paths, count * sizeof(composite_path_t));
+#endif /* MAX_COMPOSITE_OBSERVATIONS > 0 */
+  }
+  if(count <= 0) {
+    return LWM2M_STATUS_BAD_REQUEST;
+  }
+
+  success = perform_composite_read_op(ctx, paths, count, ep);
+
+#if MAX_COMPOSITE_OBSERVATIONS > 0
+  if(success == LWM2M_STATUS_OK && ep != NULL &&
+     coap_get_header_observe(request, &observe)) {
+    if(observe == 0) {
+      o = new_composite_observation(ep, request->token, request->token_len);
+      if(o == NULL) {
+        ctx->outlen = 0;
+        return LWM2M_STATUS_SERVICE_UNAVAILABLE;
+      }
+      o->path_count = count;
+      memcpy(o->paths, paths, count * sizeof(composite_path_t));
+    } else if(observe == 1 && o != NULL) {
+      o->in_use = 0;
+    }
+  }
+#endif /* MAX_COMPOSITE_OBSERVATIONS > 0 */
+  return success;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_error_status(coap_packet_t *response, lwm2m_status_t success)
+{
+  if(success == LWM2M_STATUS_NOT_FOUND) {
+    coap_set_status_code(response, NOT_FOUND_4_04);
+  } else if(success == LWM2M_STATUS_OPERATION_NOT_ALLOWED) {
+    coap_set_status_code(response, METHOD_NOT_ALLOWED_4_05);
+  } else if(success == LWM2M_STATUS_BAD_REQUEST) {
+    coap_set_status_code(response, BAD_REQUEST_4_00);
+  } else if(success == LWM2M_STATUS_NOT_ACCEPTABLE) {
+    coap_set_status_code(response, NOT_ACCEPTABLE_4_06);
+  } else if(success == LWM2M_STATUS_SERVICE_UNAVAILABLE) {
+    coap_set_status_code(response, SERVICE_UNAVAILABLE_5_03);
+  } else if(success == LWM2M_STATUS_RESOURCE_TOO_LARGE) {
+    coap_set_status_code(response, INTERNAL_SERVER_ERROR_5_00);
+    coap_set_payload(response, "ResourceTooLarge", 16);
+  } else {
+    /* Failed to handle the request */
+    coap_set_status_code(response, INTERNAL_SERVER_ERROR_5_00);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static coap_handler_status_t
+lwm2m_handle_composite(coap_packet_t *request, coap_packet_t *response,
+                       lwm2m_context_t *context, unsigned int format,
+                       unsigned int accept, int32_t *offset)
+{
+  lwm2m_status_t success;
+
+  lwm2m_engine_select_reader(context, format);
+  lwm2m_engine_select_writer(context, accept);
+  context->operation = LWM2M_OP_READ;
+  context->offset = offset != NULL ? *offset : 0;
+  context->insize = coap_get_payload(request,
+                                     (const uint8_t **)&context->inbuf);
+  context->inpos = 0;
+  REST.set_response_status(response, CONTENT_2_05);
+
+  success = perform_composite_op(context, request, format);
+  if(success != LWM2M_STATUS_OK) {
+    PRINTF("lwm2m: composite failed: %d\n", success);
+    set_error_status(response, success);
+  } else if(context->outlen > 0) {
+    coap_set_payload(response, context->outbuf, context->outlen);
+    coap_set_header_content_format(response, context->content_type);
+    if(offset != NULL) {
+      *offset = context->offset;
+    }
+  }
+  return COAP_HANDLER_STATUS_PROCESSED;
+}
+/*---------------------------------------------------------------------------*/
 static coap_handler_status_t
 lwm2m_handler_callback(coap_packet_t *request, coap_packet_t *response,
                        uint8_t *buffer, uint16_t buffer_size, int32_t *offset)
 {
   const char *url;
+  const char *query = NULL;
+  int query_len = 0;
   int url_len;
   unsigned int format;
   unsigned int accept;
@@ -840,6 +1860,14 @@ lwm2m_handler_callback(coap_packet_t *request, coap_packet_t *response,
 
   url_len = REST.get_url(request, &url);
 
+#if USE_RD_CLIENT
+  /* Only requests from a server keep a queue mode client awake */
+  if(coap_get_src_endpoint(request) != NULL &&
+     !coap_observe_is_notification(request)) {
+    lwm2m_rd_client_request_received();
+  }
+#endif /* USE_RD_CLIENT */
+
   if(url_len == 2 && strncmp("bs", url, 2) == 0) {
     PRINTF("BOOTSTRAPPED!!!\n");
     REST.set_response_status(response, CHANGED_2_04);
@@ -867,6 +1895,12 @@ lwm2m_handler_callback(coap_packet_t *request, coap_packet_t *response,
     accept = format;
   }
 
+  if(url_len == 0 && REST.get_method_type(request) == METHOD_FETCH) {
+    /* Composite read or observe of the paths in the payload */
+    return lwm2m_handle_composite(request, response, &context, format,
+                                  accept, offset);
+  }
+
   /**
    * 1 => Object only
    * 2 => Object and Instance
@@ -912,8 +1946,13 @@ lwm2m_handler_callback(coap_packet_t *request, coap_packet_t *response,
 
   switch(REST.get_method_type(request)) {
   case METHOD_PUT:
-    /* can also be write atts */
-    context.operation = LWM2M_OP_WRITE;
+    /* can also be write atts - a query but no payload */
+    if((query_len = coap_get_header_uri_query(request, &query)) > 0 &&
+       coap_get_payload(request, (const uint8_t **)&context.inbuf) == 0) {
+      context.operation = LWM2M_OP_WRITE_ATTR;
+    } else {
+      context.operation = LWM2M_OP_WRITE;
+    }
     REST.set_response_status(response, CHANGED_2_04);
     break;
   case METHOD_POST:
@@ -929,6 +1968,7 @@ lwm2m_handler_callback(coap_packet_t *request, coap_packet_t *response,
   case METHOD_GET:
     if(accept == APPLICATION_LINK_FORMAT) {
       context.operation = LWM2M_OP_DISCOVER;
+      context.content_type = APPLICATION_LINK_FORMAT;
     } else {
       context.operation = LWM2M_OP_READ;
     }
@@ -979,15 +2019,32 @@ lwm2m_handler_callback(coap_packet_t *request, coap_packet_t *response,
     context.offset = boffset;
   }
 
-    /* This is a discovery operation */
+  /* This is a discovery operation */
   if(context.operation == LWM2M_OP_DISCOVER) {
-    /* Assume only one disco at a time... */
-    success = perform_multi_resource_read_op(instance, &context);
+    success = perform_multi_resource_read_op(instance, &context,
+                                             offset != NULL ?
+                                             coap_get_src_endpoint(request) :
+                                             NULL);
+  } else if(context.operation == LWM2M_OP_READ &&
+            context.level == 3 && instance->resource_ids == NULL) {
+    /* Objects without resource list handle their own block offsets */
+    success = instance->callback(instance, &context);
   } else if(context.operation == LWM2M_OP_READ) {
     PRINTF("Multi READ\n");
-    success = perform_multi_resource_read_op(instance, &context);
+    success = perform_multi_resource_read_op(instance, &context,
+                                             offset != NULL ?
+                                             coap_get_src_endpoint(request) :
+                                             NULL);
   } else if(context.operation == LWM2M_OP_WRITE) {
     success = perform_multi_resource_write_op(instance, &context, format);
+  } else if(context.operation == LWM2M_OP_WRITE_ATTR) {
+    if(context.level == 3 && instance->resource_ids != NULL &&
+       find_resource(instance, context.resource_id) < 0) {
+      success = LWM2M_STATUS_NOT_FOUND;
+    } else {
+      success = lwm2m_notification_attributes_write(&context, query,
+                                                    query_len);
+    }
   } else {
     /* If not discovery - this is a regular OP - do the callback */
     success = instance->callback(instance, &context);
@@ -1015,14 +2072,7 @@ lwm2m_handler_callback(coap_packet_t *request, coap_packet_t *response,
       PRINTF("] no data in reply\n");
     }
   } else {
-    if(success == LWM2M_STATUS_NOT_FOUND) {
-      coap_set_status_code(response, NOT_FOUND_4_04);
-    } else if(success == LWM2M_STATUS_OPERATION_NOT_ALLOWED) {
-      coap_set_status_code(response, METHOD_NOT_ALLOWED_4_05);
-    } else {
-      /* Failed to handle the request */
-      coap_set_status_code(response, INTERNAL_SERVER_ERROR_5_00);
-    }
+    set_error_status(response, success);
     PRINTPRE("lwm2m: [", url_len, url);
     PRINTF("] resource failed: %d\n", success);
   }
@@ -1032,11 +2082,36 @@ lwm2m_handler_callback(coap_packet_t *request, coap_packet_t *response,
 void lwm2m_notify_object_observers(lwm2m_object_instance_t *obj,
                                    uint16_t resource)
 {
-  char path[20]; /* 60000/60000/60000 */
-  if(obj != NULL) {
-    snprintf(path, 20, "%d/%d/%d", obj->object_id, obj->instance_id, resource);
-    PRINTF("Notify PATH: %s\n", path);
-    coap_notify_observers_sub(NULL, path);
+#if USE_RD_CLIENT
+  if(lwm2m_rd_client_queue_notification(obj->object_id, obj->instance_id,
+                                        resource)) {
+    /* Sleeping in queue mode - notified after the next update */
+    return;
+  }
+#endif /* USE_RD_CLIENT */
+
+  /* the notification attributes decide when to notify */
+  lwm2m_notification_attributes_notify(obj, resource);
+#if MAX_COMPOSITE_OBSERVATIONS > 0
+  notify_composite_observations(obj, resource);
+#endif /* MAX_COMPOSITE_OBSERVATIONS > 0 */
+}
+/*---------------------------------------------------------------------------*/
+void
+lwm2m_notify_resource_observers(uint16_t object_id, uint16_t instance_id,
+                                uint16_t resource_id)
+{
+  lwm2m_context_t ctx;
+  lwm2m_object_instance_t *instance;
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.object_id = object_id;
+  ctx.object_instance_id = instance_id;
+  ctx.resource_id = resource_id;
+  ctx.level = 3;
+  instance = lwm2m_engine_get_object_instance(&ctx);
+  if(instance != NULL) {
+    lwm2m_notify_object_observers(instance, resource_id);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -56,7 +56,9 @@ typedef enum {
   LWM2M_JSON       = 11543,
   LWM2M_OLD_TLV    = 1542,
   LWM2M_OLD_JSON   = 1543,
-  LWM2M_OLD_OPAQUE  = 1544
+  LWM2M_OLD_OPAQUE  = 1544,
+  LWM2M_SENML_JSON = 110,
+  LWM2M_SENML_CBOR = 112
 } lwm2m_content_format_t;
 
 typedef enum {
@@ -78,12 +80,17 @@ typedef enum {
 
   LWM2M_STATUS_NOT_IMPLEMENTED,
   LWM2M_STATUS_SERVICE_UNAVAILABLE,
+
+  /* A resource larger than the unit buffer of multi resource reads */
+  LWM2M_STATUS_RESOURCE_TOO_LARGE,
 } lwm2m_status_t;
 
 void lwm2m_engine_init(void);
 void lwm2m_engine_register_default_objects(void);
 
 int lwm2m_engine_get_rd_data(uint8_t *rd_data, int size);
+const uint8_t *lwm2m_engine_get_rd_payload(uint16_t *len);
+uint16_t lwm2m_engine_get_rd_version(void);
 
 typedef struct lwm2m_object_instance lwm2m_object_instance_t;
 
@@ -107,6 +114,7 @@ struct lwm2m_object_instance {
   /* an array of resource IDs for discovery, etc */
   const lwm2m_resource_id_t *resource_ids;
   uint16_t resource_count;
+  uint8_t flags;
   /* the callback for requests */
   lwm2m_object_instance_callback_t callback;
   lwm2m_resource_dim_callback_t resource_dim_callback;
@@ -117,6 +125,9 @@ void lwm2m_engine_add_object(lwm2m_object_instance_t *object);
 void lwm2m_engine_remove_object(lwm2m_object_instance_t *object);
 void lwm2m_notify_object_observers(lwm2m_object_instance_t *obj,
                                    uint16_t resource);
+/* Notifies the observers of a resource given by its path */
+void lwm2m_notify_resource_observers(uint16_t object_id, uint16_t instance_id,
+                                     uint16_t resource_id);
 
 #endif /* LWM2M_ENGINE_H */
 /** @} */
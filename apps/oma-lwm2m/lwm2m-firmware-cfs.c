@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \addtogroup oma-lwm2m
+ * @{
+ */
+
+/**
+ * \file
+ *         Firmware image storage in the Contiki file system
+ * \author
+ *         Joakim Eriksson <joakime@sics.se>
+ */
+
+#include "lwm2m-firmware.h"
+#include "cfs/cfs.h"
+
+#ifdef LWM2M_FIRMWARE_CFS_CONF_IMAGE_FILE
+#define IMAGE_FILE LWM2M_FIRMWARE_CFS_CONF_IMAGE_FILE
+#else
+#define IMAGE_FILE "fw-image"
+#endif /* LWM2M_FIRMWARE_CFS_CONF_IMAGE_FILE */
+
+#ifdef LWM2M_FIRMWARE_CFS_CONF_STATE_FILE
+#define STATE_FILE LWM2M_FIRMWARE_CFS_CONF_STATE_FILE
+#else
+#define STATE_FILE "fw-state"
+#endif /* LWM2M_FIRMWARE_CFS_CONF_STATE_FILE */
+
+/*---------------------------------------------------------------------------*/
+static int
+image_erase(void)
+{
+  cfs_remove(IMAGE_FILE);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int32_t
+image_size(void)
+{
+  int fd;
+  cfs_offset_t end;
+
+  fd = cfs_open(IMAGE_FILE, CFS_READ);
+  if(fd < 0) {
+    return 0;
+  }
+  end = cfs_seek(fd, 0, CFS_SEEK_END);
+  cfs_close(fd);
+  return end;
+}
+/*---------------------------------------------------------------------------*/
+static int
+image_append(const uint8_t *data, uint16_t len)
+{
+  int fd;
+  int n;
+
+  fd = cfs_open(IMAGE_FILE, CFS_WRITE | CFS_APPEND);
+  if(fd < 0) {
+    return 0;
+  }
+  n = cfs_write(fd, data, len);
+  cfs_close(fd);
+  return n == len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+image_read(uint32_t offset, uint8_t *data, uint16_t len)
+{
+  int fd;
+  int n;
+
+  fd = cfs_open(IMAGE_FILE, CFS_READ);
+  if(fd < 0) {
+    return 0;
+  }
+  if(cfs_seek(fd, offset, CFS_SEEK_SET) != offset) {
+    cfs_close(fd);
+    return 0;
+  }
+  n = cfs_read(fd, data, len);
+  cfs_close(fd);
+  return n < 0 ? 0 : n;
+}
+/*---------------------------------------------------------------------------*/
+static int
+state_save(const uint8_t *data, uint16_t len)
+{
+  int fd;
+  int n;
+
+  fd = cfs_open(STATE_FILE, CFS_WRITE);
+  if(fd < 0) {
+    return 0;
+  }
+  n = cfs_write(fd, data, len);
+  cfs_close(fd);
+  return n == len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+state_load(uint8_t *data, uint16_t len)
+{
+  int fd;
+  int n;
+
+  fd = cfs_open(STATE_FILE, CFS_READ);
+  if(fd < 0) {
+    return 0;
+  }
+  n = cfs_read(fd, data, len);
+  cfs_close(fd);
+  return n < 0 ? 0 : n;
+}
+/*---------------------------------------------------------------------------*/
+const lwm2m_firmware_storage_t lwm2m_firmware_cfs_storage = {
+  image_erase,
+  image_size,
+  image_append,
+  image_read,
+  state_save,
+  state_load,
+  NULL
+};
+/*---------------------------------------------------------------------------*/
@@ -38,7 +38,9 @@
 
 #include "lwm2m-engine.h"
 #include "er-coap.h"
+#include "er-coap-callback-api.h"
 #include "lwm2m-firmware.h"
+#include "lib/crc16.h"
 #include <string.h>
 
 #define DEBUG 1
@@ -49,6 +51,12 @@
 #define PRINTF(...)
 #endif
 
+#ifdef LWM2M_FIRMWARE_CONF_URI_SIZE
+#define URI_SIZE LWM2M_FIRMWARE_CONF_URI_SIZE
+#else
+#define URI_SIZE 64
+#endif /* LWM2M_FIRMWARE_CONF_URI_SIZE */
+
 #define UPDATE_PACKAGE     0
 #define UPDATE_PACKAGE_URI 1
 #define UPDATE_UPDATE      2
@@ -68,12 +76,301 @@
 #define RESULT_UNSUPPORTED_FW  6
 #define RESULT_INVALID_URI     7
 
+/* Bytes read back at a time when verifying the stored image */
+#define VERIFY_CHUNK_SIZE  32
+
+#define SAVED_STATE_VERSION 1
+
+/* The download state kept by the storage over reboots */
+typedef struct {
+  uint8_t version;
+  uint8_t state;
+  uint8_t uri_len;
+  char uri[URI_SIZE + 1];
+} saved_state_t;
+
+static uint8_t state = STATE_IDLE;
+static uint8_t result = RESULT_DEFAULT;
+
+static lwm2m_object_instance_t reg_object;
+
+static const lwm2m_firmware_storage_t *storage;
+static saved_state_t saved;
+
+/* Size and CRC of the image stored so far */
+static uint32_t image_size;
+static uint16_t image_crc;
+
+/* Pull mode download from the Package URI */
+static struct request_state pull_state;
+static coap_packet_t pull_request[1];
+static coap_endpoint_t pull_endpoint;
+/*---------------------------------------------------------------------------*/
+static void
+save_state(void)
+{
+  saved.version = SAVED_STATE_VERSION;
+  saved.state = state;
+  if(!storage->save_state((const uint8_t *)&saved, sizeof(saved))) {
+    PRINTF("FW: failed to save the download state\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+download_failed(uint8_t reason)
+{
+  PRINTF("FW: download failed at %lu: %u\n", (unsigned long)image_size,
+         reason);
+  state = STATE_IDLE;
+  result = reason;
+  saved.uri_len = 0;
+  save_state();
+}
+/*---------------------------------------------------------------------------*/
+static int
+start_download(void)
+{
+  if(!storage->erase()) {
+    download_failed(RESULT_NO_STORAGE);
+    return 0;
+  }
+  image_size = 0;
+  image_crc = 0;
+  state = STATE_DOWNLOADING;
+  result = RESULT_DEFAULT;
+  save_state();
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Checks that data was stored at offset by reading it back */
+static int
+verify(uint32_t offset, const uint8_t *data, uint16_t len)
+{
+  uint8_t buf[VERIFY_CHUNK_SIZE];
+  uint16_t crc_data;
+  uint16_t crc_stored;
+  uint16_t pos;
+  int n;
+
+  crc_data = crc16_data(data, len, 0);
+  crc_stored = 0;
+  for(pos = 0; pos < len; pos += n) {
+    n = storage->read(offset + pos, buf, MIN(len - pos, sizeof(buf)));
+    if(n <= 0) {
+      return 0;
+    }
+    crc_stored = crc16_data(buf, n, crc_stored);
+  }
+  return crc_data == crc_stored;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Stores a block received at offset. Data that is already stored, as
+ * when a block is sent again after resuming, is skipped.
+ */
+static int
+store_block(uint32_t offset, const uint8_t *data, uint16_t len)
+{
+  uint32_t skip;
+
+  if(offset > image_size) {
+    download_failed(RESULT_CONNECTION_LOST);
+    return 0;
+  }
+  if(offset + len <= image_size) {
+    return 1;
+  }
+  skip = image_size - offset;
+  data += skip;
+  len -= skip;
+
+  if(!storage->append(data, len)) {
+    download_failed(RESULT_NO_STORAGE);
+    return 0;
+  }
+  if(!verify(image_size, data, len)) {
+    download_failed(RESULT_CRC_FAILED);
+    return 0;
+  }
+  image_crc = crc16_data(data, len, image_crc);
+  image_size += len;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+download_done(void)
+{
+  PRINTF("FW: downloaded %lu bytes, CRC 0x%04x\n",
+         (unsigned long)image_size, image_crc);
+  state = STATE_DOWNLOADED;
+  save_state();
+}
+/*---------------------------------------------------------------------------*/
+/* Computes size and CRC of the image stored before a reboot */
+static void
+load_image(void)
+{
+  uint8_t buf[VERIFY_CHUNK_SIZE];
+  int32_t size;
+  int n;
+
+  image_size = 0;
+  image_crc = 0;
+  size = storage->size();
+  while(size > 0 && image_size < size) {
+    n = storage->read(image_size, buf, MIN(size - image_size, sizeof(buf)));
+    if(n <= 0) {
+      break;
+    }
+    image_crc = crc16_data(buf, n, image_crc);
+    image_size += n;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+pull_callback(struct request_state *rs)
+{
+  uint32_t offset = 0;
+  uint8_t more = 0;
+
+  if(state != STATE_DOWNLOADING) {
+    return;
+  }
+  if(rs->response == NULL) {
+    /* Keep the saved state to resume after reboot or a new URI write */
+    PRINTF("FW: connection lost at %lu\n", (unsigned long)image_size);
+    state = STATE_IDLE;
+    result = RESULT_CONNECTION_LOST;
+    return;
+  }
+  if(rs->response->code != CONTENT_2_05) {
+    download_failed(rs->response->code == NOT_FOUND_4_04 ?
+                    RESULT_INVALID_URI : RESULT_CONNECTION_LOST);
+    coap_stop_request(rs);
+    return;
+  }
+
+  coap_get_header_block2(rs->response, NULL, &more, NULL, &offset);
+  if(!store_block(offset, rs->response->payload,
+                  rs->response->payload_len)) {
+    coap_stop_request(rs);
+    return;
+  }
+  if(!more) {
+    download_done();
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the path part of a coap://host:port/path URI */
+static const char *
+uri_path(const char *uri)
+{
+  const char *p;
 
-uint8_t state = STATE_IDLE;
-uint8_t result = RESULT_DEFAULT;
+  p = strstr(uri, "://");
+  p = p == NULL ? uri : p + 3;
+  if(*p == '[') {
+    p = strchr(p, ']');
+    if(p == NULL) {
+      return NULL;
+    }
+  }
+  return strchr(p, '/');
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_pull(void)
+{
+  const char *path;
 
-lwm2m_object_instance_t reg_object;
+  path = uri_path(saved.uri);
+  if(path == NULL ||
+     !coap_endpoint_parse(saved.uri, saved.uri_len, &pull_endpoint)) {
+    download_failed(RESULT_INVALID_URI);
+    return;
+  }
 
+  PRINTF("FW: pulling %s from %lu\n", saved.uri, (unsigned long)image_size);
+  coap_init_message(pull_request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(pull_request, path);
+  if(image_size > 0) {
+    /* resume with the block holding the first missing byte */
+    coap_set_header_block2(pull_request, image_size / COAP_MAX_BLOCK_SIZE, 0,
+                           COAP_MAX_BLOCK_SIZE);
+  }
+  coap_send_request(&pull_state, &pull_endpoint, pull_request,
+                    pull_callback);
+}
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+write_package(lwm2m_context_t *ctx)
+{
+  PRINTF("Firmware received: %d %d fin:%d\n", ctx->offset, (int) ctx->insize,
+         lwm2m_object_is_final_incoming(ctx));
+
+  if(ctx->offset == 0) {
+    if(ctx->insize == 0) {
+      /* an empty package cancels the update */
+      state = STATE_IDLE;
+      result = RESULT_DEFAULT;
+      saved.uri_len = 0;
+      save_state();
+      return LWM2M_STATUS_OK;
+    }
+    saved.uri_len = 0;
+    if(!start_download()) {
+      return LWM2M_STATUS_ERROR;
+    }
+  } else if(state != STATE_DOWNLOADING) {
+    return LWM2M_STATUS_ERROR;
+  }
+
+  if(!store_block(ctx->offset, ctx->inbuf, ctx->insize)) {
+    return LWM2M_STATUS_ERROR;
+  }
+  if(lwm2m_object_is_final_incoming(ctx)) {
+    download_done();
+  }
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+write_package_uri(lwm2m_context_t *ctx)
+{
+  PRINTF("Firmware URI received: %d %d fin:%d\n", ctx->offset, (int) ctx->insize,
+         lwm2m_object_is_final_incoming(ctx));
+
+  if(ctx->insize > URI_SIZE) {
+    result = RESULT_INVALID_URI;
+    return LWM2M_STATUS_ERROR;
+  }
+  if(ctx->insize == 0) {
+    /* an empty URI cancels the update */
+    state = STATE_IDLE;
+    result = RESULT_DEFAULT;
+    saved.uri_len = 0;
+    save_state();
+    return LWM2M_STATUS_OK;
+  }
+
+  /* resume if the same image was partially downloaded before */
+  if(ctx->insize != saved.uri_len ||
+     memcmp(ctx->inbuf, saved.uri, saved.uri_len) != 0 ||
+     image_size == 0) {
+    memcpy(saved.uri, ctx->inbuf, ctx->insize);
+    saved.uri[ctx->insize] = '\0';
+    saved.uri_len = ctx->insize;
+    if(!start_download()) {
+      return LWM2M_STATUS_ERROR;
+    }
+  } else {
+    state = STATE_DOWNLOADING;
+    result = RESULT_DEFAULT;
+    save_state();
+  }
+  start_pull();
+  return LWM2M_STATUS_OK;
+}
 /*---------------------------------------------------------------------------*/
 static lwm2m_status_t
 lwm2m_callback(lwm2m_object_instance_t *object,
@@ -95,6 +392,9 @@ lwm2m_callback(lwm2m_object_instance_t *object,
 
   if(ctx->operation == LWM2M_OP_READ) {
     switch(ctx->resource_id) {
+    case UPDATE_PACKAGE_URI:
+      lwm2m_object_write_string(ctx, saved.uri, saved.uri_len);
+      return LWM2M_STATUS_OK;
     case UPDATE_STATE:
       lwm2m_object_write_int(ctx, state); /* 1 means idle */
       return LWM2M_STATUS_OK;
@@ -109,34 +409,30 @@ lwm2m_callback(lwm2m_object_instance_t *object,
       PRINTF("LWM2M CTX->offset= %d\n", ctx->offset);
     }
 #endif
+    if(storage == NULL) {
+      result = RESULT_NO_STORAGE;
+      return LWM2M_STATUS_ERROR;
+    }
     switch(ctx->resource_id) {
     case UPDATE_PACKAGE:
       /* The firmware is written */
-      PRINTF("Firmware received: %d %d fin:%d\n", ctx->offset, (int) ctx->insize,
-             lwm2m_object_is_final_incoming(ctx));
-      if(lwm2m_object_is_final_incoming(ctx)) {
-        state = STATE_DOWNLOADED;
-      } else {
-        state = STATE_DOWNLOADING;
-      }
-      return LWM2M_STATUS_OK;
+      return write_package(ctx);
     case UPDATE_PACKAGE_URI:
       /* The firmware URI is written */
-      PRINTF("Firmware URI received: %d %d fin:%d\n", ctx->offset, (int) ctx->insize,
-             lwm2m_object_is_final_incoming(ctx));
-      if(DEBUG) {
-        int i;
-        PRINTF("Data: '");
-        for(i = 0; i < ctx->insize; i++) {
-          PRINTF("%c", ctx->inbuf[i]);
-        }
-        PRINTF("'\n");
-      }
-      return LWM2M_STATUS_OK;
+      return write_package_uri(ctx);
     }
   } else if(ctx->operation == LWM2M_OP_EXECUTE && ctx->resource_id == UPDATE_UPDATE) {
     /* Perform the update operation */
     if(state == STATE_DOWNLOADED) {
+      if(storage->install != NULL &&
+         !storage->install(image_size, image_crc)) {
+        result = RESULT_UNSUPPORTED_FW;
+        return LWM2M_STATUS_ERROR;
+      }
+      state = STATE_IDLE;
+      result = RESULT_SUCCESS;
+      saved.uri_len = 0;
+      save_state();
       return LWM2M_STATUS_OK;
     }
     /* Failure... */
@@ -144,6 +440,12 @@ lwm2m_callback(lwm2m_object_instance_t *object,
   return LWM2M_STATUS_ERROR;
 }
 
+/*---------------------------------------------------------------------------*/
+void
+lwm2m_firmware_set_storage(const lwm2m_firmware_storage_t *s)
+{
+  storage = s;
+}
 /*---------------------------------------------------------------------------*/
 void
 lwm2m_firmware_init(void)
@@ -152,4 +454,19 @@ lwm2m_firmware_init(void)
   reg_object.instance_id = 0;
   reg_object.callback = lwm2m_callback;
   lwm2m_engine_add_object(&reg_object);
+
+  if(storage != NULL &&
+     storage->load_state((uint8_t *)&saved, sizeof(saved)) == sizeof(saved) &&
+     saved.version == SAVED_STATE_VERSION && saved.uri_len <= URI_SIZE) {
+    saved.uri[saved.uri_len] = '\0';
+    load_image();
+    state = saved.state;
+    PRINTF("FW: found image of %lu bytes, state %u\n",
+           (unsigned long)image_size, state);
+    if(state == STATE_DOWNLOADING && saved.uri_len > 0) {
+      start_pull();
+    }
+  } else {
+    memset(&saved, 0, sizeof(saved));
+  }
 }
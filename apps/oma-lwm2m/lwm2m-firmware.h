@@ -36,4 +36,38 @@
  *
  */
 
+#ifndef LWM2M_FIRMWARE_H_
+#define LWM2M_FIRMWARE_H_
+
+#include <stdint.h>
+
+/*
+ * Storage for the firmware image. The image is written block by block as
+ * it is received and the stored size is where an interrupted download
+ * is resumed.
+ */
+typedef struct lwm2m_firmware_storage {
+  /* Removes any stored image, returns 0 on failure */
+  int (* erase)(void);
+  /* Returns the number of bytes stored or -1 on failure */
+  int32_t (* size)(void);
+  /* Appends data to the image, returns 0 on failure */
+  int (* append)(const uint8_t *data, uint16_t len);
+  /* Reads back part of the image, returns the number of bytes read */
+  int (* read)(uint32_t offset, uint8_t *data, uint16_t len);
+  /* Stores and loads the download state that survives a reboot */
+  int (* save_state)(const uint8_t *data, uint16_t len);
+  int (* load_state)(uint8_t *data, uint16_t len);
+  /* Installs the downloaded image, NULL if done by the bootloader */
+  int (* install)(uint32_t size, uint16_t crc);
+} lwm2m_firmware_storage_t;
+
+/* Storage in the Contiki file system */
+extern const lwm2m_firmware_storage_t lwm2m_firmware_cfs_storage;
+
+/* Must be called before lwm2m_firmware_init() to resume downloads */
+void lwm2m_firmware_set_storage(const lwm2m_firmware_storage_t *storage);
+
 void lwm2m_firmware_init(void);
+
+#endif /* LWM2M_FIRMWARE_H_ */
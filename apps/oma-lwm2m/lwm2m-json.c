@@ -49,7 +49,7 @@
 #include <stdint.h>
 #include <inttypes.h>
 
-#define DEBUG 1
+#define DEBUG 0
 #if DEBUG
 #define PRINTF(...) printf(__VA_ARGS__)
 #else
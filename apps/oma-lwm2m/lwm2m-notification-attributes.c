@@ -0,0 +1,757 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \addtogroup oma-lwm2m
+ * @{
+ */
+
+/**
+ * \file
+ *         Implementation of the OMA LWM2M notification attributes.
+ *
+ *         Write-Attributes sets pmin, pmax, gt, lt and st of the server
+ *         that writes them on an object, object instance or resource.
+ *         Each observation keeps its own notification state: value
+ *         changes are filtered on gt/lt/st, rate limited by pmin (bursts
+ *         are coalesced into one notification) and the observation is
+ *         kept alive by pmax, all driven by ntimers. The state is freed
+ *         when the observation is cancelled.
+ */
+
+#include "lwm2m-notification-attributes.h"
+#include "lwm2m-plain-text.h"
+#include "er-coap-observe.h"
+#include "sys/ntimer.h"
+#include <stdio.h>
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+/* Number of server and path pairs with attributes */
+#ifdef LWM2M_NOTIFICATION_ATTRIBUTES_CONF_MAX_ENTRIES
+#define MAX_ENTRIES LWM2M_NOTIFICATION_ATTRIBUTES_CONF_MAX_ENTRIES
+#else
+#define MAX_ENTRIES 8
+#endif /* LWM2M_NOTIFICATION_ATTRIBUTES_CONF_MAX_ENTRIES */
+
+/* Number of observations with notification state */
+#ifdef LWM2M_NOTIFICATION_ATTRIBUTES_CONF_MAX_OBSERVATIONS
+#define MAX_OBSERVATIONS LWM2M_NOTIFICATION_ATTRIBUTES_CONF_MAX_OBSERVATIONS
+#else
+#define MAX_OBSERVATIONS COAP_MAX_OBSERVERS
+#endif /* LWM2M_NOTIFICATION_ATTRIBUTES_CONF_MAX_OBSERVATIONS */
+
+/* Default minimum period in seconds, 0 for none */
+#ifdef LWM2M_NOTIFICATION_ATTRIBUTES_CONF_DEFAULT_PMIN
+#define DEFAULT_PMIN LWM2M_NOTIFICATION_ATTRIBUTES_CONF_DEFAULT_PMIN
+#else
+#define DEFAULT_PMIN 0
+#endif /* LWM2M_NOTIFICATION_ATTRIBUTES_CONF_DEFAULT_PMIN */
+
+/* Default maximum period in seconds, 0 for none */
+#ifdef LWM2M_NOTIFICATION_ATTRIBUTES_CONF_DEFAULT_PMAX
+#define DEFAULT_PMAX LWM2M_NOTIFICATION_ATTRIBUTES_CONF_DEFAULT_PMAX
+#else
+#define DEFAULT_PMAX 0
+#endif /* LWM2M_NOTIFICATION_ATTRIBUTES_CONF_DEFAULT_PMAX */
+
+#define ATTR_PMIN  0x01
+#define ATTR_PMAX  0x02
+#define ATTR_GT    0x04
+#define ATTR_LT    0x08
+#define ATTR_ST    0x10
+#define ATTR_VALUE (ATTR_GT | ATTR_LT | ATTR_ST)
+
+#define STATE_PENDING    0x01  /* notification delayed by pmin */
+#define STATE_VALUE      0x02  /* the value is known */
+#define STATE_LAST_VALUE 0x04  /* the last notified value is known */
+
+typedef struct {
+  uint32_t pmin;
+  uint32_t pmax;
+  int32_t gt;
+  int32_t lt;
+  int32_t st;
+  uint8_t attributes;
+} attributes_t;
+
+typedef struct {
+  coap_endpoint_t endpoint; /* the server that wrote the attributes */
+  attributes_t attr;
+  uint16_t object_id;
+  uint16_t instance_id;
+  uint16_t resource_id;
+  uint8_t level; /* 0 if the entry is not used */
+} attribute_entry_t;
+
+typedef struct {
+  ntimer_t timer;
+  uint64_t last_notification;
+  coap_observer_t *observer; /* NULL if the observation is not used */
+  int32_t value;
+  int32_t last_value;
+  uint16_t object_id;
+  uint16_t instance_id;
+  uint16_t resource_id;
+  uint8_t level;
+  uint8_t state;
+} observation_t;
+
+static attribute_entry_t entries[MAX_ENTRIES];
+static observation_t observations[MAX_OBSERVATIONS];
+/* The observers of a path being notified */
+static coap_observer_t *path_observers[COAP_MAX_OBSERVERS];
+/*---------------------------------------------------------------------------*/
+static attribute_entry_t *
+find_entry(const coap_endpoint_t *ep, uint16_t object_id,
+           uint16_t instance_id, uint16_t resource_id, uint8_t level)
+{
+  int i;
+  for(i = 0; i < MAX_ENTRIES; i++) {
+    if(entries[i].level == level &&
+       entries[i].object_id == object_id &&
+       (level < 2 || entries[i].instance_id == instance_id) &&
+       (level < 3 || entries[i].resource_id == resource_id) &&
+       coap_endpoint_cmp(&entries[i].endpoint, ep)) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static attribute_entry_t *
+new_entry(const coap_endpoint_t *ep, uint16_t object_id,
+          uint16_t instance_id, uint16_t resource_id, uint8_t level)
+{
+  attribute_entry_t *e;
+  int i;
+
+  for(i = 0; i < MAX_ENTRIES; i++) {
+    if(entries[i].level == 0) {
+      e = &entries[i];
+      memset(e, 0, sizeof(attribute_entry_t));
+      coap_endpoint_copy(&e->endpoint, ep);
+      e->object_id = object_id;
+      e->instance_id = instance_id;
+      e->resource_id = resource_id;
+      e->level = level;
+      return e;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Checks if any server has attributes on the resource or its parents */
+static int
+has_attributes(uint16_t object_id, uint16_t instance_id,
+               uint16_t resource_id)
+{
+  int i;
+
+  if(DEFAULT_PMIN > 0 || DEFAULT_PMAX > 0) {
+    return 1;
+  }
+  for(i = 0; i < MAX_ENTRIES; i++) {
+    if(entries[i].level != 0 &&
+       entries[i].object_id == object_id &&
+       (entries[i].level < 2 || entries[i].instance_id == instance_id) &&
+       (entries[i].level < 3 || entries[i].resource_id == resource_id)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Merges the attributes of the server inherited from the object and
+   instance levels */
+static void
+get_attributes(const coap_endpoint_t *ep, uint16_t object_id,
+               uint16_t instance_id, uint16_t resource_id, uint8_t level,
+               attributes_t *a)
+{
+  attribute_entry_t *e;
+  uint8_t l;
+
+  memset(a, 0, sizeof(attributes_t));
+  if(DEFAULT_PMIN > 0) {
+    a->pmin = DEFAULT_PMIN;
+    a->attributes |= ATTR_PMIN;
+  }
+  if(DEFAULT_PMAX > 0) {
+    a->pmax = DEFAULT_PMAX;
+    a->attributes |= ATTR_PMAX;
+  }
+
+  for(l = 1; l <= level; l++) {
+    e = find_entry(ep, object_id, instance_id, resource_id, l);
+    if(e == NULL) {
+      continue;
+    }
+    if(e->attr.attributes & ATTR_PMIN) {
+      a->pmin = e->attr.pmin;
+    }
+    if(e->attr.attributes & ATTR_PMAX) {
+      a->pmax = e->attr.pmax;
+    }
+    if(e->attr.attributes & ATTR_GT) {
+      a->gt = e->attr.gt;
+    }
+    if(e->attr.attributes & ATTR_LT) {
+      a->lt = e->attr.lt;
+    }
+    if(e->attr.attributes & ATTR_ST) {
+      a->st = e->attr.st;
+    }
+    a->attributes |= e->attr.attributes;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+get_observation_attributes(const observation_t *o, attributes_t *a)
+{
+  get_attributes(&o->observer->endpoint, o->object_id, o->instance_id,
+                 o->resource_id, o->level, a);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Parses the object, instance and resource IDs of an observed path.
+ * Returns the level of the path, or 0 if it is not an object, object
+ * instance or resource path.
+ */
+static uint8_t
+parse_path(const char *path, uint16_t *ids)
+{
+  uint32_t id;
+  uint8_t level = 0;
+
+  while(*path != '\0') {
+    if(*path == '/') {
+      path++;
+      continue;
+    }
+    if(level == 3) {
+      /* A resource instance, observed as part of the resource */
+      break;
+    }
+    for(id = 0; *path >= '0' && *path <= '9' && id <= 0xffff; path++) {
+      id = id * 10 + (*path - '0');
+    }
+    if(id > 0xffff || (*path != '/' && *path != '\0')) {
+      return 0;
+    }
+    ids[level++] = id;
+  }
+  return level;
+}
+/*---------------------------------------------------------------------------*/
+static observation_t *
+find_observation(const coap_observer_t *obs)
+{
+  int i;
+  for(i = 0; i < MAX_OBSERVATIONS; i++) {
+    if(observations[i].observer == obs) {
+      return &observations[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+free_observation(observation_t *o)
+{
+  ntimer_stop(&o->timer);
+  o->observer = NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void timer_callback(ntimer_t *timer);
+
+static observation_t *
+new_observation(coap_observer_t *obs)
+{
+  observation_t *o;
+  uint16_t ids[3];
+  uint8_t level;
+  int i;
+
+  if(obs->method != COAP_GET || (level = parse_path(obs->url, ids)) == 0) {
+    /* Not an observation of an object, instance or resource */
+    return NULL;
+  }
+  for(i = 0; i < MAX_OBSERVATIONS; i++) {
+    if(observations[i].observer == NULL) {
+      o = &observations[i];
+      memset(o, 0, sizeof(observation_t));
+      o->observer = obs;
+      o->object_id = ids[0];
+      o->instance_id = level > 1 ? ids[1] : 0;
+      o->resource_id = level > 2 ? ids[2] : 0;
+      o->level = level;
+      /* The response to the observe request is the first notification */
+      o->last_notification = ntimer_uptime();
+      ntimer_set_callback(&o->timer, timer_callback);
+      ntimer_set_user_data(&o->timer, o);
+      return o;
+    }
+  }
+  PRINTF("No notification state for /%s\n", obs->url);
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Creates the state of an observation with attributes and starts pmax */
+static void
+start_observation(coap_observer_t *obs)
+{
+  observation_t *o;
+  attributes_t a;
+
+  o = find_observation(obs);
+  if(o == NULL && (o = new_observation(obs)) == NULL) {
+    return;
+  }
+  get_observation_attributes(o, &a);
+  if(a.attributes == 0) {
+    free_observation(o);
+  } else if((a.attributes & ATTR_PMAX) && a.pmax > 0 &&
+            !(o->state & STATE_PENDING)) {
+    ntimer_set(&o->timer, (uint64_t)a.pmax * 1000);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+observer_callback(coap_observer_t *obs, int added)
+{
+  observation_t *o;
+
+  if(added) {
+    start_observation(obs);
+  } else if((o = find_observation(obs)) != NULL) {
+    PRINTF("Observation of /%s cancelled\n", obs->url);
+    free_observation(o);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_notification(observation_t *o, const attributes_t *a)
+{
+  PRINTF("Notify /%s\n", o->observer->url);
+  coap_notify_observer(o->observer);
+
+  o->last_notification = ntimer_uptime();
+  o->state &= ~STATE_PENDING;
+  if(o->state & STATE_VALUE) {
+    o->last_value = o->value;
+    o->state |= STATE_LAST_VALUE;
+  }
+
+  if((a->attributes & ATTR_PMAX) && a->pmax > 0) {
+    ntimer_set(&o->timer, (uint64_t)a->pmax * 1000);
+  } else {
+    ntimer_stop(&o->timer);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+timer_callback(ntimer_t *timer)
+{
+  observation_t *o;
+  attributes_t a;
+
+  o = ntimer_get_user_data(timer);
+  if(o == NULL || o->observer == NULL) {
+    return;
+  }
+
+  get_observation_attributes(o, &a);
+  if((o->state & STATE_PENDING) || (a.attributes & ATTR_PMAX)) {
+    /* pmin has passed for a pending change or pmax has expired */
+    send_notification(o, &a);
+  } else if(a.attributes == 0) {
+    /* The attributes have been removed */
+    free_observation(o);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Reads the current value of a numeric resource */
+static int
+read_value(lwm2m_object_instance_t *obj, uint16_t resource_id,
+           int32_t *value)
+{
+  lwm2m_context_t ctx;
+  uint8_t buf[16];
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.object_id = obj->object_id;
+  ctx.object_instance_id = obj->instance_id;
+  ctx.resource_id = resource_id;
+  ctx.level = 3;
+  ctx.operation = LWM2M_OP_READ;
+  ctx.content_type = LWM2M_TEXT_PLAIN;
+  ctx.writer = &lwm2m_plain_text_writer;
+  ctx.outbuf = buf;
+  ctx.outsize = sizeof(buf);
+
+  if(obj->callback == NULL ||
+     obj->callback(obj, &ctx) != LWM2M_STATUS_OK || ctx.outlen == 0) {
+    return 0;
+  }
+  return lwm2m_plain_text_read_float32fix(buf, ctx.outlen, value,
+                                          LWM2M_FLOAT32_BITS) > 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Checks the change of value against gt, lt and st */
+static int
+value_changed(const attributes_t *a, int32_t last, int32_t value)
+{
+  /* The difference of two fixed-point values may not fit in 32 bits */
+  if((a->attributes & ATTR_ST) &&
+     ((int64_t)value - last >= a->st || (int64_t)last - value >= a->st)) {
+    return 1;
+  }
+  if((a->attributes & ATTR_GT) && ((last > a->gt) != (value > a->gt))) {
+    return 1;
+  }
+  if((a->attributes & ATTR_LT) && ((last < a->lt) != (value < a->lt))) {
+    return 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+lwm2m_notification_attributes_notify(lwm2m_object_instance_t *obj,
+                                     uint16_t resource_id)
+{
+  char path[20]; /* 60000/60000/60000 */
+  coap_observer_t *obs;
+  observation_t *o;
+  attributes_t a;
+  uint64_t now;
+  uint64_t next;
+  int32_t value;
+  int8_t has_value = -1;
+  int count, i;
+
+  if(obj == NULL) {
+    return;
+  }
+
+  snprintf(path, sizeof(path), "%u/%u/%u", obj->object_id, obj->instance_id,
+           resource_id);
+  if(!has_attributes(obj->object_id, obj->instance_id, resource_id)) {
+    /* No attributes - notify all observers directly */
+    PRINTF("Notify PATH: %s\n", path);
+    coap_notify_observers_sub(NULL, path);
+    return;
+  }
+
+  count = coap_get_observers_sub(path, path_observers, COAP_MAX_OBSERVERS);
+  for(i = 0; i < count; i++) {
+    obs = path_observers[i];
+    get_attributes(&obs->endpoint, obj->object_id, obj->instance_id,
+                   resource_id, 3, &a);
+    o = NULL;
+    if(a.attributes != 0 && (o = find_observation(obs)) == NULL) {
+      o = new_observation(obs);
+    }
+    if(o == NULL) {
+      /* No attributes for this server, or no room for the state */
+      coap_notify_observer(obs);
+      continue;
+    }
+
+    if(a.attributes & ATTR_VALUE) {
+      if(has_value < 0) {
+        has_value = read_value(obj, resource_id, &value);
+      }
+      if(has_value) {
+        o->value = value;
+        o->state |= STATE_VALUE;
+        if((o->state & STATE_LAST_VALUE) && !(o->state & STATE_PENDING) &&
+           !value_changed(&a, o->last_value, value)) {
+          PRINTF("Change of %s within thresholds of /%s\n", path, obs->url);
+          continue;
+        }
+      }
+    }
+
+    if(a.attributes & ATTR_PMIN) {
+      now = ntimer_uptime();
+      next = o->last_notification + (uint64_t)a.pmin * 1000;
+      if(now < next) {
+        /* Coalesce with other changes until pmin has passed */
+        if(!(o->state & STATE_PENDING)) {
+          o->state |= STATE_PENDING;
+          ntimer_set(&o->timer, next - now);
+        }
+        continue;
+      }
+    }
+    send_notification(o, &a);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Restarts pmax of the observations of the server below the path */
+static void
+start_observations(const coap_endpoint_t *ep, const lwm2m_context_t *ctx)
+{
+  char path[20]; /* 60000/60000/60000 */
+  int count, i;
+
+  if(ctx->level == 1) {
+    snprintf(path, sizeof(path), "%u", ctx->object_id);
+  } else if(ctx->level == 2) {
+    snprintf(path, sizeof(path), "%u/%u", ctx->object_id,
+             ctx->object_instance_id);
+  } else {
+    snprintf(path, sizeof(path), "%u/%u/%u", ctx->object_id,
+             ctx->object_instance_id, ctx->resource_id);
+  }
+  count = coap_get_observers_sub(path, path_observers, COAP_MAX_OBSERVERS);
+  for(i = 0; i < count; i++) {
+    if(coap_endpoint_cmp(&path_observers[i]->endpoint, ep)) {
+      start_observation(path_observers[i]);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+parse_uint(const char *value, int len, uint32_t *result)
+{
+  int i;
+  *result = 0;
+  if(len == 0) {
+    return 0;
+  }
+  for(i = 0; i < len; i++) {
+    if(value[i] < '0' || value[i] > '9') {
+      return 0;
+    }
+    *result = *result * 10 + (value[i] - '0');
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+lwm2m_status_t
+lwm2m_notification_attributes_write(const lwm2m_context_t *ctx,
+                                    const char *query, int query_len)
+{
+  const coap_endpoint_t *ep;
+  attribute_entry_t *e;
+  attributes_t a;
+  int32_t *fix;
+  uint8_t set = 0, clear = 0, attr;
+  const char *name, *value;
+  int name_len, value_len, end;
+
+  if(ctx->request == NULL ||
+     (ep = coap_get_src_endpoint(ctx->request)) == NULL) {
+    /* The attributes belong to the server that writes them */
+    return LWM2M_STATUS_BAD_REQUEST;
+  }
+
+  memset(&a, 0, sizeof(a));
+  while(query_len > 0) {
+    for(end = 0; end < query_len && query[end] != '&'; end++);
+    name = query;
+    for(name_len = 0; name_len < end && name[name_len] != '='; name_len++);
+    value = name + name_len + 1;
+    value_len = name_len < end ? end - name_len - 1 : -1;
+
+    if(name_len == 4 && strncmp(name, "pmin", 4) == 0) {
+      attr = ATTR_PMIN;
+    } else if(name_len == 4 && strncmp(name, "pmax", 4) == 0) {
+      attr = ATTR_PMAX;
+    } else if(name_len == 2 && strncmp(name, "gt", 2) == 0) {
+      attr = ATTR_GT;
+    } else if(name_len == 2 && strncmp(name, "lt", 2) == 0) {
+      attr = ATTR_LT;
+    } else if(name_len == 2 && strncmp(name, "st", 2) == 0) {
+      attr = ATTR_ST;
+    } else {
+      PRINTF("Unknown attribute: %.*s\n", name_len, name);
+      return LWM2M_STATUS_BAD_REQUEST;
+    }
+
+    if((attr & ATTR_VALUE) && ctx->level < 3) {
+      /* gt, lt and st can only be set on resources */
+      return LWM2M_STATUS_BAD_REQUEST;
+    }
+
+    if(value_len < 0) {
+      /* Attribute without value - remove it */
+      clear |= attr;
+      set &= ~attr;
+    } else {
+      if(attr == ATTR_PMIN || attr == ATTR_PMAX) {
+        if(!parse_uint(value, value_len,
+                       attr == ATTR_PMIN ? &a.pmin : &a.pmax)) {
+          return LWM2M_STATUS_BAD_REQUEST;
+        }
+      } else {
+        fix = attr == ATTR_GT ? &a.gt : (attr == ATTR_LT ? &a.lt : &a.st);
+        if(value_len == 0 ||
+           lwm2m_plain_text_read_float32fix((const uint8_t *)value, value_len,
+                                            fix, LWM2M_FLOAT32_BITS)
+           != value_len) {
+          return LWM2M_STATUS_BAD_REQUEST;
+        }
+      }
+      set |= attr;
+      clear &= ~attr;
+    }
+
+    query += end;
+    query_len -= end;
+    if(query_len > 0) {
+      /* skip the '&' */
+      query++;
+      query_len--;
+    }
+  }
+
+  if((set & ATTR_ST) && a.st < 0) {
+    return LWM2M_STATUS_BAD_REQUEST;
+  }
+
+  e = find_entry(ep, ctx->object_id, ctx->object_instance_id,
+                 ctx->resource_id, ctx->level);
+  if(e == NULL) {
+    if(set == 0) {
+      /* Nothing to set or remove */
+      return LWM2M_STATUS_OK;
+    }
+    e = new_entry(ep, ctx->object_id, ctx->object_instance_id,
+                  ctx->resource_id, ctx->level);
+    if(e == NULL) {
+      PRINTF("No space for attributes\n");
+      return LWM2M_STATUS_SERVICE_UNAVAILABLE;
+    }
+  }
+
+  if(set & ATTR_PMIN) {
+    e->attr.pmin = a.pmin;
+  }
+  if(set & ATTR_PMAX) {
+    e->attr.pmax = a.pmax;
+  }
+  if(set & ATTR_GT) {
+    e->attr.gt = a.gt;
+  }
+  if(set & ATTR_LT) {
+    e->attr.lt = a.lt;
+  }
+  if(set & ATTR_ST) {
+    e->attr.st = a.st;
+  }
+  e->attr.attributes = (e->attr.attributes & ~clear) | set;
+
+  PRINTF("Attributes %u/%u/%u lv:%u: 0x%02x\n", e->object_id, e->instance_id,
+         e->resource_id, e->level, e->attr.attributes);
+
+  if(e->attr.attributes == 0) {
+    e->level = 0;
+  }
+  if(set & ATTR_PMAX) {
+    /* Start the keep-alive period of the observations */
+    start_observations(ep, ctx);
+  }
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+static int
+print_fix(char *buf, int size, const char *name, int32_t value)
+{
+  int len;
+  len = snprintf(buf, size, ";%s=", name);
+  if(len < 0 || len >= size) {
+    return size;
+  }
+  return len + lwm2m_plain_text_write_float32fix((uint8_t *)buf + len,
+                                                 size - len, value,
+                                                 LWM2M_FLOAT32_BITS);
+}
+/*---------------------------------------------------------------------------*/
+int
+lwm2m_notification_attributes_print(const coap_endpoint_t *ep,
+                                    uint16_t object_id, uint16_t instance_id,
+                                    uint16_t resource_id, char *buf, int size)
+{
+  attribute_entry_t *e;
+  int len = 0;
+
+  if(ep == NULL) {
+    return 0;
+  }
+  e = find_entry(ep, object_id, instance_id, resource_id, 3);
+  if(e == NULL || e->attr.attributes == 0) {
+    return 0;
+  }
+
+  if(len < size && (e->attr.attributes & ATTR_PMIN)) {
+    len += snprintf(buf + len, size - len, ";pmin=%lu",
+                    (unsigned long)e->attr.pmin);
+  }
+  if(len < size && (e->attr.attributes & ATTR_PMAX)) {
+    len += snprintf(buf + len, size - len, ";pmax=%lu",
+                    (unsigned long)e->attr.pmax);
+  }
+  if(len < size && (e->attr.attributes & ATTR_GT)) {
+    len += print_fix(buf + len, size - len, "gt", e->attr.gt);
+  }
+  if(len < size && (e->attr.attributes & ATTR_LT)) {
+    len += print_fix(buf + len, size - len, "lt", e->attr.lt);
+  }
+  if(len < size && (e->attr.attributes & ATTR_ST)) {
+    len += print_fix(buf + len, size - len, "st", e->attr.st);
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+void
+lwm2m_notification_attributes_init(void)
+{
+  int i;
+  for(i = 0; i < MAX_ENTRIES; i++) {
+    entries[i].level = 0;
+  }
+  for(i = 0; i < MAX_OBSERVATIONS; i++) {
+    if(observations[i].observer != NULL) {
+      free_observation(&observations[i]);
+    }
+  }
+  coap_set_observer_callback(observer_callback);
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \addtogroup oma-lwm2m
+ * @{
+ */
+
+/**
+ * \file
+ *         Header file for the OMA LWM2M notification attributes
+ *         (pmin, pmax, gt, lt, st)
+ */
+
+#ifndef LWM2M_NOTIFICATION_ATTRIBUTES_H_
+#define LWM2M_NOTIFICATION_ATTRIBUTES_H_
+
+#include "lwm2m-engine.h"
+
+void lwm2m_notification_attributes_init(void);
+
+/*
+ * Handles a Write-Attributes request, the query is not null-terminated.
+ * The attributes apply to the observations of the server that sent the
+ * request of the context.
+ */
+lwm2m_status_t
+lwm2m_notification_attributes_write(const lwm2m_context_t *ctx,
+                                    const char *query, int query_len);
+
+/* Appends the attributes of a resource set by a server to a link,
+   returns the length */
+int lwm2m_notification_attributes_print(const coap_endpoint_t *ep,
+                                        uint16_t object_id,
+                                        uint16_t instance_id,
+                                        uint16_t resource_id,
+                                        char *buf, int size);
+
+/*
+ * Notifies the observers of a resource that has changed value while
+ * honouring the notification attributes of the resource.
+ */
+void lwm2m_notification_attributes_notify(lwm2m_object_instance_t *obj,
+                                          uint16_t resource_id);
+
+#endif /* LWM2M_NOTIFICATION_ATTRIBUTES_H_ */
+/** @} */
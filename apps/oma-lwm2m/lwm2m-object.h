@@ -108,6 +108,20 @@ typedef uint32_t lwm2m_resource_id_t;
 #define RW(x) (x | LWM2M_RESOURCE_READ | LWM2M_RESOURCE_WRITE)
 #define EX(x) (x | LWM2M_RESOURCE_EXECUTE)
 
+/* Access to the resource ID and permissions of a resource definition */
+#define LWM2M_RESOURCE_ID(x)           ((x) & 0xffff)
+#define LWM2M_RESOURCE_IS_READABLE(x)  (((x) & LWM2M_RESOURCE_READ) != 0)
+#define LWM2M_RESOURCE_IS_WRITABLE(x)  (((x) & LWM2M_RESOURCE_WRITE) != 0)
+#define LWM2M_RESOURCE_IS_EXECUTABLE(x) (((x) & LWM2M_RESOURCE_EXECUTE) != 0)
+
+/*
+ * Number of resources in a resource definition array. Resource
+ * definition arrays sorted on resource ID are searched with a binary
+ * search by the engine - unsorted arrays are searched linearly.
+ */
+#define LWM2M_RESOURCE_COUNT(resources) \
+  (sizeof(resources) / sizeof(lwm2m_resource_id_t))
+
 
 #define LWM2M_OBJECT_SECURITY_ID                0
 #define LWM2M_OBJECT_SERVER_ID                  1
@@ -177,6 +191,10 @@ typedef enum {
 /* remember that we have already output a value - can be between two block's */
 #define WRITER_OUTPUT_VALUE      1
 #define WRITER_RESOURCE_INSTANCE 2
+/* set by the engine at end_write when more object instances follow */
+#define WRITER_MORE_INSTANCES    4
+/* set when a value did not fit in the output buffer */
+#define WRITER_OUTPUT_FULL       8
 
 typedef struct lwm2m_reader lwm2m_reader_t;
 typedef struct lwm2m_writer lwm2m_writer_t;
@@ -238,7 +256,9 @@ struct lwm2m_reader {
 lwm2m_context_t *ctx, const uint8_t *inbuf, size_t len, int *value);
 };
 
-#define LWM2M_INSTANCE_FLAG_USED 1
+#define LWM2M_INSTANCE_FLAG_USED             1
+/* Set by the engine when the resource definition array is sorted */
+#define LWM2M_INSTANCE_FLAG_SORTED_RESOURCES 2
 
 
 #ifdef CONTIKI
@@ -273,13 +293,23 @@ lwm2m_object_read_boolean(lwm2m_context_t *ctx, const uint8_t *inbuf, size_t len
   return ctx->reader->read_boolean(ctx, inbuf, len, value);
 }
 
+/* The writers output nothing when a value does not fit in the buffer */
+static inline void
+lwm2m_object_add_output(lwm2m_context_t *ctx, size_t s, int has_value)
+{
+  if(s == 0 && has_value) {
+    ctx->writer_flags |= WRITER_OUTPUT_FULL;
+  }
+  ctx->outlen += s;
+}
+
 static inline size_t
 lwm2m_object_write_int(lwm2m_context_t *ctx, int32_t value)
 {
   size_t s;
   s = ctx->writer->write_int(ctx, &ctx->outbuf[ctx->outlen],
                              ctx->outsize - ctx->outlen, value);
-  ctx->outlen += s;
+  lwm2m_object_add_output(ctx, s, 1);
   return s;
 }
 
@@ -289,7 +319,7 @@ lwm2m_object_write_string(lwm2m_context_t *ctx, const char *value, size_t strlen
   size_t s;
   s = ctx->writer->write_string(ctx, &ctx->outbuf[ctx->outlen],
                                 ctx->outsize - ctx->outlen, value, strlen);
-  ctx->outlen += s;
+  lwm2m_object_add_output(ctx, s, strlen > 0);
   return s;
 }
 
@@ -299,7 +329,7 @@ lwm2m_object_write_float32fix(lwm2m_context_t *ctx, int32_t value, int bits)
   size_t s;
   s = ctx->writer->write_float32fix(ctx, &ctx->outbuf[ctx->outlen],
                                     ctx->outsize - ctx->outlen, value, bits);
-  ctx->outlen += s;
+  lwm2m_object_add_output(ctx, s, 1);
   return s;
 }
 
@@ -309,7 +339,7 @@ lwm2m_object_write_boolean(lwm2m_context_t *ctx, int value)
   size_t s;
   s = ctx->writer->write_boolean(ctx, &ctx->outbuf[ctx->outlen],
                                  ctx->outsize - ctx->outlen, value);
-  ctx->outlen += s;
+  lwm2m_object_add_output(ctx, s, 1);
   return s;
 }
 
@@ -346,7 +376,7 @@ lwm2m_object_write_int_ri(lwm2m_context_t *ctx, uint16_t id, int32_t value)
   ctx->resource_instance_id = id;
   s = ctx->writer->write_int(ctx, &ctx->outbuf[ctx->outlen],
                              ctx->outsize - ctx->outlen, value);
-  ctx->outlen += s;
+  lwm2m_object_add_output(ctx, s, 1);
   return s;
 }
 
@@ -357,7 +387,7 @@ lwm2m_object_write_string_ri(lwm2m_context_t *ctx, uint16_t id, const char *valu
   ctx->resource_instance_id = id;
   s = ctx->writer->write_string(ctx, &ctx->outbuf[ctx->outlen],
                                 ctx->outsize - ctx->outlen, value, strlen);
-  ctx->outlen += s;
+  lwm2m_object_add_output(ctx, s, strlen > 0);
   return s;
 }
 
@@ -368,7 +398,7 @@ lwm2m_object_write_float32fix_ri(lwm2m_context_t *ctx, uint16_t id, int32_t valu
   ctx->resource_instance_id = id;
   s = ctx->writer->write_float32fix(ctx, &ctx->outbuf[ctx->outlen],
                                     ctx->outsize - ctx->outlen, value, bits);
-  ctx->outlen += s;
+  lwm2m_object_add_output(ctx, s, 1);
   return s;
 }
 
@@ -379,7 +409,7 @@ lwm2m_object_write_boolean_ri(lwm2m_context_t *ctx, uint16_t id, int value)
   ctx->resource_instance_id = id;
   s = ctx->writer->write_boolean(ctx, &ctx->outbuf[ctx->outlen],
                                  ctx->outsize - ctx->outlen, value);
-  ctx->outlen += s;
+  lwm2m_object_add_output(ctx, s, 1);
   return s;
 }
 
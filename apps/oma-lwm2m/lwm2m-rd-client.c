@@ -90,6 +90,29 @@
 
 #define STATE_MACHINE_UPDATE_INTERVAL 500
 
+/*
+ * In queue mode (binding UQ) the client stays awake for a while after each
+ * registration update and then sleeps until the next update is due. The
+ * notifications during sleep are buffered and sent after the update.
+ */
+#ifdef LWM2M_QUEUE_MODE_CONF_ENABLED
+#define QUEUE_MODE_ENABLED LWM2M_QUEUE_MODE_CONF_ENABLED
+#else
+#define QUEUE_MODE_ENABLED 0
+#endif /* LWM2M_QUEUE_MODE_CONF_ENABLED */
+
+#ifdef LWM2M_QUEUE_MODE_CONF_AWAKE_TIME
+#define QUEUE_MODE_AWAKE_TIME LWM2M_QUEUE_MODE_CONF_AWAKE_TIME
+#else
+#define QUEUE_MODE_AWAKE_TIME 5000 /* ms */
+#endif /* LWM2M_QUEUE_MODE_CONF_AWAKE_TIME */
+
+#ifdef LWM2M_QUEUE_MODE_CONF_MAX_NOTIFICATIONS
+#define QUEUE_MODE_MAX_NOTIFICATIONS LWM2M_QUEUE_MODE_CONF_MAX_NOTIFICATIONS
+#else
+#define QUEUE_MODE_MAX_NOTIFICATIONS 8
+#endif /* LWM2M_QUEUE_MODE_CONF_MAX_NOTIFICATIONS */
+
 static struct lwm2m_session_info session_info;
 static struct request_state rd_request_state;
 
@@ -110,6 +133,7 @@ static struct request_state rd_request_state;
 #define DEREGISTER_SENT   11
 #define DEREGISTER_FAILED 12
 #define DEREGISTERED      13
+#define QUEUE_MODE_SLEEPING 14
 
 #define FLAG_RD_DATA_DIRTY            0x01
 #define FLAG_RD_DATA_UPDATE_TRIGGERED 0x02
@@ -119,19 +143,36 @@ static uint8_t rd_state = 0;
 static uint8_t rd_flags = FLAG_RD_DATA_UPDATE_ON_DIRTY;
 static uint64_t wait_until_network_check = 0;
 static uint64_t last_update;
+static uint64_t last_activity;
 
 static char path_data[32]; /* allocate some data for building the path */
 static char query_data[64]; /* allocate some data for queries and updates */
-static uint8_t rd_data[128]; /* allocate some data for the RD */
+
+/* Version of the registration payload last accepted by the server */
+static uint16_t rd_version;
+/* Version of the registration payload in the outstanding request */
+static uint16_t rd_version_sent;
 
 static ntimer_t rd_timer;
 
-void check_periodic_observations();
+/* Resources that have changed while sleeping in queue mode */
+typedef struct {
+  uint16_t object_id;
+  uint16_t instance_id;
+  uint16_t resource_id;
+} queued_notification_t;
+
+static queued_notification_t queued_notifications[QUEUE_MODE_MAX_NOTIFICATIONS];
+static uint8_t queue_first;
+static uint8_t queue_count;
 
 /*---------------------------------------------------------------------------*/
-static void
-prepare_update(coap_packet_t *request, int triggered) {
-  int len;
+/* Returns the length of the object list to include in the update */
+static uint16_t
+prepare_update(coap_packet_t *request, int triggered, const uint8_t **rd_data) {
+  uint16_t len = 0;
+  uint16_t version;
+
   coap_init_message(request, COAP_TYPE_CON, COAP_POST, 0);
   coap_set_header_uri_path(request, session_info.assigned_ep);
 
@@ -139,12 +180,21 @@ prepare_update(coap_packet_t *request, int triggered) {
   printf("UPDATE:%s %s\n", session_info.assigned_ep, query_data);
   coap_set_header_uri_query(request, query_data);
 
-  if((triggered || rd_flags & FLAG_RD_DATA_UPDATE_ON_DIRTY) && (rd_flags & FLAG_RD_DATA_DIRTY)) {
+  rd_flags &= ~FLAG_RD_DATA_UPDATE_TRIGGERED;
+
+  /*
+   * Only include the object list when it has changed since it was last
+   * accepted by the server. Otherwise send a lifetime-only update.
+   */
+  version = lwm2m_engine_get_rd_version();
+  rd_version_sent = rd_version;
+  if((triggered || rd_flags & FLAG_RD_DATA_UPDATE_ON_DIRTY) &&
+     ((rd_flags & FLAG_RD_DATA_DIRTY) || version != rd_version)) {
     rd_flags &= ~FLAG_RD_DATA_DIRTY;
-    /* generate the rd data */
-    len = lwm2m_engine_get_rd_data(rd_data, sizeof(rd_data));
-    coap_set_payload(request, rd_data, len);
+    *rd_data = lwm2m_engine_get_rd_payload(&len);
+    rd_version_sent = version;
   }
+  return len;
 }
 
 static int
@@ -161,7 +211,14 @@ has_network_access(void)
 int
 lwm2m_rd_client_is_registered(void)
 {
-  return rd_state == REGISTRATION_DONE || rd_state == UPDATE_SENT;
+  return rd_state == REGISTRATION_DONE || rd_state == UPDATE_SENT ||
+    rd_state == QUEUE_MODE_SLEEPING;
+}
+/*---------------------------------------------------------------------------*/
+int
+lwm2m_rd_client_is_sleeping(void)
+{
+  return rd_state == QUEUE_MODE_SLEEPING;
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -190,6 +247,90 @@ perform_session_callback(int state)
   }
 }
 /*---------------------------------------------------------------------------*/
+/* Leaves queue mode sleep and runs the state machine as soon as possible */
+static void
+wake_up(void)
+{
+  if(rd_state == QUEUE_MODE_SLEEPING) {
+    PRINTF("Queue mode: waking up\n");
+    rd_state = REGISTRATION_DONE;
+    last_activity = ntimer_uptime();
+    perform_session_callback(LWM2M_RD_CLIENT_AWAKE);
+    ntimer_set(&rd_timer, 0);
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+lwm2m_rd_client_queue_notification(uint16_t object_id, uint16_t instance_id,
+                                   uint16_t resource_id)
+{
+  queued_notification_t *n;
+  int i;
+
+  if(rd_state != QUEUE_MODE_SLEEPING) {
+    return 0;
+  }
+
+  for(i = 0; i < queue_count; i++) {
+    n = &queued_notifications[(queue_first + i) % QUEUE_MODE_MAX_NOTIFICATIONS];
+    if(n->object_id == object_id && n->instance_id == instance_id &&
+       n->resource_id == resource_id) {
+      /* Already pending - the latest value is sent at wake up */
+      return 1;
+    }
+  }
+
+  if(queue_count == QUEUE_MODE_MAX_NOTIFICATIONS) {
+    /* Drop the oldest and wake up to flush the rest */
+    PRINTF("Queue mode: notification queue full\n");
+    queue_first = (queue_first + 1) % QUEUE_MODE_MAX_NOTIFICATIONS;
+    queue_count--;
+    lwm2m_rd_client_update_triggered();
+  }
+  n = &queued_notifications[(queue_first + queue_count) %
+                            QUEUE_MODE_MAX_NOTIFICATIONS];
+  n->object_id = object_id;
+  n->instance_id = instance_id;
+  n->resource_id = resource_id;
+  queue_count++;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Sends the notifications buffered during sleep in one burst */
+static void
+flush_queued_notifications(void)
+{
+  queued_notification_t n;
+
+  while(queue_count > 0 && rd_state != QUEUE_MODE_SLEEPING) {
+    n = queued_notifications[queue_first];
+    queue_first = (queue_first + 1) % QUEUE_MODE_MAX_NOTIFICATIONS;
+    queue_count--;
+    lwm2m_notify_resource_observers(n.object_id, n.instance_id,
+                                    n.resource_id);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+lwm2m_rd_client_request_received(void)
+{
+  /* Stay awake while the server is talking to us */
+  last_activity = ntimer_uptime();
+}
+/*---------------------------------------------------------------------------*/
+void
+lwm2m_rd_client_use_queue_mode(int use)
+{
+  if(session_info.use_queue_mode != (use != 0)) {
+    session_info.use_queue_mode = use != 0;
+    if(lwm2m_rd_client_is_registered()) {
+      /* The binding is only sent at registration */
+      wake_up();
+      rd_state = DO_REGISTRATION;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
 void
 lwm2m_rd_client_use_registration_server(int use)
 {
@@ -280,6 +421,7 @@ void
 lwm2m_rd_client_deregister(void)
 {
   if(lwm2m_rd_client_is_registered()) {
+    wake_up();
     rd_state = DEREGISTER;
   }
 }
@@ -287,7 +429,7 @@ void
 lwm2m_rd_client_update_triggered(void)
 {
   rd_flags |= FLAG_RD_DATA_UPDATE_TRIGGERED;
-  /* Here we need to do an ntimer poll - to get a quick request transmission! */
+  wake_up();
 }
 /*---------------------------------------------------------------------------*/
 static int
@@ -358,22 +500,28 @@ registration_callback(struct request_state *state)
   if(state->response) {
     /* check state and possibly set registration to done */
     if(CREATED_2_01 == state->response->code) {
-      if(state->response->location_path_len < LWM2M_RD_CLIENT_ASSIGNED_ENDPOINT_MAX_LEN) {
-        memcpy(session_info.assigned_ep, state->response->location_path,
-               state->response->location_path_len);
-        session_info.assigned_ep[state->response->location_path_len] = 0;
+      const char *location_path = NULL;
+      int location_path_len;
+
+      location_path_len =
+        coap_get_header_location_path(state->response, &location_path);
+      if(location_path_len < LWM2M_RD_CLIENT_ASSIGNED_ENDPOINT_MAX_LEN) {
+        memcpy(session_info.assigned_ep, location_path, location_path_len);
+        session_info.assigned_ep[location_path_len] = 0;
         /* if we decide to not pass the lt-argument on registration, we should force an initial "update" to register lifetime with server */
         rd_state = REGISTRATION_DONE;
         /* remember the last reg time */
         last_update = ntimer_uptime();
+        last_activity = last_update;
+        rd_version = rd_version_sent;
         PRINTF("Done (assigned EP='%s')!\n", session_info.assigned_ep);
         perform_session_callback(LWM2M_RD_CLIENT_REGISTERED);
+        flush_queued_notifications();
         return;
       }
 
       PRINTF("failed to handle assigned EP: '");
-      PRINTS(state->response->location_path_len,
-             state->response->location_path, "%c");
+      PRINTS(location_path_len, location_path, "%c");
       PRINTF("'. Re-init network.\n");
     } else {
       /* Possible error response codes are 4.00 Bad request & 4.03 Forbidden */
@@ -403,7 +551,10 @@ update_callback(struct request_state *state)
       PRINTF("Done!\n");
       /* remember the last reg time */
       last_update = ntimer_uptime();
+      last_activity = last_update;
+      rd_version = rd_version_sent;
       rd_state = REGISTRATION_DONE;
+      flush_queued_notifications();
       return;
     }
     /* Possible error response codes are 4.00 Bad request & 4.04 Not Found */
@@ -494,10 +645,10 @@ periodic_process(ntimer_t *timer)
         coap_endpoint_print(&session_info.bs_server_ep);
         PRINTF("] as '%s'\n", query_data);
 
+        /* set first - the callback runs at once if the request cannot be sent */
+        rd_state = BOOTSTRAP_SENT;
         coap_send_request(&rd_request_state, &session_info.bs_server_ep,
                           request, bootstrap_callback);
-
-        rd_state = BOOTSTRAP_SENT;
       }
     }
     break;
@@ -571,27 +722,31 @@ periodic_process(ntimer_t *timer)
     if(session_info.use_registration && !session_info.registered &&
        update_registration_server()) {
 
-      int len;
+      const uint8_t *rd_data;
+      uint16_t len;
 
       /* prepare request, TID was set by COAP_BLOCKING_REQUEST() */
       coap_init_message(request, COAP_TYPE_CON, COAP_POST, 0);
       coap_set_header_uri_path(request, "/rd");
 
-      snprintf(query_data, sizeof(query_data) - 1, "?ep=%s&lt=%d", session_info.ep, session_info.lifetime);
+      snprintf(query_data, sizeof(query_data) - 1, "?ep=%s&lt=%d%s",
+               session_info.ep, session_info.lifetime,
+               session_info.use_queue_mode ? "&b=UQ" : "");
       coap_set_header_uri_query(request, query_data);
 
-      /* generate the rd data */
-      len = lwm2m_engine_get_rd_data(rd_data, sizeof(rd_data));
-      coap_set_payload(request, rd_data, len);
+      /* the registration payload is cached by the engine */
+      rd_data = lwm2m_engine_get_rd_payload(&len);
+      rd_version_sent = lwm2m_engine_get_rd_version();
+      rd_flags &= ~FLAG_RD_DATA_DIRTY;
 
       PRINTF("Registering with [");
       coap_endpoint_print(&session_info.server_ep);
       PRINTF("] lwm2m endpoint '%s': '", query_data);
       PRINTS(len, rd_data, "%c");
       PRINTF("'\n");
-      coap_send_request(&rd_request_state, &session_info.server_ep,
-                        request, registration_callback);
       rd_state = REGISTRATION_SENT;
+      coap_send_request_payload(&rd_request_state, &session_info.server_ep,
+                                request, rd_data, len, registration_callback);
     }
   case REGISTRATION_SENT:
     /* just wait until the callback kicks us to the next state... */
@@ -599,16 +754,34 @@ periodic_process(ntimer_t *timer)
   case REGISTRATION_DONE:
     /* All is done! */
 
-    check_periodic_observations(); /* TODO: manage periodic observations */
-
     /* check if it is time for the next update */
     if((rd_flags & FLAG_RD_DATA_UPDATE_TRIGGERED) ||
        ((uint32_t)session_info.lifetime * 500) <= now - last_update) {
       /* triggered or time to send an update to the server, at half-time! sec vs ms */
-      prepare_update(request, rd_flags & FLAG_RD_DATA_UPDATE_TRIGGERED);
-      coap_send_request(&rd_request_state, &session_info.server_ep, request,
-                        update_callback);
+      const uint8_t *rd_data = NULL;
+      uint16_t len;
+
+      len = prepare_update(request, rd_flags & FLAG_RD_DATA_UPDATE_TRIGGERED,
+                           &rd_data);
       rd_state = UPDATE_SENT;
+      coap_send_request_payload(&rd_request_state, &session_info.server_ep,
+                                request, rd_data, len, update_callback);
+    } else if(session_info.use_queue_mode &&
+              QUEUE_MODE_AWAKE_TIME <= now - last_activity) {
+      PRINTF("Queue mode: sleeping\n");
+      rd_state = QUEUE_MODE_SLEEPING;
+      perform_session_callback(LWM2M_RD_CLIENT_SLEEPING);
+      /* Do not run the state machine until the next update is due */
+      ntimer_set(&rd_timer, last_update +
+                 (uint32_t)session_info.lifetime * 500 - now);
+    }
+    break;
+  case QUEUE_MODE_SLEEPING:
+    if(((uint32_t)session_info.lifetime * 500) <= now - last_update) {
+      wake_up();
+    } else {
+      ntimer_set(&rd_timer, last_update +
+                 (uint32_t)session_info.lifetime * 500 - now);
     }
     break;
 
@@ -619,9 +792,9 @@ periodic_process(ntimer_t *timer)
     PRINTF("DEREGISTER %s\n", session_info.assigned_ep);
     coap_init_message(request, COAP_TYPE_CON, COAP_DELETE, 0);
     coap_set_header_uri_path(request, session_info.assigned_ep);
+    rd_state = DEREGISTER_SENT;
     coap_send_request(&rd_request_state, &session_info.server_ep, request,
                       deregister_callback);
-    rd_state = DEREGISTER_SENT;
     break;
   case DEREGISTER_SENT:
     break;
@@ -642,15 +815,10 @@ lwm2m_rd_client_init(const char *ep)
   if(session_info.lifetime == 0) {
     session_info.lifetime = LWM2M_DEFAULT_CLIENT_LIFETIME;
   }
+  session_info.use_queue_mode = QUEUE_MODE_ENABLED;
   rd_state = INIT;
   /* Example using network timer */
   ntimer_set_callback(&rd_timer, periodic_process);
   ntimer_set(&rd_timer, STATE_MACHINE_UPDATE_INTERVAL); /* call the RD client 2 times per second */
 }
 /*---------------------------------------------------------------------------*/
-void
-check_periodic_observations(void)
-{
-/* TODO */
-}
-/*---------------------------------------------------------------------------*/
@@ -36,6 +36,8 @@
 #define LWM2M_RD_CLIENT_DEREGISTERED       3
 #define LWM2M_RD_CLIENT_DEREGISTER_FAILED  4
 #define LWM2M_RD_CLIENT_DISCONNECTED       5
+#define LWM2M_RD_CLIENT_SLEEPING           6
+#define LWM2M_RD_CLIENT_AWAKE              7
 
 struct lwm2m_session_info;
 typedef void (*session_callback_t)(struct lwm2m_session_info *session, int status);
@@ -54,6 +56,20 @@ void lwm2m_rd_client_set_automatic_update(int update);
 /* trigger an immediate update */
 void lwm2m_rd_client_update_triggered(void);
 
+/*
+ * Use queue mode (binding UQ). The session callback is called with
+ * LWM2M_RD_CLIENT_SLEEPING and LWM2M_RD_CLIENT_AWAKE so that the
+ * application can turn the radio off while sleeping.
+ */
+void lwm2m_rd_client_use_queue_mode(int use);
+int  lwm2m_rd_client_is_sleeping(void);
+/* Buffer a notification while sleeping, returns 1 if buffered */
+int  lwm2m_rd_client_queue_notification(uint16_t object_id,
+                                        uint16_t instance_id,
+                                        uint16_t resource_id);
+/* Indicate that a request was received from the server */
+void lwm2m_rd_client_request_received(void);
+
 void lwm2m_rd_client_deregister(void);
 void lwm2m_rd_client_init(const char *ep);
 
@@ -76,6 +92,7 @@ struct lwm2m_session_info {
   uint8_t has_registration_server_info;
   uint8_t registered;
   uint8_t bootstrapped; /* bootstrap done */
+  uint8_t use_queue_mode;
   session_callback_t callback;
 };
 
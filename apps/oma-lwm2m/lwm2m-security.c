@@ -114,7 +114,7 @@ lwm2m_security_create(int instance_id)
       security_instances[i].reg_object.object_id = LWM2M_OBJECT_SECURITY_ID;
       security_instances[i].reg_object.instance_id = instance_id;
       security_instances[i].reg_object.resource_ids = resources;
-      security_instances[i].reg_object.resource_count = sizeof(resources) / sizeof(uint16_t);
+      security_instances[i].reg_object.resource_count = LWM2M_RESOURCE_COUNT(resources);
       lwm2m_engine_add_object((lwm2m_object_instance_t *) &security_instances[i]);
       PRINTF("SEC: Create new security instance\n");
       return 1;
@@ -203,7 +203,7 @@ lwm2m_security_init(void)
   security_object.object_id = LWM2M_OBJECT_SECURITY_ID;
   security_object.instance_id = 0xffff; /* Generic instance */
   security_object.resource_ids = resources;
-  security_object.resource_count = sizeof(resources) / sizeof(lwm2m_resource_id_t);
+  security_object.resource_count = LWM2M_RESOURCE_COUNT(resources);
   security_object.callback = lwm2m_callback;
 
   PRINTF("*** Init lwm2m-security\n");
@@ -0,0 +1,683 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \addtogroup oma-lwm2m
+ * @{
+ */
+
+/**
+ * \file
+ *         Implementation of the Contiki OMA LWM2M SenML CBOR reader / writer
+ *
+ *         The writer outputs one indefinite length array of records per
+ *         request. Records are maps with the SenML integer labels and the
+ *         base name is only set in the first record of each object instance.
+ *         Fix point values with a fraction are written as single precision
+ *         floats, other numbers as integers.
+ */
+
+#include "lwm2m-object.h"
+#include "lwm2m-senml.h"
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+/* CBOR major types */
+#define CBOR_UINT   0
+#define CBOR_NINT   1
+#define CBOR_BYTES  2
+#define CBOR_TEXT   3
+#define CBOR_ARRAY  4
+#define CBOR_MAP    5
+#define CBOR_SIMPLE 7
+
+#define CBOR_FALSE          0xf4
+#define CBOR_TRUE           0xf5
+#define CBOR_FLOAT16        0xf9
+#define CBOR_FLOAT32        0xfa
+#define CBOR_FLOAT64        0xfb
+#define CBOR_BREAK          0xff
+#define CBOR_ARRAY_INDEF    0x9f
+#define CBOR_MAP_INDEF      0xbf
+
+/* SenML labels */
+#define SENML_BASE_NAME  -2
+#define SENML_NAME        0
+#define SENML_VALUE       2
+#define SENML_STRING      3
+#define SENML_BOOL        4
+#define SENML_DATA        8
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes the head of a data item. Returns the new position in the output
+ * buffer or 0 if the output buffer is full.
+ */
+static size_t
+put_head(uint8_t *outbuf, size_t outlen, size_t pos, uint8_t major,
+         uint32_t value)
+{
+  int len;
+
+  if(value < 24) {
+    len = 0;
+  } else if(value <= 0xff) {
+    len = 1;
+  } else if(value <= 0xffff) {
+    len = 2;
+  } else {
+    len = 4;
+  }
+  if(pos + 1 + len > outlen) {
+    return 0;
+  }
+
+  if(len == 0) {
+    outbuf[pos++] = (major << 5) | value;
+    return pos;
+  }
+  outbuf[pos++] = (major << 5) | (len == 1 ? 24 : (len == 2 ? 25 : 26));
+  while(len-- > 0) {
+    outbuf[pos++] = (value >> (len * 8)) & 0xff;
+  }
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+put_int(uint8_t *outbuf, size_t outlen, size_t pos, int32_t value)
+{
+  if(value < 0) {
+    return put_head(outbuf, outlen, pos, CBOR_NINT, -(value + 1));
+  }
+  return put_head(outbuf, outlen, pos, CBOR_UINT, value);
+}
+/*---------------------------------------------------------------------------*/
+/* Formats an unsigned integer as text into buf and returns the length */
+static int
+format_uint(char *buf, uint16_t value)
+{
+  char digits[5];
+  int n = 0, len = 0;
+
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while(value > 0);
+  while(n > 0) {
+    buf[len++] = digits[--n];
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+put_text(uint8_t *outbuf, size_t outlen, size_t pos, const char *text,
+         size_t len)
+{
+  pos = put_head(outbuf, outlen, pos, CBOR_TEXT, len);
+  if(pos == 0 || pos + len > outlen) {
+    return 0;
+  }
+  memcpy(&outbuf[pos], text, len);
+  return pos + len;
+}
+/*---------------------------------------------------------------------------*/
+/* Converts a fix point value into a single precision float */
+static uint32_t
+fix_to_float32(int32_t value, int bits)
+{
+  uint32_t sign = 0, mantissa;
+  int high;
+
+  if(value == 0) {
+    return 0;
+  }
+  if(value < 0) {
+    sign = 0x80000000UL;
+    mantissa = -(uint32_t)value;
+  } else {
+    mantissa = value;
+  }
+
+  for(high = 31; (mantissa & (1UL << high)) == 0; high--);
+
+  /* normalize to 24 bits with the hidden bit at bit 23 */
+  if(high > 23) {
+    mantissa >>= high - 23;
+  } else {
+    mantissa <<= 23 - high;
+  }
+  return sign | ((uint32_t)(high - bits + 127) << 23) | (mantissa & 0x7fffff);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+init_write(lwm2m_context_t *ctx)
+{
+  ctx->writer_flags &= ~WRITER_SENML_BASE_NAME;
+  if(ctx->writer_flags & WRITER_SENML_STARTED) {
+    return 0;
+  }
+  if(ctx->outlen >= ctx->outsize) {
+    return 0;
+  }
+  ctx->outbuf[ctx->outlen] = CBOR_ARRAY_INDEF;
+  ctx->writer_flags |= WRITER_SENML_STARTED;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+end_write(lwm2m_context_t *ctx)
+{
+  if(ctx->writer_flags & WRITER_MORE_INSTANCES) {
+    return 0;
+  }
+  if(ctx->outlen >= ctx->outsize) {
+    return 0;
+  }
+  ctx->outbuf[ctx->outlen] = CBOR_BREAK;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+enter_sub(lwm2m_context_t *ctx)
+{
+  PRINTF("Enter sub-resource rsc=%d\n", ctx->resource_id);
+  ctx->writer_flags |= WRITER_RESOURCE_INSTANCE;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+exit_sub(lwm2m_context_t *ctx)
+{
+  PRINTF("Exit sub-resource rsc=%d\n", ctx->resource_id);
+  ctx->writer_flags &= ~WRITER_RESOURCE_INSTANCE;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Writes the start of a record up to and including the value label */
+static size_t
+write_record_start(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+                   int label)
+{
+  /* "/65535/65535/" or "65535/65535" */
+  char name[14];
+  int len;
+  size_t pos;
+
+  if(!(ctx->writer_flags & WRITER_SENML_BASE_NAME)) {
+    pos = put_head(outbuf, outlen, 0, CBOR_MAP, 3);
+    name[0] = '/';
+    len = 1 + format_uint(&name[1], ctx->object_id);
+    name[len++] = '/';
+    len += format_uint(&name[len], ctx->object_instance_id);
+    name[len++] = '/';
+    pos = pos ? put_int(outbuf, outlen, pos, SENML_BASE_NAME) : 0;
+    pos = pos ? put_text(outbuf, outlen, pos, name, len) : 0;
+  } else {
+    pos = put_head(outbuf, outlen, 0, CBOR_MAP, 2);
+  }
+
+  len = format_uint(name, ctx->resource_id);
+  if(ctx->writer_flags & WRITER_RESOURCE_INSTANCE) {
+    name[len++] = '/';
+    len += format_uint(&name[len], ctx->resource_instance_id);
+  }
+  pos = pos ? put_int(outbuf, outlen, pos, SENML_NAME) : 0;
+  pos = pos ? put_text(outbuf, outlen, pos, name, len) : 0;
+  pos = pos ? put_int(outbuf, outlen, pos, label) : 0;
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_record_end(lwm2m_context_t *ctx, size_t pos)
+{
+  if(pos > 0) {
+    ctx->writer_flags |= WRITER_OUTPUT_VALUE | WRITER_SENML_BASE_NAME;
+  }
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_boolean(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+              int value)
+{
+  size_t pos;
+  pos = write_record_start(ctx, outbuf, outlen, SENML_BOOL);
+  if(pos == 0 || pos >= outlen) {
+    return 0;
+  }
+  outbuf[pos++] = value ? CBOR_TRUE : CBOR_FALSE;
+  return write_record_end(ctx, pos);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_int(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+          int32_t value)
+{
+  size_t pos;
+  pos = write_record_start(ctx, outbuf, outlen, SENML_VALUE);
+  pos = pos ? put_int(outbuf, outlen, pos, value) : 0;
+  return write_record_end(ctx, pos);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_float32fix(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+                 int32_t value, int bits)
+{
+  uint32_t f;
+  size_t pos;
+
+  pos = write_record_start(ctx, outbuf, outlen, SENML_VALUE);
+  if(pos == 0) {
+    return 0;
+  }
+  if((value & ((1L << bits) - 1)) == 0) {
+    /* No fraction - use the shorter integer encoding */
+    pos = put_int(outbuf, outlen, pos, value / (1L << bits));
+  } else if(pos + 5 > outlen) {
+    return 0;
+  } else {
+    f = fix_to_float32(value, bits);
+    outbuf[pos++] = CBOR_FLOAT32;
+    outbuf[pos++] = f >> 24;
+    outbuf[pos++] = f >> 16;
+    outbuf[pos++] = f >> 8;
+    outbuf[pos++] = f;
+  }
+  return write_record_end(ctx, pos);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_string(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+             const char *value, size_t stringlen)
+{
+  size_t pos;
+  pos = write_record_start(ctx, outbuf, outlen, SENML_STRING);
+  pos = pos ? put_text(outbuf, outlen, pos, value, stringlen) : 0;
+  return write_record_end(ctx, pos);
+}
+/*---------------------------------------------------------------------------*/
+const lwm2m_writer_t lwm2m_senml_cbor_writer = {
+  init_write,
+  end_write,
+  enter_sub,
+  exit_sub,
+  write_int,
+  write_string,
+  write_float32fix,
+  write_boolean
+};
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the head of a data item. Returns the length of the head or 0 if
+ * the head could not be read. Indefinite lengths are returned as
+ * 0xffffffff and the 8 byte argument of doubles is not returned.
+ */
+static size_t
+get_head(const uint8_t *inbuf, size_t len, uint8_t *major, uint32_t *value)
+{
+  uint8_t info;
+  size_t size, i;
+
+  if(len == 0) {
+    return 0;
+  }
+  *major = inbuf[0] >> 5;
+  info = inbuf[0] & 0x1f;
+  if(info < 24) {
+    *value = info;
+    return 1;
+  }
+  if(info == 31) {
+    *value = 0xffffffffUL;
+    return 1;
+  }
+  if(info > 27) {
+    return 0;
+  }
+  size = 1 << (info - 24);
+  if(size + 1 > len) {
+    return 0;
+  }
+  if(size == 8) {
+    if(*major != CBOR_SIMPLE) {
+      /* 64 bit integers and lengths are not supported */
+      return 0;
+    }
+    *value = 0;
+    return 9;
+  }
+  *value = 0;
+  for(i = 1; i <= size; i++) {
+    *value = (*value << 8) | inbuf[i];
+  }
+  return size + 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Converts a float with a 24 bit mantissa to fix point */
+static int32_t
+float_to_fix(int negative, int exponent, uint32_t mantissa, int bits)
+{
+  int shift = exponent - 23 + bits;
+  int32_t value;
+
+  if(shift >= 0) {
+    if(shift > 7 || (mantissa << shift) > 0x7fffffffUL) {
+      value = 0x7fffffffL;
+    } else {
+      value = mantissa << shift;
+    }
+  } else if(shift > -32) {
+    value = mantissa >> -shift;
+  } else {
+    value = 0;
+  }
+  return negative ? -value : value;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads a number item as fix point with the specified number of bits.
+ * Returns the length of the item or 0 if it is not a number.
+ */
+static size_t
+get_number(const uint8_t *inbuf, size_t len, int32_t *value, int bits)
+{
+  uint8_t major;
+  uint32_t arg, mantissa;
+  int exponent;
+  size_t size;
+
+  size = get_head(inbuf, len, &major, &arg);
+  if(size == 0) {
+    return 0;
+  }
+  if(major == CBOR_UINT || major == CBOR_NINT) {
+    if(arg > 0x7fffffffUL) {
+      return 0;
+    }
+    *value = major == CBOR_UINT ? (int32_t)arg : -(int32_t)arg - 1;
+    *value *= 1L << bits;
+    return size;
+  }
+  if(inbuf[0] == CBOR_FLOAT16) {
+    exponent = (arg >> 10) & 0x1f;
+    mantissa = (arg & 0x3ff) << 13;
+    if(exponent == 0) {
+      exponent = 1 - 15;
+    } else {
+      mantissa |= 1UL << 23;
+      exponent -= 15;
+    }
+    *value = float_to_fix((arg & 0x8000) != 0, exponent, mantissa, bits);
+  } else if(inbuf[0] == CBOR_FLOAT32) {
+    exponent = (arg >> 23) & 0xff;
+    mantissa = arg & 0x7fffff;
+    if(exponent == 0) {
+      exponent = 1 - 127;
+    } else {
+      mantissa |= 1UL << 23;
+      exponent -= 127;
+    }
+    *value = float_to_fix((arg & 0x80000000UL) != 0, exponent, mantissa, bits);
+  } else if(inbuf[0] == CBOR_FLOAT64) {
+    /* sign, 11 bits exponent and the 23 high bits of the mantissa */
+    arg = ((uint32_t)inbuf[1] << 24) | ((uint32_t)inbuf[2] << 16) |
+      ((uint32_t)inbuf[3] << 8) | inbuf[4];
+    exponent = (arg >> 20) & 0x7ff;
+    mantissa = ((arg & 0xfffff) << 3) | (inbuf[5] >> 5);
+    if(exponent == 0) {
+      exponent = 1 - 1023;
+    } else {
+      mantissa |= 1UL << 23;
+      exponent -= 1023;
+    }
+    *value = float_to_fix((arg & 0x80000000UL) != 0, exponent, mantissa, bits);
+  } else {
+    return 0;
+  }
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+read_int(lwm2m_context_t *ctx, const uint8_t *inbuf, size_t len,
+         int32_t *value)
+{
+  size_t size = get_number(inbuf, len, value, 0);
+  ctx->last_value_len = size;
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+read_string(lwm2m_context_t *ctx, const uint8_t *inbuf, size_t len,
+            uint8_t *value, size_t stringlen)
+{
+  uint8_t major;
+  uint32_t arg;
+  size_t size;
+
+  size = get_head(inbuf, len, &major, &arg);
+  if(size == 0 || (major != CBOR_TEXT && major != CBOR_BYTES) ||
+     arg >= stringlen || size + arg > len) {
+    /* The outbuffer can not contain the full string including ending zero */
+    return 0;
+  }
+  memcpy(value, &inbuf[size], arg);
+  value[arg] = '\0';
+  ctx->last_value_len = arg;
+  return size + arg;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+read_float32fix(lwm2m_context_t *ctx, const uint8_t *inbuf, size_t len,
+                int32_t *value, int bits)
+{
+  size_t size = get_number(inbuf, len, value, bits);
+  ctx->last_value_len = size;
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+read_boolean(lwm2m_context_t *ctx, const uint8_t *inbuf, size_t len,
+             int *value)
+{
+  if(len > 0) {
+    if(*inbuf == CBOR_TRUE || *inbuf == CBOR_FALSE) {
+      *value = *inbuf == CBOR_TRUE;
+      ctx->last_value_len = 1;
+      return 1;
+    }
+    if(*inbuf == 0 || *inbuf == 1) {
+      /* Integer 0 or 1 */
+      *value = *inbuf;
+      ctx->last_value_len = 1;
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const lwm2m_reader_t lwm2m_senml_cbor_reader = {
+  read_int,
+  read_string,
+  read_float32fix,
+  read_boolean
+};
+/*---------------------------------------------------------------------------*/
+/* Returns the size of a non-container item or 0 */
+static size_t
+item_size(const uint8_t *inbuf, size_t len)
+{
+  uint8_t major;
+  uint32_t arg;
+  size_t size;
+
+  size = get_head(inbuf, len, &major, &arg);
+  if(size == 0 || major == CBOR_ARRAY || major == CBOR_MAP ||
+     arg == 0xffffffffUL) {
+    return 0;
+  }
+  if(major == CBOR_TEXT || major == CBOR_BYTES) {
+    if(size + arg > len) {
+      return 0;
+    }
+    size += arg;
+  }
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+int
+lwm2m_senml_cbor_next_record(lwm2m_context_t *ctx,
+                             lwm2m_senml_record_t *record)
+{
+  const uint8_t *name;
+  uint8_t major;
+  uint32_t arg, pairs;
+  int32_t label;
+  size_t size, name_len, len;
+  const uint8_t *inbuf;
+
+  inbuf = &ctx->inbuf[ctx->inpos];
+  len = ctx->insize - ctx->inpos;
+
+  if(!record->started) {
+    size = get_head(inbuf, len, &major, &arg);
+    if(size == 0 || major != CBOR_ARRAY) {
+      return -1;
+    }
+    record->records_left = arg == 0xffffffffUL ? -1 : (int16_t)arg;
+    record->started = 1;
+    inbuf += size;
+    len -= size;
+  }
+
+  for(;;) {
+    if(record->records_left == 0) {
+      return 0;
+    }
+    if(record->records_left < 0 && len > 0 && *inbuf == CBOR_BREAK) {
+      return 0;
+    }
+
+    size = get_head(inbuf, len, &major, &pairs);
+    if(size == 0 || major != CBOR_MAP) {
+      return -1;
+    }
+    inbuf += size;
+    len -= size;
+    if(record->records_left > 0) {
+      record->records_left--;
+    }
+
+    name = NULL;
+    name_len = 0;
+    record->value = NULL;
+    while(pairs > 0) {
+      if(pairs == 0xffffffffUL && len > 0 && *inbuf == CBOR_BREAK) {
+        inbuf++;
+        len--;
+        break;
+      }
+      size = get_head(inbuf, len, &major, &arg);
+      if(size == 0) {
+        return -1;
+      }
+      if(major == CBOR_UINT) {
+        label = arg;
+      } else if(major == CBOR_NINT) {
+        label = -(int32_t)arg - 1;
+      } else {
+        /* Ignore labels that are not integers */
+        size = item_size(inbuf, len);
+        label = SENML_DATA + 1;
+        if(size == 0) {
+          return -1;
+        }
+      }
+      inbuf += size;
+      len -= size;
+
+      size = item_size(inbuf, len);
+      if(size == 0) {
+        return -1;
+      }
+      if(label == SENML_BASE_NAME || label == SENML_NAME) {
+        get_head(inbuf, len, &major, &arg);
+        if(major != CBOR_TEXT || arg >= sizeof(record->base)) {
+          return -1;
+        }
+        if(label == SENML_BASE_NAME) {
+          memcpy(record->base, &inbuf[size - arg], arg);
+          record->base_len = arg;
+        } else {
+          name = &inbuf[size - arg];
+          name_len = arg;
+        }
+      } else if(label == SENML_VALUE || label == SENML_STRING ||
+                label == SENML_BOOL || label == SENML_DATA) {
+        record->value = inbuf;
+        record->value_len = size;
+        record->value_type =
+          label == SENML_VALUE ? LWM2M_SENML_VALUE :
+          label == SENML_STRING ? LWM2M_SENML_STRING_VALUE :
+          label == SENML_BOOL ? LWM2M_SENML_BOOL_VALUE :
+          LWM2M_SENML_DATA_VALUE;
+      }
+      inbuf += size;
+      len -= size;
+      if(pairs != 0xffffffffUL) {
+        pairs--;
+      }
+    }
+
+    if(name == NULL && record->value == NULL) {
+      /* Records without name and value only sets the base name */
+      continue;
+    }
+    if(record->base_len + name_len >= sizeof(record->name)) {
+      return -1;
+    }
+    memcpy(record->name, record->base, record->base_len);
+    if(name != NULL) {
+      memcpy(&record->name[record->base_len], name, name_len);
+    }
+    record->name_len = record->base_len + name_len;
+    record->name[record->name_len] = '\0';
+    ctx->inpos = inbuf - ctx->inbuf;
+    PRINTF("SenML CBOR record %s\n", record->name);
+    return 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,432 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \addtogroup oma-lwm2m
+ * @{
+ */
+
+/**
+ * \file
+ *         Implementation of the Contiki OMA LWM2M SenML JSON reader / writer
+ *
+ *         The writer outputs one pack per request with the base name set
+ *         in the first record of each object instance:
+ *         [{"bn":"/3/0/","n":"0","vs":"SICS"},{"n":"9","v":95}]
+ *         Values are formatted directly into the output buffer.
+ */
+
+#include "lwm2m-object.h"
+#include "lwm2m-senml.h"
+#include "lwm2m-json.h"
+#include "lwm2m-plain-text.h"
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+/* Number of decimals for fix point values */
+#define FRAC_DIGITS 3
+/*---------------------------------------------------------------------------*/
+/*
+ * The append functions return the new position in the output buffer or
+ * 0 if the output buffer is full.
+ */
+static size_t
+append_str(uint8_t *outbuf, size_t outlen, size_t pos, const char *str)
+{
+  size_t len = strlen(str);
+  if(pos + len > outlen) {
+    return 0;
+  }
+  memcpy(&outbuf[pos], str, len);
+  return pos + len;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+append_uint(uint8_t *outbuf, size_t outlen, size_t pos, uint32_t value)
+{
+  uint8_t digits[10];
+  int n = 0;
+
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while(value > 0);
+
+  if(pos + n > outlen) {
+    return 0;
+  }
+  while(n > 0) {
+    outbuf[pos++] = digits[--n];
+  }
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+append_int(uint8_t *outbuf, size_t outlen, size_t pos, int32_t value)
+{
+  if(value < 0) {
+    if(pos >= outlen) {
+      return 0;
+    }
+    outbuf[pos++] = '-';
+    return append_uint(outbuf, outlen, pos, -(uint32_t)value);
+  }
+  return append_uint(outbuf, outlen, pos, value);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+append_fix(uint8_t *outbuf, size_t outlen, size_t pos, int32_t value,
+           int bits)
+{
+  uint32_t v, integer_part, frac_part;
+  int n, i;
+
+  if(value < 0) {
+    if(pos >= outlen) {
+      return 0;
+    }
+    outbuf[pos++] = '-';
+    v = -(uint32_t)value;
+  } else {
+    v = value;
+  }
+
+  integer_part = v >> bits;
+  /* round the fraction to FRAC_DIGITS decimals */
+  frac_part = (uint32_t)((((uint64_t)(v & ((1UL << bits) - 1)) * 1000) +
+                          (1UL << (bits - 1))) >> bits);
+  if(frac_part >= 1000) {
+    integer_part++;
+    frac_part -= 1000;
+  }
+
+  pos = append_uint(outbuf, outlen, pos, integer_part);
+  if(pos == 0 || frac_part == 0) {
+    return pos;
+  }
+
+  /* strip trailing zeroes */
+  for(n = FRAC_DIGITS; frac_part % 10 == 0; n--) {
+    frac_part /= 10;
+  }
+  if(pos + 1 + n > outlen) {
+    return 0;
+  }
+  outbuf[pos++] = '.';
+  pos += n;
+  for(i = 1; i <= n; i++) {
+    outbuf[pos - i] = '0' + frac_part % 10;
+    frac_part /= 10;
+  }
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+init_write(lwm2m_context_t *ctx)
+{
+  ctx->writer_flags &= ~WRITER_SENML_BASE_NAME;
+  if(ctx->writer_flags & WRITER_SENML_STARTED) {
+    return 0;
+  }
+  if(ctx->outlen >= ctx->outsize) {
+    return 0;
+  }
+  ctx->outbuf[ctx->outlen] = '[';
+  ctx->writer_flags |= WRITER_SENML_STARTED;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+end_write(lwm2m_context_t *ctx)
+{
+  if(ctx->writer_flags & WRITER_MORE_INSTANCES) {
+    return 0;
+  }
+  if(ctx->outlen >= ctx->outsize) {
+    return 0;
+  }
+  ctx->outbuf[ctx->outlen] = ']';
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+enter_sub(lwm2m_context_t *ctx)
+{
+  PRINTF("Enter sub-resource rsc=%d\n", ctx->resource_id);
+  ctx->writer_flags |= WRITER_RESOURCE_INSTANCE;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+exit_sub(lwm2m_context_t *ctx)
+{
+  PRINTF("Exit sub-resource rsc=%d\n", ctx->resource_id);
+  ctx->writer_flags &= ~WRITER_RESOURCE_INSTANCE;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Writes the start of a record up to the value: {"bn":"/o/i/","n":"r","v */
+static size_t
+write_record_start(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+                   const char *value_name)
+{
+  size_t pos = 0;
+
+  if(ctx->writer_flags & WRITER_OUTPUT_VALUE) {
+    pos = append_str(outbuf, outlen, pos, ",{");
+  } else {
+    pos = append_str(outbuf, outlen, pos, "{");
+  }
+  if(pos > 0 && !(ctx->writer_flags & WRITER_SENML_BASE_NAME)) {
+    pos = append_str(outbuf, outlen, pos, "\"bn\":\"/");
+    pos = pos ? append_uint(outbuf, outlen, pos, ctx->object_id) : 0;
+    pos = pos ? append_str(outbuf, outlen, pos, "/") : 0;
+    pos = pos ? append_uint(outbuf, outlen, pos, ctx->object_instance_id) : 0;
+    pos = pos ? append_str(outbuf, outlen, pos, "/\",") : 0;
+  }
+  pos = pos ? append_str(outbuf, outlen, pos, "\"n\":\"") : 0;
+  pos = pos ? append_uint(outbuf, outlen, pos, ctx->resource_id) : 0;
+  if(pos > 0 && (ctx->writer_flags & WRITER_RESOURCE_INSTANCE)) {
+    pos = append_str(outbuf, outlen, pos, "/");
+    pos = pos ? append_uint(outbuf, outlen, pos,
+                            ctx->resource_instance_id) : 0;
+  }
+  pos = pos ? append_str(outbuf, outlen, pos, "\",\"") : 0;
+  pos = pos ? append_str(outbuf, outlen, pos, value_name) : 0;
+  pos = pos ? append_str(outbuf, outlen, pos, "\":") : 0;
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_record_end(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+                 size_t pos)
+{
+  pos = pos ? append_str(outbuf, outlen, pos, "}") : 0;
+  if(pos > 0) {
+    ctx->writer_flags |= WRITER_OUTPUT_VALUE | WRITER_SENML_BASE_NAME;
+  }
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_boolean(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+              int value)
+{
+  size_t pos;
+  pos = write_record_start(ctx, outbuf, outlen, "vb");
+  pos = pos ? append_str(outbuf, outlen, pos, value ? "true" : "false") : 0;
+  return write_record_end(ctx, outbuf, outlen, pos);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_int(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+          int32_t value)
+{
+  size_t pos;
+  pos = write_record_start(ctx, outbuf, outlen, "v");
+  pos = pos ? append_int(outbuf, outlen, pos, value) : 0;
+  return write_record_end(ctx, outbuf, outlen, pos);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_float32fix(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+                 int32_t value, int bits)
+{
+  size_t pos;
+  pos = write_record_start(ctx, outbuf, outlen, "v");
+  pos = pos ? append_fix(outbuf, outlen, pos, value, bits) : 0;
+  return write_record_end(ctx, outbuf, outlen, pos);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_string(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+             const char *value, size_t stringlen)
+{
+  static const char hex[] = "0123456789abcdef";
+  size_t pos;
+  size_t i;
+
+  pos = write_record_start(ctx, outbuf, outlen, "vs");
+  pos = pos ? append_str(outbuf, outlen, pos, "\"") : 0;
+  for(i = 0; pos > 0 && i < stringlen; i++) {
+    /* Escape special characters */
+    if((uint8_t)value[i] < 0x20) {
+      if(pos + 6 > outlen) {
+        return 0;
+      }
+      memcpy(&outbuf[pos], "\\u00", 4);
+      outbuf[pos + 4] = hex[(value[i] >> 4) & 0xf];
+      outbuf[pos + 5] = hex[value[i] & 0xf];
+      pos += 6;
+      continue;
+    }
+    if(value[i] == '"' || value[i] == '\\') {
+      if(pos >= outlen) {
+        return 0;
+      }
+      outbuf[pos++] = '\\';
+    }
+    if(pos >= outlen) {
+      return 0;
+    }
+    outbuf[pos++] = value[i];
+  }
+  pos = pos ? append_str(outbuf, outlen, pos, "\"") : 0;
+  return write_record_end(ctx, outbuf, outlen, pos);
+}
+/*---------------------------------------------------------------------------*/
+const lwm2m_writer_t lwm2m_senml_json_writer = {
+  init_write,
+  end_write,
+  enter_sub,
+  exit_sub,
+  write_int,
+  write_string,
+  write_float32fix,
+  write_boolean
+};
+/*---------------------------------------------------------------------------*/
+/* Numbers and strings are read as plain text, booleans are true/false */
+static size_t
+read_int(lwm2m_context_t *ctx, const uint8_t *inbuf, size_t len,
+         int32_t *value)
+{
+  return lwm2m_plain_text_reader.read_int(ctx, inbuf, len, value);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+read_string(lwm2m_context_t *ctx, const uint8_t *inbuf, size_t len,
+            uint8_t *value, size_t stringlen)
+{
+  return lwm2m_plain_text_reader.read_string(ctx, inbuf, len, value,
+                                             stringlen);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+read_float32fix(lwm2m_context_t *ctx, const uint8_t *inbuf, size_t len,
+                int32_t *value, int bits)
+{
+  return lwm2m_plain_text_reader.read_float32fix(ctx, inbuf, len, value,
+                                                 bits);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+read_boolean(lwm2m_context_t *ctx, const uint8_t *inbuf, size_t len,
+             int *value)
+{
+  if(len >= 4 && strncmp((const char *)inbuf, "true", 4) == 0) {
+    *value = 1;
+    ctx->last_value_len = 4;
+    return 4;
+  }
+  if(len >= 5 && strncmp((const char *)inbuf, "false", 5) == 0) {
+    *value = 0;
+    ctx->last_value_len = 5;
+    return 5;
+  }
+  return lwm2m_plain_text_reader.read_boolean(ctx, inbuf, len, value);
+}
+/*---------------------------------------------------------------------------*/
+const lwm2m_reader_t lwm2m_senml_json_reader = {
+  read_int,
+  read_string,
+  read_float32fix,
+  read_boolean
+};
+/*---------------------------------------------------------------------------*/
+int
+lwm2m_senml_json_next_record(lwm2m_context_t *ctx,
+                             lwm2m_senml_record_t *record)
+{
+  struct json_data json;
+  const uint8_t *name = NULL;
+  int name_len = 0;
+
+  record->value = NULL;
+  record->value_type = 0;
+  while(lwm2m_json_next_token(ctx, &json)) {
+    if(json.name_len == 2 && strncmp((char *)json.name, "bn", 2) == 0) {
+      if(json.value_len >= sizeof(record->base)) {
+        return -1;
+      }
+      memcpy(record->base, json.value, json.value_len);
+      record->base_len = json.value_len;
+    } else if(json.name_len == 1 && json.name[0] == 'n') {
+      name = json.value;
+      name_len = json.value_len;
+    } else if((json.name_len == 1 || json.name_len == 2) &&
+              json.name[0] == 'v') {
+      if(json.name_len == 1) {
+        record->value_type = LWM2M_SENML_VALUE;
+      } else if(json.name[1] == 's') {
+        record->value_type = LWM2M_SENML_STRING_VALUE;
+      } else if(json.name[1] == 'b') {
+        record->value_type = LWM2M_SENML_BOOL_VALUE;
+      } else if(json.name[1] == 'd') {
+        record->value_type = LWM2M_SENML_DATA_VALUE;
+      }
+      if(record->value_type != 0) {
+        record->value = json.value;
+        record->value_len = json.value_len;
+      }
+    }
+
+    if(ctx->inbuf[ctx->inpos - 1] != '}') {
+      /* More fields in this record */
+      continue;
+    }
+    if(name == NULL && record->value == NULL) {
+      /* Records without name and value only sets the base name */
+      continue;
+    }
+    if(record->base_len + name_len >= sizeof(record->name)) {
+      return -1;
+    }
+    memcpy(record->name, record->base, record->base_len);
+    if(name != NULL) {
+      memcpy(&record->name[record->base_len], name, name_len);
+    }
+    record->name_len = record->base_len + name_len;
+    record->name[record->name_len] = '\0';
+    record->started = 1;
+    PRINTF("SenML JSON record %s\n", record->name);
+    return 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \addtogroup oma-lwm2m
+ * @{
+ */
+
+/**
+ * \file
+ *         Header file for the Contiki OMA LWM2M SenML JSON and CBOR
+ *         readers / writers
+ */
+
+#ifndef LWM2M_SENML_H_
+#define LWM2M_SENML_H_
+
+#include "lwm2m-object.h"
+
+/* Room for a base name and name, e.g. "/65535/65535/65535/65535" */
+#define LWM2M_SENML_NAME_LEN 26
+
+/* Value types of SenML records */
+#define LWM2M_SENML_VALUE        1  /* v - number */
+#define LWM2M_SENML_STRING_VALUE 2  /* vs - string */
+#define LWM2M_SENML_BOOL_VALUE   3  /* vb - boolean */
+#define LWM2M_SENML_DATA_VALUE   4  /* vd - opaque data */
+
+/* Writer flags used by the SenML writers */
+#define WRITER_SENML_STARTED   0x40  /* the pack has been started */
+#define WRITER_SENML_BASE_NAME 0x80  /* base name written for the instance */
+
+/*
+ * One record of a SenML pack being read. The base name is kept between
+ * records and the name is the base name followed by the record name.
+ * The value is in the encoding of the pack and is read with the SenML
+ * reader of the same format. Records with a name but without a value,
+ * as in a list of paths, have the value set to NULL. Clear the record
+ * before reading the first.
+ */
+typedef struct lwm2m_senml_record {
+  const uint8_t *value;
+  uint16_t value_len;
+  uint8_t value_type;
+  uint8_t name_len;
+  uint8_t base_len;
+  uint8_t started;
+  int16_t records_left;
+  char name[LWM2M_SENML_NAME_LEN];
+  char base[LWM2M_SENML_NAME_LEN];
+} lwm2m_senml_record_t;
+
+extern const lwm2m_writer_t lwm2m_senml_json_writer;
+extern const lwm2m_reader_t lwm2m_senml_json_reader;
+extern const lwm2m_writer_t lwm2m_senml_cbor_writer;
+extern const lwm2m_reader_t lwm2m_senml_cbor_reader;
+
+/*
+ * Reads the next record from ctx->inbuf starting at ctx->inpos.
+ * Returns 1 if a record was read, 0 at the end of the pack and -1 if
+ * the pack could not be parsed.
+ */
+int lwm2m_senml_json_next_record(lwm2m_context_t *ctx,
+                                 lwm2m_senml_record_t *record);
+int lwm2m_senml_cbor_next_record(lwm2m_context_t *ctx,
+                                 lwm2m_senml_record_t *record);
+
+#endif /* LWM2M_SENML_H_ */
+/** @} */
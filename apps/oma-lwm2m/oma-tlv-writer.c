@@ -44,7 +44,7 @@
 
 #include "lwm2m-object.h"
 #include "oma-tlv.h"
-#define DEBUG 1
+#define DEBUG 0
 #if DEBUG
 #define PRINTF(...) printf(__VA_ARGS__)
 #else
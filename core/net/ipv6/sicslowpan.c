@@ -69,6 +69,10 @@
 #include "net/rime/rime.h"
 #include "net/ipv6/sicslowpan.h"
 #include "net/netstack.h"
+#if UIP_CONF_IPV6_RPL
+#include "net/rpl/rpl-dag-root.h"
+#include "net/rpl/rpl-private.h"
+#endif /* UIP_CONF_IPV6_RPL */
 
 #include <stdio.h>
 
@@ -115,6 +119,11 @@ void uip_log(char *msg);
 #define PACKETBUF_FRAG_TAG           2   /* 16 bit */
 #define PACKETBUF_FRAG_OFFSET        4   /* 8 bit */
 
+#define PACKETBUF_RFRAG_TAG          1   /* 8 bit */
+#define PACKETBUF_RFRAG_SEQ_SIZE     2   /* 16 bit */
+#define PACKETBUF_RFRAG_OFFSET       4   /* 16 bit */
+#define PACKETBUF_RFRAG_ACK_BITMAP   2   /* 32 bit */
+
 /* define the buffer as a byte array */
 #define PACKETBUF_IPHC_BUF              ((uint8_t *)(packetbuf_ptr + packetbuf_hdr_len))
 
@@ -251,6 +260,66 @@ static uint16_t my_tag;
 /* Assuming that the worst growth for uncompression is 38 bytes */
 #define SICSLOWPAN_FIRST_FRAGMENT_SIZE (SICSLOWPAN_FRAGMENT_SIZE + 38)
 
+/* Fragment forwarding: fragments of datagrams that are not for us are
+   relayed as they arrive through a virtual reassembly buffer (VRB)
+   instead of being reassembled at every hop. Only routers forward. */
+#ifdef SICSLOWPAN_CONF_FRAG_FORWARDING
+#define SICSLOWPAN_FRAG_FORWARDING SICSLOWPAN_CONF_FRAG_FORWARDING
+#else
+#define SICSLOWPAN_FRAG_FORWARDING 0
+#endif
+
+#if !UIP_CONF_ROUTER
+#undef SICSLOWPAN_FRAG_FORWARDING
+#define SICSLOWPAN_FRAG_FORWARDING 0
+#endif
+
+/* The number of datagrams that can be forwarded simultaneously */
+#ifdef SICSLOWPAN_CONF_VRB_ENTRIES
+#define SICSLOWPAN_VRB_ENTRIES SICSLOWPAN_CONF_VRB_ENTRIES
+#else
+#define SICSLOWPAN_VRB_ENTRIES 4
+#endif
+
+/* Selective fragment recovery: datagrams are fragmented with the RFRAG
+   dispatch, the receiver acknowledges the fragments it holds and the
+   sender retransmits only the missing ones. All nodes of the network
+   need the same setting. */
+#ifdef SICSLOWPAN_CONF_FRAG_RECOVERY
+#define SICSLOWPAN_FRAG_RECOVERY SICSLOWPAN_CONF_FRAG_RECOVERY
+#else
+#define SICSLOWPAN_FRAG_RECOVERY 0
+#endif
+
+/* The number of sent datagrams kept for retransmission. Each one costs
+   a copy of the datagram. */
+#ifdef SICSLOWPAN_CONF_FRAG_RECOVERY_BUFFERS
+#define SICSLOWPAN_FRAG_RECOVERY_BUFFERS SICSLOWPAN_CONF_FRAG_RECOVERY_BUFFERS
+#else
+#define SICSLOWPAN_FRAG_RECOVERY_BUFFERS 1
+#endif
+
+/* How long to wait for an acknowledgement before asking for one again */
+#ifdef SICSLOWPAN_CONF_FRAG_RECOVERY_TIMEOUT
+#define SICSLOWPAN_FRAG_RECOVERY_TIMEOUT SICSLOWPAN_CONF_FRAG_RECOVERY_TIMEOUT
+#else
+#define SICSLOWPAN_FRAG_RECOVERY_TIMEOUT CLOCK_SECOND
+#endif
+
+#ifdef SICSLOWPAN_CONF_FRAG_RECOVERY_RETRIES
+#define SICSLOWPAN_FRAG_RECOVERY_RETRIES SICSLOWPAN_CONF_FRAG_RECOVERY_RETRIES
+#else
+#define SICSLOWPAN_FRAG_RECOVERY_RETRIES 4
+#endif
+
+/* The RFRAG sequence number has 5 bits and the acknowledgement bitmap
+   has one bit per fragment, sequence 0 being the most significant */
+#define RFRAG_MAX_FRAGMENTS 32
+#define RFRAG_BIT(seq) (0x80000000UL >> (seq))
+
+/* Marks the end of a fragment buffer chain */
+#define FRAG_BUF_NONE 0xff
+
 /* all information needed for reassembly */
 struct sicslowpan_frag_info {
   /** When reassembling, the source address of the fragments being merged */
@@ -265,6 +334,12 @@ struct sicslowpan_frag_info {
   uint16_t reassembled_len;
   /** Reassembly %process %timer. */
   struct timer reass_timer;
+  /** Head of the chain of frag_buf entries holding the other fragments */
+  uint8_t first_buf;
+#if SICSLOWPAN_FRAG_RECOVERY
+  /** The RFRAG sequence numbers received so far */
+  uint32_t rfrag_bitmap;
+#endif /* SICSLOWPAN_FRAG_RECOVERY */
 
   /** Fragment size of first fragment */
   uint16_t first_frag_len;
@@ -276,8 +351,8 @@ struct sicslowpan_frag_info {
 static struct sicslowpan_frag_info frag_info[SICSLOWPAN_REASS_CONTEXTS];
 
 struct sicslowpan_frag_buf {
-  /* the index of the frag_info */
-  uint8_t index;
+  /* the next buffer of the same datagram, or of the free list */
+  uint8_t next;
   /* Fragment offset */
   uint8_t offset;
   /* Length of this fragment (if zero this buffer is not allocated) */
@@ -287,19 +362,99 @@ struct sicslowpan_frag_buf {
 
 static struct sicslowpan_frag_buf frag_buf[SICSLOWPAN_FRAGMENT_BUFFERS];
 
+/* Head of the chain of unallocated fragment buffers */
+static uint8_t frag_buf_free;
+
+#if SICSLOWPAN_FRAG_FORWARDING
+/* Fragment offsets are in units of 8 bytes, and relayed datagrams are
+   no longer than the link MTU */
+#define VRB_UNITS(len) (((len) + 7) >> 3)
+#define VRB_MAX_UNITS VRB_UNITS(UIP_LINK_MTU)
+
+/* A virtual reassembly buffer: the state needed to relay the fragments
+   of one datagram without reassembling it */
+struct sicslowpan_vrb {
+  /** The link-layer source and tag of the incoming fragments */
+  linkaddr_t sender;
+  uint16_t in_tag;
+  /** The next hop and tag of the forwarded fragments */
+  linkaddr_t nexthop;
+  uint16_t out_tag;
+  /** Total length of the datagram (if zero the entry is not used) */
+  uint16_t size;
+  /** Number of 8-byte units of the datagram forwarded so far */
+  uint16_t forwarded;
+  /** The 8-byte units forwarded, so that duplicates are not counted */
+  uint8_t units[(VRB_MAX_UNITS + 7) / 8];
+  struct timer timer;
+};
+
+static struct sicslowpan_vrb vrb_table[SICSLOWPAN_VRB_ENTRIES];
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+
+#if SICSLOWPAN_FRAG_RECOVERY
+/* A datagram sent with RFRAG fragments, kept until the receiver has
+   acknowledged all of them */
+struct sicslowpan_rfrag_tx {
+  struct ctimer timer;
+  linkaddr_t dest;
+  /** Length of the datagram (if zero the entry is not used) */
+  uint16_t len;
+  /** Offset in the datagram at which the second fragment starts */
+  uint16_t first_end;
+  /** Payload size of all fragments but the first and the last */
+  uint16_t chunk;
+  uint8_t tag;
+  uint8_t count;
+  uint8_t retries;
+  /** The compressed header sent in the first fragment */
+  uint8_t hdr_len;
+  uint8_t uncomp_hdr_len;
+  uint8_t hdr[UIP_IPUDPH_LEN + 8];
+  uint8_t buf[UIP_BUFSIZE - UIP_LLH_LEN];
+};
+
+static struct sicslowpan_rfrag_tx rfrag_tx[SICSLOWPAN_FRAG_RECOVERY_BUFFERS];
+
+/* The last datagram reassembled from RFRAG fragments, so that late
+   acknowledgement requests for it do not trigger a full retransmission */
+static struct {
+  linkaddr_t sender;
+  uint32_t bitmap;
+  uint8_t tag;
+} rfrag_done;
+#endif /* SICSLOWPAN_FRAG_RECOVERY */
+
+/*---------------------------------------------------------------------------*/
+static void
+init_fragments(void)
+{
+  int i;
+  for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
+    frag_info[i].len = 0;
+    frag_info[i].first_buf = FRAG_BUF_NONE;
+  }
+  for(i = 0; i < SICSLOWPAN_FRAGMENT_BUFFERS; i++) {
+    frag_buf[i].len = 0;
+    frag_buf[i].next = i + 1 < SICSLOWPAN_FRAGMENT_BUFFERS ? i + 1 : FRAG_BUF_NONE;
+  }
+  frag_buf_free = 0;
+}
 /*---------------------------------------------------------------------------*/
 static int
 clear_fragments(uint8_t frag_info_index)
 {
-  int i, clear_count;
+  int clear_count;
+  uint8_t i;
   clear_count = 0;
   frag_info[frag_info_index].len = 0;
-  for(i = 0; i < SICSLOWPAN_FRAGMENT_BUFFERS; i++) {
-    if(frag_buf[i].len > 0 && frag_buf[i].index == frag_info_index) {
-      /* deallocate the buffer */
-      frag_buf[i].len = 0;
-      clear_count++;
-    }
+  while((i = frag_info[frag_info_index].first_buf) != FRAG_BUF_NONE) {
+    /* deallocate the buffer */
+    frag_info[frag_info_index].first_buf = frag_buf[i].next;
+    frag_buf[i].len = 0;
+    frag_buf[i].next = frag_buf_free;
+    frag_buf_free = i;
+    clear_count++;
   }
   return clear_count;
 }
@@ -322,22 +477,43 @@ timeout_fragments(int not_context)
 static int
 store_fragment(uint8_t index, uint8_t offset)
 {
-  int i;
-  for(i = 0; i < SICSLOWPAN_FRAGMENT_BUFFERS; i++) {
-    if(frag_buf[i].len == 0) {
-      /* copy over the data from packetbuf into the fragment buffer and store offset and len */
-      frag_buf[i].offset = offset; /* frag offset */
-      frag_buf[i].len = packetbuf_datalen() - packetbuf_hdr_len;
-      frag_buf[i].index = index;
-      memcpy(frag_buf[i].data, packetbuf_ptr + packetbuf_hdr_len,
-             packetbuf_datalen() - packetbuf_hdr_len);
-
-      PRINTF("Fragsize: %d\n", frag_buf[i].len);
-      /* return the length of the stored fragment */
-      return frag_buf[i].len;
+  uint8_t i;
+
+  i = frag_buf_free;
+  if(i == FRAG_BUF_NONE ||
+     packetbuf_datalen() - packetbuf_hdr_len > SICSLOWPAN_FRAGMENT_SIZE) {
+    /* failed */
+    return -1;
+  }
+
+  /* copy over the data from packetbuf into the fragment buffer and store offset and len */
+  frag_buf_free = frag_buf[i].next;
+  frag_buf[i].offset = offset; /* frag offset */
+  frag_buf[i].len = packetbuf_datalen() - packetbuf_hdr_len;
+  memcpy(frag_buf[i].data, packetbuf_ptr + packetbuf_hdr_len,
+         packetbuf_datalen() - packetbuf_hdr_len);
+
+  /* chain it to the datagram it belongs to */
+  frag_buf[i].next = frag_info[index].first_buf;
+  frag_info[index].first_buf = i;
+
+  PRINTF("Fragsize: %d\n", frag_buf[i].len);
+  /* return the length of the stored fragment */
+  return frag_buf[i].len;
+}
+/*---------------------------------------------------------------------------*/
+/* find the reassembly context of an N-fragment */
+static int8_t
+find_fragment_context(uint16_t tag)
+{
+  int8_t i;
+  for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
+    if(frag_info[i].tag == tag && frag_info[i].len > 0 &&
+       linkaddr_cmp(&frag_info[i].sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
+      /* Tag and Sender match - this must be the correct info to store in */
+      return i;
     }
   }
-  /* failed */
   return -1;
 }
 /*---------------------------------------------------------------------------*/
@@ -382,14 +558,7 @@ add_fragment(uint16_t tag, uint16_t frag_size, uint8_t offset)
   }
 
   /* This is a N-fragment - should find the info */
-  for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
-    if(frag_info[i].tag == tag && frag_info[i].len > 0 &&
-       linkaddr_cmp(&frag_info[i].sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
-      /* Tag and Sender match - this must be the correct info to store in */
-      found = i;
-      break;
-    }
-  }
+  found = find_fragment_context(tag);
 
   if(found < 0) {
     /* no entry found for storing the new fragment */
@@ -397,7 +566,7 @@ add_fragment(uint16_t tag, uint16_t frag_size, uint8_t offset)
     return -1;
   }
 
-  /* i is the index of the reassembly context */
+  i = found;
   len = store_fragment(i, offset);
   if(len < 0 && timeout_fragments(i) > 0) {
     len = store_fragment(i, offset);
@@ -418,17 +587,15 @@ add_fragment(uint16_t tag, uint16_t frag_size, uint8_t offset)
 static void
 copy_frags2uip(int context)
 {
-  int i;
+  uint8_t i;
 
   /* Copy from the fragment context info buffer first */
   memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)frag_info[context].first_frag,
 	 frag_info[context].first_frag_len);
-  for(i = 0; i < SICSLOWPAN_FRAGMENT_BUFFERS; i++) {
-    /* And also copy all matching fragments */
-    if(frag_buf[i].len > 0 && frag_buf[i].index == context) {
-      memcpy((uint8_t *)UIP_IP_BUF + (uint16_t)(frag_buf[i].offset << 3),
-	     (uint8_t *)frag_buf[i].data, frag_buf[i].len);
-    }
+  for(i = frag_info[context].first_buf; i != FRAG_BUF_NONE; i = frag_buf[i].next) {
+    /* And also copy all fragments of the chain */
+    memcpy((uint8_t *)UIP_IP_BUF + (uint16_t)(frag_buf[i].offset << 3),
+	   (uint8_t *)frag_buf[i].data, frag_buf[i].len);
   }
   /* deallocate all the fragments for this context */
   clear_fragments(context);
@@ -1261,6 +1428,606 @@ send_packet(linkaddr_t *dest)
      watchdog know that we are still alive. */
   watchdog_periodic();
 }
+#if SICSLOWPAN_FRAG_FORWARDING
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Check whether a datagram, of which we have the first fragment,
+ * can be forwarded fragment by fragment.
+ *
+ * Datagrams that need more than a header update are left to the
+ * regular reassembly path: datagrams that a router may have to answer
+ * with an ICMP error, datagrams for this node and datagrams that the
+ * RPL root has to rewrite.
+ */
+static int
+vrb_forwardable(struct uip_ip_hdr *ip, uint16_t len)
+{
+  if((ip->vtc & 0xf0) != 0x60 || len > UIP_LINK_MTU || ip->ttl <= 1) {
+    return 0;
+  }
+  if(uip_ds6_is_my_addr(&ip->destipaddr) ||
+     uip_ds6_is_my_maddr(&ip->destipaddr) ||
+     uip_is_addr_mcast(&ip->destipaddr) ||
+     uip_is_addr_linklocal(&ip->destipaddr) ||
+     uip_is_addr_loopback(&ip->destipaddr) ||
+     uip_is_addr_linklocal(&ip->srcipaddr) ||
+     uip_is_addr_unspecified(&ip->srcipaddr) ||
+     uip_ds6_is_my_addr(&ip->srcipaddr)) {
+    return 0;
+  }
+#if UIP_CONF_IPV6_RPL
+  if(rpl_dag_root_is_root()) {
+    /* The root inserts or removes RPL extension headers */
+    return 0;
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Process the extension headers of the first fragment in uip_buf
+ * that uip_process() handles before forwarding a datagram.
+ * \param len The length of the uncompressed first fragment
+ * \return 1 if the datagram may be forwarded, 0 if it has to be
+ * reassembled
+ *
+ * Only a Hop-by-Hop header holding the RPL option and a RPL source
+ * routing header are supported, and they must be entirely in the first
+ * fragment. When this node is the current segment of the source route,
+ * the route is advanced as rpl_process_srh_header() does, which
+ * changes the destination address.
+ */
+static int
+vrb_ext_headers(uint16_t len)
+{
+  struct uip_routing_hdr *rh;
+  uint16_t ext_len;
+  uint8_t proto;
+
+  ext_len = 0;
+  proto = UIP_IP_BUF->proto;
+  if(proto == UIP_PROTO_HBHO) {
+#if UIP_CONF_IPV6_RPL
+    struct uip_ext_hdr *ext = (struct uip_ext_hdr *)&uip_buf[UIP_LLIPH_LEN];
+
+    ext_len = (ext->len << 3) + 8;
+    if(len < UIP_IPH_LEN + RPL_HOP_BY_HOP_LEN || len < UIP_IPH_LEN + ext_len ||
+       uip_buf[UIP_LLIPH_LEN + 2] != UIP_EXT_HDR_OPT_RPL) {
+      return 0;
+    }
+    proto = ext->next;
+#else /* UIP_CONF_IPV6_RPL */
+    return 0;
+#endif /* UIP_CONF_IPV6_RPL */
+  }
+
+  if(proto != UIP_PROTO_ROUTING ||
+     !uip_ds6_is_my_addr(&UIP_IP_BUF->destipaddr)) {
+    /* Routing headers are processed only by the current segment */
+    return 1;
+  }
+
+  rh = (struct uip_routing_hdr *)&uip_buf[UIP_LLIPH_LEN + ext_len];
+  if(len < UIP_IPH_LEN + ext_len + sizeof(struct uip_routing_hdr) ||
+     len < UIP_IPH_LEN + ext_len + (rh->len << 3) + 8 ||
+     rh->seg_left == 0) {
+    return 0;
+  }
+#if UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING
+  if(rh->routing_type == RPL_RH_TYPE_SRH) {
+    return rpl_process_srh_header();
+  }
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING */
+  return 0;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Find the link-layer address of the next hop towards a
+ * destination, the same way tcpip_ipv6_output() does but without
+ * triggering neighbor discovery.
+ */
+static const uip_lladdr_t *
+vrb_nexthop(uip_ipaddr_t *destipaddr)
+{
+  uip_ipaddr_t *nexthop;
+  uip_ds6_route_t *route;
+  uip_ds6_nbr_t *nbr;
+
+#if UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING
+  uip_ipaddr_t ipaddr;
+
+  /* Look for a RPL source route in uip_buf */
+  if(rpl_srh_get_next_hop(&ipaddr)) {
+    nexthop = &ipaddr;
+  } else
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING */
+  if(uip_ds6_is_addr_onlink(destipaddr)) {
+    nexthop = destipaddr;
+  } else {
+    route = uip_ds6_route_lookup(destipaddr);
+    if(route != NULL) {
+      nexthop = uip_ds6_route_nexthop(route);
+    } else {
+      nexthop = uip_ds6_defrt_choose();
+    }
+  }
+  if(nexthop == NULL) {
+    return NULL;
+  }
+
+  nbr = uip_ds6_nbr_lookup(nexthop);
+  if(nbr == NULL || nbr->state == NBR_INCOMPLETE) {
+    return NULL;
+  }
+  return uip_ds6_nbr_get_ll(nbr);
+}
+/*--------------------------------------------------------------------*/
+static struct sicslowpan_vrb *
+vrb_lookup(uint16_t tag)
+{
+  int i;
+  for(i = 0; i < SICSLOWPAN_VRB_ENTRIES; i++) {
+    if(vrb_table[i].size > 0 && timer_expired(&vrb_table[i].timer)) {
+      vrb_table[i].size = 0;
+    }
+    if(vrb_table[i].size > 0 && vrb_table[i].in_tag == tag &&
+       linkaddr_cmp(&vrb_table[i].sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
+      return &vrb_table[i];
+    }
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Forward the first fragment of a datagram that is not for us.
+ * \param context The reassembly context holding the uncompressed first
+ * fragment
+ * \return 1 if the fragment was forwarded or the datagram dropped, and
+ * the context released, 0 if the datagram has to be reassembled
+ *
+ * The IP header is compressed again for the next hop and the fragment is
+ * sent under a new tag. The fragment keeps the same extent in the
+ * uncompressed datagram, so the offsets of the following fragments
+ * remain valid and they are relayed by vrb_forward_next()
+ * with only the tag rewritten. This overwrites uip_buf and packetbuf.
+ */
+static int
+vrb_forward_first(int8_t context)
+{
+  struct sicslowpan_frag_info *info = &frag_info[context];
+  struct sicslowpan_vrb *vrb;
+  const uip_lladdr_t *lladdr;
+  linkaddr_t dest;
+  int framer_hdrlen;
+  int payload_len;
+  int i;
+
+  vrb = NULL;
+  for(i = 0; i < SICSLOWPAN_VRB_ENTRIES; i++) {
+    if(vrb_table[i].size == 0 || timer_expired(&vrb_table[i].timer)) {
+      vrb = &vrb_table[i];
+      break;
+    }
+  }
+  if(vrb == NULL) {
+    PRINTFI("sicslowpan input: no free VRB, reassembling\n");
+    return 0;
+  }
+
+  /* The header processing and compression work on uip_buf. The first
+     fragment is left untouched in case the datagram is reassembled. */
+  memcpy((uint8_t *)UIP_IP_BUF, info->first_frag, info->first_frag_len);
+  if(!vrb_ext_headers(info->first_frag_len) ||
+     !vrb_forwardable(UIP_IP_BUF, info->len)) {
+    return 0;
+  }
+  lladdr = vrb_nexthop(&UIP_IP_BUF->destipaddr);
+  if(lladdr == NULL) {
+    PRINTFI("sicslowpan input: no next hop to forward to, reassembling\n");
+    return 0;
+  }
+  linkaddr_copy(&dest, (const linkaddr_t *)lladdr);
+
+#if UIP_CONF_IPV6_RPL
+  /* Verify and update the RPL option like uip_process() and
+     tcpip_ipv6_output() do, dropping the datagram on errors */
+  uip_ext_len = 0;
+  if((UIP_IP_BUF->proto == UIP_PROTO_HBHO &&
+      !rpl_verify_hbh_header(2)) || !rpl_update_header()) {
+    PRINTFI("sicslowpan input: RPL header error, dropping tag %u\n", info->tag);
+    UIP_STAT(++uip_stat.ip.drop);
+    clear_fragments(context);
+    return 1;
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+  UIP_IP_BUF->ttl = UIP_IP_BUF->ttl - 1;
+
+  uncomp_hdr_len = 0;
+  packetbuf_hdr_len = 0;
+  packetbuf_clear();
+  packetbuf_ptr = packetbuf_dataptr();
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+  compress_hdr_iphc(&dest);
+#else /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+  compress_hdr_ipv6(&dest);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+
+#ifndef SICSLOWPAN_USE_FIXED_HDRLEN
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &dest);
+  framer_hdrlen = NETSTACK_FRAMER.length();
+  if(framer_hdrlen < 0) {
+    framer_hdrlen = SICSLOWPAN_FIXED_HDRLEN;
+  }
+#else /* USE_FRAMER_HDRLEN */
+  framer_hdrlen = SICSLOWPAN_FIXED_HDRLEN;
+#endif /* USE_FRAMER_HDRLEN */
+
+  /* The compressed header for the next hop may be larger than the one
+     the fragment arrived with */
+  payload_len = info->first_frag_len - uncomp_hdr_len;
+  if(payload_len < 0 ||
+     packetbuf_hdr_len + SICSLOWPAN_FRAG1_HDR_LEN + payload_len >
+     MAC_MAX_PAYLOAD - framer_hdrlen) {
+    PRINTFI("sicslowpan input: first fragment too large to forward, reassembling\n");
+    return 0;
+  }
+
+  memmove(packetbuf_ptr + SICSLOWPAN_FRAG1_HDR_LEN, packetbuf_ptr, packetbuf_hdr_len);
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
+        ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | info->len));
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, my_tag);
+  packetbuf_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
+  memcpy(packetbuf_ptr + packetbuf_hdr_len,
+         (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, payload_len);
+  packetbuf_set_datalen(packetbuf_hdr_len + payload_len);
+
+  linkaddr_copy(&vrb->sender, &info->sender);
+  vrb->in_tag = info->tag;
+  linkaddr_copy(&vrb->nexthop, &dest);
+  vrb->out_tag = my_tag++;
+  vrb->size = info->len;
+  vrb->forwarded = VRB_UNITS(info->first_frag_len);
+  memset(vrb->units, 0, sizeof(vrb->units));
+  for(i = 0; i < vrb->forwarded; i++) {
+    vrb->units[i >> 3] |= 0x80 >> (i & 7);
+  }
+  timer_set(&vrb->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 16);
+  clear_fragments(context);
+
+  PRINTFI("sicslowpan input: forwarding tag %u as %u\n", vrb->in_tag, vrb->out_tag);
+  UIP_STAT(++uip_stat.ip.forwarded);
+  send_packet(&dest);
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Forward an N-fragment of a datagram whose first fragment was
+ * forwarded.
+ * \param tag The tag of the fragment
+ * \param offset The offset of the fragment in units of 8 bytes
+ * \return 1 if the fragment was forwarded or dropped, 0 if it belongs
+ * to no VRB
+ *
+ * Only the units of the datagram not forwarded before are counted, so
+ * that duplicate fragments are dropped and do not close the VRB early.
+ */
+static int
+vrb_forward_next(uint16_t tag, uint8_t offset)
+{
+  struct sicslowpan_vrb *vrb;
+  uint8_t *ptr;
+  uint16_t len;
+  uint16_t unit, end, added;
+
+  vrb = vrb_lookup(tag);
+  if(vrb == NULL) {
+    return 0;
+  }
+
+  end = offset + VRB_UNITS(packetbuf_datalen() - SICSLOWPAN_FRAGN_HDR_LEN);
+  if(end > VRB_UNITS(vrb->size)) {
+    PRINTFI("sicslowpan input: fragment past the datagram, dropping tag %u\n", tag);
+    return 1;
+  }
+  added = 0;
+  for(unit = offset; unit < end; unit++) {
+    if(!(vrb->units[unit >> 3] & (0x80 >> (unit & 7)))) {
+      vrb->units[unit >> 3] |= 0x80 >> (unit & 7);
+      added++;
+    }
+  }
+  if(added == 0) {
+    PRINTFI("sicslowpan input: duplicate fragment, dropping tag %u\n", tag);
+    return 1;
+  }
+
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, vrb->out_tag);
+  vrb->forwarded += added;
+  if(vrb->forwarded >= VRB_UNITS(vrb->size)) {
+    /* This was the last fragment */
+    vrb->size = 0;
+  }
+
+  /* Move the fragment to a clean packetbuf, leaving room for the
+     MAC header */
+  ptr = packetbuf_dataptr();
+  len = packetbuf_datalen();
+  packetbuf_clear();
+  memmove(packetbuf_dataptr(), ptr, len);
+  packetbuf_set_datalen(len);
+
+  send_packet(&vrb->nexthop);
+  return 1;
+}
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+
+#if SICSLOWPAN_FRAG_RECOVERY
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Send one RFRAG fragment of a datagram kept for recovery.
+ *
+ * RFRAG header, modelled on RFC 8931:
+ * \verbatim
+ * 0                   1                   2                   3
+ * 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |1 1 1 0 1 0 0|0|  Datagram_Tag |X| Sequence|   Fragment_Size   |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |   Fragment_Offset / Size      |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * \endverbatim
+ * X requests an acknowledgement. The last field is the offset of the
+ * fragment in the uncompressed datagram, or the datagram size in the
+ * first fragment, which also carries the compressed IP header.
+ */
+static void
+rfrag_send(struct sicslowpan_rfrag_tx *tx, uint8_t seq, uint8_t ack_req)
+{
+  uint16_t offset;
+  uint16_t len;
+  uint8_t hdr_len;
+
+  packetbuf_clear();
+  packetbuf_ptr = packetbuf_dataptr();
+
+  hdr_len = SICSLOWPAN_RFRAG_HDR_LEN;
+  if(seq == 0) {
+    offset = tx->uncomp_hdr_len;
+    len = tx->first_end - offset;
+    memcpy(packetbuf_ptr + hdr_len, tx->hdr, tx->hdr_len);
+    hdr_len += tx->hdr_len;
+    SET16(PACKETBUF_FRAG_PTR, PACKETBUF_RFRAG_OFFSET, tx->len);
+  } else {
+    offset = tx->first_end + (seq - 1) * tx->chunk;
+    len = tx->chunk;
+    if(tx->len - offset < len) {
+      /* last fragment */
+      len = tx->len - offset;
+    }
+    SET16(PACKETBUF_FRAG_PTR, PACKETBUF_RFRAG_OFFSET, offset);
+  }
+
+  PACKETBUF_FRAG_PTR[0] = SICSLOWPAN_DISPATCH_RFRAG;
+  PACKETBUF_FRAG_PTR[PACKETBUF_RFRAG_TAG] = tx->tag;
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_RFRAG_SEQ_SIZE,
+        (ack_req ? 0x8000 : 0) | (seq << 10) |
+        ((hdr_len - SICSLOWPAN_RFRAG_HDR_LEN + len) & 0x03ff));
+  memcpy(packetbuf_ptr + hdr_len, tx->buf + offset, len);
+  packetbuf_set_datalen(hdr_len + len);
+
+  PRINTFO("sicslowpan output: RFRAG (seq %u, offset %u, len %u, tag %u%s)\n",
+          seq, offset, len, tx->tag, ack_req ? ", ack req" : "");
+  send_packet(&tx->dest);
+}
+/*--------------------------------------------------------------------*/
+static void
+rfrag_timeout(void *ptr)
+{
+  struct sicslowpan_rfrag_tx *tx = ptr;
+
+  if(++tx->retries > SICSLOWPAN_FRAG_RECOVERY_RETRIES) {
+    PRINTFO("sicslowpan output: RFRAG tag %u not acknowledged, giving up\n", tx->tag);
+    tx->len = 0;
+    return;
+  }
+  /* Resending the last fragment asks for the current bitmap */
+  rfrag_send(tx, tx->count - 1, 1);
+  ctimer_set(&tx->timer, SICSLOWPAN_FRAG_RECOVERY_TIMEOUT, rfrag_timeout, tx);
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Send the fragments of a datagram with recovery.
+ * \return 1 if the fragments were sent, 0 if the datagram must be sent
+ * with RFC 4944 fragments instead: it does not fit the RFRAG sequence
+ * space or no recovery buffer is free
+ *
+ * The datagram is in uip_buf and its compressed header in packetbuf.
+ */
+static int
+rfrag_output(const linkaddr_t *dest, int max_payload)
+{
+  struct sicslowpan_rfrag_tx *tx;
+  uint16_t first_end;
+  uint16_t chunk;
+  int count;
+  int i;
+
+  first_end = uncomp_hdr_len +
+    ((max_payload - packetbuf_hdr_len - SICSLOWPAN_RFRAG_HDR_LEN) & 0xfff8);
+  chunk = (max_payload - SICSLOWPAN_RFRAG_HDR_LEN) & 0xfff8;
+  if(max_payload - packetbuf_hdr_len - SICSLOWPAN_RFRAG_HDR_LEN < 8 ||
+     packetbuf_hdr_len > sizeof(rfrag_tx[0].hdr) || uip_len > sizeof(rfrag_tx[0].buf)) {
+    return 0;
+  }
+  count = 1 + (uip_len - first_end + chunk - 1) / chunk;
+  if(count > RFRAG_MAX_FRAGMENTS) {
+    return 0;
+  }
+
+  tx = NULL;
+  for(i = 0; i < SICSLOWPAN_FRAG_RECOVERY_BUFFERS; i++) {
+    if(rfrag_tx[i].len == 0) {
+      tx = &rfrag_tx[i];
+      break;
+    }
+  }
+  if(tx == NULL) {
+    PRINTFO("sicslowpan output: no free RFRAG buffer\n");
+    return 0;
+  }
+
+  linkaddr_copy(&tx->dest, dest);
+  tx->len = uip_len;
+  tx->first_end = first_end;
+  tx->chunk = chunk;
+  tx->tag = my_tag++;
+  tx->count = count;
+  tx->retries = 0;
+  tx->hdr_len = packetbuf_hdr_len;
+  tx->uncomp_hdr_len = uncomp_hdr_len;
+  memcpy(tx->hdr, packetbuf_ptr, packetbuf_hdr_len);
+  memcpy(tx->buf, (uint8_t *)UIP_IP_BUF, uip_len);
+
+  for(i = 0; i < count; i++) {
+    rfrag_send(tx, i, i == count - 1);
+  }
+  ctimer_set(&tx->timer, SICSLOWPAN_FRAG_RECOVERY_TIMEOUT, rfrag_timeout, tx);
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Send an RFRAG acknowledgement.
+ *
+ * \verbatim
+ * 0                   1                   2                   3
+ * 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |1 1 1 0 1 0 1|0|  Datagram_Tag |   RFRAG_Ack_Bitmap ...
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  ...                            |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * \endverbatim
+ * An empty bitmap asks for the whole datagram again.
+ */
+static void
+rfrag_send_ack(linkaddr_t *dest, uint8_t tag, uint32_t bitmap)
+{
+  packetbuf_clear();
+  packetbuf_ptr = packetbuf_dataptr();
+  PACKETBUF_FRAG_PTR[0] = SICSLOWPAN_DISPATCH_RFRAG_ACK;
+  PACKETBUF_FRAG_PTR[PACKETBUF_RFRAG_TAG] = tag;
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_RFRAG_ACK_BITMAP, bitmap >> 16);
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_RFRAG_ACK_BITMAP + 2, bitmap & 0xffff);
+  packetbuf_set_datalen(SICSLOWPAN_RFRAG_ACK_HDR_LEN);
+
+  PRINTFI("sicslowpan input: RFRAG ack tag %u bitmap %08lx\n",
+          tag, (unsigned long)bitmap);
+  send_packet(dest);
+}
+/*--------------------------------------------------------------------*/
+/* Process an RFRAG acknowledgement: retransmit what is missing */
+static void
+rfrag_ack_input(void)
+{
+  struct sicslowpan_rfrag_tx *tx;
+  uint32_t missing;
+  uint8_t tag;
+  int last;
+  int i;
+
+  if(packetbuf_datalen() < SICSLOWPAN_RFRAG_ACK_HDR_LEN) {
+    return;
+  }
+  tag = PACKETBUF_FRAG_PTR[PACKETBUF_RFRAG_TAG];
+  tx = NULL;
+  for(i = 0; i < SICSLOWPAN_FRAG_RECOVERY_BUFFERS; i++) {
+    if(rfrag_tx[i].len > 0 && rfrag_tx[i].tag == tag &&
+       linkaddr_cmp(&rfrag_tx[i].dest, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
+      tx = &rfrag_tx[i];
+      break;
+    }
+  }
+  if(tx == NULL) {
+    return;
+  }
+
+  missing = ~(((uint32_t)GET16(PACKETBUF_FRAG_PTR, PACKETBUF_RFRAG_ACK_BITMAP) << 16) |
+              GET16(PACKETBUF_FRAG_PTR, PACKETBUF_RFRAG_ACK_BITMAP + 2));
+  missing &= ~(RFRAG_BIT(tx->count - 1) - 1);
+  if(missing == 0) {
+    PRINTFI("sicslowpan input: RFRAG tag %u acknowledged\n", tag);
+    ctimer_stop(&tx->timer);
+    tx->len = 0;
+    return;
+  }
+
+  if(++tx->retries > SICSLOWPAN_FRAG_RECOVERY_RETRIES) {
+    PRINTFI("sicslowpan input: RFRAG tag %u still incomplete, giving up\n", tag);
+    ctimer_stop(&tx->timer);
+    tx->len = 0;
+    return;
+  }
+
+  last = tx->count - 1;
+  while((missing & RFRAG_BIT(last)) == 0) {
+    last--;
+  }
+  for(i = 0; i <= last; i++) {
+    if(missing & RFRAG_BIT(i)) {
+      rfrag_send(tx, i, i == last);
+    }
+  }
+  ctimer_set(&tx->timer, SICSLOWPAN_FRAG_RECOVERY_TIMEOUT, rfrag_timeout, tx);
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Find or create the reassembly context of an RFRAG fragment.
+ * \return The context, or -1 if the fragment is not to be stored
+ *
+ * Fragments that were already received are dropped, and answered with
+ * the current bitmap if the sender asks for it.
+ */
+static int8_t
+rfrag_add_fragment(uint8_t tag, uint16_t frag_size, uint8_t offset,
+                   uint8_t seq, uint8_t ack_req)
+{
+  linkaddr_t sender;
+  int8_t context;
+
+  linkaddr_copy(&sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  if(rfrag_done.tag == tag && linkaddr_cmp(&rfrag_done.sender, &sender) &&
+     (rfrag_done.bitmap & RFRAG_BIT(seq))) {
+    if(ack_req) {
+      rfrag_send_ack(&sender, tag, rfrag_done.bitmap);
+    }
+    return -1;
+  }
+
+  context = find_fragment_context(tag);
+  if(context >= 0 && (frag_info[context].rfrag_bitmap & RFRAG_BIT(seq))) {
+    if(ack_req) {
+      rfrag_send_ack(&sender, tag, frag_info[context].rfrag_bitmap);
+    }
+    return -1;
+  }
+  if(context < 0 && seq != 0) {
+    /* The first fragment was lost */
+    if(ack_req) {
+      rfrag_send_ack(&sender, tag, 0);
+    }
+    return -1;
+  }
+
+  context = add_fragment(tag, frag_size, offset);
+  if(context >= 0) {
+    if(seq == 0) {
+      frag_info[context].rfrag_bitmap = 0;
+    }
+    frag_info[context].rfrag_bitmap |= RFRAG_BIT(seq);
+  }
+  return context;
+}
+#endif /* SICSLOWPAN_FRAG_RECOVERY */
 /*--------------------------------------------------------------------*/
 /** \brief Take an IP packet and format it to be sent on an 802.15.4
  *  network using 6lowpan.
@@ -1375,6 +2142,12 @@ output(const uip_lladdr_t *localdest)
       return 0;
     }
 
+#if SICSLOWPAN_FRAG_RECOVERY
+    if(rfrag_output(&dest, max_payload)) {
+      return 1;
+    }
+#endif /* SICSLOWPAN_FRAG_RECOVERY */
+
     PRINTFO("Fragmentation sending packet len %d\n", uip_len);
 
     /* Create 1st Fragment */
@@ -1516,6 +2289,11 @@ input(void)
   uint16_t frag_tag = 0;
   uint8_t first_fragment = 0, last_fragment = 0;
 #endif /*SICSLOWPAN_CONF_FRAG*/
+#if SICSLOWPAN_FRAG_RECOVERY
+  uint8_t rfrag = 0, rfrag_seq = 0, rfrag_ack_req = 0;
+  uint32_t rfrag_bitmap = 0;
+  linkaddr_t rfrag_sender;
+#endif /* SICSLOWPAN_FRAG_RECOVERY */
 
   /* Update link statistics */
   link_stats_input_callback(packetbuf_addr(PACKETBUF_ADDR_SENDER));
@@ -1578,6 +2356,13 @@ input(void)
              frag_size, frag_tag, frag_offset);
       packetbuf_hdr_len += SICSLOWPAN_FRAGN_HDR_LEN;
 
+#if SICSLOWPAN_FRAG_FORWARDING
+      /* Relay fragments of datagrams whose first fragment we forwarded */
+      if(vrb_forward_next(frag_tag, frag_offset)) {
+        return;
+      }
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+
       /* If this is the last fragment, we may shave off any extrenous
          bytes at the end. We must be liberal in what we accept. */
       PRINTFI("last_fragment?: packetbuf_payload_len %d frag_size %d\n",
@@ -1600,6 +2385,54 @@ input(void)
       }
       is_fragment = 1;
       break;
+#if SICSLOWPAN_FRAG_RECOVERY
+    case SICSLOWPAN_DISPATCH_RFRAG:
+      if((PACKETBUF_FRAG_PTR[0] & 0xfe) == SICSLOWPAN_DISPATCH_RFRAG_ACK) {
+        rfrag_ack_input();
+        return;
+      }
+      if(packetbuf_datalen() < SICSLOWPAN_RFRAG_HDR_LEN) {
+        return;
+      }
+      PRINTFI("sicslowpan input: RFRAG ");
+      frag_tag = PACKETBUF_FRAG_PTR[PACKETBUF_RFRAG_TAG];
+      rfrag_seq = (GET16(PACKETBUF_FRAG_PTR, PACKETBUF_RFRAG_SEQ_SIZE) >> 10) & 0x1f;
+      rfrag_ack_req = (PACKETBUF_FRAG_PTR[PACKETBUF_RFRAG_SEQ_SIZE] & 0x80) != 0;
+      if(rfrag_seq == 0) {
+        /* The first fragment carries the datagram size */
+        frag_size = GET16(PACKETBUF_FRAG_PTR, PACKETBUF_RFRAG_OFFSET);
+        first_fragment = 1;
+      } else {
+        /* Offsets are kept in units of 8 bytes */
+        frag_offset = GET16(PACKETBUF_FRAG_PTR, PACKETBUF_RFRAG_OFFSET) >> 3;
+        if(GET16(PACKETBUF_FRAG_PTR, PACKETBUF_RFRAG_OFFSET) != (uint16_t)frag_offset << 3) {
+          return;
+        }
+      }
+      PRINTFI("seq %d, tag %d, offset %d)\n", rfrag_seq, frag_tag, frag_offset);
+      packetbuf_hdr_len += SICSLOWPAN_RFRAG_HDR_LEN;
+      linkaddr_copy(&rfrag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+      rfrag = 1;
+      is_fragment = 1;
+
+      frag_context = rfrag_add_fragment(frag_tag, frag_size, frag_offset,
+                                        rfrag_seq, rfrag_ack_req);
+      if(frag_context == -1) {
+        return;
+      }
+
+      if(first_fragment) {
+        buffer = frag_info[frag_context].first_frag;
+      } else {
+        /* add_fragment has stored the payload */
+        buffer = NULL;
+        frag_size = frag_info[frag_context].len;
+        if(frag_info[frag_context].reassembled_len >= frag_size) {
+          last_fragment = 1;
+        }
+      }
+      break;
+#endif /* SICSLOWPAN_FRAG_RECOVERY */
     default:
       break;
   }
@@ -1680,7 +2513,29 @@ input(void)
     if(first_fragment != 0) {
       frag_info[frag_context].reassembled_len = uncomp_hdr_len + packetbuf_payload_len;
       frag_info[frag_context].first_frag_len = uncomp_hdr_len + packetbuf_payload_len;
+#if SICSLOWPAN_FRAG_FORWARDING
+      /* RFRAG datagrams are reassembled and recovered hop by hop */
+      if(
+#if SICSLOWPAN_FRAG_RECOVERY
+         !rfrag &&
+#endif /* SICSLOWPAN_FRAG_RECOVERY */
+         vrb_forward_first(frag_context)) {
+        return;
+      }
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+    }
+#if SICSLOWPAN_FRAG_RECOVERY
+    if(rfrag) {
+      rfrag_bitmap = frag_info[frag_context].rfrag_bitmap;
+      if(last_fragment != 0) {
+        /* Acknowledge the complete datagram, now and on later requests */
+        rfrag_ack_req = 1;
+        linkaddr_copy(&rfrag_done.sender, &rfrag_sender);
+        rfrag_done.tag = frag_tag;
+        rfrag_done.bitmap = rfrag_bitmap;
+      }
     }
+#endif /* SICSLOWPAN_FRAG_RECOVERY */
     /* For the last fragment, we are OK if there is extrenous bytes at
        the end of the packet. */
     if(last_fragment != 0) {
@@ -1729,6 +2584,12 @@ input(void)
 #if SICSLOWPAN_CONF_FRAG
   }
 #endif /* SICSLOWPAN_CONF_FRAG */
+
+#if SICSLOWPAN_FRAG_RECOVERY
+  if(rfrag_ack_req) {
+    rfrag_send_ack(&rfrag_sender, frag_tag, rfrag_bitmap);
+  }
+#endif /* SICSLOWPAN_FRAG_RECOVERY */
 }
 /** @} */
 
@@ -1745,6 +2606,10 @@ sicslowpan_init(void)
 
   tcpip_set_outputfunc(output);
 
+#if SICSLOWPAN_CONF_FRAG
+  init_fragments();
+#endif /* SICSLOWPAN_CONF_FRAG */
+
 #if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
 /* Preinitialize any address contexts for better header compression
  * (Saves up to 13 bytes per 6lowpan packet)
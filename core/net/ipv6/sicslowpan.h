@@ -82,6 +82,8 @@
 #define SICSLOWPAN_DISPATCH_IPHC                    0x60 /* 011xxxxx = ... */
 #define SICSLOWPAN_DISPATCH_FRAG1                   0xc0 /* 11000xxx */
 #define SICSLOWPAN_DISPATCH_FRAGN                   0xe0 /* 11100xxx */
+#define SICSLOWPAN_DISPATCH_RFRAG                   0xe8 /* 1110100x */
+#define SICSLOWPAN_DISPATCH_RFRAG_ACK               0xea /* 1110101x */
 /** @} */
 
 /** \name HC1 encoding
@@ -175,6 +177,8 @@
 #define SICSLOWPAN_HC1_HC_UDP_HDR_LEN               7
 #define SICSLOWPAN_FRAG1_HDR_LEN                    4
 #define SICSLOWPAN_FRAGN_HDR_LEN                    5
+#define SICSLOWPAN_RFRAG_HDR_LEN                    6
+#define SICSLOWPAN_RFRAG_ACK_HDR_LEN                6
 /** @} */
 
 /**
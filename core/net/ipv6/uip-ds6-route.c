@@ -75,6 +75,17 @@ MEMB(routememb, uip_ds6_route_t, UIP_DS6_ROUTE_NB);
 static int num_routes = 0;
 static void rm_routelist_callback(nbr_table_item_t *ptr);
 
+#if UIP_DS6_ROUTE_HASH
+/* Lookup index: host routes hash on their full address, all other
+   routes sit on prefix_routes, longest prefix first, so the first
+   match is the longest one. routelist still holds every route. */
+static uip_ds6_route_t *route_hash[UIP_DS6_ROUTE_HASH_NB];
+static uip_ds6_route_t *prefix_routes;
+#if UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED
+static uint32_t route_use_counter;
+#endif
+#endif /* UIP_DS6_ROUTE_HASH */
+
 #endif /* (UIP_CONF_MAX_ROUTES != 0) */
 
 /* Default routes are held on the defaultrouterlist and their
@@ -162,6 +173,10 @@ uip_ds6_route_init(void)
 #if (UIP_CONF_MAX_ROUTES != 0)
   memb_init(&routememb);
   list_init(routelist);
+#if UIP_DS6_ROUTE_HASH
+  memset(route_hash, 0, sizeof(route_hash));
+  prefix_routes = NULL;
+#endif /* UIP_DS6_ROUTE_HASH */
   nbr_table_register(nbr_routes,
                      (nbr_table_callback *)rm_routelist_callback);
 #endif /* (UIP_CONF_MAX_ROUTES != 0) */
@@ -174,6 +189,74 @@ uip_ds6_route_init(void)
 #endif
 }
 #if (UIP_CONF_MAX_ROUTES != 0)
+#if UIP_DS6_ROUTE_HASH
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t **
+index_head(const uip_ipaddr_t *addr, uint8_t length)
+{
+  uint32_t h;
+  int i;
+
+  if(length != 128) {
+    return &prefix_routes;
+  }
+  /* FNV-1a over the address; most of the entropy is in the IID. */
+  h = 2166136261UL;
+  for(i = 0; i < sizeof(uip_ipaddr_t); i++) {
+    h = (h ^ addr->u8[i]) * 16777619UL;
+  }
+  return &route_hash[h % UIP_DS6_ROUTE_HASH_NB];
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_add(uip_ds6_route_t *r)
+{
+  uip_ds6_route_t **p;
+
+  p = index_head(&r->ipaddr, r->length);
+  if(r->length != 128) {
+    /* Keep the prefix routes sorted, longest first. */
+    while(*p != NULL && (*p)->length > r->length) {
+      p = &(*p)->hash_next;
+    }
+  }
+  r->hash_next = *p;
+  *p = r;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_rm(uip_ds6_route_t *r)
+{
+  uip_ds6_route_t **p;
+
+  for(p = index_head(&r->ipaddr, r->length);
+      *p != NULL;
+      p = &(*p)->hash_next) {
+    if(*p == r) {
+      *p = r->hash_next;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+index_lookup(const uip_ipaddr_t *addr)
+{
+  uip_ds6_route_t *r;
+
+  for(r = *index_head(addr, 128); r != NULL; r = r->hash_next) {
+    if(uip_ipaddr_cmp(addr, &r->ipaddr)) {
+      return r;
+    }
+  }
+  for(r = prefix_routes; r != NULL; r = r->hash_next) {
+    if(uip_ipaddr_prefixcmp(addr, &r->ipaddr, r->length)) {
+      return r;
+    }
+  }
+  return NULL;
+}
+#endif /* UIP_DS6_ROUTE_HASH */
 /*---------------------------------------------------------------------------*/
 static uip_lladdr_t *
 uip_ds6_route_nexthop_lladdr(uip_ds6_route_t *route)
@@ -254,15 +337,19 @@ uip_ds6_route_t *
 uip_ds6_route_lookup(uip_ipaddr_t *addr)
 {
 #if (UIP_CONF_MAX_ROUTES != 0)
-  uip_ds6_route_t *r;
   uip_ds6_route_t *found_route;
+#if !UIP_DS6_ROUTE_HASH
+  uip_ds6_route_t *r;
   uint8_t longestmatch;
+#endif /* !UIP_DS6_ROUTE_HASH */
 
   PRINTF("uip-ds6-route: Looking up route for ");
   PRINT6ADDR(addr);
   PRINTF("\n");
 
-
+#if UIP_DS6_ROUTE_HASH
+  found_route = index_lookup(addr);
+#else /* UIP_DS6_ROUTE_HASH */
   found_route = NULL;
   longestmatch = 0;
   for(r = uip_ds6_route_head();
@@ -278,6 +365,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
       }
     }
   }
+#endif /* UIP_DS6_ROUTE_HASH */
 
   if(found_route != NULL) {
     PRINTF("uip-ds6-route: Found route: ");
@@ -289,6 +377,15 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
     PRINTF("uip-ds6-route: No route found\n");
   }
 
+#if UIP_DS6_ROUTE_HASH
+  /* Reordering routelist would cost a scan; stamp the route instead
+     so that the least recently used one can still be found. */
+#if UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED
+  if(found_route != NULL) {
+    found_route->last_used = ++route_use_counter;
+  }
+#endif
+#else /* UIP_DS6_ROUTE_HASH */
   if(found_route != NULL && found_route != list_head(routelist)) {
     /* If we found a route, we put it at the start of the routeslist
        list. The list is ordered by how recently we looked them up:
@@ -298,6 +395,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
     list_remove(routelist, found_route);
     list_push(routelist, found_route);
   }
+#endif /* UIP_DS6_ROUTE_HASH */
 
   return found_route;
 #else /* (UIP_CONF_MAX_ROUTES != 0) */
@@ -353,9 +451,17 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
       uip_ds6_route_t *oldest;
       oldest = NULL;
 #if UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED
+#if UIP_DS6_ROUTE_HASH
+      for(r = list_head(routelist); r != NULL; r = list_item_next(r)) {
+        if(oldest == NULL || r->last_used < oldest->last_used) {
+          oldest = r;
+        }
+      }
+#else /* UIP_DS6_ROUTE_HASH */
       /* Removing the oldest route entry from the route table. The
          least recently used route is the first route on the list. */
       oldest = list_tail(routelist);
+#endif /* UIP_DS6_ROUTE_HASH */
 #endif
       if(oldest == NULL) {
         return NULL;
@@ -436,6 +542,12 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 
   uip_ipaddr_copy(&(r->ipaddr), ipaddr);
   r->length = length;
+#if UIP_DS6_ROUTE_HASH
+  index_add(r);
+#if UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED
+  r->last_used = ++route_use_counter;
+#endif
+#endif /* UIP_DS6_ROUTE_HASH */
 
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   memset(&r->state, 0, sizeof(UIP_DS6_ROUTE_STATE_TYPE));
@@ -479,6 +591,9 @@ uip_ds6_route_rm(uip_ds6_route_t *route)
 
     /* Remove the route from the route list */
     list_remove(routelist, route);
+#if UIP_DS6_ROUTE_HASH
+    index_rm(route);
+#endif /* UIP_DS6_ROUTE_HASH */
 
     /* Find the corresponding neighbor_route and remove it. */
     for(neighbor_route = list_head(route->neighbor_routes->route_list);
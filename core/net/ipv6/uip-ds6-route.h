@@ -88,6 +88,21 @@ void uip_ds6_notification_rm(struct uip_ds6_notification *n);
 #define UIP_DS6_ROUTE_NB 4
 #endif /* UIP_CONF_MAX_ROUTES */
 
+/* Index the routing table for lookups: host (/128) routes are kept in
+   a hash table, shorter prefixes on a list sorted by prefix length.
+   Worth enabling on roots and border routers with large tables. */
+#ifdef UIP_CONF_DS6_ROUTE_HASH
+#define UIP_DS6_ROUTE_HASH UIP_CONF_DS6_ROUTE_HASH
+#else /* UIP_CONF_DS6_ROUTE_HASH */
+#define UIP_DS6_ROUTE_HASH 0
+#endif /* UIP_CONF_DS6_ROUTE_HASH */
+
+#ifdef UIP_CONF_DS6_ROUTE_HASH_NB
+#define UIP_DS6_ROUTE_HASH_NB UIP_CONF_DS6_ROUTE_HASH_NB
+#else /* UIP_CONF_DS6_ROUTE_HASH_NB */
+#define UIP_DS6_ROUTE_HASH_NB UIP_DS6_ROUTE_NB
+#endif /* UIP_CONF_DS6_ROUTE_HASH_NB */
+
 /** \brief define some additional RPL related route state and
  *  neighbor callback for RPL - if not a DS6_ROUTE_STATE is already set */
 #ifndef UIP_DS6_ROUTE_STATE_TYPE
@@ -157,6 +172,13 @@ typedef struct uip_ds6_route {
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   UIP_DS6_ROUTE_STATE_TYPE state;
 #endif
+#if UIP_DS6_ROUTE_HASH
+  /* Next entry in the same hash bucket, or on the prefix route list */
+  struct uip_ds6_route *hash_next;
+#if UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED
+  uint32_t last_used;
+#endif
+#endif /* UIP_DS6_ROUTE_HASH */
   uint8_t length;
 } uip_ds6_route_t;
 
@@ -77,6 +77,99 @@ LIST(neighbor_list);
 struct tsch_neighbor *n_broadcast;
 struct tsch_neighbor *n_eb;
 
+#if TSCH_QUEUE_READY_SET
+#if TSCH_QUEUE_MAX_NEIGHBOR_QUEUES > 256
+#error TSCH_QUEUE_READY_SET supports at most 256 neighbor queues
+#endif
+
+/* The ready notification ring (ringbufindex) size must be a power of two */
+#if TSCH_QUEUE_MAX_NEIGHBOR_QUEUES <= 8
+#define READY_RING_SIZE 8
+#elif TSCH_QUEUE_MAX_NEIGHBOR_QUEUES <= 16
+#define READY_RING_SIZE 16
+#elif TSCH_QUEUE_MAX_NEIGHBOR_QUEUES <= 32
+#define READY_RING_SIZE 32
+#elif TSCH_QUEUE_MAX_NEIGHBOR_QUEUES <= 64
+#define READY_RING_SIZE 64
+#else
+#define READY_RING_SIZE 128
+#endif
+
+/* Neighbors, by neighbor_memb index, that may be ready to transmit in a
+ * shared slot, and neighbors that may be in backoff. Both bitmaps are
+ * only written from slot operation. Bits may be stale and are checked
+ * against the neighbor state before use. A neighbor that gets a packet
+ * from process context is passed on through ready_ring instead, which
+ * is lock-free like the neighbor queues. */
+static uint8_t ready_set[(TSCH_QUEUE_MAX_NEIGHBOR_QUEUES + 7) / 8];
+static uint8_t backoff_set[(TSCH_QUEUE_MAX_NEIGHBOR_QUEUES + 7) / 8];
+static uint8_t ready_ring_array[READY_RING_SIZE];
+static struct ringbufindex ready_ring;
+/* Set when ready_ring was full: rebuild ready_set from all neighbors */
+static volatile uint8_t ready_ring_overflow;
+
+#define NBR_INDEX(n) ((n) - (struct tsch_neighbor *)neighbor_memb.mem)
+#define NBR_FROM_INDEX(i) ((struct tsch_neighbor *)neighbor_memb.mem + (i))
+#define BIT_IS_SET(bitmap, i) (((bitmap)[(i) / 8] & (1 << ((i) % 8))) != 0)
+#define BIT_SET(bitmap, i) ((bitmap)[(i) / 8] |= 1 << ((i) % 8))
+#define BIT_CLEAR(bitmap, i) ((bitmap)[(i) / 8] &= ~(1 << ((i) % 8)))
+
+/*---------------------------------------------------------------------------*/
+/* Add a neighbor to the ready set if it may transmit in a shared slot.
+ * Called from slot operation, or with an empty queue. */
+static void
+ready_set_update(struct tsch_neighbor *n)
+{
+  if(!n->is_broadcast && n->backoff_window == 0
+     && !ringbufindex_empty(&n->tx_ringbuf)) {
+    BIT_SET(ready_set, NBR_INDEX(n));
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Tell slot operation that a neighbor got a packet. Called from process
+ * context, when adding a packet. */
+static void
+ready_ring_notify(struct tsch_neighbor *n)
+{
+  if(!n->is_broadcast && !n->ready_notified) {
+    int16_t put_index = ringbufindex_peek_put(&ready_ring);
+    n->ready_notified = 1;
+    if(put_index != -1) {
+      ready_ring_array[put_index] = NBR_INDEX(n);
+      ringbufindex_put(&ready_ring);
+    } else {
+      ready_ring_overflow = 1;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Move the neighbors notified through ready_ring to the ready set.
+ * Called from slot operation. */
+static void
+ready_set_sync(void)
+{
+  int16_t get_index;
+  if(ready_ring_overflow) {
+    struct tsch_neighbor *n = list_head(neighbor_list);
+    ready_ring_overflow = 0;
+    while(n != NULL) {
+      n->ready_notified = 0;
+      ready_set_update(n);
+      n = list_item_next(n);
+    }
+  }
+  while((get_index = ringbufindex_peek_get(&ready_ring)) != -1) {
+    uint8_t i = ready_ring_array[get_index];
+    ringbufindex_get(&ready_ring);
+    if(neighbor_memb.count[i]) {
+      struct tsch_neighbor *n = NBR_FROM_INDEX(i);
+      n->ready_notified = 0;
+      ready_set_update(n);
+    }
+  }
+}
+#endif /* TSCH_QUEUE_READY_SET */
+
 /*---------------------------------------------------------------------------*/
 /* Add a TSCH neighbor */
 struct tsch_neighbor *
@@ -253,6 +346,9 @@ tsch_queue_add_packet(const linkaddr_t *addr, mac_callback_t sent, void *ptr)
             /* Add to ringbuf (actual add committed through atomic operation) */
             n->tx_array[put_index] = p;
             ringbufindex_put(&n->tx_ringbuf);
+#if TSCH_QUEUE_READY_SET
+            ready_ring_notify(n);
+#endif
             return p;
           } else {
             memb_free(&packet_memb, p);
@@ -262,6 +358,9 @@ tsch_queue_add_packet(const linkaddr_t *addr, mac_callback_t sent, void *ptr)
     }
   }
   PRINTF("TSCH-queue:! add packet failed: %u %p %d %p %p\n", tsch_is_locked(), n, put_index, p, p ? p->qb : NULL);
+  if(n != NULL) {
+    n->queue_drops++;
+  }
   return 0;
 }
 /*---------------------------------------------------------------------------*/
@@ -279,6 +378,13 @@ tsch_queue_packet_count(const linkaddr_t *addr)
   return -1;
 }
 /*---------------------------------------------------------------------------*/
+/* Returns the number of packets currently in the queue of a neighbor */
+int
+tsch_queue_nbr_packet_count(const struct tsch_neighbor *n)
+{
+  return n != NULL ? ringbufindex_elements(&n->tx_ringbuf) : -1;
+}
+/*---------------------------------------------------------------------------*/
 /* Remove first packet from a neighbor queue */
 struct tsch_packet *
 tsch_queue_remove_packet_from_queue(struct tsch_neighbor *n)
@@ -396,8 +502,46 @@ struct tsch_packet *
 tsch_queue_get_unicast_packet_for_any(struct tsch_neighbor **n, struct tsch_link *link)
 {
   if(!tsch_is_locked()) {
-    struct tsch_neighbor *curr_nbr = list_head(neighbor_list);
+    struct tsch_neighbor *curr_nbr;
     struct tsch_packet *p = NULL;
+#if TSCH_QUEUE_READY_SET
+    /* The ready set only tracks neighbors with an expired backoff, which
+     * is a condition on shared links only */
+    if(link != NULL && (link->link_options & LINK_OPTION_SHARED)) {
+      int i;
+      ready_set_sync();
+      for(i = 0; i < TSCH_QUEUE_MAX_NEIGHBOR_QUEUES; i++) {
+        if(ready_set[i / 8] == 0) {
+          /* Skip to the next byte */
+          i |= 7;
+          continue;
+        }
+        if(!BIT_IS_SET(ready_set, i)) {
+          continue;
+        }
+        curr_nbr = NBR_FROM_INDEX(i);
+        if(!neighbor_memb.count[i] || curr_nbr->is_broadcast
+           || curr_nbr->backoff_window != 0
+           || ringbufindex_empty(&curr_nbr->tx_ringbuf)) {
+          /* Stale entry */
+          BIT_CLEAR(ready_set, i);
+          continue;
+        }
+        if(curr_nbr->tx_links_count == 0) {
+          /* Only look up for neighbors we do not have a tx link to */
+          p = tsch_queue_get_packet_for_nbr(curr_nbr, link);
+          if(p != NULL) {
+            if(n != NULL) {
+              *n = curr_nbr;
+            }
+            return p;
+          }
+        }
+      }
+      return NULL;
+    }
+#endif /* TSCH_QUEUE_READY_SET */
+    curr_nbr = list_head(neighbor_list);
     while(curr_nbr != NULL) {
       if(!curr_nbr->is_broadcast && curr_nbr->tx_links_count == 0) {
         /* Only look up for non-broadcast neighbors we do not have a tx link to */
@@ -428,6 +572,9 @@ tsch_queue_backoff_reset(struct tsch_neighbor *n)
 {
   n->backoff_window = 0;
   n->backoff_exponent = TSCH_MAC_MIN_BE;
+#if TSCH_QUEUE_READY_SET
+  ready_set_update(n);
+#endif
 }
 /*---------------------------------------------------------------------------*/
 /* Increment backoff exponent, pick a new window */
@@ -443,6 +590,9 @@ tsch_queue_backoff_inc(struct tsch_neighbor *n)
   /* Add one to the window as we will decrement it at the end of the current slot
    * through tsch_queue_update_all_backoff_windows */
   n->backoff_window++;
+#if TSCH_QUEUE_READY_SET
+  BIT_SET(backoff_set, NBR_INDEX(n));
+#endif
 }
 /*---------------------------------------------------------------------------*/
 /* Decrement backoff window for all queues directed at dest_addr */
@@ -451,6 +601,34 @@ tsch_queue_update_all_backoff_windows(const linkaddr_t *dest_addr)
 {
   if(!tsch_is_locked()) {
     int is_broadcast = linkaddr_cmp(dest_addr, &tsch_broadcast_address);
+#if TSCH_QUEUE_READY_SET
+    int i;
+    for(i = 0; i < TSCH_QUEUE_MAX_NEIGHBOR_QUEUES; i++) {
+      struct tsch_neighbor *n;
+      if(backoff_set[i / 8] == 0) {
+        /* Skip to the next byte */
+        i |= 7;
+        continue;
+      }
+      if(!BIT_IS_SET(backoff_set, i)) {
+        continue;
+      }
+      n = NBR_FROM_INDEX(i);
+      if(!neighbor_memb.count[i] || n->backoff_window == 0) {
+        /* Stale entry */
+        BIT_CLEAR(backoff_set, i);
+        continue;
+      }
+      if((n->tx_links_count == 0 && is_broadcast)
+         || (n->tx_links_count > 0 && linkaddr_cmp(dest_addr, &n->addr))) {
+        n->backoff_window--;
+        if(n->backoff_window == 0) {
+          BIT_CLEAR(backoff_set, i);
+          ready_set_update(n);
+        }
+      }
+    }
+#else /* TSCH_QUEUE_READY_SET */
     struct tsch_neighbor *n = list_head(neighbor_list);
     while(n != NULL) {
       if(n->backoff_window != 0 /* Is the queue in backoff state? */
@@ -460,6 +638,7 @@ tsch_queue_update_all_backoff_windows(const linkaddr_t *dest_addr)
       }
       n = list_item_next(n);
     }
+#endif /* TSCH_QUEUE_READY_SET */
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -470,6 +649,12 @@ tsch_queue_init(void)
   list_init(neighbor_list);
   memb_init(&neighbor_memb);
   memb_init(&packet_memb);
+#if TSCH_QUEUE_READY_SET
+  memset(ready_set, 0, sizeof(ready_set));
+  memset(backoff_set, 0, sizeof(backoff_set));
+  ringbufindex_init(&ready_ring, READY_RING_SIZE);
+  ready_ring_overflow = 0;
+#endif
   /* Add virtual EB and the broadcast neighbors */
   n_eb = tsch_queue_add_nbr(&tsch_eb_address);
   n_broadcast = tsch_queue_add_nbr(&tsch_broadcast_address);
@@ -77,6 +77,15 @@
 #define TSCH_QUEUE_MAX_NEIGHBOR_QUEUES ((NBR_TABLE_CONF_MAX_NEIGHBORS) + 2)
 #endif
 
+/* Keep track of the unicast neighbors that may transmit in a shared
+ * slot (queued packets, expired backoff) in a bitmap, so that shared
+ * slots and backoff updates do not walk the whole neighbor list */
+#ifdef TSCH_QUEUE_CONF_READY_SET
+#define TSCH_QUEUE_READY_SET TSCH_QUEUE_CONF_READY_SET
+#else
+#define TSCH_QUEUE_READY_SET 0
+#endif
+
 /* TSCH CSMA-CA parameters, see IEEE 802.15.4e-2012 */
 /* Min backoff exponent */
 #ifdef TSCH_CONF_MAC_MIN_BE
@@ -135,6 +144,11 @@ struct tsch_neighbor {
   uint8_t last_backoff_window; /* Last CSMA backoff window */
   uint8_t tx_links_count; /* How many links do we have to this neighbor? */
   uint8_t dedicated_tx_links_count; /* How many dedicated links do we have to this neighbor? */
+#if TSCH_QUEUE_READY_SET
+  uint8_t ready_notified; /* Is the neighbor pending on the ready notification ring? */
+#endif
+  uint16_t queue_drops; /* Packets rejected at enqueue (queue or packet pool full) */
+  uint16_t tx_drops; /* Packets dropped after TSCH_MAC_MAX_FRAME_RETRIES */
   /* Array for the ringbuf. Contains pointers to packets.
    * Its size must be a power of two to allow for atomic put */
   struct tsch_packet *tx_array[TSCH_QUEUE_NUM_PER_NEIGHBOR];
@@ -162,6 +176,8 @@ int tsch_queue_update_time_source(const linkaddr_t *new_addr);
 struct tsch_packet *tsch_queue_add_packet(const linkaddr_t *addr, mac_callback_t sent, void *ptr);
 /* Returns the number of packets currently a given neighbor queue */
 int tsch_queue_packet_count(const linkaddr_t *addr);
+/* Returns the number of packets currently in the queue of a neighbor */
+int tsch_queue_nbr_packet_count(const struct tsch_neighbor *n);
 /* Remove first packet from a neighbor queue. The packet is stored in a separate
  * dequeued packet list, for later processing. Return the packet. */
 struct tsch_packet *tsch_queue_remove_packet_from_queue(struct tsch_neighbor *n);
@@ -69,6 +69,37 @@ MEMB(slotframe_memb, struct tsch_slotframe, TSCH_SCHEDULE_MAX_SLOTFRAMES);
 /* List of slotframes (each slotframe holds its own list of links) */
 LIST(slotframe_list);
 
+#if TSCH_SCHEDULE_SORTED_LINKS
+/* All links, grouped per slotframe in slotframe_list order, and sorted
+ * by timeslot within a slotframe. Links sharing a timeslot keep their
+ * links_list order, so that ties are broken as with the plain lists. */
+static struct tsch_link *sorted_links[TSCH_SCHEDULE_MAX_LINKS];
+
+/* Rebuilds sorted_links. Must be called with the lock held. */
+static void
+sorted_links_update(void)
+{
+  uint16_t n = 0;
+  struct tsch_slotframe *sf = list_head(slotframe_list);
+  while(sf != NULL) {
+    struct tsch_link *l = list_head(sf->links_list);
+    sf->sorted_first = n;
+    while(l != NULL) {
+      /* Insertion sort, placing l after links with the same timeslot */
+      uint16_t i = n++;
+      while(i > sf->sorted_first && sorted_links[i - 1]->timeslot > l->timeslot) {
+        sorted_links[i] = sorted_links[i - 1];
+        i--;
+      }
+      sorted_links[i] = l;
+      l = list_item_next(l);
+    }
+    sf->sorted_count = n - sf->sorted_first;
+    sf = list_item_next(sf);
+  }
+}
+#endif /* TSCH_SCHEDULE_SORTED_LINKS */
+
 /* Adds and returns a slotframe (NULL if failure) */
 struct tsch_slotframe *
 tsch_schedule_add_slotframe(uint16_t handle, uint16_t size)
@@ -91,6 +122,9 @@ tsch_schedule_add_slotframe(uint16_t handle, uint16_t size)
       LIST_STRUCT_INIT(sf, links_list);
       /* Add the slotframe to the global list */
       list_add(slotframe_list, sf);
+#if TSCH_SCHEDULE_SORTED_LINKS
+      sorted_links_update();
+#endif
     }
     PRINTF("TSCH-schedule: add_slotframe %u %u\n",
            handle, size);
@@ -129,6 +163,9 @@ tsch_schedule_remove_slotframe(struct tsch_slotframe *slotframe)
       PRINTF("TSCH-schedule: remove slotframe %u %u\n", slotframe->handle, slotframe->size.val);
       memb_free(&slotframe_memb, slotframe);
       list_remove(slotframe_list, slotframe);
+#if TSCH_SCHEDULE_SORTED_LINKS
+      sorted_links_update();
+#endif
       tsch_release_lock();
       return 1;
     }
@@ -209,6 +246,9 @@ tsch_schedule_add_link(struct tsch_slotframe *slotframe,
           address = &linkaddr_null;
         }
         linkaddr_copy(&l->addr, address);
+#if TSCH_SCHEDULE_SORTED_LINKS
+        sorted_links_update();
+#endif
 
         PRINTF("TSCH-schedule: add_link %u %u %u %u %u %u\n",
                slotframe->handle, link_options, link_type, timeslot, channel_offset, TSCH_LOG_ID_FROM_LINKADDR(address));
@@ -257,6 +297,9 @@ tsch_schedule_remove_link(struct tsch_slotframe *slotframe, struct tsch_link *l)
 
       list_remove(slotframe->links_list, l);
       memb_free(&link_memb, l);
+#if TSCH_SCHEDULE_SORTED_LINKS
+      sorted_links_update();
+#endif
 
       /* Release the lock before we update the neighbor (will take the lock) */
       tsch_release_lock();
@@ -308,6 +351,52 @@ tsch_schedule_get_link_by_timeslot(struct tsch_slotframe *slotframe, uint16_t ti
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+/* Compares a link occurring in time_to_timeslot slots with the best link
+ * found so far, and updates the best and backup links accordingly */
+static void
+select_link(struct tsch_link *l, uint16_t time_to_timeslot,
+    struct tsch_link **curr_best, uint16_t *time_to_curr_best,
+    struct tsch_link **curr_backup)
+{
+  if(*curr_best == NULL || time_to_timeslot < *time_to_curr_best) {
+    *time_to_curr_best = time_to_timeslot;
+    *curr_best = l;
+    *curr_backup = NULL;
+  } else if(time_to_timeslot == *time_to_curr_best) {
+    struct tsch_link *new_best = NULL;
+    /* Two links are overlapping, we need to select one of them.
+     * By standard: prioritize Tx links first, second by lowest handle */
+    if(((*curr_best)->link_options & LINK_OPTION_TX) == (l->link_options & LINK_OPTION_TX)) {
+      /* Both or neither links have Tx, select the one with lowest handle */
+      if(l->slotframe_handle < (*curr_best)->slotframe_handle) {
+        new_best = l;
+      }
+    } else {
+      /* Select the link that has the Tx option */
+      if(l->link_options & LINK_OPTION_TX) {
+        new_best = l;
+      }
+    }
+
+    /* Maintain backup_link */
+    if(*curr_backup == NULL) {
+      /* Check if 'l' best can be used as backup */
+      if(new_best != l && (l->link_options & LINK_OPTION_RX)) { /* Does 'l' have Rx flag? */
+        *curr_backup = l;
+      }
+      /* Check if curr_best can be used as backup */
+      if(new_best != *curr_best && ((*curr_best)->link_options & LINK_OPTION_RX)) { /* Does curr_best have Rx flag? */
+        *curr_backup = *curr_best;
+      }
+    }
+
+    /* Maintain curr_best */
+    if(new_best != NULL) {
+      *curr_best = new_best;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
 /* Returns the next active link after a given ASN, and a backup link (for the same ASN, with Rx flag) */
 struct tsch_link *
 tsch_schedule_get_next_active_link(struct tsch_asn_t *asn, uint16_t *time_offset,
@@ -325,52 +414,49 @@ tsch_schedule_get_next_active_link(struct tsch_asn_t *asn, uint16_t *time_offset
     while(sf != NULL) {
       /* Get timeslot from ASN, given the slotframe length */
       uint16_t timeslot = TSCH_ASN_MOD(*asn, sf->size);
+#if TSCH_SCHEDULE_SORTED_LINKS
+      if(sf->sorted_count > 0) {
+        struct tsch_link **links = &sorted_links[sf->sorted_first];
+        uint16_t lo = 0;
+        uint16_t hi = sf->sorted_count;
+        uint16_t next_timeslot;
+        /* Binary search for the first link after timeslot. If there is
+         * none, the earliest one is the first link of the next round. */
+        while(lo < hi) {
+          uint16_t mid = (lo + hi) / 2;
+          if(links[mid]->timeslot > timeslot) {
+            hi = mid;
+          } else {
+            lo = mid + 1;
+          }
+        }
+        if(lo == sf->sorted_count) {
+          lo = 0;
+        }
+        next_timeslot = links[lo]->timeslot;
+        /* Only the links at next_timeslot can be the earliest ones */
+        while(lo < sf->sorted_count && links[lo]->timeslot == next_timeslot) {
+          uint16_t time_to_timeslot =
+            next_timeslot > timeslot ?
+            next_timeslot - timeslot :
+            sf->size.val + next_timeslot - timeslot;
+          select_link(links[lo], time_to_timeslot,
+                      &curr_best, &time_to_curr_best, &curr_backup);
+          lo++;
+        }
+      }
+#else /* TSCH_SCHEDULE_SORTED_LINKS */
       struct tsch_link *l = list_head(sf->links_list);
       while(l != NULL) {
         uint16_t time_to_timeslot =
           l->timeslot > timeslot ?
           l->timeslot - timeslot :
           sf->size.val + l->timeslot - timeslot;
-        if(curr_best == NULL || time_to_timeslot < time_to_curr_best) {
-          time_to_curr_best = time_to_timeslot;
-          curr_best = l;
-          curr_backup = NULL;
-        } else if(time_to_timeslot == time_to_curr_best) {
-          struct tsch_link *new_best = NULL;
-          /* Two links are overlapping, we need to select one of them.
-           * By standard: prioritize Tx links first, second by lowest handle */
-          if((curr_best->link_options & LINK_OPTION_TX) == (l->link_options & LINK_OPTION_TX)) {
-            /* Both or neither links have Tx, select the one with lowest handle */
-            if(l->slotframe_handle < curr_best->slotframe_handle) {
-              new_best = l;
-            }
-          } else {
-            /* Select the link that has the Tx option */
-            if(l->link_options & LINK_OPTION_TX) {
-              new_best = l;
-            }
-          }
-
-          /* Maintain backup_link */
-          if(curr_backup == NULL) {
-            /* Check if 'l' best can be used as backup */
-            if(new_best != l && (l->link_options & LINK_OPTION_RX)) { /* Does 'l' have Rx flag? */
-              curr_backup = l;
-            }
-            /* Check if curr_best can be used as backup */
-            if(new_best != curr_best && (curr_best->link_options & LINK_OPTION_RX)) { /* Does curr_best have Rx flag? */
-              curr_backup = curr_best;
-            }
-          }
-
-          /* Maintain curr_best */
-          if(new_best != NULL) {
-            curr_best = new_best;
-          }
-        }
-
+        select_link(l, time_to_timeslot,
+                    &curr_best, &time_to_curr_best, &curr_backup);
         l = list_item_next(l);
       }
+#endif /* TSCH_SCHEDULE_SORTED_LINKS */
       sf = list_item_next(sf);
     }
     if(time_offset != NULL) {
@@ -72,6 +72,16 @@
 #define TSCH_SCHEDULE_MAX_LINKS 32
 #endif
 
+/* Keep a copy of the schedule with the links of each slotframe sorted
+ * by timeslot, rebuilt whenever links are added or removed. The next
+ * active link is then found with one binary search per slotframe
+ * instead of a walk over all links. Costs one pointer per link. */
+#ifdef TSCH_SCHEDULE_CONF_SORTED_LINKS
+#define TSCH_SCHEDULE_SORTED_LINKS TSCH_SCHEDULE_CONF_SORTED_LINKS
+#else
+#define TSCH_SCHEDULE_SORTED_LINKS 0
+#endif
+
 /********** Constants *********/
 
 /* Link options */
@@ -122,6 +132,11 @@ struct tsch_slotframe {
   struct tsch_asn_divisor_t size;
   /* List of links belonging to this slotframe */
   LIST_STRUCT(links_list);
+#if TSCH_SCHEDULE_SORTED_LINKS
+  /* Position and number of this slotframe's links in the sorted schedule */
+  uint16_t sorted_first;
+  uint16_t sorted_count;
+#endif
 };
 
 /********** Functions *********/
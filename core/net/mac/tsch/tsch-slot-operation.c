@@ -383,6 +383,7 @@ update_neighbor_state(struct tsch_neighbor *n, struct tsch_packet *p,
       /* Drop packet */
       tsch_queue_remove_packet_from_queue(n);
       in_queue = 0;
+      n->tx_drops++;
     }
     /* Update CSMA state in the unicast case */
     if(is_unicast) {
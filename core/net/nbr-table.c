@@ -83,6 +83,32 @@ static unsigned num_tables;
 MEMB(neighbor_addr_mem, nbr_table_key_t, NBR_TABLE_MAX_NEIGHBORS);
 LIST(nbr_table_keys);
 
+/* Optional open-addressing index over the link-layer addresses on
+ * nbr_table_keys, so that lookups do not walk the whole list. Slots
+ * hold the neighbor index plus one, zero marks an empty slot. */
+#ifdef NBR_TABLE_CONF_HASH
+#define NBR_TABLE_HASH NBR_TABLE_CONF_HASH
+#else /* NBR_TABLE_CONF_HASH */
+#define NBR_TABLE_HASH 0
+#endif /* NBR_TABLE_CONF_HASH */
+
+#if NBR_TABLE_HASH
+/* Keep the load factor at or below one half */
+#ifdef NBR_TABLE_CONF_HASH_SIZE
+#define NBR_TABLE_HASH_SIZE NBR_TABLE_CONF_HASH_SIZE
+#else /* NBR_TABLE_CONF_HASH_SIZE */
+#define NBR_TABLE_HASH_SIZE (2 * NBR_TABLE_MAX_NEIGHBORS)
+#endif /* NBR_TABLE_CONF_HASH_SIZE */
+
+/* Probing for an absent address stops at an empty slot, so the index
+ * must never fill up */
+#if NBR_TABLE_HASH_SIZE <= NBR_TABLE_MAX_NEIGHBORS
+#error "NBR_TABLE_CONF_HASH_SIZE must be larger than NBR_TABLE_MAX_NEIGHBORS"
+#endif
+
+static uint16_t nbr_table_hash[NBR_TABLE_HASH_SIZE];
+#endif /* NBR_TABLE_HASH */
+
 /*---------------------------------------------------------------------------*/
 /* Get a key from a neighbor index */
 static nbr_table_key_t *
@@ -125,17 +151,92 @@ key_from_item(nbr_table_t *table, const nbr_table_item_t *item)
 {
   return key_from_index(index_from_item(table, item));
 }
+#if NBR_TABLE_HASH
+/*---------------------------------------------------------------------------*/
+/* Get the home slot of a link-layer address in the hash index */
+static int
+hash_slot(const linkaddr_t *lladdr)
+{
+  uint32_t h;
+  int i;
+
+  h = 2166136261UL;
+  for(i = 0; i < LINKADDR_SIZE; i++) {
+    h = (h ^ lladdr->u8[i]) * 16777619UL;
+  }
+  return h % NBR_TABLE_HASH_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+/* Add a neighbor index to the hash index, under its current lladdr */
+static void
+hash_add(int index)
+{
+  int i = hash_slot(&key_from_index(index)->lladdr);
+
+  while(nbr_table_hash[i] != 0) {
+    i = (i + 1) % NBR_TABLE_HASH_SIZE;
+  }
+  nbr_table_hash[i] = index + 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Remove a neighbor from the hash index. Entries after it in the same
+ * probe run are shifted back, so that no tombstones are needed. */
+static void
+hash_remove(nbr_table_key_t *key)
+{
+  int i, j, home;
+  int index = index_from_key(key);
+
+  i = hash_slot(&key->lladdr);
+  while(nbr_table_hash[i] != index + 1) {
+    if(nbr_table_hash[i] == 0) {
+      return;
+    }
+    i = (i + 1) % NBR_TABLE_HASH_SIZE;
+  }
+
+  j = i;
+  for(;;) {
+    j = (j + 1) % NBR_TABLE_HASH_SIZE;
+    if(nbr_table_hash[j] == 0) {
+      break;
+    }
+    home = hash_slot(&key_from_index(nbr_table_hash[j] - 1)->lladdr);
+    /* Leave the entry where it is if its home slot lies in (i, j] */
+    if(i <= j ? (i < home && home <= j) : (i < home || home <= j)) {
+      continue;
+    }
+    nbr_table_hash[i] = nbr_table_hash[j];
+    i = j;
+  }
+  nbr_table_hash[i] = 0;
+}
+#endif /* NBR_TABLE_HASH */
 /*---------------------------------------------------------------------------*/
 /* Get the index of a neighbor from its link-layer address */
 static int
 index_from_lladdr(const linkaddr_t *lladdr)
 {
   nbr_table_key_t *key;
+#if NBR_TABLE_HASH
+  int i;
+#endif /* NBR_TABLE_HASH */
   /* Allow lladdr-free insertion, useful e.g. for IPv6 ND.
    * Only one such entry is possible at a time, indexed by linkaddr_null. */
   if(lladdr == NULL) {
     lladdr = &linkaddr_null;
   }
+#if NBR_TABLE_HASH
+  for(i = hash_slot(lladdr);
+      nbr_table_hash[i] != 0;
+      i = (i + 1) % NBR_TABLE_HASH_SIZE) {
+    key = key_from_index(nbr_table_hash[i] - 1);
+    if(linkaddr_cmp(lladdr, &key->lladdr)) {
+      return nbr_table_hash[i] - 1;
+    }
+  }
+  return -1;
+#else /* NBR_TABLE_HASH */
   key = list_head(nbr_table_keys);
   while(key != NULL) {
     if(lladdr && linkaddr_cmp(lladdr, &key->lladdr)) {
@@ -144,6 +245,7 @@ index_from_lladdr(const linkaddr_t *lladdr)
     key = list_item_next(key);
   }
   return -1;
+#endif /* NBR_TABLE_HASH */
 }
 /*---------------------------------------------------------------------------*/
 /* Get bit from "used" or "locked" bitmap */
@@ -195,6 +297,9 @@ remove_key(nbr_table_key_t *least_used_key)
   used_map[index_from_key(least_used_key)] = 0;
   /* Remove neighbor from list */
   list_remove(nbr_table_keys, least_used_key);
+#if NBR_TABLE_HASH
+  hash_remove(least_used_key);
+#endif /* NBR_TABLE_HASH */
 }
 /*---------------------------------------------------------------------------*/
 static nbr_table_key_t *
@@ -359,6 +464,9 @@ nbr_table_add_lladdr(nbr_table_t *table, const linkaddr_t *lladdr, nbr_table_rea
 
     /* Set link-layer address */
     linkaddr_copy(&key->lladdr, lladdr);
+#if NBR_TABLE_HASH
+    hash_add(index);
+#endif /* NBR_TABLE_HASH */
   }
 
   /* Get item in the current table */
@@ -446,11 +554,17 @@ nbr_table_update_lladdr(const linkaddr_t *old_addr, const linkaddr_t *new_addr,
     return 0;
   }
   key = key_from_index(index);
+#if NBR_TABLE_HASH
+  hash_remove(key);
+#endif /* NBR_TABLE_HASH */
   /**
    * Copy the new lladdr into the key - since we know that there is no
    * conflicting entry.
    */
   memcpy(&key->lladdr, new_addr, sizeof(linkaddr_t));
+#if NBR_TABLE_HASH
+  hash_add(index);
+#endif /* NBR_TABLE_HASH */
   return 1;
 }
 /*---------------------------------------------------------------------------*/
@@ -37,6 +37,7 @@
 
 #include "sys/ntimer.h"
 #include "lib/list.h"
+#include <stdint.h>
 
 #define DEBUG 0
 #if DEBUG
@@ -50,11 +51,327 @@
 #define NULL 0
 #endif
 
-LIST(timer_list);
 static uint8_t is_initialized;
+
+#if NTIMER_WHEEL
+/*
+ * Hierarchical timer wheel. Level 0 has one slot per millisecond and
+ * each following level covers WHEEL_SLOTS slots of the previous
+ * level. A timer is added to the lowest level where it fits relative
+ * to wheel_time and is moved down one level at a time when
+ * wheel_time reaches the start of its slot. Timers that do not fit
+ * in the highest level are kept in an unsorted overflow slot. The
+ * slots are doubly linked so that a timer is stopped without a walk,
+ * except for the earliest overflow timer, which is hours away.
+ */
+#ifdef NTIMER_CONF_WHEEL_SLOT_BITS
+#define WHEEL_SLOT_BITS NTIMER_CONF_WHEEL_SLOT_BITS
+#else /* NTIMER_CONF_WHEEL_SLOT_BITS */
+#define WHEEL_SLOT_BITS 6
+#endif /* NTIMER_CONF_WHEEL_SLOT_BITS */
+
+/* The occupied slots of a level are kept in one 64-bit word */
+#if WHEEL_SLOT_BITS < 1 || WHEEL_SLOT_BITS > 6
+#error "NTIMER_CONF_WHEEL_SLOT_BITS must be between 1 and 6"
+#endif
+
+#define WHEEL_LEVELS    4
+#define WHEEL_SLOTS     (1 << WHEEL_SLOT_BITS)
+#define WHEEL_SLOT_MASK (WHEEL_SLOTS - 1)
+#define LEVEL_SHIFT(level) ((level) * WHEEL_SLOT_BITS)
+
+/*
+ * Slot numbers stored in the timers, 0 means not added to the wheel.
+ * A timer must be zeroed or set before it is first stopped.
+ */
+#define SLOT_NONE       0
+#define SLOT_OVERFLOW   (WHEEL_LEVELS * WHEEL_SLOTS + 1)
+#define SLOT_NUMBER(level, index) ((level) * WHEEL_SLOTS + (index) + 1)
+
+#define NO_EXPIRATION   UINT64_MAX
+
+static ntimer_t *slots[WHEEL_LEVELS * WHEEL_SLOTS + 1];
+static uint64_t occupied[WHEEL_LEVELS];
+/* All slots before wheel_time have been processed */
+static uint64_t wheel_time;
+/* The earliest expiration time of the timers in the overflow slot */
+static uint64_t overflow_expiration = NO_EXPIRATION;
+static uint64_t next_expiration;
+static uint8_t next_is_valid;
+/*---------------------------------------------------------------------------*/
+static unsigned
+first_bit(uint64_t bits)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll(bits);
+#else /* __GNUC__ */
+  unsigned n;
+  for(n = 0; (bits & 1) == 0; n++) {
+    bits >>= 1;
+  }
+  return n;
+#endif /* __GNUC__ */
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the distance from the current slot to the next used slot */
+static int
+next_used_slot(uint8_t level)
+{
+  uint64_t bits;
+  unsigned index;
+
+  bits = occupied[level];
+  if(bits == 0) {
+    return -1;
+  }
+  index = (wheel_time >> LEVEL_SHIFT(level)) & WHEEL_SLOT_MASK;
+  if(bits >> index) {
+    return first_bit(bits >> index);
+  }
+  return WHEEL_SLOTS - index + first_bit(bits);
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_empty(void)
+{
+  uint8_t level;
+  for(level = 0; level < WHEEL_LEVELS; level++) {
+    if(occupied[level]) {
+      return 0;
+    }
+  }
+  return slots[SLOT_OVERFLOW - 1] == NULL;
+}
 /*---------------------------------------------------------------------------*/
 static void
-add_timer(ntimer_t *timer)
+wheel_insert(ntimer_t *timer)
+{
+  uint64_t time;
+  uint8_t level;
+  unsigned index;
+
+  /* Timers that already have expired are placed in the current slot */
+  time = timer->expiration_time;
+  if(time < wheel_time) {
+    time = wheel_time;
+  }
+
+  timer->slot = SLOT_OVERFLOW;
+  for(level = 0; level < WHEEL_LEVELS; level++) {
+    if((time >> LEVEL_SHIFT(level)) - (wheel_time >> LEVEL_SHIFT(level))
+       < WHEEL_SLOTS) {
+      index = (time >> LEVEL_SHIFT(level)) & WHEEL_SLOT_MASK;
+      occupied[level] |= (uint64_t)1 << index;
+      timer->slot = SLOT_NUMBER(level, index);
+      break;
+    }
+  }
+
+  if(timer->slot == SLOT_OVERFLOW && time < overflow_expiration) {
+    overflow_expiration = time;
+  }
+
+  timer->prev = NULL;
+  timer->next = slots[timer->slot - 1];
+  if(timer->next != NULL) {
+    timer->next->prev = timer;
+  }
+  slots[timer->slot - 1] = timer;
+}
+/*---------------------------------------------------------------------------*/
+static void
+wheel_remove(ntimer_t *timer)
+{
+  ntimer_t *t;
+  unsigned slot;
+
+  slot = timer->slot;
+  if(slot == SLOT_NONE || slot > SLOT_OVERFLOW) {
+    return;
+  }
+
+  if(timer->prev != NULL) {
+    timer->prev->next = timer->next;
+  } else {
+    slots[slot - 1] = timer->next;
+  }
+  if(timer->next != NULL) {
+    timer->next->prev = timer->prev;
+  }
+  timer->slot = SLOT_NONE;
+
+  if(slot == SLOT_OVERFLOW) {
+    if(timer->expiration_time <= overflow_expiration) {
+      overflow_expiration = NO_EXPIRATION;
+      for(t = slots[slot - 1]; t != NULL; t = t->next) {
+        if(t->expiration_time < overflow_expiration) {
+          overflow_expiration = t->expiration_time;
+        }
+      }
+    }
+  } else if(slots[slot - 1] == NULL) {
+    occupied[(slot - 1) / WHEEL_SLOTS] &=
+      ~((uint64_t)1 << ((slot - 1) & WHEEL_SLOT_MASK));
+  }
+
+  /* Only the earliest timer changes the next expiration */
+  if(timer->expiration_time <= next_expiration) {
+    next_is_valid = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Re-add all timers in a slot relative to the current wheel time */
+static void
+cascade(unsigned slot)
+{
+  ntimer_t *timer, *next;
+
+  timer = slots[slot - 1];
+  slots[slot - 1] = NULL;
+  if(slot == SLOT_OVERFLOW) {
+    overflow_expiration = NO_EXPIRATION;
+  } else {
+    occupied[(slot - 1) / WHEEL_SLOTS] &=
+      ~((uint64_t)1 << ((slot - 1) & WHEEL_SLOT_MASK));
+  }
+
+  for(; timer != NULL; timer = next) {
+    next = timer->next;
+    wheel_insert(timer);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint64_t
+find_next_expiration(void)
+{
+  uint64_t next;
+  ntimer_t *timer;
+  uint8_t level;
+  unsigned index;
+  int offset;
+
+  next = NO_EXPIRATION;
+  for(level = 0; level < WHEEL_LEVELS; level++) {
+    offset = next_used_slot(level);
+    if(offset >= 0) {
+      /* The first used slot holds the earliest timers of the level */
+      index = ((wheel_time >> LEVEL_SHIFT(level)) + offset) & WHEEL_SLOT_MASK;
+      for(timer = slots[SLOT_NUMBER(level, index) - 1]; timer != NULL;
+          timer = timer->next) {
+        if(timer->expiration_time < next) {
+          next = timer->expiration_time;
+        }
+      }
+    }
+  }
+  if(overflow_expiration < next) {
+    next = overflow_expiration;
+  }
+  return next;
+}
+/*---------------------------------------------------------------------------*/
+static uint64_t
+get_next_expiration(void)
+{
+  if(!next_is_valid) {
+    next_expiration = find_next_expiration();
+    next_is_valid = 1;
+  }
+  return next_expiration;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the next time the wheel needs to be processed, either to
+ * expire the timers in a level 0 slot or to move the timers in a
+ * higher level slot down.
+ */
+static uint64_t
+next_event(unsigned *slot)
+{
+  uint64_t time, next;
+  uint8_t level;
+  unsigned shift;
+  int offset;
+
+  next = NO_EXPIRATION;
+  for(level = 0; level < WHEEL_LEVELS; level++) {
+    offset = next_used_slot(level);
+    if(offset >= 0) {
+      shift = LEVEL_SHIFT(level);
+      time = ((wheel_time >> shift) + offset) << shift;
+      if(time < wheel_time) {
+        time = wheel_time;
+      }
+      if(time < next) {
+        next = time;
+        *slot = SLOT_NUMBER(level, ((wheel_time >> shift) + offset)
+                            & WHEEL_SLOT_MASK);
+      }
+    }
+  }
+
+  if(slots[SLOT_OVERFLOW - 1] != NULL) {
+    /* Overflow timers are re-added when the earliest fits in the wheel */
+    shift = LEVEL_SHIFT(WHEEL_LEVELS - 1);
+    time = ((overflow_expiration >> shift) - (WHEEL_SLOTS - 1)) << shift;
+    if(time < wheel_time) {
+      time = wheel_time;
+    }
+    if(time < next) {
+      next = time;
+      *slot = SLOT_OVERFLOW;
+    }
+  }
+  return next;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_timer(ntimer_t *timer, uint64_t expiration_time)
+{
+  if(!is_initialized) {
+    /* The ntimer system has not yet been initialized */
+    ntimer_init();
+  }
+
+  PRINTF("ntimer: adding timer %p at %lu\n", timer,
+         (unsigned long)expiration_time);
+
+  /* Make sure the timer is not already added to the wheel, while it
+     still has the expiration time it was added with */
+  wheel_remove(timer);
+  timer->expiration_time = expiration_time;
+
+  if(is_empty()) {
+    /* Nothing to process before now */
+    wheel_time = ntimer_uptime();
+  }
+
+  if(timer->expiration_time < get_next_expiration()) {
+    wheel_insert(timer);
+    next_expiration = timer->expiration_time;
+    /* The next timer to expire has changed so we need to notify the driver */
+    NTIMER_DRIVER.update();
+  } else {
+    wheel_insert(timer);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+ntimer_stop(ntimer_t *timer)
+{
+  PRINTF("ntimer: stopping timer %p\n", timer);
+
+  wheel_remove(timer);
+
+  /* Mark timer as expired right now */
+  timer->expiration_time = ntimer_uptime();
+}
+#else /* NTIMER_WHEEL */
+
+LIST(timer_list);
+/*---------------------------------------------------------------------------*/
+static void
+add_timer(ntimer_t *timer, uint64_t expiration_time)
 {
   ntimer_t *n, *l, *p;
 
@@ -63,6 +380,8 @@ add_timer(ntimer_t *timer)
     ntimer_init();
   }
 
+  timer->expiration_time = expiration_time;
+
   PRINTF("ntimer: adding timer %p at %lu\n", timer,
          (unsigned long)timer->expiration_time);
 
@@ -99,21 +418,83 @@ ntimer_stop(ntimer_t *timer)
 
   list_remove(timer_list, timer);
 }
+#endif /* NTIMER_WHEEL */
 /*---------------------------------------------------------------------------*/
 void
 ntimer_set(ntimer_t *timer, uint64_t time)
 {
-  timer->expiration_time = ntimer_uptime() + time;
-  add_timer(timer);
+  add_timer(timer, ntimer_uptime() + time);
 }
 /*---------------------------------------------------------------------------*/
 void
 ntimer_reset(ntimer_t *timer, uint64_t time)
 {
-  timer->expiration_time += time;
-  add_timer(timer);
+  add_timer(timer, timer->expiration_time + time);
 }
 /*---------------------------------------------------------------------------*/
+#if NTIMER_WHEEL
+uint64_t
+ntimer_time_to_next_expiration(void)
+{
+  uint64_t now, next;
+
+  next = get_next_expiration();
+  if(next == NO_EXPIRATION) {
+    /* No pending timers - return a time in the future */
+    return 60000;
+  }
+
+  now = ntimer_uptime();
+  if(now < next) {
+    return next - now;
+  }
+  /* The next timer should already have expired */
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+ntimer_run(void)
+{
+  uint64_t now;
+  ntimer_t *next;
+  unsigned slot;
+
+  /* Always get the current time because it might trigger clock updates */
+  now = ntimer_uptime();
+
+  if(get_next_expiration() > now) {
+    /* No expired timers */
+    return 0;
+  }
+
+  /* Move timers down the wheel until an expired level 0 slot is found */
+  slot = SLOT_NONE;
+  for(;;) {
+    wheel_time = next_event(&slot);
+    if(slot <= WHEEL_SLOTS) {
+      break;
+    }
+    cascade(slot);
+  }
+
+  next = slots[slot - 1];
+  PRINTF("ntimer: timer %p expired at %lu\n", next,
+         (unsigned long)now);
+
+  /* This timer should expire now */
+  wheel_remove(next);
+
+  if(next->callback) {
+    next->callback(next);
+  }
+
+  /* The next timer has changed */
+  NTIMER_DRIVER.update();
+
+  /* Check if there is another pending timer */
+  return get_next_expiration() <= ntimer_uptime();
+}
+#else /* NTIMER_WHEEL */
 uint64_t
 ntimer_time_to_next_expiration(void)
 {
@@ -173,6 +554,7 @@ ntimer_run(void)
 
   return 0;
 }
+#endif /* NTIMER_WHEEL */
 /*---------------------------------------------------------------------------*/
 void
 ntimer_init(void)
@@ -181,9 +563,14 @@ ntimer_init(void)
     return;
   }
   is_initialized = 1;
+#if !NTIMER_WHEEL
   list_init(timer_list);
+#endif /* !NTIMER_WHEEL */
   if(NTIMER_DRIVER.init) {
     NTIMER_DRIVER.init();
   }
+#if NTIMER_WHEEL
+  wheel_time = ntimer_uptime();
+#endif /* NTIMER_WHEEL */
 }
 /*---------------------------------------------------------------------------*/
@@ -41,12 +41,30 @@
 #include "contiki-conf.h"
 #include <stdint.h>
 
+/*
+ * Pending timers are by default kept in a sorted list, which makes
+ * adding a timer O(n). With many concurrent timers (retransmissions,
+ * observe and periodic resources) a hierarchical timer wheel with
+ * O(1) add and stop can be selected instead.
+ */
+#ifdef NTIMER_CONF_WHEEL
+#define NTIMER_WHEEL NTIMER_CONF_WHEEL
+#else /* NTIMER_CONF_WHEEL */
+#define NTIMER_WHEEL 0
+#endif /* NTIMER_CONF_WHEEL */
+
 typedef struct ntimer ntimer_t;
 struct ntimer {
   ntimer_t *next;
   void (* callback)(ntimer_t *);
   void *user_data;
   uint64_t expiration_time;
+#if NTIMER_WHEEL
+  /* The previous timer in the wheel slot, for stopping without a walk */
+  ntimer_t *prev;
+  /* The wheel slot the timer is in, 0 if it is not pending */
+  uint16_t slot;
+#endif /* NTIMER_WHEEL */
 };
 
 typedef struct {
@@ -51,7 +51,7 @@
 #undef REST_MAX_CHUNK_SIZE
 #define REST_MAX_CHUNK_SIZE            64
 
-/* Multiplies with chunk size, be aware of memory constraints. */
+/* Concurrent exchanges, message buffers are set by COAP_TRANSACTION_*_BUFFERS. */
 #undef COAP_MAX_OPEN_TRANSACTIONS
 #define COAP_MAX_OPEN_TRANSACTIONS     4
 
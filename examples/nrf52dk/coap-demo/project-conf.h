@@ -59,11 +59,11 @@
    #define COAP_MAX_HEADER_SIZE           70
  */
 
-/* Multiplies with chunk size, be aware of memory constraints. */
+/* Concurrent exchanges, message buffers are set by COAP_TRANSACTION_*_BUFFERS. */
 #undef COAP_MAX_OPEN_TRANSACTIONS
 #define COAP_MAX_OPEN_TRANSACTIONS     4
 
-/* Must be <= open transactions, default is COAP_MAX_OPEN_TRANSACTIONS-1. */
+/* Number of observers, default is 3. */
 /*
    #undef COAP_MAX_OBSERVERS
    #define COAP_MAX_OBSERVERS             2
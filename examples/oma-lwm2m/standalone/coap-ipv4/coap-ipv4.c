@@ -35,6 +35,12 @@
  *         Joakim Eriksson <joakime@sics.se>
  */
 
+#ifdef __linux__
+/* Needed for recvmmsg() and sendmmsg() */
+#define _GNU_SOURCE
+#define WITH_MMSG 1
+#endif /* __linux__ */
+
 #include "er-coap.h"
 #include "er-coap-endpoint.h"
 #include "er-coap-engine.h"
@@ -66,6 +72,13 @@
 
 #define BUFSIZE 1280
 
+/* Max number of datagrams received or sent in one system call */
+#ifdef COAP_IPV4_CONF_BATCH_SIZE
+#define BATCH_SIZE COAP_IPV4_CONF_BATCH_SIZE
+#else
+#define BATCH_SIZE 16
+#endif
+
 typedef union {
   uint32_t u32[(BUFSIZE + 3) / 4];
   uint8_t u8[BUFSIZE];
@@ -77,6 +90,24 @@ static coap_endpoint_t last_source;
 static coap_buf_t coap_aligned_buf;
 static uint16_t coap_buf_len;
 
+/* Received datagrams not yet processed */
+static coap_buf_t rx_buf[BATCH_SIZE];
+static coap_endpoint_t rx_source[BATCH_SIZE];
+static uint16_t rx_len[BATCH_SIZE];
+
+#if WITH_MMSG
+static struct mmsghdr rx_msgs[BATCH_SIZE];
+static struct iovec rx_iov[BATCH_SIZE];
+
+/* Responses queued while processing received datagrams */
+static struct mmsghdr tx_msgs[BATCH_SIZE];
+static struct iovec tx_iov[BATCH_SIZE];
+static coap_buf_t tx_buf[BATCH_SIZE];
+static coap_endpoint_t tx_dest[BATCH_SIZE];
+static int tx_count;
+static uint8_t is_tx_batching;
+#endif /* WITH_MMSG */
+
 #if WITH_DTLS
 #define PSK_DEFAULT_IDENTITY "Client_identity"
 #define PSK_DEFAULT_KEY      "secretPSK"
@@ -256,9 +287,84 @@ coap_ipv4_set_fd(fd_set *rset, fd_set *wset)
 }
 /*---------------------------------------------------------------------------*/
 static void
+print_data(const char *title, const uint8_t *data, int len)
+{
+  if(DEBUG) {
+    int i;
+    PRINTF("%s:", title);
+    for(i = 0; i < len; i++) {
+      PRINTF("%02x", data[i]);
+    }
+    PRINTF("\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Receives up to BATCH_SIZE datagrams without blocking */
+static int
+receive_batch(void)
+{
+  int i, len;
+
+#if WITH_MMSG
+  for(i = 0; i < BATCH_SIZE; i++) {
+    memset(&rx_source[i], 0, sizeof(rx_source[i]));
+    rx_iov[i].iov_base = rx_buf[i].u8;
+    rx_iov[i].iov_len = BUFSIZE;
+    memset(&rx_msgs[i].msg_hdr, 0, sizeof(rx_msgs[i].msg_hdr));
+    rx_msgs[i].msg_hdr.msg_name = &rx_source[i].addr;
+    rx_msgs[i].msg_hdr.msg_namelen = sizeof(rx_source[i].addr);
+    rx_msgs[i].msg_hdr.msg_iov = &rx_iov[i];
+    rx_msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  len = recvmmsg(coap_ipv4_fd, rx_msgs, BATCH_SIZE, MSG_DONTWAIT, NULL);
+  if(len == -1) {
+    return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+  }
+  for(i = 0; i < len; i++) {
+    rx_source[i].size = rx_msgs[i].msg_hdr.msg_namelen;
+    rx_len[i] = rx_msgs[i].msg_len;
+  }
+  return len;
+#else /* WITH_MMSG */
+  for(i = 0; i < BATCH_SIZE; i++) {
+    memset(&rx_source[i], 0, sizeof(rx_source[i]));
+    rx_source[i].size = sizeof(rx_source[i].addr);
+    len = recvfrom(coap_ipv4_fd, rx_buf[i].u8, BUFSIZE, MSG_DONTWAIT,
+                   (struct sockaddr *)&rx_source[i].addr, &rx_source[i].size);
+    if(len == -1) {
+      if(errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      return i > 0 ? i : -1;
+    }
+    rx_len[i] = len;
+  }
+  return i;
+#endif /* WITH_MMSG */
+}
+/*---------------------------------------------------------------------------*/
+#if WITH_MMSG
+static void
+flush_tx_batch(void)
+{
+  int i, sent;
+
+  for(i = 0; i < tx_count; i += sent) {
+    sent = sendmmsg(coap_ipv4_fd, &tx_msgs[i], tx_count - i, 0);
+    if(sent < 1) {
+      PRINTF("failed to send %d messages: %s\n", tx_count - i,
+             strerror(errno));
+      break;
+    }
+  }
+  tx_count = 0;
+}
+#endif /* WITH_MMSG */
+/*---------------------------------------------------------------------------*/
+static void
 coap_ipv4_handle_fd(fd_set *rset, fd_set *wset)
 {
-  int len;
+  int count, i;
 
   if(coap_ipv4_fd < 0) {
     return;
@@ -267,40 +373,37 @@ coap_ipv4_handle_fd(fd_set *rset, fd_set *wset)
     return;
   }
 
-  memset(&last_source, 0, sizeof(last_source));
-  last_source.size = sizeof(last_source.addr);
-  len = recvfrom(coap_ipv4_fd, coap_databuf(), BUFSIZE, 0,
-                 (struct sockaddr *)&last_source.addr, &last_source.size);
-  if(len == -1) {
-    if(errno == EAGAIN) {
-      return;
-    }
+  count = receive_batch();
+  if(count == -1) {
     err(1, "CoAP-IPv4: recv");
     return;
   }
-  PRINTF("RECV from ");
-  PRINTEP(&last_source);
-  PRINTF(" %u bytes\n", len);
-  coap_buf_len = len;
 
-  if(DEBUG) {
-    int i;
-    uint8_t *data;
-    data = coap_databuf();
-    PRINTF("Received:");
-    for(i = 0; i < len; i++) {
-      PRINTF("%02x", data[i]);
-    }
-    PRINTF("\n");
-  }
+#if WITH_MMSG
+  /* Send all responses to this batch together */
+  is_tx_batching = 1;
+#endif /* WITH_MMSG */
+
+  for(i = 0; i < count; i++) {
+    memcpy(&last_source, &rx_source[i], sizeof(last_source));
+    PRINTF("RECV from ");
+    PRINTEP(&last_source);
+    PRINTF(" %u bytes\n", rx_len[i]);
+    print_data("Received", rx_buf[i].u8, rx_len[i]);
 
 #if WITH_DTLS
-  /* DTLS receive??? */
-  last_source.secure = 1;
-  dtls_handle_message(dtls_context, &last_source, coap_databuf(), coap_datalen());
+    /* DTLS receive??? */
+    last_source.secure = 1;
+    dtls_handle_message(dtls_context, &last_source, rx_buf[i].u8, rx_len[i]);
 #else
-  coap_receive(coap_src_endpoint(), coap_databuf(), coap_datalen());
+    coap_receive(coap_src_endpoint(), rx_buf[i].u8, rx_len[i]);
 #endif
+  }
+
+#if WITH_MMSG
+  is_tx_batching = 0;
+  flush_tx_batch();
+#endif /* WITH_MMSG */
 }
 /*---------------------------------------------------------------------------*/
 static const struct select_callback udp_callback = {
@@ -371,26 +474,46 @@ coap_send_message(const coap_endpoint_t *ep, const uint8_t *data, uint16_t len)
     return;
   }
 #endif
-  if(coap_ipv4_fd >= 0) {
-    if(sendto(coap_ipv4_fd, data, len, 0,
-              (struct sockaddr *)&ep->addr, ep->size) < 1) {
-      PRINTF("failed to send to ");
-      PRINTEP(ep);
-      PRINTF(" %u bytes: %s\n", len, strerror(errno));
-    } else {
-      PRINTF("SENT to ");
-      PRINTEP(ep);
-      PRINTF(" %u bytes\n", len);
-
-      if(DEBUG) {
-        int i;
-        PRINTF("Sent:");
-        for(i = 0; i < len; i++) {
-          PRINTF("%02x", data[i]);
-        }
-        PRINTF("\n");
-      }
+
+  if(coap_ipv4_fd < 0) {
+    return;
+  }
+
+#if WITH_MMSG
+  if(is_tx_batching && len <= BUFSIZE) {
+    memcpy(tx_buf[tx_count].u8, data, len);
+    memcpy(&tx_dest[tx_count], ep, sizeof(coap_endpoint_t));
+    tx_iov[tx_count].iov_base = tx_buf[tx_count].u8;
+    tx_iov[tx_count].iov_len = len;
+    memset(&tx_msgs[tx_count].msg_hdr, 0, sizeof(tx_msgs[tx_count].msg_hdr));
+    tx_msgs[tx_count].msg_hdr.msg_name = &tx_dest[tx_count].addr;
+    tx_msgs[tx_count].msg_hdr.msg_namelen = tx_dest[tx_count].size;
+    tx_msgs[tx_count].msg_hdr.msg_iov = &tx_iov[tx_count];
+    tx_msgs[tx_count].msg_hdr.msg_iovlen = 1;
+    tx_count++;
+
+    PRINTF("QUEUED to ");
+    PRINTEP(ep);
+    PRINTF(" %u bytes\n", len);
+    print_data("Sent", data, len);
+
+    if(tx_count == BATCH_SIZE) {
+      flush_tx_batch();
     }
+    return;
+  }
+#endif /* WITH_MMSG */
+
+  if(sendto(coap_ipv4_fd, data, len, 0,
+            (struct sockaddr *)&ep->addr, ep->size) < 1) {
+    PRINTF("failed to send to ");
+    PRINTEP(ep);
+    PRINTF(" %u bytes: %s\n", len, strerror(errno));
+  } else {
+    PRINTF("SENT to ");
+    PRINTEP(ep);
+    PRINTF(" %u bytes\n", len);
+    print_data("Sent", data, len);
   }
 }
 /* DTLS */
@@ -39,7 +39,7 @@
 #define REST_MAX_CHUNK_SIZE          64
 #endif
 
-/* Multiplies with chunk size, be aware of memory constraints. */
+/* Concurrent exchanges, message buffers are set by COAP_TRANSACTION_*_BUFFERS. */
 #ifndef COAP_MAX_OPEN_TRANSACTIONS
 #define COAP_MAX_OPEN_TRANSACTIONS   2
 #endif
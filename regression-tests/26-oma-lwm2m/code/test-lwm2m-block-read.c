@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Tests block-wise multi resource reads of the LWM2M engine
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "lwm2m-engine.h"
+#include "lwm2m-object.h"
+#include "er-coap-engine.h"
+
+#include <stdio.h>
+#include <string.h>
+
+PROCESS(test_process, "LWM2M block read test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define LARGE_OBJECT_ID      32001
+#define OVERSIZED_OBJECT_ID  32002
+#define RESOURCES            200
+#define VALUE_LEN            48
+#define BLOCK_SIZE           64
+/* TLV header of a resource with an 8-bit identifier and length */
+#define TLV_LEN              (3 + VALUE_LEN)
+#define OBJECT_LEN           (RESOURCES * TLV_LEN)
+
+static lwm2m_resource_id_t large_resources[RESOURCES];
+static const lwm2m_resource_id_t oversized_resources[] = { RO(0) };
+static lwm2m_object_instance_t large_object;
+static lwm2m_object_instance_t oversized_object;
+
+static coap_packet_t request[1];
+static coap_packet_t response[1];
+static coap_endpoint_t endpoint;
+static uint8_t buffer[BLOCK_SIZE];
+static uint8_t expected[OBJECT_LEN];
+static uint8_t received[OBJECT_LEN + BLOCK_SIZE];
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_value(uint16_t id, char *value, int len)
+{
+  int i;
+  for(i = 0; i < len; i++) {
+    value[i] = 'a' + (id + i) % 26;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+object_callback(lwm2m_object_instance_t *object, lwm2m_context_t *ctx)
+{
+  char value[2 * BLOCK_SIZE];
+  int len;
+
+  if(ctx->operation != LWM2M_OP_READ) {
+    return LWM2M_STATUS_OPERATION_NOT_ALLOWED;
+  }
+  len = object == &large_object ? VALUE_LEN : sizeof(value);
+  make_value(ctx->resource_id, value, len);
+  lwm2m_object_write_string(ctx, value, len);
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+/* Calls the CoAP handlers as coap_receive() does for a GET request */
+static int32_t
+get(const char *path, uint32_t block_num, uint16_t block_size)
+{
+  int32_t offset = block_num * block_size;
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(request, path);
+  coap_set_header_accept(request, LWM2M_TLV);
+  coap_set_header_block2(request, block_num, 0, block_size);
+  coap_set_src_endpoint(request, &endpoint);
+  coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+
+  if(er_coap_call_handlers(request, response, buffer, block_size,
+                           &offset) != COAP_HANDLER_STATUS_PROCESSED) {
+    return -2;
+  }
+  return offset;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(block_read, "10 KB object read in 64 byte blocks");
+UNIT_TEST(block_read)
+{
+  uint32_t num;
+  size_t len;
+  int32_t next;
+
+  UNIT_TEST_BEGIN();
+
+  len = 0;
+  for(num = 0; ; num++) {
+    next = get("32001/0", num, BLOCK_SIZE);
+    UNIT_TEST_ASSERT(next != -2);
+    UNIT_TEST_ASSERT(response->code == CONTENT_2_05);
+    UNIT_TEST_ASSERT(response->payload_len <= BLOCK_SIZE);
+    UNIT_TEST_ASSERT(len + response->payload_len <= sizeof(received));
+    memcpy(&received[len], response->payload, response->payload_len);
+    len += response->payload_len;
+    if(next == -1) {
+      break;
+    }
+    /* every block but the last is full */
+    UNIT_TEST_ASSERT(response->payload_len == BLOCK_SIZE);
+    UNIT_TEST_ASSERT(next == (num + 1) * BLOCK_SIZE);
+  }
+
+  UNIT_TEST_ASSERT(num == (OBJECT_LEN + BLOCK_SIZE - 1) / BLOCK_SIZE - 1);
+  UNIT_TEST_ASSERT(len == OBJECT_LEN);
+  UNIT_TEST_ASSERT(memcmp(received, expected, OBJECT_LEN) == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(block_reread, "Blocks read again out of order");
+UNIT_TEST(block_reread)
+{
+  static const uint32_t blocks[] = { 17, 3, 158, 0, 42, 43, 159 };
+  int i;
+
+  UNIT_TEST_BEGIN();
+
+  for(i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++) {
+    UNIT_TEST_ASSERT(get("32001/0", blocks[i], BLOCK_SIZE) != -2);
+    UNIT_TEST_ASSERT(response->code == CONTENT_2_05);
+    UNIT_TEST_ASSERT(response->payload_len ==
+                     MIN(BLOCK_SIZE, OBJECT_LEN - blocks[i] * BLOCK_SIZE));
+    UNIT_TEST_ASSERT(memcmp(response->payload,
+                            &expected[blocks[i] * BLOCK_SIZE],
+                            response->payload_len) == 0);
+  }
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(oversized, "Resource larger than the unit buffer");
+UNIT_TEST(oversized)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(get("32002/0", 0, BLOCK_SIZE) != -2);
+  UNIT_TEST_ASSERT(response->code == INTERNAL_SERVER_ERROR_5_00);
+  UNIT_TEST_ASSERT(response->payload_len == 16);
+  UNIT_TEST_ASSERT(memcmp(response->payload, "ResourceTooLarge", 16) == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  uint8_t *p;
+  int i;
+
+  PROCESS_BEGIN();
+
+  lwm2m_engine_init();
+
+  for(i = 0; i < RESOURCES; i++) {
+    large_resources[i] = RO(i);
+  }
+  large_object.object_id = LARGE_OBJECT_ID;
+  large_object.instance_id = 0;
+  large_object.resource_ids = large_resources;
+  large_object.resource_count = RESOURCES;
+  large_object.callback = object_callback;
+  lwm2m_engine_add_object(&large_object);
+
+  oversized_object.object_id = OVERSIZED_OBJECT_ID;
+  oversized_object.instance_id = 0;
+  oversized_object.resource_ids = oversized_resources;
+  oversized_object.resource_count = LWM2M_RESOURCE_COUNT(oversized_resources);
+  oversized_object.callback = object_callback;
+  lwm2m_engine_add_object(&oversized_object);
+
+  for(i = 0, p = expected; i < RESOURCES; i++) {
+    *p++ = 0xc8;
+    *p++ = i;
+    *p++ = VALUE_LEN;
+    make_value(i, (char *)p, VALUE_LEN);
+    p += VALUE_LEN;
+  }
+
+  coap_endpoint_parse("coap://[fd00::1]", 16, &endpoint);
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(block_read);
+  UNIT_TEST_RUN(block_reread);
+  UNIT_TEST_RUN(oversized);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Tests block-wise composite reads of the LWM2M engine
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "lwm2m-engine.h"
+#include "lwm2m-object.h"
+#include "er-coap-engine.h"
+
+#include <stdio.h>
+#include <string.h>
+
+PROCESS(test_process, "LWM2M composite read test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define TEST_OBJECT_ID       32001
+#define RESOURCES            40
+#define VALUE_LEN            20
+#define MAX_OUTPUT           4096
+
+static const char paths[] =
+  "[{\"n\":\"/32001/0\"},{\"n\":\"/32001/7\"},{\"n\":\"/32001/1\"},"
+  "{\"n\":\"/32001/0/5\"}]";
+
+static lwm2m_resource_id_t resources[RESOURCES];
+static lwm2m_object_instance_t instances[2];
+
+static coap_packet_t request[1];
+static coap_packet_t response[1];
+static coap_endpoint_t endpoint;
+static uint8_t buffer[REST_MAX_CHUNK_SIZE];
+static uint8_t output[2][MAX_OUTPUT];
+static unsigned callbacks;
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+object_callback(lwm2m_object_instance_t *object, lwm2m_context_t *ctx)
+{
+  char value[VALUE_LEN];
+  int i;
+
+  if(ctx->operation != LWM2M_OP_READ) {
+    return LWM2M_STATUS_OPERATION_NOT_ALLOWED;
+  }
+  for(i = 0; i < VALUE_LEN; i++) {
+    value[i] = 'a' + (object->instance_id + ctx->resource_id + i) % 26;
+  }
+  lwm2m_object_write_string(ctx, value, VALUE_LEN);
+  callbacks++;
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+/* Calls the CoAP handlers as coap_receive() does for a FETCH request */
+static int32_t
+fetch(uint32_t block_num, uint16_t block_size)
+{
+  int32_t offset = block_num * block_size;
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_FETCH, 0);
+  coap_set_header_content_format(request, LWM2M_SENML_JSON);
+  coap_set_header_accept(request, LWM2M_SENML_JSON);
+  coap_set_header_block2(request, block_num, 0, block_size);
+  coap_set_payload(request, paths, sizeof(paths) - 1);
+  coap_set_src_endpoint(request, &endpoint);
+  coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+
+  if(er_coap_call_handlers(request, response, buffer, block_size,
+                           &offset) != COAP_HANDLER_STATUS_PROCESSED) {
+    return -2;
+  }
+  return offset;
+}
+/*---------------------------------------------------------------------------*/
+/* Reads all blocks and returns the output length, or -1 on failure */
+static int
+fetch_all(uint16_t block_size, uint8_t *out)
+{
+  uint32_t num;
+  int32_t next;
+  int len = 0;
+
+  for(num = 0; ; num++) {
+    next = fetch(num, block_size);
+    if(next == -2 || response->code != CONTENT_2_05 ||
+       response->payload_len > block_size ||
+       len + response->payload_len > MAX_OUTPUT) {
+      return -1;
+    }
+    memcpy(&out[len], response->payload, response->payload_len);
+    len += response->payload_len;
+    if(next == -1) {
+      return len;
+    }
+    if(response->payload_len != block_size ||
+       next != (num + 1) * block_size) {
+      return -1;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(composite_read, "Composite read in 64 byte blocks");
+UNIT_TEST(composite_read)
+{
+  int small_len, large_len;
+  unsigned small_callbacks;
+
+  UNIT_TEST_BEGIN();
+
+  callbacks = 0;
+  small_len = fetch_all(64, output[0]);
+  small_callbacks = callbacks;
+  large_len = fetch_all(256, output[1]);
+
+  printf("composite read: %d bytes, %u callbacks in 64 byte blocks\n",
+         small_len, small_callbacks);
+
+  /* two instances and one resource again, with a missing instance */
+  UNIT_TEST_ASSERT(small_len > 2 * RESOURCES * VALUE_LEN);
+  UNIT_TEST_ASSERT(small_len == large_len);
+  UNIT_TEST_ASSERT(memcmp(output[0], output[1], small_len) == 0);
+  UNIT_TEST_ASSERT(output[0][0] == '[' && output[0][small_len - 1] == ']');
+
+  /* each block renders at most one resource again */
+  UNIT_TEST_ASSERT(small_callbacks <=
+                   2 * RESOURCES + 1 + (small_len + 63) / 64);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  int i;
+
+  PROCESS_BEGIN();
+
+  lwm2m_engine_init();
+
+  for(i = 0; i < RESOURCES; i++) {
+    resources[i] = RO(i);
+  }
+  for(i = 0; i < 2; i++) {
+    instances[i].object_id = TEST_OBJECT_ID;
+    instances[i].instance_id = i;
+    instances[i].resource_ids = resources;
+    instances[i].resource_count = RESOURCES;
+    instances[i].callback = object_callback;
+    lwm2m_engine_add_object(&instances[i]);
+  }
+
+  coap_endpoint_parse("coap://[fd00::1]", 16, &endpoint);
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(composite_read);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Tests the object instance index of the LWM2M engine and
+ *         compares its lookup time with the list walk the engine falls
+ *         back to when the index is full
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "lwm2m-engine.h"
+#include "lwm2m-object.h"
+#include "oma-tlv.h"
+#include "er-coap-engine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+PROCESS(test_process, "LWM2M instance index test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define FIRST_OBJECT_ID      32101
+#define OBJECTS              4
+#define INSTANCES_PER_OBJECT 16
+#define INSTANCES            (OBJECTS * INSTANCES_PER_OBJECT)
+#define BENCH_OBJECT_ID      32110
+#define FILLER_OBJECT_ID     32199
+#define BENCH_ROUNDS         20000
+#define BUFFER_SIZE          256
+
+static const lwm2m_resource_id_t resources[] = { RO(0) };
+static lwm2m_object_instance_t instances[LWM2M_ENGINE_CONF_MAX_OBJECTS + 1];
+static lwm2m_object_instance_t *added[LWM2M_ENGINE_CONF_MAX_OBJECTS + 1];
+static int added_count;
+
+static coap_packet_t request[1];
+static coap_packet_t response[1];
+static coap_endpoint_t endpoint;
+static uint8_t buffer[BUFFER_SIZE];
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int32_t
+instance_value(uint16_t object_id, uint16_t instance_id)
+{
+  return (int32_t)object_id * 1000 + instance_id;
+}
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+object_callback(lwm2m_object_instance_t *object, lwm2m_context_t *ctx)
+{
+  if(ctx->operation != LWM2M_OP_READ) {
+    return LWM2M_STATUS_OPERATION_NOT_ALLOWED;
+  }
+  lwm2m_object_write_int(ctx, instance_value(object->object_id,
+                                             object->instance_id));
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_instance(uint16_t object_id, uint16_t instance_id)
+{
+  lwm2m_object_instance_t *i = &instances[added_count];
+
+  memset(i, 0, sizeof(*i));
+  i->object_id = object_id;
+  i->instance_id = instance_id;
+  i->resource_ids = resources;
+  i->resource_count = LWM2M_RESOURCE_COUNT(resources);
+  i->callback = object_callback;
+  lwm2m_engine_add_object(i);
+  added[added_count++] = i;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_all(void)
+{
+  while(added_count > 0) {
+    lwm2m_engine_remove_object(added[--added_count]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Calls the CoAP handlers as coap_receive() does for a GET request */
+static int
+get(const char *path, unsigned int accept)
+{
+  int32_t offset = 0;
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(request, path);
+  coap_set_header_accept(request, accept);
+  coap_set_src_endpoint(request, &endpoint);
+  coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+
+  if(er_coap_call_handlers(request, response, buffer, sizeof(buffer),
+                           &offset) != COAP_HANDLER_STATUS_PROCESSED) {
+    /* As call_service() answers when no handler takes the request */
+    return NOT_FOUND_4_04;
+  }
+  return response->code;
+}
+/*---------------------------------------------------------------------------*/
+/* Reads resource 0 of an instance as text and checks its value */
+static int
+read_instance(uint16_t object_id, uint16_t instance_id)
+{
+  char path[24];
+  char value[12];
+
+  snprintf(path, sizeof(path), "%u/%u/0", object_id, instance_id);
+  if(get(path, LWM2M_TEXT_PLAIN) != CONTENT_2_05) {
+    return 0;
+  }
+  snprintf(value, sizeof(value), "%ld",
+           (long)instance_value(object_id, instance_id));
+  return response->payload_len == strlen(value) &&
+    memcmp(response->payload, value, response->payload_len) == 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_missing(const char *path)
+{
+  return get(path, LWM2M_TEXT_PLAIN) == NOT_FOUND_4_04;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(lookup, "instances added out of order are found");
+UNIT_TEST(lookup)
+{
+  int k, n;
+
+  UNIT_TEST_BEGIN();
+
+  /* A permutation of all instances */
+  for(k = 0; k < INSTANCES; k++) {
+    n = (k * 37) % INSTANCES;
+    add_instance(FIRST_OBJECT_ID + n % OBJECTS, n / OBJECTS);
+  }
+
+  for(n = 0; n < INSTANCES; n++) {
+    UNIT_TEST_ASSERT(read_instance(FIRST_OBJECT_ID + n % OBJECTS,
+                                   n / OBJECTS));
+  }
+  UNIT_TEST_ASSERT(is_missing("32101/16/0"));
+  UNIT_TEST_ASSERT(is_missing("32100/0/0"));
+  UNIT_TEST_ASSERT(is_missing("32105/0/0"));
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(object_read, "object read returns instances in order");
+UNIT_TEST(object_read)
+{
+  oma_tlv_t tlv;
+  size_t pos, len;
+  uint16_t expected;
+
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(get("32102", LWM2M_TLV) == CONTENT_2_05);
+
+  expected = 0;
+  for(pos = 0; pos < response->payload_len; pos += len) {
+    len = oma_tlv_read(&tlv, response->payload + pos,
+                       response->payload_len - pos);
+    UNIT_TEST_ASSERT(len > 0);
+    /* The resources of all instances follow each other */
+    UNIT_TEST_ASSERT(tlv.type == OMA_TLV_TYPE_RESOURCE && tlv.id == 0);
+    UNIT_TEST_ASSERT(oma_tlv_get_int32(&tlv) ==
+                     instance_value(FIRST_OBJECT_ID + 1, expected));
+    expected++;
+  }
+  UNIT_TEST_ASSERT(expected == INSTANCES_PER_OBJECT);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(remove, "removed instances are not found");
+UNIT_TEST(remove)
+{
+  int k;
+  lwm2m_object_instance_t *i;
+
+  UNIT_TEST_BEGIN();
+
+  /* Remove every other instance */
+  for(k = 0; k < added_count; k += 2) {
+    lwm2m_engine_remove_object(added[k]);
+  }
+  for(k = 0; k < added_count; k++) {
+    i = added[k];
+    if(k % 2 == 0) {
+      UNIT_TEST_ASSERT(!read_instance(i->object_id, i->instance_id));
+    } else {
+      UNIT_TEST_ASSERT(read_instance(i->object_id, i->instance_id));
+    }
+  }
+
+  /* And add them again */
+  for(k = 0; k < added_count; k += 2) {
+    lwm2m_engine_add_object(added[k]);
+  }
+  for(k = 0; k < added_count; k++) {
+    UNIT_TEST_ASSERT(read_instance(added[k]->object_id,
+                                   added[k]->instance_id));
+  }
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(full_index, "lookup with more instances than the index");
+UNIT_TEST(full_index)
+{
+  int k;
+
+  UNIT_TEST_BEGIN();
+
+  /* Overflow the index - the engine walks its list instead */
+  while(added_count <= LWM2M_ENGINE_CONF_MAX_OBJECTS) {
+    add_instance(FILLER_OBJECT_ID, added_count);
+  }
+  for(k = 0; k < added_count; k++) {
+    UNIT_TEST_ASSERT(read_instance(added[k]->object_id,
+                                   added[k]->instance_id));
+  }
+
+  /* Back under the limit the index is rebuilt */
+  while(added_count > INSTANCES) {
+    lwm2m_engine_remove_object(added[--added_count]);
+  }
+  for(k = 0; k < added_count; k++) {
+    UNIT_TEST_ASSERT(read_instance(added[k]->object_id,
+                                   added[k]->instance_id));
+  }
+  UNIT_TEST_ASSERT(is_missing("32199/0/0"));
+
+  remove_all();
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+/* Reads the last instance of the benchmark object repeatedly */
+static clock_time_t
+bench_reads(uint16_t last)
+{
+  char path[24];
+  clock_time_t start;
+  int32_t offset;
+  long r;
+
+  snprintf(path, sizeof(path), "%u/%u/0", BENCH_OBJECT_ID, last);
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(request, path);
+  coap_set_header_accept(request, LWM2M_TEXT_PLAIN);
+  coap_set_src_endpoint(request, &endpoint);
+
+  start = clock_time();
+  for(r = 0; r < BENCH_ROUNDS; r++) {
+    offset = 0;
+    coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+    er_coap_call_handlers(request, response, buffer, sizeof(buffer), &offset);
+  }
+  return clock_time() - start;
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(int count)
+{
+  clock_time_t indexed, walked;
+
+  while(added_count < count) {
+    add_instance(BENCH_OBJECT_ID, added_count);
+  }
+  indexed = bench_reads(count - 1);
+
+  /* Overflow the index with instances sorted after the benchmark
+     object, so that the list walk visits the same instances */
+  while(added_count <= LWM2M_ENGINE_CONF_MAX_OBJECTS) {
+    add_instance(FILLER_OBJECT_ID, added_count);
+  }
+  walked = bench_reads(count - 1);
+
+  printf("%d instances, %d reads of the last: index %lu ms, list %lu ms\n",
+         count, BENCH_ROUNDS,
+         (unsigned long)(indexed * 1000 / CLOCK_SECOND),
+         (unsigned long)(walked * 1000 / CLOCK_SECOND));
+
+  remove_all();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  lwm2m_engine_init();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(lookup);
+  UNIT_TEST_RUN(object_read);
+  UNIT_TEST_RUN(remove);
+  UNIT_TEST_RUN(full_index);
+
+  bench(16);
+  bench(64);
+  bench(LWM2M_ENGINE_CONF_MAX_OBJECTS);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Tests pmin, pmax, st and gt/lt of the LWM2M notification
+ *         attributes with two servers observing the same resource
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "lwm2m-engine.h"
+#include "lwm2m-object.h"
+#include "er-coap-engine.h"
+#include "net/ip/tcpip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "sys/ntimer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+PROCESS(test_process, "LWM2M notification attributes test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define UIP_IP_BUF  ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_UDP_BUF ((struct uip_udp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+
+#define OBJECT_ID   3303
+#define RSC_VALUE   5700
+#define PATH        "3303/0/5700"
+
+/* Servers A and B observe from two ports of the same host */
+#define SERVER_A    0
+#define SERVER_B    1
+#define FIRST_PORT  5683
+
+#define FIX(x)      ((int32_t)(x) * LWM2M_FLOAT32_FRAC)
+
+static const lwm2m_resource_id_t resources[] = { RO(RSC_VALUE) };
+static lwm2m_object_instance_t instance;
+static int32_t value;
+
+static coap_packet_t request[1];
+static coap_packet_t response[1];
+static coap_endpoint_t servers[2];
+static uint8_t buffer[REST_MAX_CHUNK_SIZE];
+
+/* Notifications sent to each server */
+static unsigned sent[2];
+
+/* Notifications counted at the steps of the scenario */
+static unsigned burst[2];
+static unsigned after_pmin[2];
+static unsigned thresholds[2];
+static unsigned pmax[2];
+static unsigned after_cancel[2];
+static uint64_t next_expiration;
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+object_callback(lwm2m_object_instance_t *object, lwm2m_context_t *ctx)
+{
+  if(ctx->operation != LWM2M_OP_READ) {
+    return LWM2M_STATUS_OPERATION_NOT_ALLOWED;
+  }
+  lwm2m_object_write_float32fix(ctx, value, LWM2M_FLOAT32_BITS);
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+/* Replaces the link layer: counts the notifications sent to each server */
+static uint8_t
+capture_output(const uip_lladdr_t *lladdr)
+{
+  uint16_t n;
+
+  if(UIP_IP_BUF->proto == UIP_PROTO_UDP) {
+    n = UIP_HTONS(UIP_UDP_BUF->destport) - FIRST_PORT;
+    if(n < 2) {
+      sent[n]++;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Calls the CoAP handlers as coap_receive() does for a request of a server */
+static unsigned
+send_request(int server, coap_method_t method, const char *path,
+             const char *query, int observe)
+{
+  int32_t offset = 0;
+  uint8_t token = server;
+
+  coap_init_message(request, COAP_TYPE_CON, method, 0);
+  coap_set_token(request, &token, 1);
+  coap_set_header_uri_path(request, path);
+  if(query != NULL) {
+    coap_set_header_uri_query(request, query);
+  }
+  if(observe >= 0) {
+    coap_set_header_observe(request, observe);
+  }
+  coap_set_src_endpoint(request, &servers[server]);
+  coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+
+  if(er_coap_call_handlers(request, response, buffer, sizeof(buffer),
+                           &offset) != COAP_HANDLER_STATUS_PROCESSED) {
+    return 0;
+  }
+  return response->code;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_value(int32_t new_value)
+{
+  value = new_value;
+  lwm2m_notify_object_observers(&instance, RSC_VALUE);
+}
+/*---------------------------------------------------------------------------*/
+static void
+count(unsigned *counts)
+{
+  counts[SERVER_A] = sent[SERVER_A];
+  counts[SERVER_B] = sent[SERVER_B];
+  sent[SERVER_A] = 0;
+  sent[SERVER_B] = 0;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(rate_limit, "pmin coalesces the changes for one server");
+UNIT_TEST(rate_limit)
+{
+  UNIT_TEST_BEGIN();
+
+  /* A is within pmin of its observe request, B has no attributes */
+  UNIT_TEST_ASSERT(burst[SERVER_A] == 0);
+  UNIT_TEST_ASSERT(burst[SERVER_B] == 10);
+  /* One notification of the whole burst once pmin has passed */
+  UNIT_TEST_ASSERT(after_pmin[SERVER_A] == 1);
+  UNIT_TEST_ASSERT(after_pmin[SERVER_B] == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(step, "st and gt filter the changes, also of large values");
+UNIT_TEST(step)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(thresholds[SERVER_A] == 6);
+  UNIT_TEST_ASSERT(thresholds[SERVER_B] == 7);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(keep_alive, "pmax stops with the observation");
+UNIT_TEST(keep_alive)
+{
+  UNIT_TEST_BEGIN();
+
+  /* B is notified every second without changes, A is not */
+  UNIT_TEST_ASSERT(pmax[SERVER_A] == 0);
+  UNIT_TEST_ASSERT(pmax[SERVER_B] == 2);
+
+  /* Nothing is sent or scheduled once B has cancelled */
+  UNIT_TEST_ASSERT(after_cancel[SERVER_A] == 0);
+  UNIT_TEST_ASSERT(after_cancel[SERVER_B] == 0);
+  UNIT_TEST_ASSERT(next_expiration > 10000);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  static const uip_lladdr_t lladdr = { { 0x02, 0x00, 0x00, 0x00,
+                                         0x00, 0x00, 0x00, 0x02 } };
+  static struct etimer et;
+  int i;
+
+  PROCESS_BEGIN();
+
+  lwm2m_engine_init();
+
+  instance.object_id = OBJECT_ID;
+  instance.instance_id = 0;
+  instance.resource_ids = resources;
+  instance.resource_count = sizeof(resources) / sizeof(resources[0]);
+  instance.callback = object_callback;
+  lwm2m_engine_add_object(&instance);
+
+  /* The notifications go to a reachable neighbor and are captured
+     instead of being sent */
+  for(i = 0; i < 2; i++) {
+    uip_ip6addr(&servers[i].ipaddr, 0xfe80, 0, 0, 0, 0, 0, 0, 2);
+    servers[i].port = UIP_HTONS(FIRST_PORT + i);
+  }
+  uip_ds6_nbr_add(&servers[0].ipaddr, &lladdr, 0, NBR_REACHABLE,
+                  NBR_TABLE_REASON_UNDEFINED, NULL);
+  tcpip_set_outputfunc(capture_output);
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  /* A burst of changes with pmin of 1 s for A */
+  send_request(SERVER_A, COAP_PUT, PATH, "pmin=1", -1);
+  send_request(SERVER_A, COAP_GET, PATH, NULL, 0);
+  send_request(SERVER_B, COAP_GET, PATH, NULL, 0);
+  for(i = 0; i < 10; i++) {
+    set_value(FIX(i));
+  }
+  count(burst);
+  etimer_set(&et, CLOCK_SECOND * 3 / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  count(after_pmin);
+
+  /* Steps of 100 and a threshold at 1000 for A, largest values last */
+  send_request(SERVER_A, COAP_PUT, PATH, "pmin&st=100&gt=1000", -1);
+  set_value(FIX(10));           /* the first value is notified */
+  set_value(FIX(60));
+  set_value(FIX(200));          /* step */
+  set_value(FIX(950));          /* step */
+  set_value(FIX(1020));         /* above gt */
+  /* Without gt only the step can notify the largest changes */
+  send_request(SERVER_A, COAP_PUT, PATH, "gt", -1);
+  set_value(FIX(-2097151));     /* step */
+  set_value(FIX(2097151));      /* step that does not fit in 32 bits */
+  count(thresholds);
+
+  /* pmax of 1 s on the instance for B */
+  send_request(SERVER_B, COAP_PUT, "3303/0", "pmax=1", -1);
+  etimer_set(&et, CLOCK_SECOND * 5 / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  count(pmax);
+
+  /* B cancels its observation */
+  send_request(SERVER_B, COAP_GET, PATH, NULL, 1);
+  etimer_set(&et, CLOCK_SECOND * 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  count(after_cancel);
+  next_expiration = ntimer_time_to_next_expiration();
+
+  printf("A/B notifications: burst %u/%u, after pmin %u/%u, "
+         "thresholds %u/%u, pmax %u/%u, after cancel %u/%u\n",
+         burst[SERVER_A], burst[SERVER_B],
+         after_pmin[SERVER_A], after_pmin[SERVER_B],
+         thresholds[SERVER_A], thresholds[SERVER_B],
+         pmax[SERVER_A], pmax[SERVER_B],
+         after_cancel[SERVER_A], after_cancel[SERVER_B]);
+
+  UNIT_TEST_RUN(rate_limit);
+  UNIT_TEST_RUN(step);
+  UNIT_TEST_RUN(keep_alive);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Tests the resource lookup of the LWM2M engine on sorted and
+ *         unsorted resource arrays and compares the time of single
+ *         resource reads for both
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "lwm2m-engine.h"
+#include "lwm2m-object.h"
+#include "er-coap-engine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+PROCESS(test_process, "LWM2M resource search test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define OBJECT_ID       32201
+#define RESOURCES       50
+#define MAX_RESOURCES   200
+#define BENCH_ROUNDS    20000
+#define BUFFER_SIZE     256
+
+static lwm2m_resource_id_t resources[MAX_RESOURCES];
+static lwm2m_object_instance_t instance;
+
+static coap_packet_t request[1];
+static coap_packet_t response[1];
+static coap_endpoint_t endpoint;
+static uint8_t buffer[BUFFER_SIZE];
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+object_callback(lwm2m_object_instance_t *object, lwm2m_context_t *ctx)
+{
+  if(ctx->operation == LWM2M_OP_READ) {
+    lwm2m_object_write_int(ctx, ctx->resource_id);
+  }
+  return LWM2M_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+/* Resource IDs 1, 4, 7... that are in turn readable, writable and
+   executable. Unsorted arrays have the same resources in another order. */
+static void
+add_instance(int sorted)
+{
+  int k, n;
+  uint16_t rid;
+
+  for(k = 0; k < RESOURCES; k++) {
+    n = sorted ? k : (k * 17) % RESOURCES;
+    rid = 3 * n + 1;
+    if(n % 3 == 0) {
+      resources[k] = RO(rid);
+    } else if(n % 3 == 1) {
+      resources[k] = RW(rid);
+    } else {
+      resources[k] = EX(rid);
+    }
+  }
+
+  memset(&instance, 0, sizeof(instance));
+  instance.object_id = OBJECT_ID;
+  instance.instance_id = 0;
+  instance.resource_ids = resources;
+  instance.resource_count = RESOURCES;
+  instance.callback = object_callback;
+  lwm2m_engine_add_object(&instance);
+}
+/*---------------------------------------------------------------------------*/
+/* Calls the CoAP handlers as coap_receive() does */
+static int
+call(coap_method_t method, uint16_t rid, const char *payload)
+{
+  char path[24];
+  int32_t offset = 0;
+
+  snprintf(path, sizeof(path), "%u/0/%u", OBJECT_ID, rid);
+  coap_init_message(request, COAP_TYPE_CON, method, 0);
+  coap_set_header_uri_path(request, path);
+  coap_set_src_endpoint(request, &endpoint);
+  if(payload != NULL) {
+    coap_set_header_content_format(request, LWM2M_TEXT_PLAIN);
+    coap_set_payload(request, payload, strlen(payload));
+  } else {
+    coap_set_header_accept(request, LWM2M_TEXT_PLAIN);
+  }
+  coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+
+  if(er_coap_call_handlers(request, response, buffer, sizeof(buffer),
+                           &offset) != COAP_HANDLER_STATUS_PROCESSED) {
+    /* As call_service() answers when no handler takes the request */
+    return NOT_FOUND_4_04;
+  }
+  return response->code;
+}
+/*---------------------------------------------------------------------------*/
+/* Reads all resource IDs up to the last one and checks each outcome */
+static int
+check_reads(void)
+{
+  char value[8];
+  uint16_t rid;
+
+  for(rid = 0; rid <= 3 * RESOURCES; rid++) {
+    if(rid % 3 != 1) {
+      if(call(COAP_GET, rid, NULL) != NOT_FOUND_4_04) {
+        return 0;
+      }
+    } else if((rid / 3) % 3 == 2) {
+      if(call(COAP_GET, rid, NULL) != METHOD_NOT_ALLOWED_4_05) {
+        return 0;
+      }
+    } else {
+      if(call(COAP_GET, rid, NULL) != CONTENT_2_05) {
+        return 0;
+      }
+      snprintf(value, sizeof(value), "%u", rid);
+      if(response->payload_len != strlen(value) ||
+         memcmp(response->payload, value, response->payload_len) != 0) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Writes all resource IDs up to the last one and checks each outcome */
+static int
+check_writes(void)
+{
+  uint16_t rid;
+  int expected;
+
+  for(rid = 0; rid <= 3 * RESOURCES; rid++) {
+    if(rid % 3 == 1 && (rid / 3) % 3 == 1) {
+      expected = CHANGED_2_04;
+    } else {
+      expected = METHOD_NOT_ALLOWED_4_05;
+    }
+    if(call(COAP_PUT, rid, "42") != expected) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(sorted, "sorted resources are searched");
+UNIT_TEST(sorted)
+{
+  UNIT_TEST_BEGIN();
+
+  add_instance(1);
+  UNIT_TEST_ASSERT(instance.flags & LWM2M_INSTANCE_FLAG_SORTED_RESOURCES);
+  UNIT_TEST_ASSERT(check_reads());
+  UNIT_TEST_ASSERT(check_writes());
+  lwm2m_engine_remove_object(&instance);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(unsorted, "unsorted resources are scanned");
+UNIT_TEST(unsorted)
+{
+  UNIT_TEST_BEGIN();
+
+  add_instance(0);
+  UNIT_TEST_ASSERT(!(instance.flags & LWM2M_INSTANCE_FLAG_SORTED_RESOURCES));
+  UNIT_TEST_ASSERT(check_reads());
+  UNIT_TEST_ASSERT(check_writes());
+  lwm2m_engine_remove_object(&instance);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+/* Reads the last resource of the instance repeatedly */
+static clock_time_t
+bench_reads(int count)
+{
+  char path[24];
+  clock_time_t start;
+  int32_t offset;
+  long r;
+
+  snprintf(path, sizeof(path), "%u/0/%u", OBJECT_ID, count - 1);
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(request, path);
+  coap_set_header_accept(request, LWM2M_TEXT_PLAIN);
+  coap_set_src_endpoint(request, &endpoint);
+
+  start = clock_time();
+  for(r = 0; r < BENCH_ROUNDS; r++) {
+    offset = 0;
+    coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+    er_coap_call_handlers(request, response, buffer, sizeof(buffer), &offset);
+  }
+  return clock_time() - start;
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(int count)
+{
+  clock_time_t searched, scanned;
+  int k;
+
+  for(k = 0; k < count; k++) {
+    resources[k] = RO(k);
+  }
+  memset(&instance, 0, sizeof(instance));
+  instance.object_id = OBJECT_ID;
+  instance.resource_ids = resources;
+  instance.resource_count = count;
+  instance.callback = object_callback;
+  lwm2m_engine_add_object(&instance);
+  searched = bench_reads(count);
+
+  /* Swap the first two so that the last resource is found by a scan
+     over all resources */
+  resources[0] = RO(1);
+  resources[1] = RO(0);
+  lwm2m_engine_add_object(&instance);
+  scanned = bench_reads(count);
+
+  printf("%d resources, %d reads of the last: search %lu ms, scan %lu ms\n",
+         count, BENCH_ROUNDS,
+         (unsigned long)(searched * 1000 / CLOCK_SECOND),
+         (unsigned long)(scanned * 1000 / CLOCK_SECOND));
+
+  lwm2m_engine_remove_object(&instance);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  lwm2m_engine_init();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(sorted);
+  UNIT_TEST_RUN(unsorted);
+
+  bench(10);
+  bench(50);
+  bench(MAX_RESOURCES);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
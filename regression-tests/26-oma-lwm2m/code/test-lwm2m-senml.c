@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Round-trip tests of the SenML JSON and CBOR formats of the
+ *         LWM2M engine and a comparison of their payload size and encode
+ *         time with the TLV and OMA JSON formats
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "lwm2m-engine.h"
+#include "lwm2m-object.h"
+#include "er-coap-engine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+PROCESS(test_process, "LWM2M SenML test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define OBJECT_ID       32301
+/* Instances in the round-trip tests - their payloads fit in a request */
+#define TEST_INSTANCES  2
+#define BENCH_INSTANCES 8
+#define BENCH_ROUNDS    2000
+#define BLOCK_SIZE      REST_MAX_CHUNK_SIZE
+#define STRING_LEN      16
+
+#define RSC_INT         0
+#define RSC_FLOAT       1
+#define RSC_STRING      2
+#define RSC_BOOL        3
+
+static const lwm2m_resource_id_t resources[] =
+  { RW(RSC_INT), RW(RSC_FLOAT), RW(RSC_STRING), RW(RSC_BOOL) };
+
+typedef struct {
+  int32_t int_value;
+  int32_t float_value;
+  char string_value[STRING_LEN];
+  int bool_value;
+} values_t;
+
+static lwm2m_object_instance_t instances[BENCH_INSTANCES];
+static values_t values[BENCH_INSTANCES];
+
+static coap_packet_t request[1];
+static coap_packet_t response[1];
+static coap_endpoint_t endpoint;
+static uint8_t buffer[BLOCK_SIZE];
+static uint8_t payload[BENCH_INSTANCES * 160];
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Values with negative and multi-byte numbers and both booleans */
+static void
+expected_values(uint16_t instance_id, values_t *v)
+{
+  memset(v, 0, sizeof(*v));
+  v->int_value = (int32_t)instance_id * 100000 - 7;
+  v->float_value = -LWM2M_FLOAT32_FRAC / 4 +
+    (int32_t)instance_id * 3 * LWM2M_FLOAT32_FRAC / 2;
+  snprintf(v->string_value, sizeof(v->string_value), "sensor-%u",
+           instance_id);
+  v->bool_value = instance_id & 1;
+}
+/*---------------------------------------------------------------------------*/
+static lwm2m_status_t
+object_callback(lwm2m_object_instance_t *object, lwm2m_context_t *ctx)
+{
+  values_t *v = &values[object - instances];
+  size_t len = 0;
+
+  if(ctx->operation == LWM2M_OP_READ) {
+    switch(ctx->resource_id) {
+    case RSC_INT:
+      lwm2m_object_write_int(ctx, v->int_value);
+      break;
+    case RSC_FLOAT:
+      lwm2m_object_write_float32fix(ctx, v->float_value, LWM2M_FLOAT32_BITS);
+      break;
+    case RSC_STRING:
+      lwm2m_object_write_string(ctx, v->string_value,
+                                strlen(v->string_value));
+      break;
+    case RSC_BOOL:
+      lwm2m_object_write_boolean(ctx, v->bool_value);
+      break;
+    }
+    return LWM2M_STATUS_OK;
+  }
+
+  if(ctx->operation == LWM2M_OP_WRITE) {
+    switch(ctx->resource_id) {
+    case RSC_INT:
+      len = lwm2m_object_read_int(ctx, ctx->inbuf, ctx->insize,
+                                  &v->int_value);
+      break;
+    case RSC_FLOAT:
+      len = lwm2m_object_read_float32fix(ctx, ctx->inbuf, ctx->insize,
+                                         &v->float_value,
+                                         LWM2M_FLOAT32_BITS);
+      break;
+    case RSC_STRING:
+      len = lwm2m_object_read_string(ctx, ctx->inbuf, ctx->insize,
+                                     (uint8_t *)v->string_value,
+                                     sizeof(v->string_value));
+      break;
+    case RSC_BOOL:
+      len = lwm2m_object_read_boolean(ctx, ctx->inbuf, ctx->insize,
+                                      &v->bool_value);
+      break;
+    }
+    return len > 0 ? LWM2M_STATUS_OK : LWM2M_STATUS_BAD_REQUEST;
+  }
+  return LWM2M_STATUS_OPERATION_NOT_ALLOWED;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_instances(int count)
+{
+  lwm2m_object_instance_t *i;
+  int k;
+
+  for(k = 0; k < count; k++) {
+    i = &instances[k];
+    memset(i, 0, sizeof(*i));
+    i->object_id = OBJECT_ID;
+    i->instance_id = k;
+    i->resource_ids = resources;
+    i->resource_count = LWM2M_RESOURCE_COUNT(resources);
+    i->callback = object_callback;
+    expected_values(k, &values[k]);
+    lwm2m_engine_add_object(i);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_instances(int count)
+{
+  int k;
+
+  for(k = 0; k < count; k++) {
+    lwm2m_engine_remove_object(&instances[k]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+init_request(coap_method_t method, const char *path)
+{
+  coap_init_message(request, COAP_TYPE_CON, method, 0);
+  coap_set_header_uri_path(request, path);
+  coap_set_src_endpoint(request, &endpoint);
+  coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+}
+/*
+ * Reads a path block by block as coap_receive() does and returns the
+ * length of the payload or -1 on error.
+ */
+static int
+read_all(const char *path, unsigned int format)
+{
+  uint32_t num;
+  int32_t offset;
+  int len = 0;
+
+  for(num = 0; ; num++) {
+    init_request(COAP_GET, path);
+    coap_set_header_accept(request, format);
+    coap_set_header_block2(request, num, 0, BLOCK_SIZE);
+    offset = num * BLOCK_SIZE;
+    if(er_coap_call_handlers(request, response, buffer, BLOCK_SIZE,
+                             &offset) != COAP_HANDLER_STATUS_PROCESSED ||
+       response->code != CONTENT_2_05 ||
+       len + response->payload_len > sizeof(payload)) {
+      return -1;
+    }
+    memcpy(&payload[len], response->payload, response->payload_len);
+    len += response->payload_len;
+    if(offset == -1) {
+      return len;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+write(coap_method_t method, const char *path, unsigned int format, int len)
+{
+  int32_t offset = 0;
+
+  init_request(method, path);
+  coap_set_header_content_format(request, format);
+  coap_set_payload(request, payload, len);
+  if(er_coap_call_handlers(request, response, buffer, BLOCK_SIZE,
+                           &offset) != COAP_HANDLER_STATUS_PROCESSED) {
+    return NOT_FOUND_4_04;
+  }
+  return response->code;
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_values(int first, int count)
+{
+  values_t expected;
+  int k;
+
+  for(k = first; k < first + count; k++) {
+    expected_values(k, &expected);
+    if(memcmp(&values[k], &expected, sizeof(expected)) != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the whole object and then one instance, clears the values and
+ * writes them back from the read payloads.
+ */
+static int
+round_trip(unsigned int format)
+{
+  char path[16];
+  int len, k;
+
+  for(k = 0; k < TEST_INSTANCES; k++) {
+    expected_values(k, &values[k]);
+  }
+
+  snprintf(path, sizeof(path), "%u", OBJECT_ID);
+  len = read_all(path, format);
+  if(len <= 0 || len > REST_MAX_CHUNK_SIZE) {
+    return 0;
+  }
+  memset(values, 0, sizeof(values));
+  if(write(COAP_POST, path, format, len) != CHANGED_2_04 ||
+     !check_values(0, TEST_INSTANCES)) {
+    return 0;
+  }
+
+  snprintf(path, sizeof(path), "%u/1", OBJECT_ID);
+  len = read_all(path, format);
+  if(len <= 0 || len > REST_MAX_CHUNK_SIZE) {
+    return 0;
+  }
+  memset(values, 0, sizeof(values));
+  if(write(COAP_PUT, path, format, len) != CHANGED_2_04 ||
+     !check_values(1, 1)) {
+    return 0;
+  }
+
+  /* A record of another instance is rejected */
+  return write(COAP_PUT, "32301/0", format, len) == BAD_REQUEST_4_00;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(senml_json, "SenML JSON round trip");
+UNIT_TEST(senml_json)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(round_trip(LWM2M_SENML_JSON));
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(senml_cbor, "SenML CBOR round trip");
+UNIT_TEST(senml_cbor)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(round_trip(LWM2M_SENML_CBOR));
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+/* Reads all instances of the object repeatedly */
+static void
+bench(const char *name, unsigned int format)
+{
+  char path[8];
+  clock_time_t start;
+  int len = 0;
+  int r;
+
+  snprintf(path, sizeof(path), "%u", OBJECT_ID);
+  start = clock_time();
+  for(r = 0; r < BENCH_ROUNDS; r++) {
+    len = read_all(path, format);
+  }
+  start = clock_time() - start;
+
+  printf("%-10s %d instances: %d bytes, %d reads %lu ms\n", name,
+         BENCH_INSTANCES, len, BENCH_ROUNDS,
+         (unsigned long)(start * 1000 / CLOCK_SECOND));
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  lwm2m_engine_init();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  add_instances(TEST_INSTANCES);
+  UNIT_TEST_RUN(senml_json);
+  UNIT_TEST_RUN(senml_cbor);
+  remove_instances(TEST_INSTANCES);
+
+  add_instances(BENCH_INSTANCES);
+  bench("TLV", LWM2M_TLV);
+  bench("JSON", LWM2M_JSON);
+  bench("SenML JSON", LWM2M_SENML_JSON);
+  bench("SenML CBOR", LWM2M_SENML_CBOR);
+  remove_instances(BENCH_INSTANCES);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Runs confirmable exchanges over an emulated path with delay and
+ *         loss and checks that the retransmission timeout adapts to it.
+ *         Build with DEFINES=COAP_MAX_RTT_ESTIMATORS=0 to get the numbers
+ *         of the fixed timeout for comparison.
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "er-coap-engine.h"
+#include "er-coap-cocoa.h"
+#include "er-coap-transactions.h"
+#include "sys/ntimer.h"
+#include "net/ip/tcpip.h"
+#include "net/ipv6/uip-ds6.h"
+
+#include <stdio.h>
+#include <string.h>
+
+PROCESS(test_process, "CoAP CoCoA test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define UIP_IP_BUF  ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+/* Answers in flight on the emulated path */
+#define MAX_ANSWERS 8
+
+typedef struct {
+  const char *name;
+  uint16_t port;
+  uint32_t rtt;          /* ms */
+  uint8_t loss_period;   /* every n:th transmission is lost, 0 for none */
+  uint8_t exchanges;
+} scenario_t;
+
+typedef struct {
+  uint64_t time;
+  uint32_t retransmissions;
+  uint32_t late_retransmissions; /* in the second half of the exchanges */
+  uint32_t spurious;
+  uint32_t timeouts;
+  uint32_t rto;
+} result_t;
+
+/* A lossy path with a short RTT and a slow path without loss */
+static const scenario_t fast_lossy = { "fast lossy", 5684, 200, 4, 24 };
+static const scenario_t slow = { "slow", 5685, 4000, 0, 6 };
+
+static result_t fast_lossy_result;
+static result_t slow_result;
+
+static coap_endpoint_t peer;
+static const scenario_t *scenario;
+static unsigned transmissions;
+static uint8_t exchange_done;
+
+static struct {
+  ntimer_t timer;
+  uint16_t mid;
+} answers[MAX_ANSWERS];
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The peer piggybacks its response on the ACK */
+static void
+answer(ntimer_t *t)
+{
+  coap_packet_t ack[1];
+  uint8_t data[COAP_MAX_HEADER_SIZE];
+  int i = (int)(uintptr_t)ntimer_get_user_data(t);
+
+  coap_init_message(ack, COAP_TYPE_ACK, CONTENT_2_05, answers[i].mid);
+  coap_receive(&peer, data, coap_serialize_message(ack, data));
+}
+/*---------------------------------------------------------------------------*/
+/* Replaces the link layer: the path answers or loses each transmission */
+static uint8_t
+emulate_path(const uip_lladdr_t *lladdr)
+{
+  const uint8_t *coap = &uip_buf[UIP_LLIPH_LEN + UIP_UDPH_LEN];
+  int i;
+
+  if(UIP_IP_BUF->proto != UIP_PROTO_UDP || uip_len < UIP_IPUDPH_LEN + 4) {
+    return 0;
+  }
+  transmissions++;
+  if(scenario->loss_period > 0 &&
+     transmissions % scenario->loss_period == 0) {
+    return 0;
+  }
+  for(i = 0; i < MAX_ANSWERS; i++) {
+    if(ntimer_expired(&answers[i].timer)) {
+      answers[i].mid = (coap[2] << 8) | coap[3];
+      ntimer_set_callback(&answers[i].timer, answer);
+      ntimer_set_user_data(&answers[i].timer, (void *)(uintptr_t)i);
+      ntimer_set(&answers[i].timer, scenario->rtt);
+      break;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+response_handler(void *data, void *response)
+{
+  exchange_done = response != NULL ? 1 : 2;
+  process_poll(&test_process);
+}
+/*---------------------------------------------------------------------------*/
+static int
+send_request(void)
+{
+  coap_packet_t request[1];
+  coap_transaction_t *t;
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, coap_get_mid());
+  coap_set_header_uri_path(request, "sensors/temperature");
+  if((t = coap_new_transaction(request->mid, &peer)) == NULL) {
+    return 0;
+  }
+  t->callback = response_handler;
+  if(!coap_transaction_serialize(t, request)) {
+    coap_clear_transaction(t);
+    return 0;
+  }
+  coap_send_transaction(t);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_result(const result_t *r)
+{
+  printf("%-10s %u exchanges: %lu ms, %lu retransmissions "
+         "(%lu in the second half, %lu spurious), %lu timeouts, RTO %lu ms\n",
+         scenario->name, scenario->exchanges, (unsigned long)r->time,
+         (unsigned long)r->retransmissions,
+         (unsigned long)r->late_retransmissions,
+         (unsigned long)r->spurious, (unsigned long)r->timeouts,
+         (unsigned long)r->rto);
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(fast_path, "RTO follows a fast lossy path");
+UNIT_TEST(fast_path)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(fast_lossy_result.timeouts == 0);
+#if COAP_MAX_RTT_ESTIMATORS > 0
+  /* Well below the default of 3 to 4.5 s */
+  UNIT_TEST_ASSERT(fast_lossy_result.rto < 1000);
+#endif /* COAP_MAX_RTT_ESTIMATORS > 0 */
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(slow_path, "RTO follows a slow path");
+UNIT_TEST(slow_path)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(slow_result.timeouts == 0);
+#if COAP_MAX_RTT_ESTIMATORS > 0
+  /* No more spurious retransmissions once the RTT is known */
+  UNIT_TEST_ASSERT(slow_result.late_retransmissions == 0);
+  UNIT_TEST_ASSERT(slow_result.rto > slow.rtt);
+#endif /* COAP_MAX_RTT_ESTIMATORS > 0 */
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  static const uip_lladdr_t lladdr = { { 0x02, 0x00, 0x00, 0x00,
+                                         0x00, 0x00, 0x00, 0x02 } };
+  static const scenario_t *scenarios[] = { &fast_lossy, &slow };
+  static result_t *results[] = { &fast_lossy_result, &slow_result };
+  static coap_cocoa_stats_t stats;
+  static result_t *r;
+  static int s, n;
+
+  PROCESS_BEGIN();
+
+  rest_init_engine();
+
+  /* The requests go to a reachable neighbor on the emulated path */
+  uip_ip6addr(&peer.ipaddr, 0xfe80, 0, 0, 0, 0, 0, 0, 2);
+  uip_ds6_nbr_add(&peer.ipaddr, &lladdr, 0, NBR_REACHABLE,
+                  NBR_TABLE_REASON_UNDEFINED, NULL);
+  tcpip_set_outputfunc(emulate_path);
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  for(s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+    scenario = scenarios[s];
+    r = results[s];
+    peer.port = UIP_HTONS(scenario->port);
+    transmissions = 0;
+    stats = *coap_cocoa_get_stats();
+    r->time = ntimer_uptime();
+
+    for(n = 0; n < scenario->exchanges; n++) {
+      if(n == scenario->exchanges / 2) {
+        r->late_retransmissions = coap_cocoa_get_stats()->retransmissions;
+      }
+      exchange_done = 0;
+      if(!send_request()) {
+        break;
+      }
+      PROCESS_WAIT_UNTIL(exchange_done);
+    }
+
+    r->time = ntimer_uptime() - r->time;
+    r->retransmissions = coap_cocoa_get_stats()->retransmissions -
+      stats.retransmissions;
+    r->late_retransmissions = coap_cocoa_get_stats()->retransmissions -
+      r->late_retransmissions;
+    r->spurious = coap_cocoa_get_stats()->spurious_retransmissions -
+      stats.spurious_retransmissions;
+    r->timeouts = coap_cocoa_get_stats()->timeouts - stats.timeouts;
+    /* Without the dithering, which is at most half the RTO */
+    r->rto = coap_cocoa_get_rto(&peer) * 2 / 3;
+    print_result(r);
+  }
+
+  UNIT_TEST_RUN(fast_path);
+  UNIT_TEST_RUN(slow_path);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Tests that retransmitted CoAP requests are answered from the
+ *         duplicate detection cache without running the handlers again
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "er-coap-engine.h"
+#include "er-coap-dedup.h"
+#include "net/ip/tcpip.h"
+#include "net/ipv6/uip-ds6.h"
+
+#include <stdio.h>
+#include <string.h>
+
+PROCESS(test_process, "CoAP duplicate detection test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+static void res_get_handler(void *request, void *response, uint8_t *buffer,
+                            uint16_t preferred_size, int32_t *offset);
+static void res_post_handler(void *request, void *response, uint8_t *buffer,
+                             uint16_t preferred_size, int32_t *offset);
+
+RESOURCE(res_counter, "title=\"Counter\"", res_get_handler, res_post_handler,
+         NULL, NULL);
+
+static unsigned handler_calls;
+
+static coap_endpoint_t endpoint;
+static coap_packet_t request[1];
+static uint8_t request_data[COAP_MAX_PACKET_SIZE];
+static uint16_t request_len;
+static uint8_t received[COAP_MAX_PACKET_SIZE];
+
+/* The last datagram sent by the CoAP engine */
+static uint8_t sent[COAP_MAX_PACKET_SIZE];
+static uint16_t sent_len;
+static unsigned sent_count;
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+res_get_handler(void *request, void *response, uint8_t *buffer,
+                uint16_t preferred_size, int32_t *offset)
+{
+  int len;
+
+  handler_calls++;
+  len = snprintf((char *)buffer, preferred_size, "calls=%u", handler_calls);
+  REST.set_response_payload(response, buffer, len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+res_post_handler(void *request, void *response, uint8_t *buffer,
+                 uint16_t preferred_size, int32_t *offset)
+{
+  /* Stands for an action that must not be repeated */
+  handler_calls++;
+  REST.set_response_status(response, REST.status.CHANGED);
+}
+/*---------------------------------------------------------------------------*/
+/* Replaces the link layer: keeps the payload of the UDP datagrams sent */
+static uint8_t
+capture_output(const uip_lladdr_t *lladdr)
+{
+  if(UIP_IP_BUF->proto == UIP_PROTO_UDP && uip_len > UIP_IPUDPH_LEN) {
+    sent_len = uip_len - UIP_IPUDPH_LEN;
+    memcpy(sent, &uip_buf[UIP_LLIPH_LEN + UIP_UDPH_LEN], sent_len);
+    sent_count++;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_request(coap_message_type_t type, rest_resource_flags_t method,
+             uint16_t mid, const char *token)
+{
+  coap_init_message(request, type, method, mid);
+  coap_set_token(request, (const uint8_t *)token, strlen(token));
+  coap_set_header_uri_path(request, "test/counter");
+  request_len = coap_serialize_message(request, request_data);
+}
+/*---------------------------------------------------------------------------*/
+/* Receives a copy of the request, since parsing may modify the data */
+static void
+receive_request(void)
+{
+  memcpy(received, request_data, request_len);
+  coap_receive(&endpoint, received, request_len);
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(retransmitted_get, "retransmitted GET is replayed");
+UNIT_TEST(retransmitted_get)
+{
+  static uint8_t first[COAP_MAX_PACKET_SIZE];
+  static uint16_t first_len;
+  coap_dedup_stats_t stats;
+  int i;
+
+  UNIT_TEST_BEGIN();
+
+  handler_calls = 0;
+  sent_count = 0;
+  stats = *coap_dedup_get_stats();
+
+  make_request(COAP_TYPE_CON, COAP_GET, 0x1001, "tok1");
+  receive_request();
+  UNIT_TEST_ASSERT(handler_calls == 1);
+  UNIT_TEST_ASSERT(sent_count == 1);
+  first_len = sent_len;
+  memcpy(first, sent, sent_len);
+
+  /* The client did not get the ACK and retransmits the request */
+  for(i = 0; i < 3; i++) {
+    receive_request();
+    UNIT_TEST_ASSERT(handler_calls == 1);
+    UNIT_TEST_ASSERT(sent_count == 2 + i);
+    UNIT_TEST_ASSERT(sent_len == first_len);
+    UNIT_TEST_ASSERT(memcmp(sent, first, first_len) == 0);
+  }
+
+  UNIT_TEST_ASSERT(coap_dedup_get_stats()->hits == stats.hits + 3);
+  UNIT_TEST_ASSERT(coap_dedup_get_stats()->misses == stats.misses + 1);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(retransmitted_post, "retransmitted POST runs once");
+UNIT_TEST(retransmitted_post)
+{
+  UNIT_TEST_BEGIN();
+
+  handler_calls = 0;
+  sent_count = 0;
+
+  make_request(COAP_TYPE_CON, COAP_POST, 0x2001, "exec");
+  receive_request();
+  receive_request();
+  UNIT_TEST_ASSERT(handler_calls == 1);
+  UNIT_TEST_ASSERT(sent_count == 2);
+
+  /* The same request under another MID is a new request */
+  make_request(COAP_TYPE_CON, COAP_POST, 0x2002, "exec");
+  receive_request();
+  UNIT_TEST_ASSERT(handler_calls == 2);
+
+  /* So is the same MID with another token */
+  make_request(COAP_TYPE_CON, COAP_POST, 0x2002, "exe2");
+  receive_request();
+  UNIT_TEST_ASSERT(handler_calls == 3);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(other_endpoint, "same MID from another endpoint");
+UNIT_TEST(other_endpoint)
+{
+  UNIT_TEST_BEGIN();
+
+  handler_calls = 0;
+
+  make_request(COAP_TYPE_CON, COAP_GET, 0x3001, "tok3");
+  receive_request();
+  UNIT_TEST_ASSERT(handler_calls == 1);
+
+  endpoint.port = UIP_HTONS(COAP_DEFAULT_PORT + 1);
+  receive_request();
+  UNIT_TEST_ASSERT(handler_calls == 2);
+
+  endpoint.port = UIP_HTONS(COAP_DEFAULT_PORT);
+  receive_request();
+  UNIT_TEST_ASSERT(handler_calls == 2);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(eviction, "cache keeps the most recent exchanges");
+UNIT_TEST(eviction)
+{
+  uint16_t mid;
+
+  UNIT_TEST_BEGIN();
+
+  make_request(COAP_TYPE_CON, COAP_GET, 0x4000, "old");
+  receive_request();
+
+  /* Fill the cache with newer exchanges */
+  for(mid = 0x4001; mid <= 0x4000 + COAP_DEDUP_CACHE_SIZE; mid++) {
+    make_request(COAP_TYPE_CON, COAP_GET, mid, "new");
+    receive_request();
+  }
+
+  /* The most recent one is still replayed */
+  handler_calls = 0;
+  receive_request();
+  UNIT_TEST_ASSERT(handler_calls == 0);
+
+  /* The oldest one was evicted and is handled again */
+  make_request(COAP_TYPE_CON, COAP_GET, 0x4000, "old");
+  receive_request();
+  UNIT_TEST_ASSERT(handler_calls == 1);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  static const uip_lladdr_t lladdr = { { 0x02, 0x00, 0x00, 0x00,
+                                         0x00, 0x00, 0x00, 0x02 } };
+
+  PROCESS_BEGIN();
+
+  rest_init_engine();
+  rest_activate_resource(&res_counter, "test/counter");
+
+  /* The responses go to a reachable neighbor and are captured instead
+     of being sent */
+  uip_ip6addr(&endpoint.ipaddr, 0xfe80, 0, 0, 0, 0, 0, 0, 2);
+  endpoint.port = UIP_HTONS(COAP_DEFAULT_PORT);
+  uip_ds6_nbr_add(&endpoint.ipaddr, &lladdr, 0, NBR_REACHABLE,
+                  NBR_TABLE_REASON_UNDEFINED, NULL);
+  tcpip_set_outputfunc(capture_output);
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(retransmitted_get);
+  UNIT_TEST_RUN(retransmitted_post);
+  UNIT_TEST_RUN(other_endpoint);
+  UNIT_TEST_RUN(eviction);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
@@ -0,0 +1,442 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Tests which observers the CoAP engine notifies and removes, and
+ *         measures notification and re-registration time with 8, 64 and
+ *         512 observers
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "er-coap-engine.h"
+#include "er-coap-observe.h"
+#include "net/ip/tcpip.h"
+#include "net/ipv6/uip-ds6.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+PROCESS(test_process, "CoAP observe test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define UIP_IP_BUF  ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_UDP_BUF ((struct uip_udp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+
+/* Observer n is at port FIRST_PORT + n of the same host */
+#define FIRST_PORT   10000
+#define BENCH_ROUNDS 20000
+
+static void res_get_handler(void *request, void *response, uint8_t *buffer,
+                            uint16_t preferred_size, int32_t *offset);
+
+PARENT_RESOURCE(res_sensors, "title=\"Sensors\"", res_get_handler,
+                NULL, NULL, NULL);
+
+static uip_ipaddr_t host;
+
+/* Notifications sent to each observer and the MID of the last one */
+static unsigned sent_count[COAP_MAX_OBSERVERS];
+static uint16_t sent_mid[COAP_MAX_OBSERVERS];
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+res_get_handler(void *request, void *response, uint8_t *buffer,
+                uint16_t preferred_size, int32_t *offset)
+{
+  REST.set_response_payload(response, "42", 2);
+}
+/*---------------------------------------------------------------------------*/
+/* Replaces the link layer: counts the datagrams sent to each observer */
+static uint8_t
+capture_output(const uip_lladdr_t *lladdr)
+{
+  const uint8_t *coap;
+  uint16_t n;
+
+  if(UIP_IP_BUF->proto == UIP_PROTO_UDP && uip_len >= UIP_IPUDPH_LEN + 4) {
+    n = UIP_HTONS(UIP_UDP_BUF->destport) - FIRST_PORT;
+    if(n < COAP_MAX_OBSERVERS) {
+      coap = &uip_buf[UIP_LLIPH_LEN + UIP_UDPH_LEN];
+      sent_count[n]++;
+      sent_mid[n] = (coap[2] << 8) | coap[3];
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_endpoint(coap_endpoint_t *ep, int n)
+{
+  uip_ipaddr_copy(&ep->ipaddr, &host);
+  ep->port = UIP_HTONS(FIRST_PORT + n);
+}
+/*---------------------------------------------------------------------------*/
+/* Registers observer n of a path as a GET with Observe 0 from it would */
+static int
+observe(int n, const char *path)
+{
+  coap_packet_t request[1];
+  coap_packet_t response[1];
+  coap_endpoint_t ep;
+  uint8_t token[2];
+
+  set_endpoint(&ep, n);
+  token[0] = n >> 8;
+  token[1] = n & 0xff;
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_token(request, token, sizeof(token));
+  coap_set_header_uri_path(request, path);
+  coap_set_header_observe(request, 0);
+  coap_set_src_endpoint(request, &ep);
+  coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+
+  coap_observe_handler(&res_sensors, request, response);
+  return response->code == CONTENT_2_05;
+}
+/*---------------------------------------------------------------------------*/
+static int
+cancel(int n)
+{
+  coap_endpoint_t ep;
+  uint8_t token[2];
+
+  set_endpoint(&ep, n);
+  token[0] = n >> 8;
+  token[1] = n & 0xff;
+  return coap_remove_observer_by_token(&ep, token, sizeof(token));
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_all(void)
+{
+  coap_observer_t *obs;
+
+  while((obs = coap_get_first_observer()) != NULL) {
+    coap_remove_observer(obs);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+observer_count(void)
+{
+  coap_observer_t *obs;
+  int count = 0;
+
+  for(obs = coap_get_first_observer(); obs != NULL;
+      obs = coap_get_next_observer(obs)) {
+    count++;
+  }
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+/* Notifies a sub-path of the resource, or all of it, and returns the
+   observers notified as a bit mask */
+static unsigned
+notify(const char *subpath)
+{
+  unsigned mask = 0;
+  int n;
+
+  memset(sent_count, 0, sizeof(sent_count));
+  coap_notify_observers_sub(&res_sensors, subpath);
+  for(n = 0; n < 8 * sizeof(mask); n++) {
+    if(sent_count[n] == 1) {
+      mask |= 1 << n;
+    } else if(sent_count[n] > 1) {
+      return ~0;
+    }
+  }
+  return mask;
+}
+/*---------------------------------------------------------------------------*/
+/* Observers 0..6 of the test paths */
+static int
+observe_test_paths(void)
+{
+  static const char *paths[] = {
+    "sensors", "sensors/1", "sensors/1/0", "sensors/1/1", "sensors/2",
+    "sensors/10", "other/1"
+  };
+  int n;
+
+  remove_all();
+  for(n = 0; n < sizeof(paths) / sizeof(paths[0]); n++) {
+    if(!observe(n, paths[n])) {
+      return 0;
+    }
+  }
+  return observer_count() == n;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(notify_match, "notifications reach the observed paths");
+UNIT_TEST(notify_match)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(observe_test_paths());
+
+  /* The path and all paths below it, but not sensors/10 */
+  UNIT_TEST_ASSERT(notify("/1") == 0x0e);
+  UNIT_TEST_ASSERT(notify("/1/0") == 0x04);
+  UNIT_TEST_ASSERT(notify("/10") == 0x20);
+  UNIT_TEST_ASSERT(notify("/3") == 0);
+  UNIT_TEST_ASSERT(notify(NULL) == 0x3f);
+
+  /* Observing the same path again replaces the observer */
+  UNIT_TEST_ASSERT(observe(4, "sensors/2"));
+  UNIT_TEST_ASSERT(observer_count() == 7);
+  UNIT_TEST_ASSERT(notify("/2") == 0x10);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(remove_token, "observers are cancelled by token");
+UNIT_TEST(remove_token)
+{
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(observe_test_paths());
+
+  UNIT_TEST_ASSERT(cancel(2) == 1);
+  UNIT_TEST_ASSERT(cancel(2) == 0);
+  UNIT_TEST_ASSERT(notify("/1") == 0x0a);
+
+  /* Same path, another observer */
+  UNIT_TEST_ASSERT(observe(2, "sensors/1/1"));
+  UNIT_TEST_ASSERT(notify("/1/1") == 0x0c);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(remove_mid, "observers are removed by the MID of a RST");
+UNIT_TEST(remove_mid)
+{
+  coap_endpoint_t ep;
+
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(observe_test_paths());
+  UNIT_TEST_ASSERT(notify(NULL) == 0x3f);
+
+  /* The MID of another observer does not match */
+  set_endpoint(&ep, 3);
+  UNIT_TEST_ASSERT(coap_remove_observer_by_mid(&ep, sent_mid[2]) == 0);
+  UNIT_TEST_ASSERT(coap_remove_observer_by_mid(&ep, sent_mid[3]) == 1);
+  UNIT_TEST_ASSERT(notify(NULL) == 0x37);
+
+  /* The MID of the latest notification is used */
+  set_endpoint(&ep, 1);
+  UNIT_TEST_ASSERT(coap_remove_observer_by_mid(&ep, sent_mid[1]) == 1);
+  UNIT_TEST_ASSERT(notify(NULL) == 0x35);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(remove_uri, "observers are removed by path");
+UNIT_TEST(remove_uri)
+{
+  coap_endpoint_t ep;
+
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(observe_test_paths());
+
+  /* The path and its parents, but neither children nor sensors/10 */
+  UNIT_TEST_ASSERT(coap_remove_observer_by_uri(NULL, "sensors/1") == 2);
+  UNIT_TEST_ASSERT(notify(NULL) == 0x3c);
+
+  /* Only the observers of the endpoint */
+  set_endpoint(&ep, 4);
+  UNIT_TEST_ASSERT(coap_remove_observer_by_uri(&ep, "sensors/10") == 0);
+  UNIT_TEST_ASSERT(coap_remove_observer_by_uri(&ep, "sensors/2") == 1);
+  UNIT_TEST_ASSERT(notify(NULL) == 0x2c);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(remove_client, "observers are removed by endpoint");
+UNIT_TEST(remove_client)
+{
+  coap_endpoint_t ep;
+
+  UNIT_TEST_BEGIN();
+
+  UNIT_TEST_ASSERT(observe_test_paths());
+  UNIT_TEST_ASSERT(observe(3, "other/2"));
+  UNIT_TEST_ASSERT(observer_count() == 8);
+
+  /* All observations of the endpoint, wherever they are in the trie */
+  set_endpoint(&ep, 3);
+  UNIT_TEST_ASSERT(coap_remove_observer_by_client(&ep) == 2);
+  UNIT_TEST_ASSERT(coap_remove_observer_by_client(&ep) == 0);
+  UNIT_TEST_ASSERT(observer_count() == 6);
+  UNIT_TEST_ASSERT(notify(NULL) == 0x37);
+
+  remove_all();
+  UNIT_TEST_ASSERT(coap_get_first_observer() == NULL);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+static uint64_t
+ns_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+static void
+observe_all(int count)
+{
+  char path[24];
+  int n;
+
+  for(n = 0; n < count; n++) {
+    snprintf(path, sizeof(path), "sensors/%d", n);
+    observe(n, path);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Notifies the last of count observers of their own paths, cancels it
+ * and registers it again, and removes all observers by the MID of a RST
+ * to their latest notification.
+ */
+static void
+bench(int count)
+{
+  static coap_endpoint_t eps[COAP_MAX_OBSERVERS];
+  clock_time_t notified, registered;
+  coap_transaction_t *t;
+  uint64_t start, reset;
+  char path[24];
+  char subpath[16];
+  long r, removed;
+  int n;
+
+  for(n = 0; n < count; n++) {
+    set_endpoint(&eps[n], n);
+  }
+  observe_all(count);
+  snprintf(path, sizeof(path), "sensors/%d", count - 1);
+  snprintf(subpath, sizeof(subpath), "/%d", count - 1);
+  memset(sent_count, 0, sizeof(sent_count));
+
+  notified = clock_time();
+  for(r = 0; r < BENCH_ROUNDS; r++) {
+    coap_notify_observers_sub(&res_sensors, subpath);
+    /* The observer acknowledges confirmable notifications */
+    t = coap_get_transaction_by_mid(sent_mid[count - 1]);
+    if(t != NULL) {
+      coap_clear_transaction(t);
+    }
+  }
+  notified = clock_time() - notified;
+
+  registered = clock_time();
+  for(r = 0; r < BENCH_ROUNDS; r++) {
+    cancel(count - 1);
+    observe(count - 1, path);
+  }
+  registered = clock_time() - registered;
+
+  /* Only the removals are timed, not the registrations and notifications
+     that give every observer a MID to reset */
+  reset = 0;
+  removed = 0;
+  for(r = 0; r < BENCH_ROUNDS / count; r++) {
+    observe_all(count);
+    coap_notify_observers(&res_sensors);
+    start = ns_now();
+    for(n = 0; n < count; n++) {
+      removed += coap_remove_observer_by_mid(&eps[n], sent_mid[n]);
+    }
+    reset += ns_now() - start;
+  }
+
+  printf("%d observers, %d rounds: notify %lu ms (%u sent), "
+         "cancel and observe %lu ms, %ld RST %lu us (%ld removed)\n",
+         count, BENCH_ROUNDS,
+         (unsigned long)(notified * 1000 / CLOCK_SECOND),
+         sent_count[count - 1],
+         (unsigned long)(registered * 1000 / CLOCK_SECOND),
+         r * count, (unsigned long)(reset / 1000), removed);
+
+  remove_all();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  static const uip_lladdr_t lladdr = { { 0x02, 0x00, 0x00, 0x00,
+                                         0x00, 0x00, 0x00, 0x02 } };
+
+  PROCESS_BEGIN();
+
+  rest_init_engine();
+  rest_activate_resource(&res_sensors, "sensors");
+
+  /* The notifications go to a reachable neighbor and are captured
+     instead of being sent */
+  uip_ip6addr(&host, 0xfe80, 0, 0, 0, 0, 0, 0, 2);
+  uip_ds6_nbr_add(&host, &lladdr, 0, NBR_REACHABLE,
+                  NBR_TABLE_REASON_UNDEFINED, NULL);
+  tcpip_set_outputfunc(capture_output);
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(notify_match);
+  UNIT_TEST_RUN(remove_token);
+  UNIT_TEST_RUN(remove_mid);
+  UNIT_TEST_RUN(remove_uri);
+  UNIT_TEST_RUN(remove_client);
+
+  bench(8);
+  bench(64);
+  bench(COAP_MAX_OBSERVERS);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Tests that parsed CoAP messages read and serialize the same
+ *         as they were built, and measures parse and serialize time
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "er-coap.h"
+
+#include <stdio.h>
+#include <string.h>
+
+PROCESS(test_process, "CoAP parse test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define BENCH_ROUNDS 100000
+
+static const uint8_t etag[] = { 0xde, 0xad, 0xbe, 0xef };
+
+static coap_packet_t message[1];
+static coap_packet_t parsed[1];
+static uint8_t original[COAP_MAX_PACKET_SIZE];
+static size_t original_len;
+static uint8_t data[COAP_MAX_PACKET_SIZE];
+static uint8_t serialized[COAP_MAX_PACKET_SIZE];
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* A block-wise request of a gateway with most of the options set */
+static void
+make_message(const char *path)
+{
+  coap_init_message(message, COAP_TYPE_CON, COAP_PUT, 0x1234);
+  coap_set_token(message, (const uint8_t *)"tok", 3);
+  coap_set_header_uri_host(message, "gw");
+  coap_set_header_etag(message, etag, sizeof(etag));
+  coap_set_header_observe(message, 0);
+  coap_set_header_uri_path(message, path);
+  coap_set_header_content_format(message, APPLICATION_JSON);
+  coap_set_header_uri_query(message, "lt=300");
+  coap_set_header_accept(message, APPLICATION_XML);
+  coap_set_header_block2(message, 0, 0, 64);
+  coap_set_header_block1(message, 3, 1, 128);
+  coap_set_header_size1(message, 1000);
+  coap_set_payload(message, "{\"v\":21.5}", 10);
+  original_len = coap_serialize_message(message, original);
+}
+/*---------------------------------------------------------------------------*/
+/* Parses a copy of the message, since parsing may modify the data */
+static coap_status_t
+parse(void)
+{
+  memcpy(data, original, original_len);
+  return coap_parse_message(parsed, data, original_len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+string_equals(int len, const char *value, const char *expected)
+{
+  return len == strlen(expected) && memcmp(value, expected, len) == 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_options(const char *path)
+{
+  const char *s;
+  const uint8_t *e;
+  unsigned int format;
+  uint32_t num, u32;
+  uint16_t size;
+  uint8_t more;
+  int len;
+
+  len = coap_get_header_uri_host(parsed, &s);
+  if(!string_equals(len, s, "gw")) {
+    return 0;
+  }
+  len = coap_get_header_uri_path(parsed, &s);
+  if(!string_equals(len, s, path)) {
+    return 0;
+  }
+  len = coap_get_header_uri_query(parsed, &s);
+  if(!string_equals(len, s, "lt=300")) {
+    return 0;
+  }
+  if(coap_get_header_etag(parsed, &e) != sizeof(etag) ||
+     memcmp(e, etag, sizeof(etag)) != 0) {
+    return 0;
+  }
+  if(!coap_get_header_observe(parsed, &u32) || u32 != 0 ||
+     !coap_get_header_content_format(parsed, &format) ||
+     format != APPLICATION_JSON ||
+     !coap_get_header_accept(parsed, &format) ||
+     format != APPLICATION_XML ||
+     !coap_get_header_size1(parsed, &u32) || u32 != 1000) {
+    return 0;
+  }
+  if(!coap_get_header_block2(parsed, &num, &more, &size, NULL) ||
+     num != 0 || more != 0 || size != 64) {
+    return 0;
+  }
+  if(!coap_get_header_block1(parsed, &num, &more, &size, NULL) ||
+     num != 3 || more != 1 || size != 128) {
+    return 0;
+  }
+  /* Options that were not sent */
+  return coap_get_header_max_age(parsed, &u32) &&
+    u32 == COAP_DEFAULT_MAX_AGE &&
+    coap_get_header_location_path(parsed, &s) == 0 &&
+    !coap_get_header_size2(parsed, &u32);
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(all_options, "all options read back");
+UNIT_TEST(all_options)
+{
+  UNIT_TEST_BEGIN();
+
+  make_message("sensors/1/temperature");
+  UNIT_TEST_ASSERT(original_len > 0);
+  UNIT_TEST_ASSERT(parse() == NO_ERROR);
+  UNIT_TEST_ASSERT(parsed->type == COAP_TYPE_CON);
+  UNIT_TEST_ASSERT(parsed->code == COAP_PUT);
+  UNIT_TEST_ASSERT(parsed->mid == 0x1234);
+  UNIT_TEST_ASSERT(parsed->token_len == 3);
+  UNIT_TEST_ASSERT(memcmp(parsed->token, "tok", 3) == 0);
+  UNIT_TEST_ASSERT(check_options("sensors/1/temperature"));
+  UNIT_TEST_ASSERT(parsed->payload_len == 10);
+  UNIT_TEST_ASSERT(memcmp(parsed->payload, "{\"v\":21.5}", 10) == 0);
+
+  /* Reading again gives the same values */
+  UNIT_TEST_ASSERT(check_options("sensors/1/temperature"));
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(reserialize, "options not read are serialized");
+UNIT_TEST(reserialize)
+{
+  const char *path;
+  uint32_t num;
+
+  UNIT_TEST_BEGIN();
+
+  make_message("sensors/1/temperature");
+
+  /* Nothing read */
+  UNIT_TEST_ASSERT(parse() == NO_ERROR);
+  UNIT_TEST_ASSERT(coap_serialize_message(parsed, serialized) ==
+                   original_len);
+  UNIT_TEST_ASSERT(memcmp(serialized, original, original_len) == 0);
+
+  /* Only what a gateway reads */
+  UNIT_TEST_ASSERT(parse() == NO_ERROR);
+  UNIT_TEST_ASSERT(coap_get_header_uri_path(parsed, &path) > 0);
+  UNIT_TEST_ASSERT(coap_get_header_block2(parsed, &num, NULL, NULL, NULL));
+  UNIT_TEST_ASSERT(coap_serialize_message(parsed, serialized) ==
+                   original_len);
+  UNIT_TEST_ASSERT(memcmp(serialized, original, original_len) == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(set_option, "a set option replaces the parsed one");
+UNIT_TEST(set_option)
+{
+  uint32_t num;
+  uint16_t size;
+  uint8_t more;
+  size_t len;
+
+  UNIT_TEST_BEGIN();
+
+  make_message("sensors/1/temperature");
+  UNIT_TEST_ASSERT(parse() == NO_ERROR);
+  coap_set_header_block2(parsed, 5, 1, 32);
+  len = coap_serialize_message(parsed, serialized);
+
+  memcpy(original, serialized, len);
+  original_len = len;
+  UNIT_TEST_ASSERT(parse() == NO_ERROR);
+  UNIT_TEST_ASSERT(coap_get_header_block2(parsed, &num, &more, &size, NULL));
+  UNIT_TEST_ASSERT(num == 5 && more == 1 && size == 32);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(many_options, "a path of many segments");
+UNIT_TEST(many_options)
+{
+  const char *path;
+  uint32_t num;
+  uint16_t size;
+  uint8_t more;
+  int len;
+
+  UNIT_TEST_BEGIN();
+
+  /* Every path segment is an option of its own */
+  coap_init_message(message, COAP_TYPE_CON, COAP_GET, 0x1235);
+  coap_set_header_uri_path(message, "a/b/c/d/e/f/g/h/i/j/k/l/m/n/o/p");
+  coap_set_header_block2(message, 2, 0, 64);
+  original_len = coap_serialize_message(message, original);
+  UNIT_TEST_ASSERT(original_len > 0);
+
+  UNIT_TEST_ASSERT(parse() == NO_ERROR);
+  len = coap_get_header_uri_path(parsed, &path);
+  UNIT_TEST_ASSERT(string_equals(len, path,
+                                 "a/b/c/d/e/f/g/h/i/j/k/l/m/n/o/p"));
+  UNIT_TEST_ASSERT(coap_get_header_block2(parsed, &num, &more, &size, NULL));
+  UNIT_TEST_ASSERT(num == 2 && more == 0 && size == 64);
+
+  UNIT_TEST_ASSERT(parse() == NO_ERROR);
+  UNIT_TEST_ASSERT(coap_serialize_message(parsed, serialized) ==
+                   original_len);
+  UNIT_TEST_ASSERT(memcmp(serialized, original, original_len) == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(bad_option, "unknown critical options are rejected");
+UNIT_TEST(bad_option)
+{
+  UNIT_TEST_BEGIN();
+
+  /* Uri-Path "a" followed by the unknown critical option 13 */
+  static const uint8_t bad[] = { 0x40, 0x01, 0x12, 0x34,
+                                 0xb1, 'a', 0x20 };
+  /* The same with the unknown elective option 16 */
+  static const uint8_t elective[] = { 0x40, 0x01, 0x12, 0x34,
+                                      0xb1, 'a', 0x50 };
+
+  memcpy(data, bad, sizeof(bad));
+  UNIT_TEST_ASSERT(coap_parse_message(parsed, data, sizeof(bad)) ==
+                   BAD_OPTION_4_02);
+  memcpy(data, elective, sizeof(elective));
+  UNIT_TEST_ASSERT(coap_parse_message(parsed, data, sizeof(elective)) ==
+                   NO_ERROR);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(void)
+{
+  clock_time_t parse_only, gateway, all, serialize;
+  const char *path;
+  uint32_t num;
+  long r;
+
+  make_message("sensors/1/temperature");
+
+  parse_only = clock_time();
+  for(r = 0; r < BENCH_ROUNDS; r++) {
+    parse();
+  }
+  parse_only = clock_time() - parse_only;
+
+  gateway = clock_time();
+  for(r = 0; r < BENCH_ROUNDS; r++) {
+    parse();
+    coap_get_header_uri_path(parsed, &path);
+    coap_get_header_block2(parsed, &num, NULL, NULL, NULL);
+  }
+  gateway = clock_time() - gateway;
+
+  all = clock_time();
+  for(r = 0; r < BENCH_ROUNDS; r++) {
+    parse();
+    check_options("sensors/1/temperature");
+  }
+  all = clock_time() - all;
+
+  serialize = clock_time();
+  for(r = 0; r < BENCH_ROUNDS; r++) {
+    parse();
+    coap_serialize_message(parsed, serialized);
+  }
+  serialize = clock_time() - serialize;
+
+  printf("%d rounds of a %u byte message: parse %lu ms, "
+         "path and block %lu ms, all options %lu ms, serialize %lu ms\n",
+         BENCH_ROUNDS,
+         (unsigned)original_len,
+         (unsigned long)(parse_only * 1000 / CLOCK_SECOND),
+         (unsigned long)(gateway * 1000 / CLOCK_SECOND),
+         (unsigned long)(all * 1000 / CLOCK_SECOND),
+         (unsigned long)(serialize * 1000 / CLOCK_SECOND));
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(all_options);
+  UNIT_TEST_RUN(reserialize);
+  UNIT_TEST_RUN(set_option);
+  UNIT_TEST_RUN(many_options);
+  UNIT_TEST_RUN(bad_option);
+
+  bench();
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Tests that confirmable messages waiting for their ACK do not
+ *         keep incoming requests from being answered
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "er-coap-engine.h"
+#include "er-coap-transactions.h"
+#include "net/ip/tcpip.h"
+#include "net/ipv6/uip-ds6.h"
+
+#include <stdio.h>
+#include <string.h>
+
+PROCESS(test_process, "CoAP transaction buffer test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+static void res_get_handler(void *request, void *response, uint8_t *buffer,
+                            uint16_t preferred_size, int32_t *offset);
+
+RESOURCE(res_hello, "title=\"Hello\"", res_get_handler, NULL, NULL, NULL);
+
+static coap_endpoint_t endpoint;
+static uint8_t received[COAP_MAX_PACKET_SIZE];
+
+/* The last datagram sent by the CoAP engine */
+static coap_packet_t sent_message[1];
+static uint8_t sent[COAP_MAX_PACKET_SIZE];
+static uint16_t sent_len;
+static unsigned sent_count;
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+res_get_handler(void *request, void *response, uint8_t *buffer,
+                uint16_t preferred_size, int32_t *offset)
+{
+  REST.set_response_payload(response, "hello", 5);
+}
+/*---------------------------------------------------------------------------*/
+/* Replaces the link layer: keeps the payload of the UDP datagrams sent */
+static uint8_t
+capture_output(const uip_lladdr_t *lladdr)
+{
+  if(UIP_IP_BUF->proto == UIP_PROTO_UDP && uip_len > UIP_IPUDPH_LEN) {
+    sent_len = uip_len - UIP_IPUDPH_LEN;
+    memcpy(sent, &uip_buf[UIP_LLIPH_LEN + UIP_UDPH_LEN], sent_len);
+    sent_count++;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Sends a confirmable POST with a payload of the given size to the peer */
+static int
+send_post(uint16_t mid, const char *path, uint16_t payload_len)
+{
+  static uint8_t payload[COAP_MAX_PACKET_SIZE];
+  coap_packet_t message[1];
+  coap_transaction_t *t;
+
+  memset(payload, 'x', sizeof(payload));
+  coap_init_message(message, COAP_TYPE_CON, COAP_POST, mid);
+  coap_set_header_uri_path(message, path);
+  coap_set_payload(message, payload, payload_len);
+
+  if((t = coap_new_transaction(mid, &endpoint)) == NULL) {
+    return 0;
+  }
+  if(!coap_transaction_serialize(t, message)) {
+    coap_clear_transaction(t);
+    return 0;
+  }
+  coap_send_transaction(t);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Receives a message from the peer and returns the code of the reply */
+static uint8_t
+receive(coap_message_type_t type, uint8_t code, uint16_t mid)
+{
+  coap_packet_t message[1];
+  unsigned count = sent_count;
+
+  coap_init_message(message, type, code, mid);
+  if(code != 0) {
+    coap_set_token(message, (const uint8_t *)"tok", 3);
+    coap_set_header_uri_path(message, "test/hello");
+  }
+  coap_receive(&endpoint, received, coap_serialize_message(message, received));
+  if(sent_count == count ||
+     coap_parse_message(sent_message, sent, sent_len) != NO_ERROR) {
+    return 0;
+  }
+  return sent_message->code;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(large_in_flight,
+                   "requests are answered while large messages wait");
+UNIT_TEST(large_in_flight)
+{
+  int i;
+
+  UNIT_TEST_BEGIN();
+
+  sent_count = 0;
+
+  /* A registration update goes out and waits for its ACK */
+  UNIT_TEST_ASSERT(send_post(0x1001, "rd/update", 60));
+  UNIT_TEST_ASSERT(sent_count == 1);
+  UNIT_TEST_ASSERT(sent_len > COAP_TRANSACTION_SMALL_BUFFER_SIZE);
+
+  /* A large message behind it would take the last large buffer */
+  UNIT_TEST_ASSERT(!send_post(0x1002, "obs/refresh", 60));
+
+  /* A small one is queued for NSTART */
+  UNIT_TEST_ASSERT(send_post(0x1003, "obs/small", 4));
+  UNIT_TEST_ASSERT(sent_count == 1);
+
+  /* Incoming requests are answered meanwhile */
+  for(i = 0; i < 10; i++) {
+    UNIT_TEST_ASSERT(receive(COAP_TYPE_CON, COAP_GET, 0x2000 + i) ==
+                     CONTENT_2_05);
+    UNIT_TEST_ASSERT(receive(COAP_TYPE_NON, COAP_GET, 0x3000 + i) ==
+                     CONTENT_2_05);
+  }
+  UNIT_TEST_ASSERT(sent_count == 21);
+
+  /* The ACK lets the queued message go */
+  UNIT_TEST_ASSERT(receive(COAP_TYPE_ACK, 0, 0x1001) == COAP_POST);
+  UNIT_TEST_ASSERT(sent_message->mid == 0x1003);
+  UNIT_TEST_ASSERT(coap_get_transaction_by_mid(0x1001) == NULL);
+
+  /* With the large buffer back, a large message can be sent again */
+  UNIT_TEST_ASSERT(receive(COAP_TYPE_ACK, 0, 0x1003) == 0);
+  UNIT_TEST_ASSERT(send_post(0x1004, "obs/refresh", 60));
+  UNIT_TEST_ASSERT(coap_parse_message(sent_message, sent, sent_len) ==
+                   NO_ERROR);
+  UNIT_TEST_ASSERT(sent_message->mid == 0x1004);
+  UNIT_TEST_ASSERT(receive(COAP_TYPE_CON, COAP_GET, 0x2100) == CONTENT_2_05);
+  UNIT_TEST_ASSERT(receive(COAP_TYPE_ACK, 0, 0x1004) == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  static const uip_lladdr_t lladdr = { { 0x02, 0x00, 0x00, 0x00,
+                                         0x00, 0x00, 0x00, 0x02 } };
+
+  PROCESS_BEGIN();
+
+  rest_init_engine();
+  rest_activate_resource(&res_hello, "test/hello");
+
+  /* The messages go to a reachable neighbor and are captured instead
+     of being sent */
+  uip_ip6addr(&endpoint.ipaddr, 0xfe80, 0, 0, 0, 0, 0, 0, 2);
+  endpoint.port = UIP_HTONS(COAP_DEFAULT_PORT);
+  uip_ds6_nbr_add(&endpoint.ipaddr, &lladdr, 0, NBR_REACHABLE,
+                  NBR_TABLE_REASON_UNDEFINED, NULL);
+  tcpip_set_outputfunc(capture_output);
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(large_in_flight);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+#define UNIT_TEST_PRINT_FUNCTION test_print_report
+
+/* test-ntimer runs the timers on a clock of its own */
+#define NTIMER_CONF_DRIVER             ntimer_test_driver
+
+/* Run the tests with the indexes unless set on the command line */
+#ifndef NTIMER_CONF_WHEEL
+#define NTIMER_CONF_WHEEL              1
+#endif /* NTIMER_CONF_WHEEL */
+
+#ifndef UIP_CONF_DS6_ROUTE_HASH
+#define UIP_CONF_DS6_ROUTE_HASH        1
+#endif /* UIP_CONF_DS6_ROUTE_HASH */
+
+#ifndef NBR_TABLE_CONF_HASH
+#define NBR_TABLE_CONF_HASH            1
+#endif /* NBR_TABLE_CONF_HASH */
+
+#ifndef TSCH_SCHEDULE_CONF_SORTED_LINKS
+#define TSCH_SCHEDULE_CONF_SORTED_LINKS 1
+#endif /* TSCH_SCHEDULE_CONF_SORTED_LINKS */
+
+/* Room for the benchmarks: up to 256 neighbors, 5000 host routes and
+   a prefix route, and 256 TSCH links */
+#undef NBR_TABLE_CONF_MAX_NEIGHBORS
+#define NBR_TABLE_CONF_MAX_NEIGHBORS   256
+#undef UIP_CONF_MAX_ROUTES
+#define UIP_CONF_MAX_ROUTES            5001
+#define UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED 1
+#define TSCH_SCHEDULE_CONF_MAX_LINKS   256
+#define TSCH_LOG_CONF_LEVEL            0
+
+/* The tests add the routes themselves, without RPL, and a full
+   neighbor table evicts by the nbr-table policy */
+#undef UIP_CONF_IPV6_RPL
+#define UIP_CONF_IPV6_RPL              0
+
+#undef UIP_CONF_TCP
+#define UIP_CONF_TCP                   0
+
+#endif /* PROJECT_CONF_H_ */
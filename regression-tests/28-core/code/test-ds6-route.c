@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Tests longest-prefix matching in the IPv6 routing table and
+ *         times lookups in tables of 100 to 5000 routes
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-ds6-route.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <string.h>
+
+PROCESS(test_process, "IPv6 route table test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define NEXTHOPS       16
+#define BENCH_TIME     (CLOCK_SECOND / 2)
+#define BENCH_BATCH    1000
+
+static uip_ipaddr_t nexthops[NEXTHOPS];
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The address of the i:th destination node, all within fd00::/64 */
+static void
+node_addr(uip_ipaddr_t *addr, unsigned i)
+{
+  uip_ip6addr(addr, 0xfd00, 0, 0, 0, 0x0200, 0, (i >> 16) + 1, i & 0xffff);
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+add_node_route(unsigned i)
+{
+  uip_ipaddr_t addr;
+
+  node_addr(&addr, i);
+  return uip_ds6_route_add(&addr, 128, &nexthops[i % NEXTHOPS]);
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+lookup_node(unsigned i)
+{
+  uip_ipaddr_t addr;
+
+  node_addr(&addr, i);
+  return uip_ds6_route_lookup(&addr);
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+add_prefix_route(uint16_t group4, uint16_t group5, uint16_t group6,
+                 uint8_t length, int nexthop)
+{
+  uip_ipaddr_t prefix;
+
+  uip_ip6addr(&prefix, 0xfd00, 0, 0, 0, group4, group5, group6, 0);
+  return uip_ds6_route_add(&prefix, length, &nexthops[nexthop]);
+}
+/*---------------------------------------------------------------------------*/
+static int
+routes_via(uip_ds6_route_t *r, int nexthop)
+{
+  return r != NULL &&
+    uip_ipaddr_cmp(uip_ds6_route_nexthop(r), &nexthops[nexthop]);
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_all_routes(void)
+{
+  uip_ds6_route_t *r;
+
+  while((r = uip_ds6_route_head()) != NULL) {
+    uip_ds6_route_rm(r);
+  }
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(host_routes, "host routes are found");
+UNIT_TEST(host_routes)
+{
+  uip_ds6_route_t *r;
+  uip_ipaddr_t addr;
+  unsigned i;
+
+  UNIT_TEST_BEGIN();
+
+  remove_all_routes();
+  for(i = 0; i < 200; i++) {
+    UNIT_TEST_ASSERT(add_node_route(i) != NULL);
+  }
+  UNIT_TEST_ASSERT(uip_ds6_route_num_routes() == 200);
+
+  for(i = 0; i < 200; i++) {
+    r = lookup_node(i);
+    node_addr(&addr, i);
+    UNIT_TEST_ASSERT(r != NULL && r->length == 128);
+    UNIT_TEST_ASSERT(uip_ipaddr_cmp(&r->ipaddr, &addr));
+    UNIT_TEST_ASSERT(routes_via(r, i % NEXTHOPS));
+  }
+  UNIT_TEST_ASSERT(lookup_node(200) == NULL);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(longest_prefix, "the longest prefix wins");
+UNIT_TEST(longest_prefix)
+{
+  uip_ds6_route_t *r64, *r80, *r96;
+  uip_ipaddr_t addr;
+
+  UNIT_TEST_BEGIN();
+
+  /* Adding a route replaces the route that its address already
+     matches, so nested prefixes are added longest first. The host
+     route to fd00::200:0:1:5 is the longest match for that node. */
+  r96 = add_prefix_route(0x0200, 0, 0xffff, 96, 3);
+  r80 = add_prefix_route(0x0200, 0xffff, 0, 80, 2);
+  r64 = add_prefix_route(0xffff, 0, 0, 64, 1);
+  UNIT_TEST_ASSERT(r64 != NULL && r80 != NULL && r96 != NULL);
+  UNIT_TEST_ASSERT(uip_ds6_route_num_routes() == 203);
+
+  UNIT_TEST_ASSERT(routes_via(lookup_node(5), 5));
+
+  uip_ip6addr(&addr, 0xfd00, 0, 0, 0, 0x0200, 0, 0x7000, 1);
+  UNIT_TEST_ASSERT(uip_ds6_route_lookup(&addr) == r96);
+  uip_ip6addr(&addr, 0xfd00, 0, 0, 0, 0x0200, 0x0001, 1, 5);
+  UNIT_TEST_ASSERT(uip_ds6_route_lookup(&addr) == r80);
+  uip_ip6addr(&addr, 0xfd00, 0, 0, 0, 0x0201, 0, 1, 5);
+  UNIT_TEST_ASSERT(uip_ds6_route_lookup(&addr) == r64);
+  uip_ip6addr(&addr, 0xfd01, 0, 0, 0, 0x0200, 0, 1, 5);
+  UNIT_TEST_ASSERT(uip_ds6_route_lookup(&addr) == NULL);
+
+  /* Shorter prefixes take over when longer routes go away */
+  uip_ds6_route_rm(lookup_node(5));
+  UNIT_TEST_ASSERT(lookup_node(5) == r96);
+  uip_ds6_route_rm(r96);
+  UNIT_TEST_ASSERT(lookup_node(5) == r80);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(replace_and_remove, "routes replaced and removed by next hop");
+UNIT_TEST(replace_and_remove)
+{
+  int count;
+  unsigned i;
+  uip_ds6_route_t *r80;
+  uip_ipaddr_t addr;
+
+  UNIT_TEST_BEGIN();
+
+  count = uip_ds6_route_num_routes();
+  r80 = lookup_node(5);
+
+  /* A route to the same destination via another next hop replaces it */
+  node_addr(&addr, 6);
+  UNIT_TEST_ASSERT(uip_ds6_route_add(&addr, 128, &nexthops[0]) != NULL);
+  UNIT_TEST_ASSERT(uip_ds6_route_num_routes() == count);
+  UNIT_TEST_ASSERT(routes_via(lookup_node(6), 0));
+
+  /* The routes via a lost next hop fall back to the prefix */
+  uip_ds6_route_rm_by_nexthop(&nexthops[3]);
+  for(i = 0; i < 200; i++) {
+    if(i % NEXTHOPS == 3) {
+      UNIT_TEST_ASSERT(lookup_node(i) == r80);
+    } else if(i != 5) {
+      UNIT_TEST_ASSERT(lookup_node(i)->length == 128);
+    }
+  }
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(lru_eviction, "a full table drops the least recently used route");
+UNIT_TEST(lru_eviction)
+{
+  unsigned i;
+
+  UNIT_TEST_BEGIN();
+
+  remove_all_routes();
+  for(i = 0; i < UIP_DS6_ROUTE_NB; i++) {
+    add_node_route(i);
+  }
+  UNIT_TEST_ASSERT(uip_ds6_route_num_routes() == UIP_DS6_ROUTE_NB);
+
+  /* Use every route but the second one */
+  lookup_node(0);
+  for(i = 2; i < UIP_DS6_ROUTE_NB; i++) {
+    lookup_node(i);
+  }
+  UNIT_TEST_ASSERT(add_node_route(UIP_DS6_ROUTE_NB) != NULL);
+  UNIT_TEST_ASSERT(uip_ds6_route_num_routes() == UIP_DS6_ROUTE_NB);
+  UNIT_TEST_ASSERT(lookup_node(1) == NULL);
+  UNIT_TEST_ASSERT(lookup_node(0) != NULL);
+  UNIT_TEST_ASSERT(lookup_node(UIP_DS6_ROUTE_NB) != NULL);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(unsigned routes)
+{
+  clock_time_t start, elapsed;
+  unsigned long lookups;
+  unsigned i, misses;
+
+  remove_all_routes();
+  for(i = 0; i < routes; i++) {
+    add_node_route(i);
+  }
+  add_prefix_route(0xffff, 0, 0, 64, 0);
+
+  lookups = 0;
+  misses = 0;
+  start = clock_time();
+  do {
+    for(i = 0; i < BENCH_BATCH; i++) {
+      if(lookup_node(random_rand() % routes)->length != 128) {
+        misses++;
+      }
+    }
+    lookups += BENCH_BATCH;
+    elapsed = clock_time() - start;
+  } while(elapsed < BENCH_TIME);
+
+  printf("%s, %u routes: %lu lookups/s, %u by the prefix\n",
+         UIP_DS6_ROUTE_HASH ? "hashed" : "linear scan", routes,
+         lookups * CLOCK_SECOND / elapsed, misses);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  int i;
+
+  PROCESS_BEGIN();
+
+  /* Reachable next hops, link-layer address 02:00:00:00:00:00:00:<i+1> */
+  for(i = 0; i < NEXTHOPS; i++) {
+    uip_lladdr_t lladdr = { { 0x02, 0, 0, 0, 0, 0, 0, i + 1 } };
+    uip_ip6addr(&nexthops[i], 0xfe80, 0, 0, 0, 0, 0, 0, i + 1);
+    uip_ds6_nbr_add(&nexthops[i], &lladdr, 1, NBR_REACHABLE,
+                    NBR_TABLE_REASON_UNDEFINED, NULL);
+  }
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(host_routes);
+  UNIT_TEST_RUN(longest_prefix);
+  UNIT_TEST_RUN(replace_and_remove);
+  UNIT_TEST_RUN(lru_eviction);
+
+  bench(100);
+  bench(1000);
+  bench(5000);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
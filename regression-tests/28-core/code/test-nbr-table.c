@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Tests lookups and eviction in the neighbor table and times
+ *         lookups with 16 to 256 neighbors
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "net/nbr-table.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <string.h>
+
+PROCESS(test_process, "Neighbor table test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define ADDR_TEST      0x02
+#define ADDR_BENCH     0x12
+#define CHURN_ADDRS    512
+#define CHURN_ROUNDS   20000
+#define BENCH_TIME     (CLOCK_SECOND / 2)
+#define BENCH_BATCH    1000
+
+struct test_nbr {
+  unsigned id;
+};
+
+NBR_TABLE(struct test_nbr, test_nbrs);
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_addr(linkaddr_t *lladdr, uint8_t space, unsigned i)
+{
+  memset(lladdr, 0, sizeof(linkaddr_t));
+  lladdr->u8[0] = space;
+  lladdr->u8[LINKADDR_SIZE - 2] = i >> 8;
+  lladdr->u8[LINKADDR_SIZE - 1] = i & 0xff;
+}
+/*---------------------------------------------------------------------------*/
+static struct test_nbr *
+add_nbr(uint8_t space, unsigned i)
+{
+  linkaddr_t lladdr;
+  struct test_nbr *nbr;
+
+  make_addr(&lladdr, space, i);
+  nbr = nbr_table_add_lladdr(test_nbrs, &lladdr,
+                             NBR_TABLE_REASON_UNDEFINED, NULL);
+  if(nbr != NULL) {
+    nbr->id = i;
+  }
+  return nbr;
+}
+/*---------------------------------------------------------------------------*/
+static struct test_nbr *
+get_nbr(uint8_t space, unsigned i)
+{
+  linkaddr_t lladdr;
+
+  make_addr(&lladdr, space, i);
+  return nbr_table_get_from_lladdr(test_nbrs, &lladdr);
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_nbr(uint8_t space, unsigned i)
+{
+  struct test_nbr *nbr = get_nbr(space, i);
+  return nbr != NULL && nbr->id == i;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(lookups, "neighbors are found by address");
+UNIT_TEST(lookups)
+{
+  linkaddr_t lladdr;
+  struct test_nbr *nbr;
+  unsigned i;
+
+  UNIT_TEST_BEGIN();
+
+  /* Replaces the neighbors of the benchmark */
+  for(i = 0; i < NBR_TABLE_MAX_NEIGHBORS; i++) {
+    UNIT_TEST_ASSERT(add_nbr(ADDR_TEST, i) != NULL);
+  }
+  for(i = 0; i < NBR_TABLE_MAX_NEIGHBORS; i++) {
+    nbr = get_nbr(ADDR_TEST, i);
+    make_addr(&lladdr, ADDR_TEST, i);
+    UNIT_TEST_ASSERT(nbr != NULL && nbr->id == i);
+    UNIT_TEST_ASSERT(linkaddr_cmp(nbr_table_get_lladdr(test_nbrs, nbr),
+                                  &lladdr));
+    UNIT_TEST_ASSERT(get_nbr(ADDR_BENCH, i) == NULL);
+  }
+  UNIT_TEST_ASSERT(get_nbr(ADDR_TEST, NBR_TABLE_MAX_NEIGHBORS) == NULL);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(eviction, "a full table evicts unused then oldest neighbors");
+UNIT_TEST(eviction)
+{
+  struct test_nbr *nbr;
+  unsigned n;
+
+  UNIT_TEST_BEGIN();
+
+  n = NBR_TABLE_MAX_NEIGHBORS;
+
+  /* A removed neighbor added again keeps its entry */
+  nbr = get_nbr(ADDR_TEST, 7);
+  nbr_table_remove(test_nbrs, nbr);
+  UNIT_TEST_ASSERT(get_nbr(ADDR_TEST, 7) == NULL);
+  UNIT_TEST_ASSERT(add_nbr(ADDR_TEST, 7) == nbr);
+
+  /* Entries no table uses go first */
+  nbr_table_remove(test_nbrs, get_nbr(ADDR_TEST, 8));
+  UNIT_TEST_ASSERT(add_nbr(ADDR_TEST, n) != NULL);
+  UNIT_TEST_ASSERT(get_nbr(ADDR_TEST, 8) == NULL);
+  UNIT_TEST_ASSERT(is_nbr(ADDR_TEST, 0));
+
+  /* Then the oldest ones that are not locked */
+  UNIT_TEST_ASSERT(add_nbr(ADDR_TEST, n + 1) != NULL);
+  UNIT_TEST_ASSERT(get_nbr(ADDR_TEST, 0) == NULL);
+  nbr_table_lock(test_nbrs, get_nbr(ADDR_TEST, 1));
+  UNIT_TEST_ASSERT(add_nbr(ADDR_TEST, n + 2) != NULL);
+  UNIT_TEST_ASSERT(is_nbr(ADDR_TEST, 1));
+  UNIT_TEST_ASSERT(get_nbr(ADDR_TEST, 2) == NULL);
+  nbr_table_unlock(test_nbrs, get_nbr(ADDR_TEST, 1));
+
+  UNIT_TEST_ASSERT(is_nbr(ADDR_TEST, n));
+  UNIT_TEST_ASSERT(is_nbr(ADDR_TEST, n + 1));
+  UNIT_TEST_ASSERT(is_nbr(ADDR_TEST, n + 2));
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(update_lladdr, "neighbors move to a new address");
+UNIT_TEST(update_lladdr)
+{
+  linkaddr_t old_addr, new_addr;
+  struct test_nbr *nbr;
+
+  UNIT_TEST_BEGIN();
+
+  nbr = get_nbr(ADDR_TEST, 3);
+  make_addr(&old_addr, ADDR_TEST, 3);
+  make_addr(&new_addr, ADDR_TEST, 1000);
+  UNIT_TEST_ASSERT(nbr_table_update_lladdr(&old_addr, &new_addr, 0) == 1);
+  UNIT_TEST_ASSERT(get_nbr(ADDR_TEST, 3) == NULL);
+  UNIT_TEST_ASSERT(get_nbr(ADDR_TEST, 1000) == nbr);
+  UNIT_TEST_ASSERT(nbr->id == 3);
+
+  /* An address in use is not taken over */
+  make_addr(&old_addr, ADDR_TEST, 4);
+  UNIT_TEST_ASSERT(nbr_table_update_lladdr(&old_addr, &new_addr, 0) == 0);
+  UNIT_TEST_ASSERT(is_nbr(ADDR_TEST, 4));
+  UNIT_TEST_ASSERT(get_nbr(ADDR_TEST, 1000) == nbr);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(churn, "lookups agree with the table after churn");
+UNIT_TEST(churn)
+{
+  linkaddr_t old_addr, new_addr;
+  struct test_nbr *nbr;
+  linkaddr_t *lladdr;
+  unsigned i, count;
+
+  UNIT_TEST_BEGIN();
+
+  for(i = 0; i < CHURN_ROUNDS; i++) {
+    switch(random_rand() % 4) {
+    case 0:
+    case 1:
+      add_nbr(ADDR_TEST, random_rand() % CHURN_ADDRS);
+      break;
+    case 2:
+      nbr = get_nbr(ADDR_TEST, random_rand() % CHURN_ADDRS);
+      if(nbr != NULL) {
+        nbr_table_remove(test_nbrs, nbr);
+      }
+      break;
+    default:
+      make_addr(&old_addr, ADDR_TEST, random_rand() % CHURN_ADDRS);
+      make_addr(&new_addr, ADDR_TEST, random_rand() % CHURN_ADDRS);
+      nbr_table_update_lladdr(&old_addr, &new_addr, random_rand() & 1);
+      break;
+    }
+  }
+
+  /* Every neighbor in the table is found under its own address */
+  count = 0;
+  for(nbr = nbr_table_head(test_nbrs); nbr != NULL;
+      nbr = nbr_table_next(test_nbrs, nbr)) {
+    lladdr = nbr_table_get_lladdr(test_nbrs, nbr);
+    UNIT_TEST_ASSERT(nbr_table_get_from_lladdr(test_nbrs, lladdr) == nbr);
+    count++;
+  }
+
+  /* And every address found belongs to a neighbor in the table */
+  for(i = 0; i < CHURN_ADDRS; i++) {
+    nbr = get_nbr(ADDR_TEST, i);
+    if(nbr != NULL) {
+      make_addr(&new_addr, ADDR_TEST, i);
+      UNIT_TEST_ASSERT(linkaddr_cmp(nbr_table_get_lladdr(test_nbrs, nbr),
+                                    &new_addr));
+      count--;
+    }
+  }
+  UNIT_TEST_ASSERT(count == 0);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+/* Adds neighbors up to the given number and times lookups among them */
+static void
+bench(unsigned neighbors)
+{
+  static unsigned added;
+  clock_time_t start, elapsed;
+  unsigned long lookups;
+  unsigned i, misses;
+
+  for(; added < neighbors; added++) {
+    add_nbr(ADDR_BENCH, added);
+  }
+
+  lookups = 0;
+  misses = 0;
+  start = clock_time();
+  do {
+    for(i = 0; i < BENCH_BATCH; i++) {
+      if(get_nbr(ADDR_BENCH, random_rand() % neighbors) == NULL) {
+        misses++;
+      }
+    }
+    lookups += BENCH_BATCH;
+    elapsed = clock_time() - start;
+  } while(elapsed < BENCH_TIME);
+
+  printf("%s, %u neighbors: %lu lookups/s, %u misses\n",
+         NBR_TABLE_CONF_HASH ? "hashed" : "list scan", neighbors,
+         lookups * CLOCK_SECOND / elapsed, misses);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  nbr_table_register(test_nbrs, NULL);
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  /* The benchmark runs first, on an empty table */
+  bench(16);
+  bench(64);
+  bench(NBR_TABLE_MAX_NEIGHBORS);
+
+  UNIT_TEST_RUN(lookups);
+  UNIT_TEST_RUN(eviction);
+  UNIT_TEST_RUN(update_lladdr);
+  UNIT_TEST_RUN(churn);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
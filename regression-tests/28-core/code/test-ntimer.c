@@ -0,0 +1,377 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Tests that ntimers expire on time and in order, and times
+ *         setting, stopping and expiring many timers
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "sys/ntimer.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <string.h>
+
+PROCESS(test_process, "ntimer test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define RANDOM_TIMERS 1000
+#define BENCH_TIMERS  10000
+#define BENCH_ROUNDS  10
+
+/* The timers run on a clock of their own that the tests move forward */
+static uint64_t now;
+static unsigned update_calls;
+
+typedef struct {
+  ntimer_t timer;
+  uint64_t expected;
+  uint64_t fired_at;
+  unsigned fired;
+  /* Reset the timer by this much when it expires, if not zero */
+  uint64_t period;
+} test_timer_t;
+
+static test_timer_t timers[RANDOM_TIMERS];
+static ntimer_t bench_timers[BENCH_TIMERS];
+static uint64_t last_fired_at;
+static unsigned fired_in_order;
+static unsigned bench_fired;
+/*---------------------------------------------------------------------------*/
+static uint64_t
+test_uptime(void)
+{
+  return now;
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_update(void)
+{
+  update_calls++;
+}
+/*---------------------------------------------------------------------------*/
+const ntimer_driver_t ntimer_test_driver = {
+  .init = NULL,
+  .uptime = test_uptime,
+  .update = test_update,
+};
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+timer_callback(ntimer_t *timer)
+{
+  test_timer_t *t = ntimer_get_user_data(timer);
+
+  t->fired++;
+  t->fired_at = now;
+  if(now >= last_fired_at) {
+    fired_in_order++;
+  }
+  last_fired_at = now;
+  if(t->period > 0) {
+    t->expected += t->period;
+    ntimer_reset(timer, t->period);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_callback(ntimer_t *timer)
+{
+  bench_fired++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_timer(test_timer_t *t, uint64_t time)
+{
+  ntimer_set_callback(&t->timer, timer_callback);
+  ntimer_set_user_data(&t->timer, t);
+  t->expected = now + time;
+  t->fired = 0;
+  t->period = 0;
+  ntimer_set(&t->timer, time);
+}
+/*---------------------------------------------------------------------------*/
+/* Moves the clock to each expiration until the given time, as a driver
+   waking up exactly on time would */
+static void
+run_until(uint64_t time)
+{
+  uint64_t next;
+
+  for(;;) {
+    while(ntimer_run());
+    next = now + ntimer_time_to_next_expiration();
+    if(next > time) {
+      break;
+    }
+    now = next;
+  }
+  now = time;
+  while(ntimer_run());
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+random_time(uint32_t max)
+{
+  return (((uint32_t)random_rand() << 16) | random_rand()) % max;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(expiry_order, "timers expire on time and in order");
+UNIT_TEST(expiry_order)
+{
+  /* From the current millisecond to past the range of the wheel */
+  static const uint32_t times[] = {
+    5, 1, 70, 64, 4100, 300000, 20000000, 0, 63, 4096, 262144, 16777300
+  };
+  int i;
+  int n = sizeof(times) / sizeof(times[0]);
+
+  UNIT_TEST_BEGIN();
+
+  fired_in_order = 0;
+  last_fired_at = now;
+  for(i = 0; i < n; i++) {
+    set_timer(&timers[i], times[i]);
+  }
+  run_until(now + 20000001);
+
+  UNIT_TEST_ASSERT(fired_in_order == n);
+  for(i = 0; i < n; i++) {
+    UNIT_TEST_ASSERT(timers[i].fired == 1);
+    UNIT_TEST_ASSERT(timers[i].fired_at == timers[i].expected);
+  }
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(stop_and_reset, "stopped and reset timers");
+UNIT_TEST(stop_and_reset)
+{
+  uint64_t start;
+
+  UNIT_TEST_BEGIN();
+
+  start = now;
+  set_timer(&timers[0], 100);
+  set_timer(&timers[1], 200);
+  set_timer(&timers[2], 100);
+  timers[2].period = 100;
+
+  /* Stopped timers do not expire, set timers move */
+  ntimer_stop(&timers[0].timer);
+  set_timer(&timers[1], 50);
+  UNIT_TEST_ASSERT(ntimer_time_to_next_expiration() == 50);
+
+  run_until(start + 350);
+  UNIT_TEST_ASSERT(timers[0].fired == 0);
+  UNIT_TEST_ASSERT(timers[1].fired == 1);
+  UNIT_TEST_ASSERT(timers[1].fired_at == start + 50);
+
+  /* The periodic timer is reset from its expiration time */
+  UNIT_TEST_ASSERT(timers[2].fired == 3);
+  UNIT_TEST_ASSERT(timers[2].fired_at == start + 300);
+  UNIT_TEST_ASSERT(ntimer_time_to_next_expiration() == 50);
+
+  /* A timer reset into the past expires at once until it catches up */
+  ntimer_stop(&timers[2].timer);
+  set_timer(&timers[3], 10);
+  timers[3].period = 10;
+  now += 500;
+  while(ntimer_run());
+  UNIT_TEST_ASSERT(timers[3].fired == 50);
+  UNIT_TEST_ASSERT(ntimer_time_to_next_expiration() == 10);
+
+  ntimer_stop(&timers[3].timer);
+  UNIT_TEST_ASSERT(ntimer_time_to_next_expiration() == 60000);
+
+  /* Stopping the earliest timer past the wheel finds the next one */
+  set_timer(&timers[4], 30000000);
+  set_timer(&timers[5], 40000000);
+  set_timer(&timers[6], 35000000);
+  ntimer_stop(&timers[4].timer);
+  ntimer_stop(&timers[4].timer);
+  UNIT_TEST_ASSERT(ntimer_time_to_next_expiration() == 35000000);
+  ntimer_stop(&timers[5].timer);
+  UNIT_TEST_ASSERT(ntimer_time_to_next_expiration() == 35000000);
+  ntimer_stop(&timers[6].timer);
+  UNIT_TEST_ASSERT(ntimer_time_to_next_expiration() == 60000);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(driver_updates, "the driver is told of new next timers");
+UNIT_TEST(driver_updates)
+{
+  unsigned updates;
+
+  UNIT_TEST_BEGIN();
+
+  updates = update_calls;
+  set_timer(&timers[0], 1000);
+  UNIT_TEST_ASSERT(update_calls == updates + 1);
+
+  /* A later timer does not change the next expiration */
+  set_timer(&timers[1], 2000);
+  UNIT_TEST_ASSERT(update_calls == updates + 1);
+  UNIT_TEST_ASSERT(ntimer_time_to_next_expiration() == 1000);
+
+  set_timer(&timers[2], 500);
+  UNIT_TEST_ASSERT(update_calls == updates + 2);
+  UNIT_TEST_ASSERT(ntimer_time_to_next_expiration() == 500);
+
+  now += 400;
+  UNIT_TEST_ASSERT(ntimer_time_to_next_expiration() == 100);
+  now += 200;
+  UNIT_TEST_ASSERT(ntimer_time_to_next_expiration() == 0);
+
+  /* Each expired timer is followed by an update */
+  while(ntimer_run());
+  UNIT_TEST_ASSERT(update_calls == updates + 3);
+  run_until(now + 2000);
+  UNIT_TEST_ASSERT(update_calls == updates + 5);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(random_timers, "random timers set, stopped and moved");
+UNIT_TEST(random_timers)
+{
+  int i;
+  unsigned expected_count;
+  uint64_t start;
+
+  UNIT_TEST_BEGIN();
+
+  start = now;
+  for(i = 0; i < RANDOM_TIMERS; i++) {
+    set_timer(&timers[i], random_time(i % 10 == 0 ? 30000000 : 100000));
+  }
+
+  /* Stop some timers and move others, halfway through */
+  run_until(start + 50000);
+  expected_count = 0;
+  for(i = 0; i < RANDOM_TIMERS; i++) {
+    if(timers[i].fired) {
+      expected_count++;
+    } else if(i % 3 == 0) {
+      ntimer_stop(&timers[i].timer);
+    } else {
+      if(i % 3 == 1) {
+        set_timer(&timers[i], random_time(100000));
+      }
+      expected_count++;
+    }
+  }
+
+  run_until(start + 30000000 + 100000);
+  for(i = 0; i < RANDOM_TIMERS; i++) {
+    if(timers[i].fired) {
+      UNIT_TEST_ASSERT(timers[i].fired == 1);
+      UNIT_TEST_ASSERT(timers[i].fired_at == timers[i].expected);
+      expected_count--;
+    }
+  }
+  UNIT_TEST_ASSERT(expected_count == 0);
+  UNIT_TEST_ASSERT(ntimer_time_to_next_expiration() == 60000);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(void)
+{
+  clock_time_t set_time, stop_time, expire_time, start;
+  int round, i;
+
+  set_time = stop_time = expire_time = 0;
+  bench_fired = 0;
+  for(round = 0; round < BENCH_ROUNDS; round++) {
+    start = clock_time();
+    for(i = 0; i < BENCH_TIMERS; i++) {
+      ntimer_set_callback(&bench_timers[i], bench_callback);
+      ntimer_set(&bench_timers[i], 1 + random_time(60000));
+    }
+    set_time += clock_time() - start;
+
+    /* Cancel every other timer, as when a response arrives */
+    start = clock_time();
+    for(i = 0; i < BENCH_TIMERS; i += 2) {
+      ntimer_stop(&bench_timers[i]);
+    }
+    stop_time += clock_time() - start;
+
+    start = clock_time();
+    run_until(now + 60000);
+    expire_time += clock_time() - start;
+  }
+
+  printf("%s, %d rounds of %d timers: set %lu ms, stop %lu ms, "
+         "expire %lu ms, %u expired\n",
+         NTIMER_WHEEL ? "timer wheel" : "sorted list",
+         BENCH_ROUNDS, BENCH_TIMERS,
+         (unsigned long)(set_time * 1000 / CLOCK_SECOND),
+         (unsigned long)(stop_time * 1000 / CLOCK_SECOND),
+         (unsigned long)(expire_time * 1000 / CLOCK_SECOND),
+         bench_fired);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  now = 1000;
+  ntimer_init();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(expiry_order);
+  UNIT_TEST_RUN(stop_and_reset);
+  UNIT_TEST_RUN(driver_updates);
+  UNIT_TEST_RUN(random_timers);
+
+  bench();
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
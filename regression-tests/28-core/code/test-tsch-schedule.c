@@ -0,0 +1,456 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Tests that the next active TSCH link is the one the standard
+ *         selects, and times the lookup in schedules of 8 to 256 links.
+ *         The schedule is built on its own, without the rest of TSCH.
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "lib/random.h"
+
+/* The schedule itself, with the TSCH functions it needs stubbed below */
+#include "net/mac/tsch/tsch-schedule.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+PROCESS(test_process, "TSCH schedule test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define SLOTFRAMES     4
+#define CHECK_ASNS     100000
+#define BENCH_ASNS     200000
+/* Each ASN is timed this many times and the shortest time is kept, so
+   that the worst case is not the time the host was doing something else */
+#define BENCH_REPEATS  5
+
+static const uint16_t slotframe_sizes[SLOTFRAMES] = { 397, 31, 17, 101 };
+static struct tsch_slotframe *slotframes[SLOTFRAMES];
+
+/* Query times in ns, for the percentiles and the worst case */
+static uint32_t query_times[BENCH_ASNS];
+
+const linkaddr_t tsch_broadcast_address = { { 0xff, 0xff } };
+struct tsch_link *current_link;
+static int locked;
+/*---------------------------------------------------------------------------*/
+int
+tsch_is_locked(void)
+{
+  return locked;
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_get_lock(void)
+{
+  if(locked) {
+    return 0;
+  }
+  locked = 1;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_release_lock(void)
+{
+  locked = 0;
+}
+/*---------------------------------------------------------------------------*/
+struct tsch_neighbor *
+tsch_queue_add_nbr(const linkaddr_t *addr)
+{
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The next active link found by walking all links: the earliest one,
+ * Tx links first and then the lowest slotframe handle, with an Rx link
+ * at the same time as backup.
+ */
+static struct tsch_link *
+reference_next_link(struct tsch_asn_t *asn, uint16_t *time_offset,
+                    struct tsch_link **backup_link)
+{
+  struct tsch_slotframe *sf;
+  struct tsch_link *l, *best, *backup, *new_best;
+  uint16_t timeslot, time_to_timeslot, time_to_best;
+
+  best = NULL;
+  backup = NULL;
+  time_to_best = 0;
+  for(sf = list_head(slotframe_list); sf != NULL; sf = list_item_next(sf)) {
+    timeslot = TSCH_ASN_MOD(*asn, sf->size);
+    for(l = list_head(sf->links_list); l != NULL; l = list_item_next(l)) {
+      time_to_timeslot = l->timeslot > timeslot ?
+        l->timeslot - timeslot : sf->size.val + l->timeslot - timeslot;
+      if(best == NULL || time_to_timeslot < time_to_best) {
+        best = l;
+        backup = NULL;
+        time_to_best = time_to_timeslot;
+      } else if(time_to_timeslot == time_to_best) {
+        new_best = NULL;
+        if((best->link_options & LINK_OPTION_TX) ==
+           (l->link_options & LINK_OPTION_TX)) {
+          if(l->slotframe_handle < best->slotframe_handle) {
+            new_best = l;
+          }
+        } else if(l->link_options & LINK_OPTION_TX) {
+          new_best = l;
+        }
+        if(backup == NULL) {
+          if(new_best != l && (l->link_options & LINK_OPTION_RX)) {
+            backup = l;
+          }
+          if(new_best != best && (best->link_options & LINK_OPTION_RX)) {
+            backup = best;
+          }
+        }
+        if(new_best != NULL) {
+          best = new_best;
+        }
+      }
+    }
+  }
+  *time_offset = time_to_best;
+  *backup_link = backup;
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+/* Compares the schedule with the reference over consecutive ASNs */
+static int
+matches_reference(uint32_t first_asn, uint32_t asns)
+{
+  struct tsch_asn_t asn;
+  struct tsch_link *link, *backup, *ref_link, *ref_backup;
+  uint16_t offset, ref_offset;
+  uint32_t i;
+
+  TSCH_ASN_INIT(asn, 0, first_asn);
+  for(i = 0; i < asns; i++) {
+    link = tsch_schedule_get_next_active_link(&asn, &offset, &backup);
+    ref_link = reference_next_link(&asn, &ref_offset, &ref_backup);
+    if(link != ref_link || backup != ref_backup ||
+       (link != NULL && offset != ref_offset)) {
+      printf("ASN %lu: link %p/%p offset %u/%u backup %p/%p\n",
+             (unsigned long)asn.ls4b, link, ref_link, offset, ref_offset,
+             backup, ref_backup);
+      return 0;
+    }
+    TSCH_ASN_INC(asn, 1);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Replaces the schedule with random links spread over the slotframes */
+static void
+random_schedule(unsigned links)
+{
+  linkaddr_t addr;
+  unsigned i, n;
+  uint16_t timeslot;
+
+  tsch_schedule_remove_all_slotframes();
+  for(i = 0; i < SLOTFRAMES; i++) {
+    slotframes[i] = tsch_schedule_add_slotframe(i, slotframe_sizes[i]);
+  }
+
+  /* A link added to a used timeslot would replace the link there */
+  for(n = 0; n < links; ) {
+    i = random_rand() % SLOTFRAMES;
+    timeslot = random_rand() % slotframe_sizes[i];
+    memset(&addr, 0, sizeof(addr));
+    addr.u8[0] = random_rand() % 16;
+    if(tsch_schedule_get_link_by_timeslot(slotframes[i], timeslot) == NULL &&
+       tsch_schedule_add_link(slotframes[i], 1 + random_rand() % 7,
+                              LINK_TYPE_NORMAL, &addr, timeslot,
+                              random_rand() % 16) != NULL) {
+      n++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned
+count_links(void)
+{
+  struct tsch_slotframe *sf;
+  struct tsch_link *l;
+  unsigned n = 0;
+
+  for(sf = list_head(slotframe_list); sf != NULL; sf = list_item_next(sf)) {
+    for(l = list_head(sf->links_list); l != NULL; l = list_item_next(l)) {
+      n++;
+    }
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(single_link, "time to a single link");
+UNIT_TEST(single_link)
+{
+  struct tsch_asn_t asn;
+  struct tsch_slotframe *sf;
+  struct tsch_link *l, *backup;
+  uint16_t offset, timeslot;
+
+  UNIT_TEST_BEGIN();
+
+  tsch_schedule_remove_all_slotframes();
+  TSCH_ASN_INIT(asn, 0, 0);
+  UNIT_TEST_ASSERT(tsch_schedule_get_next_active_link(&asn, &offset,
+                                                      &backup) == NULL);
+
+  sf = tsch_schedule_add_slotframe(0, 10);
+  UNIT_TEST_ASSERT(tsch_schedule_get_next_active_link(&asn, &offset,
+                                                      &backup) == NULL);
+  l = tsch_schedule_add_link(sf, LINK_OPTION_RX, LINK_TYPE_NORMAL,
+                             &tsch_broadcast_address, 5, 0);
+
+  /* The link is next at the following slots, or a slotframe later */
+  TSCH_ASN_INIT(asn, 0, 24);
+  UNIT_TEST_ASSERT(tsch_schedule_get_next_active_link(&asn, &offset,
+                                                      &backup) == l);
+  UNIT_TEST_ASSERT(offset == 1 && backup == NULL);
+  TSCH_ASN_INIT(asn, 0, 25);
+  tsch_schedule_get_next_active_link(&asn, &offset, &backup);
+  UNIT_TEST_ASSERT(offset == 10);
+
+  /* With the fifth byte of the ASN in use */
+  TSCH_ASN_INIT(asn, 1, 26);
+  timeslot = TSCH_ASN_MOD(asn, sf->size);
+  tsch_schedule_get_next_active_link(&asn, &offset, &backup);
+  UNIT_TEST_ASSERT(offset == (timeslot < 5 ? 5 - timeslot : 15 - timeslot));
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(overlapping_links, "Tx links and then lowest handles win");
+UNIT_TEST(overlapping_links)
+{
+  struct tsch_asn_t asn;
+  struct tsch_slotframe *sf0, *sf1;
+  struct tsch_link *rx0, *tx1, *link, *backup;
+  uint16_t offset;
+
+  UNIT_TEST_BEGIN();
+
+  tsch_schedule_remove_all_slotframes();
+  sf0 = tsch_schedule_add_slotframe(0, 10);
+  sf1 = tsch_schedule_add_slotframe(1, 5);
+  rx0 = tsch_schedule_add_link(sf0, LINK_OPTION_RX, LINK_TYPE_NORMAL,
+                               &tsch_broadcast_address, 3, 0);
+  tx1 = tsch_schedule_add_link(sf1, LINK_OPTION_TX, LINK_TYPE_NORMAL,
+                               &tsch_broadcast_address, 3, 0);
+
+  /* The Tx link wins over the lower handle, the Rx link is the backup */
+  TSCH_ASN_INIT(asn, 0, 1);
+  link = tsch_schedule_get_next_active_link(&asn, &offset, &backup);
+  UNIT_TEST_ASSERT(link == tx1 && backup == rx0 && offset == 2);
+
+  /* From ASN 6 the link of slotframe 1 comes first */
+  TSCH_ASN_INIT(asn, 0, 6);
+  link = tsch_schedule_get_next_active_link(&asn, &offset, &backup);
+  UNIT_TEST_ASSERT(link == tx1 && backup == NULL && offset == 2);
+
+  /* Between two Rx links the lowest slotframe handle wins. The new
+     link replaces the Tx link in its timeslot. */
+  tsch_schedule_add_link(sf1, LINK_OPTION_RX, LINK_TYPE_NORMAL,
+                               &tsch_broadcast_address, 3, 0);
+  TSCH_ASN_INIT(asn, 0, 1);
+  link = tsch_schedule_get_next_active_link(&asn, &offset, &backup);
+  UNIT_TEST_ASSERT(link == rx0 && offset == 2);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(random_schedules, "random schedules match the link walk");
+UNIT_TEST(random_schedules)
+{
+  static const unsigned sizes[] = { 1, 8, 32, 128, 256 };
+  unsigned i;
+
+  UNIT_TEST_BEGIN();
+
+  for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    random_schedule(sizes[i]);
+    UNIT_TEST_ASSERT(count_links() == sizes[i]);
+    UNIT_TEST_ASSERT(matches_reference(0, CHECK_ASNS));
+    /* Near the end of the 4-byte ASN */
+    UNIT_TEST_ASSERT(matches_reference(UINT32_MAX - CHECK_ASNS / 10,
+                                       CHECK_ASNS / 10));
+  }
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(schedule_changes, "the lookup follows schedule changes");
+UNIT_TEST(schedule_changes)
+{
+  struct tsch_link *l;
+  unsigned i, removed;
+
+  UNIT_TEST_BEGIN();
+
+  random_schedule(64);
+
+  /* Remove links, by pointer and by timeslot */
+  removed = 0;
+  for(i = 0; i < 16; i++) {
+    l = list_head(slotframes[i % SLOTFRAMES]->links_list);
+    if(l == NULL) {
+      continue;
+    }
+    if(i & 1) {
+      tsch_schedule_remove_link(slotframes[i % SLOTFRAMES], l);
+    } else {
+      tsch_schedule_remove_link_by_timeslot(slotframes[i % SLOTFRAMES],
+                                            l->timeslot);
+    }
+    removed++;
+  }
+  UNIT_TEST_ASSERT(count_links() == 64 - removed);
+  UNIT_TEST_ASSERT(matches_reference(0, CHECK_ASNS));
+
+  /* Replace links in used timeslots and remove a slotframe */
+  for(i = 0; i < 16; i++) {
+    l = list_head(slotframes[1]->links_list);
+    if(l != NULL) {
+      tsch_schedule_add_link(slotframes[2], LINK_OPTION_TX | LINK_OPTION_RX,
+                             LINK_TYPE_NORMAL, &tsch_broadcast_address,
+                             l->timeslot % slotframe_sizes[2], 0);
+    }
+    l = list_head(slotframes[3]->links_list);
+    if(l != NULL) {
+      tsch_schedule_add_link(slotframes[3], LINK_OPTION_TX, LINK_TYPE_NORMAL,
+                             &tsch_broadcast_address, l->timeslot, 1);
+    }
+  }
+  UNIT_TEST_ASSERT(matches_reference(0, CHECK_ASNS));
+  tsch_schedule_remove_slotframe(slotframes[0]);
+  UNIT_TEST_ASSERT(matches_reference(0, CHECK_ASNS));
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+static uint64_t
+ns_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+static int
+compare_times(const void *a, const void *b)
+{
+  uint32_t ta = *(const uint32_t *)a;
+  uint32_t tb = *(const uint32_t *)b;
+
+  return ta < tb ? -1 : ta > tb;
+}
+/*---------------------------------------------------------------------------*/
+/* Times the lookup at each of BENCH_ASNS consecutive ASNs */
+static void
+bench(unsigned links)
+{
+  struct tsch_asn_t asn;
+  struct tsch_link *backup;
+  uint16_t offset;
+  uint64_t start, elapsed, shortest, total;
+  uint32_t i;
+  int r;
+
+  random_schedule(links);
+  TSCH_ASN_INIT(asn, 0, 0);
+  total = 0;
+  for(i = 0; i < BENCH_ASNS; i++) {
+    shortest = UINT64_MAX;
+    for(r = 0; r < BENCH_REPEATS; r++) {
+      start = ns_now();
+      tsch_schedule_get_next_active_link(&asn, &offset, &backup);
+      elapsed = ns_now() - start;
+      if(elapsed < shortest) {
+        shortest = elapsed;
+      }
+    }
+    query_times[i] = shortest;
+    total += shortest;
+    TSCH_ASN_INC(asn, 1);
+  }
+  qsort(query_times, BENCH_ASNS, sizeof(query_times[0]), compare_times);
+
+  printf("%s, %u links: mean %lu ns, median %lu ns, 99.9%% %lu ns, "
+         "worst %lu ns\n",
+         TSCH_SCHEDULE_SORTED_LINKS ? "sorted links" : "link lists", links,
+         (unsigned long)(total / BENCH_ASNS),
+         (unsigned long)query_times[BENCH_ASNS / 2],
+         (unsigned long)query_times[BENCH_ASNS - BENCH_ASNS / 1000],
+         (unsigned long)query_times[BENCH_ASNS - 1]);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  tsch_schedule_init();
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(single_link);
+  UNIT_TEST_RUN(overlapping_links);
+  UNIT_TEST_RUN(random_schedules);
+  UNIT_TEST_RUN(schedule_changes);
+
+  bench(8);
+  bench(32);
+  bench(128);
+  bench(256);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}
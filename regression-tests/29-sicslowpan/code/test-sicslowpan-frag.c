@@ -0,0 +1,485 @@
+/*
+ * Copyright (c) 2016, SICS Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Tests 6LoWPAN selective fragment recovery over a lossy link and
+ *         the relaying of fragments through virtual reassembly buffers
+ */
+
+#include "contiki.h"
+#include "unit-test.h"
+#include "net/ip/simple-udp.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-ds6-route.h"
+#include "net/mac/mac.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+
+#include <stdio.h>
+#include <string.h>
+
+PROCESS(test_process, "6LoWPAN fragmentation test");
+AUTOSTART_PROCESSES(&test_process);
+
+#define UDP_PORT      1234
+#define DATAGRAM_LEN  600
+#define MAX_FRAMES    40
+
+/* Dispatch bytes of the fragment headers */
+#define IS_FRAG1(f)     (((f)->data[0] & 0xf8) == 0xc0)
+#define IS_FRAGN(f)     (((f)->data[0] & 0xf8) == 0xe0)
+#define IS_RFRAG(f)     (((f)->data[0] & 0xfe) == 0xe8)
+#define IS_RFRAG_ACK(f) (((f)->data[0] & 0xfe) == 0xea)
+#define RFRAG_SEQ(f)    ((((f)->data[2] << 8 | (f)->data[3]) >> 10) & 0x1f)
+#define RFRAG_ACK_REQ(f) (((f)->data[2] & 0x80) != 0)
+#define RFRAG_TAG(f)    ((f)->data[1])
+#define FRAG_TAG(f)     ((f)->data[2] << 8 | (f)->data[3])
+#define FRAGN_OFFSET(f) ((f)->data[4])
+
+/* A frame passed to the MAC layer */
+typedef struct {
+  linkaddr_t dest;
+  uint16_t len;
+  uint8_t data[PACKETBUF_SIZE];
+} frame_t;
+
+static frame_t frames[MAX_FRAMES];
+static int frame_count;
+
+/* The fragments of the datagram of the first test, as sent */
+static frame_t datagram[MAX_FRAMES];
+static int datagram_frames;
+
+static const linkaddr_t nexthop_lladdr = { { 0x02, 0x00, 0x00, 0x00,
+                                             0x00, 0x00, 0x00, 0x0c } };
+static const linkaddr_t sender_lladdr = { { 0x02, 0x00, 0x00, 0x00,
+                                            0x00, 0x00, 0x00, 0x05 } };
+static uip_ipaddr_t my_addr;
+static uip_ipaddr_t peer_addr;
+static uip_ipaddr_t nexthop_addr;
+
+static struct simple_udp_connection conn;
+static uint8_t payload[DATAGRAM_LEN];
+static unsigned received_count;
+static uint16_t received_len;
+static int received_ok;
+
+/* Results of the timeout scenario run by the process */
+static int timeout_polls;
+static int timeout_polls_ok;
+static int timeout_resend_rfrag;
+/*---------------------------------------------------------------------------*/
+static void
+test_print_report(const unit_test_t *utp)
+{
+  printf("=check-me= ");
+  if(utp->result == unit_test_failure) {
+    printf("FAILED   - %s: at line %d\n", utp->descr, utp->exit_line);
+  } else {
+    printf("SUCEEDED - %s\n", utp->descr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Replaces the MAC layer: keeps the frames sent and reports success */
+static void
+mac_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+mac_send(mac_callback_t sent, void *ptr)
+{
+  frame_t *f;
+
+  if(frame_count < MAX_FRAMES) {
+    f = &frames[frame_count];
+    linkaddr_copy(&f->dest, packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+    f->len = packetbuf_datalen();
+    memcpy(f->data, packetbuf_dataptr(), f->len);
+  }
+  frame_count++;
+  mac_call_sent_callback(sent, ptr, MAC_TX_OK, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+mac_input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static int
+mac_on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+mac_off(int keep_radio_on)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+mac_channel_check_interval(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct mac_driver test_mac_driver = {
+  "test-mac",
+  mac_init,
+  mac_send,
+  mac_input,
+  mac_on,
+  mac_off,
+  mac_channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
+/* Passes a frame to 6LoWPAN as if it came from a neighbor */
+static void
+inject(const frame_t *f, const linkaddr_t *sender)
+{
+  packetbuf_clear();
+  memcpy(packetbuf_dataptr(), f->data, f->len);
+  packetbuf_set_datalen(f->len);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, sender);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &linkaddr_node_addr);
+  NETSTACK_NETWORK.input();
+}
+/*---------------------------------------------------------------------------*/
+/* Acknowledges RFRAG fragments from the next hop */
+static void
+inject_ack(uint8_t tag, uint32_t bitmap)
+{
+  frame_t ack;
+
+  ack.len = 6;
+  ack.data[0] = 0xea;
+  ack.data[1] = tag;
+  ack.data[2] = bitmap >> 24;
+  ack.data[3] = bitmap >> 16;
+  ack.data[4] = bitmap >> 8;
+  ack.data[5] = bitmap;
+  inject(&ack, &nexthop_lladdr);
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+ack_bitmap(const frame_t *f)
+{
+  return (uint32_t)f->data[2] << 24 | (uint32_t)f->data[3] << 16 |
+    f->data[4] << 8 | f->data[5];
+}
+/*---------------------------------------------------------------------------*/
+/* The bitmap of a datagram of n fragments received in full */
+static uint32_t
+all_fragments(int n)
+{
+  return ~(uint32_t)0 << (32 - n);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_datagram(void)
+{
+  simple_udp_sendto(&conn, payload, sizeof(payload), &peer_addr);
+}
+/*---------------------------------------------------------------------------*/
+static void
+receiver(struct simple_udp_connection *c, const uip_ipaddr_t *sender_addr,
+         uint16_t sender_port, const uip_ipaddr_t *receiver_addr,
+         uint16_t receiver_port, const uint8_t *data, uint16_t datalen)
+{
+  received_count++;
+  received_len = datalen;
+  received_ok = datalen == sizeof(payload) &&
+    memcmp(data, payload, datalen) == 0;
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(lost_fragments, "lost fragments are sent again");
+UNIT_TEST(lost_fragments)
+{
+  uint32_t bitmap;
+  uint8_t tag;
+  int i;
+
+  UNIT_TEST_BEGIN();
+
+  frame_count = 0;
+  send_datagram();
+  datagram_frames = frame_count;
+  UNIT_TEST_ASSERT(datagram_frames >= 5 && datagram_frames <= MAX_FRAMES);
+  memcpy(datagram, frames, sizeof(frames));
+  tag = RFRAG_TAG(&datagram[0]);
+  for(i = 0; i < datagram_frames; i++) {
+    UNIT_TEST_ASSERT(IS_RFRAG(&datagram[i]));
+    UNIT_TEST_ASSERT(RFRAG_TAG(&datagram[i]) == tag);
+    UNIT_TEST_ASSERT(RFRAG_SEQ(&datagram[i]) == i);
+    UNIT_TEST_ASSERT(RFRAG_ACK_REQ(&datagram[i]) == (i == datagram_frames - 1));
+    UNIT_TEST_ASSERT(linkaddr_cmp(&datagram[i].dest, &nexthop_lladdr));
+  }
+
+  /* Fragments 1 and 3 were lost: only they are sent again, and the
+     last of them asks for an acknowledgement */
+  bitmap = all_fragments(datagram_frames) & ~(0x80000000UL >> 1) &
+    ~(0x80000000UL >> 3);
+  frame_count = 0;
+  inject_ack(tag, bitmap);
+  UNIT_TEST_ASSERT(frame_count == 2);
+  UNIT_TEST_ASSERT(frames[0].len == datagram[1].len);
+  UNIT_TEST_ASSERT(memcmp(frames[0].data, datagram[1].data,
+                          datagram[1].len) == 0);
+  UNIT_TEST_ASSERT(RFRAG_SEQ(&frames[1]) == 3 && RFRAG_ACK_REQ(&frames[1]));
+
+  /* An empty bitmap means that the first fragment was lost */
+  frame_count = 0;
+  inject_ack(tag, 0);
+  UNIT_TEST_ASSERT(frame_count == datagram_frames);
+
+  /* Acknowledging another tag changes nothing */
+  frame_count = 0;
+  inject_ack(tag + 1, 0);
+  UNIT_TEST_ASSERT(frame_count == 0);
+
+  /* A complete acknowledgement releases the datagram: the next one is
+     sent with RFRAG again */
+  inject_ack(tag, all_fragments(datagram_frames));
+  UNIT_TEST_ASSERT(frame_count == 0);
+  send_datagram();
+  UNIT_TEST_ASSERT(frame_count == datagram_frames);
+  UNIT_TEST_ASSERT(IS_RFRAG(&frames[0]) && RFRAG_TAG(&frames[0]) != tag);
+  inject_ack(RFRAG_TAG(&frames[0]), all_fragments(datagram_frames));
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(timeouts, "unacknowledged datagrams are polled");
+UNIT_TEST(timeouts)
+{
+  UNIT_TEST_BEGIN();
+
+  /* The last fragment is sent again to ask for the bitmap, until the
+     sender gives up and frees the datagram */
+  UNIT_TEST_ASSERT(timeout_polls == SICSLOWPAN_CONF_FRAG_RECOVERY_RETRIES);
+  UNIT_TEST_ASSERT(timeout_polls_ok);
+  UNIT_TEST_ASSERT(timeout_resend_rfrag);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(reassembly, "fragments are reassembled and acknowledged");
+UNIT_TEST(reassembly)
+{
+  frame_t f;
+  int i;
+  int n = datagram_frames;
+
+  UNIT_TEST_BEGIN();
+
+  /* Receive the datagram of the first test as its destination */
+  uip_ds6_addr_add(&peer_addr, 0, ADDR_MANUAL);
+  received_count = 0;
+
+  /* Fragment 1 is lost, the last one asks for the bitmap */
+  frame_count = 0;
+  for(i = 0; i < n; i++) {
+    if(i != 1) {
+      inject(&datagram[i], &sender_lladdr);
+    }
+  }
+  UNIT_TEST_ASSERT(received_count == 0);
+  UNIT_TEST_ASSERT(frame_count == 1);
+  UNIT_TEST_ASSERT(IS_RFRAG_ACK(&frames[0]));
+  UNIT_TEST_ASSERT(linkaddr_cmp(&frames[0].dest, &sender_lladdr));
+  UNIT_TEST_ASSERT(RFRAG_TAG(&frames[0]) == RFRAG_TAG(&datagram[0]));
+  UNIT_TEST_ASSERT(ack_bitmap(&frames[0]) ==
+                   (all_fragments(n) & ~(0x80000000UL >> 1)));
+
+  /* A duplicate is dropped and answered with the same bitmap */
+  f = datagram[2];
+  f.data[2] |= 0x80;
+  frame_count = 0;
+  inject(&f, &sender_lladdr);
+  UNIT_TEST_ASSERT(frame_count == 1);
+  UNIT_TEST_ASSERT(ack_bitmap(&frames[0]) ==
+                   (all_fragments(n) & ~(0x80000000UL >> 1)));
+
+  /* The retransmission completes the datagram, which is acknowledged */
+  frame_count = 0;
+  inject(&datagram[1], &sender_lladdr);
+  UNIT_TEST_ASSERT(received_count == 1);
+  UNIT_TEST_ASSERT(received_ok);
+  UNIT_TEST_ASSERT(frame_count == 1);
+  UNIT_TEST_ASSERT(ack_bitmap(&frames[0]) == all_fragments(n));
+
+  /* Late requests are answered without delivering the datagram again */
+  frame_count = 0;
+  inject(&f, &sender_lladdr);
+  UNIT_TEST_ASSERT(received_count == 1);
+  UNIT_TEST_ASSERT(frame_count == 1);
+  UNIT_TEST_ASSERT(ack_bitmap(&frames[0]) == all_fragments(n));
+
+  /* Fragments of a datagram whose first fragment was lost ask for all */
+  f = datagram[2];
+  f.data[1]++;
+  f.data[2] |= 0x80;
+  frame_count = 0;
+  inject(&f, &sender_lladdr);
+  UNIT_TEST_ASSERT(frame_count == 1);
+  UNIT_TEST_ASSERT(ack_bitmap(&frames[0]) == 0);
+
+  uip_ds6_addr_rm(uip_ds6_addr_lookup(&peer_addr));
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+UNIT_TEST_REGISTER(relay, "relayed fragments are counted once");
+UNIT_TEST(relay)
+{
+  static frame_t plain[MAX_FRAMES];
+  frame_t f;
+  int n;
+  uint16_t tag;
+  uint8_t held_tag;
+  int i;
+
+  UNIT_TEST_BEGIN();
+
+  /* With the recovery buffer taken, a datagram is sent with RFC 4944
+     fragments */
+  frame_count = 0;
+  send_datagram();
+  UNIT_TEST_ASSERT(frame_count == datagram_frames && IS_RFRAG(&frames[0]));
+  held_tag = RFRAG_TAG(&frames[0]);
+  frame_count = 0;
+  send_datagram();
+  n = frame_count;
+  UNIT_TEST_ASSERT(n >= 5 && n <= MAX_FRAMES);
+  memcpy(plain, frames, sizeof(frames));
+  UNIT_TEST_ASSERT(IS_FRAG1(&plain[0]));
+  for(i = 1; i < n; i++) {
+    UNIT_TEST_ASSERT(IS_FRAGN(&plain[i]));
+  }
+  inject_ack(held_tag, all_fragments(datagram_frames));
+
+  /* Relay the datagram to its destination behind the next hop, as a
+     router that did not send it */
+  uip_ds6_addr_rm(uip_ds6_addr_lookup(&my_addr));
+
+  frame_count = 0;
+  inject(&plain[0], &sender_lladdr);
+  UNIT_TEST_ASSERT(frame_count == 1);
+  UNIT_TEST_ASSERT(IS_FRAG1(&frames[0]));
+  UNIT_TEST_ASSERT(linkaddr_cmp(&frames[0].dest, &nexthop_lladdr));
+  tag = FRAG_TAG(&frames[0]);
+
+  inject(&plain[1], &sender_lladdr);
+  UNIT_TEST_ASSERT(frame_count == 2);
+  UNIT_TEST_ASSERT(IS_FRAGN(&frames[1]) && FRAG_TAG(&frames[1]) == tag);
+  UNIT_TEST_ASSERT(FRAGN_OFFSET(&frames[1]) == FRAGN_OFFSET(&plain[1]));
+
+  /* A duplicate and a fragment past the end of the datagram are dropped
+     and do not count as forwarded */
+  inject(&plain[1], &sender_lladdr);
+  UNIT_TEST_ASSERT(frame_count == 2);
+  f = plain[n - 1];
+  FRAGN_OFFSET(&f) = 0xf0;
+  inject(&f, &sender_lladdr);
+  UNIT_TEST_ASSERT(frame_count == 2);
+
+  /* All the other fragments are relayed */
+  for(i = 2; i < n; i++) {
+    inject(&plain[i], &sender_lladdr);
+  }
+  UNIT_TEST_ASSERT(frame_count == n);
+  for(i = 1; i < n; i++) {
+    UNIT_TEST_ASSERT(IS_FRAGN(&frames[i]) && FRAG_TAG(&frames[i]) == tag);
+  }
+
+  /* The VRB is closed after the last fragment */
+  inject(&plain[n - 1], &sender_lladdr);
+  UNIT_TEST_ASSERT(frame_count == n);
+
+  uip_ds6_addr_add(&my_addr, 0, ADDR_MANUAL);
+
+  UNIT_TEST_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_process, ev, data)
+{
+  static struct etimer et;
+  static int sent;
+  int i;
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i < sizeof(payload); i++) {
+    payload[i] = i;
+  }
+
+  /* Datagrams to peer_addr go through the next hop */
+  uip_ip6addr(&my_addr, 0xaaaa, 0, 0, 0, 0, 0, 0, 1);
+  uip_ip6addr(&peer_addr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0x99);
+  uip_ip6addr(&nexthop_addr, 0xfe80, 0, 0, 0, 0, 0, 0, 0x0c);
+  uip_ds6_addr_add(&my_addr, 0, ADDR_MANUAL);
+  uip_ds6_nbr_add(&nexthop_addr, (const uip_lladdr_t *)&nexthop_lladdr, 0,
+                  NBR_REACHABLE, NBR_TABLE_REASON_UNDEFINED, NULL);
+  uip_ds6_route_add(&peer_addr, 128, &nexthop_addr);
+  simple_udp_register(&conn, UDP_PORT, NULL, UDP_PORT, receiver);
+
+  printf("Run unit-test\n");
+  printf("---\n");
+
+  UNIT_TEST_RUN(lost_fragments);
+
+  /* Nothing acknowledges this datagram */
+  frame_count = 0;
+  send_datagram();
+  sent = frame_count;
+  etimer_set(&et, SICSLOWPAN_CONF_FRAG_RECOVERY_TIMEOUT *
+             (SICSLOWPAN_CONF_FRAG_RECOVERY_RETRIES + 3));
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  timeout_polls = frame_count - sent;
+  timeout_polls_ok = 1;
+  for(i = sent; i < frame_count && i < MAX_FRAMES; i++) {
+    if(memcmp(frames[i].data, frames[sent - 1].data, frames[i].len) != 0) {
+      timeout_polls_ok = 0;
+    }
+  }
+  frame_count = 0;
+  send_datagram();
+  timeout_resend_rfrag = frame_count == sent && IS_RFRAG(&frames[0]);
+  inject_ack(RFRAG_TAG(&frames[0]), all_fragments(sent));
+
+  UNIT_TEST_RUN(timeouts);
+  UNIT_TEST_RUN(reassembly);
+  UNIT_TEST_RUN(relay);
+
+  printf("=check-me= DONE\n");
+  PROCESS_END();
+}